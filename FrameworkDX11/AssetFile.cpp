@@ -0,0 +1,103 @@
+#include "AssetFile.h"
+
+#include <atomic>
+
+namespace
+{
+	std::atomic<int> g_packedOpens(0);
+	std::atomic<int> g_looseOpens(0);
+}
+
+AssetFile::AssetFile()
+	: m_data(nullptr), m_size(0)
+{
+}
+
+AssetFile::~AssetFile()
+{
+	Close();
+}
+
+bool AssetFile::Open(const std::string& fileName)
+{
+	Close();
+	if (OpenPacked(AssetPackage::NormaliseName(fileName)))
+		return true;
+
+	if (!m_file.Open(fileName))
+		return false;
+	m_data = m_file.GetData();
+	m_size = m_file.GetSize();
+	++g_looseOpens;
+	return true;
+}
+
+#ifdef _WIN32
+
+bool AssetFile::Open(const wchar_t* fileName)
+{
+	Close();
+	if (OpenPacked(AssetPackage::NormaliseName(std::wstring(fileName))))
+		return true;
+
+	if (!m_file.Open(fileName))
+		return false;
+	m_data = m_file.GetData();
+	m_size = m_file.GetSize();
+	++g_looseOpens;
+	return true;
+}
+
+#else
+
+bool AssetFile::Open(const wchar_t* fileName)
+{
+	return Open(AssetPackage::ToUTF8(fileName));
+}
+
+#endif
+
+bool AssetFile::OpenPacked(const std::string& normalisedName)
+{
+	std::shared_ptr<const AssetPackage> package;
+	int asset;
+	if (!AssetPackages::Find(normalisedName, package, asset) || package->GetSize(asset) == 0)
+		return false;
+
+	// Blocks that fail to decompress leave it to the loose file, if there is one
+	const uint8_t* mapped = package->GetMapped(asset);
+	if (!mapped)
+	{
+		if (!package->Read(asset, m_decompressed))
+		{
+			m_decompressed.clear();
+			return false;
+		}
+		mapped = m_decompressed.data();
+	}
+
+	m_package = package;
+	m_data = mapped;
+	m_size = (size_t)package->GetSize(asset);
+	++g_packedOpens;
+	return true;
+}
+
+void AssetFile::Close()
+{
+	m_file.Close();
+	m_package.reset();
+	std::vector<uint8_t>().swap(m_decompressed);
+	m_data = nullptr;
+	m_size = 0;
+}
+
+int AssetFile::GetPackedOpenCount()
+{
+	return g_packedOpens;
+}
+
+int AssetFile::GetLooseOpenCount()
+{
+	return g_looseOpens;
+}
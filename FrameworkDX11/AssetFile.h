@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AssetPackage.h"
+#include "MappedFile.h"
+
+// Read-only view of a whole asset, found first in the mounted packages and otherwise opened as
+// a loose file. A stored asset is viewed in place in its package's mapping and a loose file
+// through its own, as MappedFile does; only a compressed asset is read into memory. Loaders
+// open assets through this by the same names they would the files.
+class AssetFile
+{
+public:
+	AssetFile();
+	~AssetFile();
+
+	AssetFile(const AssetFile&) = delete;
+	AssetFile& operator=(const AssetFile&) = delete;
+
+	bool Open(const std::string& fileName);
+	// Outside Windows the wide name is opened as UTF-8
+	bool Open(const wchar_t* fileName);
+	void Close();
+
+	bool IsOpen() const { return m_data != nullptr; }
+	const uint8_t* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+	bool IsPacked() const { return m_package != nullptr; }
+
+	// Opens so far from packages and from loose files, across every AssetFile
+	static int GetPackedOpenCount();
+	static int GetLooseOpenCount();
+
+private:
+	bool OpenPacked(const std::string& normalisedName);
+
+	MappedFile							m_file;
+	std::shared_ptr<const AssetPackage>	m_package;
+	std::vector<uint8_t>				m_decompressed;
+	const uint8_t*						m_data;
+	size_t								m_size;
+};
@@ -0,0 +1,601 @@
+#include "AssetPackage.h"
+#include "JobSystem.h"
+#include "LZCodec.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+namespace
+{
+	uint64_t HashBytes(const uint8_t* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// MappedFile will not map an empty file, so those are told apart from unreadable ones here
+	bool IsEmptyFile(const string& fileName)
+	{
+		ifstream file(fileName, ios::binary | ios::ate);
+		return file.is_open() && file.tellg() == streampos(0);
+	}
+
+	bool Fail(string* error, const string& message)
+	{
+		if (error)
+			*error = message;
+		return false;
+	}
+
+	mutex g_mountMutex;
+	vector<shared_ptr<const AssetPackage>> g_mounted;
+}
+
+bool AssetPackage::Open(const string& fileName)
+{
+	Close();
+	if (!m_file.Open(fileName) || m_file.GetSize() < sizeof(AssetPackageHeader))
+	{
+		Close();
+		return false;
+	}
+
+	const uint8_t* data = m_file.GetData();
+	m_header = reinterpret_cast<const AssetPackageHeader*>(data);
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+
+	m_assetCount = m_header->assetCount;
+	m_entries = reinterpret_cast<const AssetPackageEntry*>(data + m_header->indexOffset);
+	m_blockEnds = reinterpret_cast<const uint64_t*>(data + m_header->blockTableOffset);
+	m_names = reinterpret_cast<const char*>(data + m_header->namesOffset);
+	return true;
+}
+
+void AssetPackage::Close()
+{
+	m_file.Close();
+	m_header = nullptr;
+	m_entries = nullptr;
+	m_blockEnds = nullptr;
+	m_names = nullptr;
+	m_assetCount = 0;
+}
+
+bool AssetPackage::Validate() const
+{
+	// Everything is checked once here, so reads need only check what they are asked for
+	const AssetPackageHeader& header = *m_header;
+	const uint64_t fileSize = m_file.GetSize();
+	if (header.magic != MAGIC || header.version != VERSION || header.fileSize != fileSize || header.blockSize == 0)
+		return false;
+	if (header.indexOffset % 8 != 0 || header.blockTableOffset % 8 != 0)
+		return false;
+	if (header.indexOffset > fileSize || header.assetCount > (fileSize - header.indexOffset) / sizeof(AssetPackageEntry))
+		return false;
+	if (header.blockTableOffset < header.indexOffset + header.assetCount * sizeof(AssetPackageEntry) || header.namesOffset < header.blockTableOffset || header.namesOffset > fileSize)
+		return false;
+
+	const uint8_t* data = m_file.GetData();
+	const AssetPackageEntry* entries = reinterpret_cast<const AssetPackageEntry*>(data + header.indexOffset);
+	const uint64_t* blockEnds = reinterpret_cast<const uint64_t*>(data + header.blockTableOffset);
+	const uint64_t blockCount = (header.namesOffset - header.blockTableOffset) / sizeof(uint64_t);
+	const uint64_t namesSize = fileSize - header.namesOffset;
+
+	for (uint32_t i = 0; i < header.assetCount; ++i)
+	{
+		const AssetPackageEntry& entry = entries[i];
+		if (i > 0 && entries[i - 1].nameHash > entry.nameHash)
+			return false;
+		if (entry.offset > header.indexOffset || entry.storedSize > header.indexOffset - entry.offset)
+			return false;
+		if ((uint64_t)entry.nameOffset + entry.nameLength > namesSize)
+			return false;
+
+		if (entry.blockCount == 0)
+		{
+			if (entry.storedSize != entry.size)
+				return false;
+			continue;
+		}
+
+		if ((uint64_t)entry.firstBlock + entry.blockCount > blockCount || (entry.size + header.blockSize - 1) / header.blockSize != entry.blockCount)
+			return false;
+		uint64_t start = 0;
+		for (uint32_t block = 0; block < entry.blockCount; ++block)
+		{
+			uint64_t end = blockEnds[entry.firstBlock + block];
+			uint64_t length = min<uint64_t>(header.blockSize, entry.size - (uint64_t)block * header.blockSize);
+			if (end < start || end - start > length)
+				return false;
+			start = end;
+		}
+		if (start != entry.storedSize)
+			return false;
+	}
+	return true;
+}
+
+int AssetPackage::Find(const string& name) const
+{
+	const string normalised = NormaliseName(name);
+	const uint64_t hash = HashName(normalised);
+
+	// Binary search on the hash, then the names settle any collision
+	const AssetPackageEntry* end = m_entries + m_assetCount;
+	const AssetPackageEntry* entry = lower_bound(m_entries, end, hash, [](const AssetPackageEntry& e, uint64_t h) { return e.nameHash < h; });
+	for (; entry != end && entry->nameHash == hash; ++entry)
+	{
+		if (entry->nameLength == normalised.size() && memcmp(m_names + entry->nameOffset, normalised.data(), normalised.size()) == 0)
+			return (int)(entry - m_entries);
+	}
+	return -1;
+}
+
+string AssetPackage::GetName(int asset) const
+{
+	const AssetPackageEntry& entry = m_entries[asset];
+	return string(m_names + entry.nameOffset, entry.nameLength);
+}
+
+const uint8_t* AssetPackage::GetMapped(int asset) const
+{
+	const AssetPackageEntry& entry = m_entries[asset];
+	return entry.blockCount == 0 ? m_file.GetData() + entry.offset : nullptr;
+}
+
+bool AssetPackage::Read(int asset, vector<uint8_t>& data) const
+{
+	const uint64_t size = m_entries[asset].size;
+	if (size > (size_t)-1)
+		return false;
+	data.resize((size_t)size);
+	return ReadRange(asset, 0, (size_t)size, data.data());
+}
+
+bool AssetPackage::ReadRange(int asset, uint64_t offset, size_t size, uint8_t* dst) const
+{
+	const AssetPackageEntry& entry = m_entries[asset];
+	if (offset > entry.size || size > entry.size - offset)
+		return false;
+
+	if (size == 0)
+		return true;
+
+	const uint8_t* stored = m_file.GetData() + entry.offset;
+	if (entry.blockCount == 0)
+	{
+		memcpy(dst, stored + offset, size);
+		return true;
+	}
+
+	const uint64_t blockSize = m_header->blockSize;
+	const uint64_t* ends = m_blockEnds + entry.firstBlock;
+	vector<uint8_t> scratch;
+	for (uint64_t block = offset / blockSize; block * blockSize < offset + size; ++block)
+	{
+		const uint64_t blockStart = block * blockSize;
+		const size_t length = (size_t)min(blockSize, entry.size - blockStart);
+		const uint64_t storedStart = block == 0 ? 0 : ends[block - 1];
+		const size_t storedLength = (size_t)(ends[block] - storedStart);
+
+		// The part of the range in this block
+		const uint64_t first = max(offset, blockStart);
+		const uint64_t last = min(offset + size, blockStart + length);
+		uint8_t* out = dst + (first - offset);
+
+		if (storedLength == length)
+		{
+			memcpy(out, stored + storedStart + (first - blockStart), (size_t)(last - first));
+		}
+		else if (first == blockStart && last == blockStart + length)
+		{
+			if (!LZCodec::Decompress(stored + storedStart, storedLength, out, length))
+				return false;
+		}
+		else
+		{
+			scratch.resize(length);
+			if (!LZCodec::Decompress(stored + storedStart, storedLength, scratch.data(), length))
+				return false;
+			memcpy(out, scratch.data() + (first - blockStart), (size_t)(last - first));
+		}
+	}
+	return true;
+}
+
+string AssetPackage::NormaliseName(const string& name)
+{
+	string normalised;
+	normalised.reserve(name.size());
+	for (char c : name)
+	{
+		if (c == '/')
+			c = '\\';
+		else if (c >= 'A' && c <= 'Z')
+			c = (char)(c - 'A' + 'a');
+		normalised.push_back(c);
+	}
+	while (normalised.compare(0, 2, ".\\") == 0)
+		normalised.erase(0, 2);
+	return normalised;
+}
+
+string AssetPackage::NormaliseName(const wstring& name)
+{
+	// To UTF-8, so non-ASCII names compare the same whichever way they were given
+	return NormaliseName(ToUTF8(name));
+}
+
+string AssetPackage::ToUTF8(const wstring& name)
+{
+	string utf8;
+	utf8.reserve(name.size());
+	for (size_t i = 0; i < name.size(); ++i)
+	{
+		uint32_t c = (uint32_t)name[i];
+		if (c >= 0xD800 && c < 0xDC00 && i + 1 < name.size() && (uint32_t)name[i + 1] >= 0xDC00 && (uint32_t)name[i + 1] < 0xE000)
+			c = 0x10000 + ((c - 0xD800) << 10) + ((uint32_t)name[++i] - 0xDC00);
+
+		if (c < 0x80)
+		{
+			utf8.push_back((char)c);
+		}
+		else if (c < 0x800)
+		{
+			utf8.push_back((char)(0xC0 | (c >> 6)));
+			utf8.push_back((char)(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x10000)
+		{
+			utf8.push_back((char)(0xE0 | (c >> 12)));
+			utf8.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+			utf8.push_back((char)(0x80 | (c & 0x3F)));
+		}
+		else
+		{
+			utf8.push_back((char)(0xF0 | (c >> 18)));
+			utf8.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+			utf8.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+			utf8.push_back((char)(0x80 | (c & 0x3F)));
+		}
+	}
+	return utf8;
+}
+
+uint64_t AssetPackage::HashName(const string& normalisedName)
+{
+	return HashBytes(reinterpret_cast<const uint8_t*>(normalisedName.data()), normalisedName.size());
+}
+
+bool AssetPackages::Mount(const string& fileName)
+{
+	auto package = make_shared<AssetPackage>();
+	if (!package->Open(fileName))
+		return false;
+
+	lock_guard<mutex> lock(g_mountMutex);
+	g_mounted.insert(g_mounted.begin(), package);
+	return true;
+}
+
+void AssetPackages::UnmountAll()
+{
+	// Files opened from them keep their package mapped until they close
+	lock_guard<mutex> lock(g_mountMutex);
+	g_mounted.clear();
+}
+
+bool AssetPackages::Find(const string& normalisedName, shared_ptr<const AssetPackage>& package, int& asset)
+{
+	lock_guard<mutex> lock(g_mountMutex);
+	for (const shared_ptr<const AssetPackage>& mounted : g_mounted)
+	{
+		asset = mounted->Find(normalisedName);
+		if (asset >= 0)
+		{
+			package = mounted;
+			return true;
+		}
+	}
+	return false;
+}
+
+int AssetPackages::GetMountedCount()
+{
+	lock_guard<mutex> lock(g_mountMutex);
+	return (int)g_mounted.size();
+}
+
+int AssetPackages::GetAssetCount()
+{
+	lock_guard<mutex> lock(g_mountMutex);
+	int count = 0;
+	for (const shared_ptr<const AssetPackage>& mounted : g_mounted)
+		count += mounted->GetAssetCount();
+	return count;
+}
+
+bool AssetPacker::Pack(const vector<string>& files, const string& packageFile, const AssetPackSettings& settings, AssetPackStats* stats, string* error)
+{
+	if (settings.blockSize <= 0 || settings.alignment < 8 || (settings.alignment & (settings.alignment - 1)) != 0)
+		return Fail(error, "Invalid pack settings");
+
+	struct Asset
+	{
+		string					name;
+		unique_ptr<MappedFile>	file;
+		uint64_t				contentHash = 0;
+		int						sharedWith = -1;		// an earlier asset with the same bytes
+		vector<uint8_t>			stored;					// the compressed blocks, when compressed
+		vector<uint64_t>		blockEnds;
+		AssetPackageEntry		entry = {};
+	};
+
+	vector<Asset> assets(files.size());
+	unordered_map<uint64_t, vector<int>> byContent;
+	unordered_map<uint64_t, vector<int>> byName;
+	AssetPackStats result;
+
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		Asset& asset = assets[i];
+		asset.name = AssetPackage::NormaliseName(files[i]);
+		asset.file.reset(new MappedFile());
+		if (!asset.file->Open(files[i]) && !IsEmptyFile(files[i]))
+			return Fail(error, "Cannot read " + files[i]);
+
+		// Two files packed under one name could never both be found
+		uint64_t nameHash = AssetPackage::HashName(asset.name);
+		for (int other : byName[nameHash])
+		{
+			if (assets[other].name == asset.name)
+				return Fail(error, files[other] + " and " + files[i] + " pack under the same name");
+		}
+		byName[nameHash].push_back((int)i);
+
+		asset.contentHash = HashBytes(asset.file->GetData(), asset.file->GetSize());
+		for (int other : byContent[asset.contentHash])
+		{
+			const MappedFile& file = *assets[other].file;
+			if (file.GetSize() == asset.file->GetSize() && (file.GetSize() == 0 || memcmp(file.GetData(), asset.file->GetData(), file.GetSize()) == 0))
+			{
+				asset.sharedWith = other;
+				break;
+			}
+		}
+		if (asset.sharedWith < 0)
+			byContent[asset.contentHash].push_back((int)i);
+	}
+
+	const size_t blockSize = (size_t)settings.blockSize;
+	for (Asset& asset : assets)
+	{
+		if (asset.sharedWith >= 0)
+		{
+			++result.duplicateCount;
+			continue;
+		}
+
+		// Blocks compress independently, so all of them at once
+		const uint8_t* data = asset.file->GetData();
+		const size_t size = asset.file->GetSize();
+		const int blockCount = (int)((size + blockSize - 1) / blockSize);
+		vector<vector<uint8_t>> blocks(blockCount);
+		JobSystem::Get().ParallelFor(blockCount, 1, [&](int begin, int end)
+		{
+			for (int block = begin; block < end; ++block)
+			{
+				const size_t length = min(blockSize, size - (size_t)block * blockSize);
+				vector<uint8_t>& out = blocks[block];
+				out.resize(LZCodec::CompressBound(length));
+				size_t written = LZCodec::Compress(data + (size_t)block * blockSize, length, out.data(), out.size());
+				if (written == 0 || written >= length)
+					out.assign(data + (size_t)block * blockSize, data + (size_t)block * blockSize + length);
+				else
+					out.resize(written);
+			}
+		});
+
+		size_t compressed = 0;
+		for (const vector<uint8_t>& block : blocks)
+			compressed += block.size();
+
+		result.rawBytes += size;
+		if (size == 0 || compressed > size * (1.0 - settings.minSaving))
+		{
+			result.storedBytes += size;
+			continue;
+		}
+
+		++result.compressedCount;
+		result.storedBytes += compressed;
+		asset.stored.reserve(compressed);
+		for (const vector<uint8_t>& block : blocks)
+		{
+			asset.stored.insert(asset.stored.end(), block.begin(), block.end());
+			asset.blockEnds.push_back(asset.stored.size());
+		}
+	}
+
+	ofstream file(packageFile, ios::binary | ios::trunc);
+	if (!file)
+		return Fail(error, "Cannot create " + packageFile);
+
+	const char padding[4096] = {};
+	uint64_t position = 0;
+	auto Write = [&](const void* bytes, size_t size)
+	{
+		file.write(static_cast<const char*>(bytes), size);
+		position += size;
+	};
+	auto Align = [&](uint64_t alignment)
+	{
+		uint64_t pad = (alignment - position % alignment) % alignment;
+		while (pad > 0)
+		{
+			size_t chunk = (size_t)min<uint64_t>(pad, sizeof(padding));
+			Write(padding, chunk);
+			pad -= chunk;
+		}
+	};
+
+	AssetPackageHeader header = {};
+	Write(&header, sizeof(header));
+
+	uint32_t blockCount = 0;
+	string names;
+	for (Asset& asset : assets)
+	{
+		AssetPackageEntry& entry = asset.entry;
+		entry.nameHash = AssetPackage::HashName(asset.name);
+		entry.contentHash = asset.contentHash;
+		entry.size = asset.file->GetSize();
+		entry.nameOffset = (uint32_t)names.size();
+		entry.nameLength = (uint32_t)asset.name.size();
+		names += asset.name;
+
+		if (asset.sharedWith >= 0)
+		{
+			const AssetPackageEntry& shared = assets[asset.sharedWith].entry;
+			entry.offset = shared.offset;
+			entry.storedSize = shared.storedSize;
+			entry.firstBlock = shared.firstBlock;
+			entry.blockCount = shared.blockCount;
+			continue;
+		}
+
+		Align((uint64_t)settings.alignment);
+		entry.offset = position;
+		if (asset.blockEnds.empty())
+		{
+			entry.storedSize = entry.size;
+			Write(asset.file->GetData(), asset.file->GetSize());
+		}
+		else
+		{
+			entry.storedSize = asset.stored.size();
+			entry.firstBlock = blockCount;
+			entry.blockCount = (uint32_t)asset.blockEnds.size();
+			blockCount += entry.blockCount;
+			Write(asset.stored.data(), asset.stored.size());
+		}
+	}
+
+	vector<AssetPackageEntry> index;
+	vector<uint64_t> blockEnds;
+	for (const Asset& asset : assets)
+	{
+		index.push_back(asset.entry);
+		if (asset.sharedWith < 0)
+			blockEnds.insert(blockEnds.end(), asset.blockEnds.begin(), asset.blockEnds.end());
+	}
+	stable_sort(index.begin(), index.end(), [](const AssetPackageEntry& a, const AssetPackageEntry& b) { return a.nameHash < b.nameHash; });
+
+	Align(8);
+	header.indexOffset = position;
+	Write(index.data(), index.size() * sizeof(AssetPackageEntry));
+	header.blockTableOffset = position;
+	Write(blockEnds.data(), blockEnds.size() * sizeof(uint64_t));
+	header.namesOffset = position;
+	Write(names.data(), names.size());
+
+	header.magic = AssetPackage::MAGIC;
+	header.version = AssetPackage::VERSION;
+	header.assetCount = (uint32_t)assets.size();
+	header.blockSize = (uint32_t)settings.blockSize;
+	header.fileSize = position;
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!file)
+		return Fail(error, "Cannot write " + packageFile);
+
+	if (stats)
+	{
+		result.assetCount = (int)assets.size();
+		result.fileSize = position;
+		*stats = result;
+	}
+	return true;
+}
+
+#ifdef _WIN32
+
+bool AssetPacker::ListFiles(const string& directory, vector<string>& files)
+{
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &found);
+	if (search == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool ok = true;
+	vector<string> listed;
+	do
+	{
+		string name = found.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			ok = ListFiles(directory + "\\" + name, listed) && ok;
+		else
+			listed.push_back(directory + "\\" + name);
+	} while (FindNextFileA(search, &found));
+	FindClose(search);
+
+	sort(listed.begin(), listed.end());
+	files.insert(files.end(), listed.begin(), listed.end());
+	return ok;
+}
+
+#else
+
+bool AssetPacker::ListFiles(const string& directory, vector<string>& files)
+{
+	DIR* search = opendir(directory.c_str());
+	if (!search)
+		return false;
+
+	bool ok = true;
+	vector<string> listed;
+	while (dirent* found = readdir(search))
+	{
+		string name = found->d_name;
+		if (name == "." || name == "..")
+			continue;
+		string path = directory + "/" + name;
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			ok = false;
+		else if (S_ISDIR(info.st_mode))
+			ok = ListFiles(path, listed) && ok;
+		else
+			listed.push_back(path);
+	}
+	closedir(search);
+
+	sort(listed.begin(), listed.end());
+	files.insert(files.end(), listed.begin(), listed.end());
+	return ok;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Asset package (.pak), little-endian:
+//   AssetPackageHeader
+//   each asset's bytes, starting on a multiple of the alignment it was packed with
+//   AssetPackageEntry[assetCount], sorted by nameHash
+//   uint64_t block ends[], for the compressed assets
+//   the names, not terminated
+//
+// An asset is stored either as it is, and read in place from the mapping, or as blocks of
+// blockSize bytes compressed one by one with LZCodec, so any range of it can be read by
+// decompressing only the blocks it touches. Block i of an asset runs from ends[i - 1] (0 for the
+// first) to ends[i], relative to the asset's offset; a block whose stored length equals its
+// length did not compress and is stored as it is. Assets with the same bytes share them.
+struct AssetPackageHeader
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	assetCount;
+	uint32_t	blockSize;
+	uint64_t	indexOffset;
+	uint64_t	blockTableOffset;
+	uint64_t	namesOffset;
+	uint64_t	fileSize;
+};
+
+struct AssetPackageEntry
+{
+	uint64_t	nameHash;			// of the normalised name
+	uint64_t	contentHash;		// FNV-1a of the asset's bytes
+	uint64_t	offset;
+	uint64_t	size;
+	uint64_t	storedSize;
+	uint32_t	nameOffset;			// from namesOffset
+	uint32_t	nameLength;
+	uint32_t	firstBlock;			// in the block table
+	uint32_t	blockCount;			// 0 when stored as it is
+};
+
+// A package opened for reading. Every method is const and safe from any thread once Open
+// has returned.
+class AssetPackage
+{
+public:
+	static const uint32_t	MAGIC = 0x314B5041;		// "APK1"
+	static const uint32_t	VERSION = 1;
+
+	bool						Open(const std::string& fileName);
+	void						Close();
+	bool						IsOpen() const { return m_file.IsOpen(); }
+
+	// The asset packed under name, or -1
+	int							Find(const std::string& name) const;
+
+	int							GetAssetCount() const { return (int)m_assetCount; }
+	std::string					GetName(int asset) const;
+	uint64_t					GetSize(int asset) const { return m_entries[asset].size; }
+	uint64_t					GetStoredSize(int asset) const { return m_entries[asset].storedSize; }
+	uint64_t					GetContentHash(int asset) const { return m_entries[asset].contentHash; }
+	bool						IsCompressed(int asset) const { return m_entries[asset].blockCount != 0; }
+
+	// An uncompressed asset's bytes, straight from the mapping; nullptr if it is compressed
+	const uint8_t*				GetMapped(int asset) const;
+
+	bool						Read(int asset, std::vector<uint8_t>& data) const;
+	// size bytes from offset into dst, decompressing only the blocks they lie in
+	bool						ReadRange(int asset, uint64_t offset, size_t size, uint8_t* dst) const;
+
+	uint64_t					GetFileSize() const { return m_file.GetSize(); }
+
+	// The name an asset is packed and found under: lower case, backslash separated, without a
+	// leading ".\". Wide names are taken as UTF-16.
+	static std::string			NormaliseName(const std::string& name);
+	static std::string			NormaliseName(const std::wstring& name);
+	static uint64_t				HashName(const std::string& normalisedName);
+	// UTF-16 (UTF-32 where wchar_t is four bytes) to UTF-8, without normalising
+	static std::string			ToUTF8(const std::wstring& name);
+
+private:
+	bool						Validate() const;
+
+	MappedFile					m_file;
+	const AssetPackageHeader*	m_header = nullptr;
+	const AssetPackageEntry*	m_entries = nullptr;
+	const uint64_t*				m_blockEnds = nullptr;
+	const char*					m_names = nullptr;
+	uint32_t					m_assetCount = 0;
+};
+
+// The packages the asset loaders look in before the loose files, newest mount first
+namespace AssetPackages
+{
+	bool						Mount(const std::string& fileName);
+	void						UnmountAll();
+
+	// Sets package and asset when some mounted package has name
+	bool						Find(const std::string& normalisedName, std::shared_ptr<const AssetPackage>& package, int& asset);
+
+	int							GetMountedCount();
+	int							GetAssetCount();
+}
+
+struct AssetPackSettings
+{
+	int							blockSize = 64 * 1024;
+	int							alignment = 4096;			// a power of two; 4096 keeps each asset on its own pages
+	float						minSaving = 0.05f;			// compressed only when it saves this much, else mapped in place
+};
+
+struct AssetPackStats
+{
+	int							assetCount = 0;
+	int							duplicateCount = 0;			// sharing another asset's bytes
+	int							compressedCount = 0;
+	uint64_t					rawBytes = 0;				// of the unique assets
+	uint64_t					storedBytes = 0;
+	uint64_t					fileSize = 0;
+};
+
+// Offline path: builds packages out of loose files
+namespace AssetPacker
+{
+	// Packs each file under its name as given, which should be the path the loaders open it by.
+	// Empty files are packed as empty assets. On failure error, if given, says what failed.
+	bool						Pack(const std::vector<std::string>& files, const std::string& packageFile, const AssetPackSettings& settings, AssetPackStats* stats = nullptr, std::string* error = nullptr);
+
+	// Every file below directory, recursively, as directory\...\name, sorted
+	bool						ListFiles(const std::string& directory, std::vector<std::string>& files);
+}
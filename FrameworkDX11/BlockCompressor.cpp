@@ -0,0 +1,1206 @@
+#include "BlockCompressor.h"
+#include "DDSFile.h"
+#include "ImageIO.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#include <fstream>
+#include <limits>
+
+namespace
+{
+	const int TEXELS = 16;
+
+	// Two-subset partitions of BC7 mode 1, one bit per texel (set = subset 1)
+	const uint16_t PARTITIONS2[64] =
+	{
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+		0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+		0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+		0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+		0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+		0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+		0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+	};
+
+	// The texel of subset 1 whose index drops its top bit; subset 0's is always texel 0
+	const uint8_t ANCHORS2[64] =
+	{
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+		15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+		 6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+	};
+
+	const int WEIGHTS3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const int WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Interpolation weight towards the second endpoint for each BC1 and BC4 index
+	const float BC1_WEIGHTS4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	const float BC1_WEIGHTS3[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+
+	// One 4x4 block, each channel's texels together so SSE takes four at a time
+	struct Block
+	{
+		alignas(16) float	channel[4][TEXELS];
+		bool				opaque;
+	};
+
+	// What the decoder produces for each index, over the channels being fitted
+	struct Palette
+	{
+		int					count = 0;
+		float				entry[16][4];
+	};
+
+	inline float Clamp255(float v)
+	{
+		return std::min(std::max(v, 0.0f), 255.0f);
+	}
+
+	inline int Interpolate(int e0, int e1, int weight)
+	{
+		return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+	}
+
+	int RefinePasses(BCQuality quality)
+	{
+		return quality == BCQualityFast ? 0 : quality == BCQualityBalanced ? 1 : 4;
+	}
+
+	void LoadBlock(const Image& image, int blockX, int blockY, Block& block)
+	{
+		block.opaque = true;
+		for (int y = 0; y < 4; ++y)
+		{
+			const int sourceY = std::min(blockY * 4 + y, image.GetHeight() - 1);
+			for (int x = 0; x < 4; ++x)
+			{
+				const uint8_t* texel = image.At(std::min(blockX * 4 + x, image.GetWidth() - 1), sourceY);
+				for (int c = 0; c < 4; ++c)
+					block.channel[c][y * 4 + x] = texel[c];
+				block.opaque &= texel[3] == 255;
+			}
+		}
+	}
+
+	// Nearest palette entry for every texel over channels [first, first + count), four texels per
+	// SSE step; ties keep the lower index. errors receives each texel's squared distance.
+	void FitIndices(const Block& block, int first, int count, const Palette& palette, uint8_t indices[TEXELS], float errors[TEXELS])
+	{
+		for (int t = 0; t < TEXELS; t += 4)
+		{
+			__m128 texel[4];
+			for (int c = 0; c < count; ++c)
+				texel[c] = _mm_load_ps(&block.channel[first + c][t]);
+
+			__m128 best = _mm_set1_ps(FLT_MAX);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int i = 0; i < palette.count; ++i)
+			{
+				__m128 error = _mm_setzero_ps();
+				for (int c = 0; c < count; ++c)
+				{
+					const __m128 difference = _mm_sub_ps(texel[c], _mm_set1_ps(palette.entry[i][c]));
+					error = _mm_add_ps(error, _mm_mul_ps(difference, difference));
+				}
+				const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best));
+				best = _mm_min_ps(error, best);
+				bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, bestIndex));
+			}
+
+			alignas(16) int32_t index[4];
+			_mm_store_si128((__m128i*)index, bestIndex);
+			_mm_storeu_ps(errors + t, best);
+			for (int k = 0; k < 4; ++k)
+				indices[t + k] = (uint8_t)index[k];
+		}
+	}
+
+	float SumErrors(const float errors[TEXELS], uint16_t mask)
+	{
+		float sum = 0.0f;
+		for (int t = 0; t < TEXELS; ++t)
+		{
+			if (mask & (1 << t))
+				sum += errors[t];
+		}
+		return sum;
+	}
+
+	// Ends of the texels' spread along their principal axis (power iteration on the covariance)
+	void PrincipalEndpoints(const Block& block, int first, int count, uint16_t mask, float e0[4], float e1[4])
+	{
+		float mean[4] = {};
+		int texels = 0;
+		for (int t = 0; t < TEXELS; ++t)
+		{
+			if (!(mask & (1 << t)))
+				continue;
+			for (int c = 0; c < count; ++c)
+				mean[c] += block.channel[first + c][t];
+			++texels;
+		}
+		for (int c = 0; c < count; ++c)
+		{
+			mean[c] = texels ? mean[c] / texels : 0.0f;
+			e0[c] = e1[c] = mean[c];
+		}
+		if (texels < 2)
+			return;
+
+		float covariance[4][4] = {};
+		for (int t = 0; t < TEXELS; ++t)
+		{
+			if (!(mask & (1 << t)))
+				continue;
+			for (int i = 0; i < count; ++i)
+			{
+				for (int j = 0; j < count; ++j)
+					covariance[i][j] += (block.channel[first + i][t] - mean[i]) * (block.channel[first + j][t] - mean[j]);
+			}
+		}
+
+		int widest = 0;
+		for (int c = 1; c < count; ++c)
+		{
+			if (covariance[c][c] > covariance[widest][widest])
+				widest = c;
+		}
+		if (covariance[widest][widest] < 1e-6f)
+			return;
+
+		float axis[4];
+		for (int c = 0; c < count; ++c)
+			axis[c] = covariance[widest][c] / covariance[widest][widest];
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+			for (int i = 0; i < count; ++i)
+			{
+				for (int j = 0; j < count; ++j)
+					next[i] += covariance[i][j] * axis[j];
+				length += next[i] * next[i];
+			}
+			if (length < 1e-12f)
+				break;
+			length = 1.0f / std::sqrt(length);
+			for (int c = 0; c < count; ++c)
+				axis[c] = next[c] * length;
+		}
+
+		float low = FLT_MAX;
+		float high = -FLT_MAX;
+		for (int t = 0; t < TEXELS; ++t)
+		{
+			if (!(mask & (1 << t)))
+				continue;
+			float projection = 0.0f;
+			for (int c = 0; c < count; ++c)
+				projection += (block.channel[first + c][t] - mean[c]) * axis[c];
+			low = std::min(low, projection);
+			high = std::max(high, projection);
+		}
+		for (int c = 0; c < count; ++c)
+		{
+			e0[c] = Clamp255(mean[c] + low * axis[c]);
+			e1[c] = Clamp255(mean[c] + high * axis[c]);
+		}
+	}
+
+	// Least-squares endpoints for fixed indices, weight[t] being texel t's blend towards e1.
+	// False if the weights cannot separate the two (all texels on one index).
+	bool RefineEndpoints(const Block& block, int first, int count, uint16_t mask, const float weight[TEXELS], float e0[4], float e1[4])
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = {}, bx[4] = {};
+		for (int t = 0; t < TEXELS; ++t)
+		{
+			if (!(mask & (1 << t)))
+				continue;
+			const float b = weight[t];
+			const float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < count; ++c)
+			{
+				ax[c] += a * block.channel[first + c][t];
+				bx[c] += b * block.channel[first + c][t];
+			}
+		}
+
+		const float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		const float inverse = 1.0f / determinant;
+		for (int c = 0; c < count; ++c)
+		{
+			e0[c] = Clamp255((bb * ax[c] - ab * bx[c]) * inverse);
+			e1[c] = Clamp255((aa * bx[c] - ab * ax[c]) * inverse);
+		}
+		return true;
+	}
+
+	// --- BC1 ---
+
+	uint16_t Quantize565(const float c[4])
+	{
+		const int r = (int)(Clamp255(c[0]) * (31.0f / 255.0f) + 0.5f);
+		const int g = (int)(Clamp255(c[1]) * (63.0f / 255.0f) + 0.5f);
+		const int b = (int)(Clamp255(c[2]) * (31.0f / 255.0f) + 0.5f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void Expand565(uint16_t colour, uint8_t rgba[4])
+	{
+		const int r = (colour >> 11) & 31;
+		const int g = (colour >> 5) & 63;
+		const int b = colour & 31;
+		rgba[0] = (uint8_t)((r << 3) | (r >> 2));
+		rgba[1] = (uint8_t)((g << 2) | (g >> 4));
+		rgba[2] = (uint8_t)((b << 3) | (b >> 2));
+		rgba[3] = 255;
+	}
+
+	// The colours a BC1 block decodes to. c0 <= c1 selects three colours and transparent black,
+	// except in BC3, whose colour blocks always have four.
+	void BC1Colours(uint16_t c0, uint16_t c1, bool threeColourAllowed, uint8_t colours[4][4])
+	{
+		Expand565(c0, colours[0]);
+		Expand565(c1, colours[1]);
+		if (c0 > c1 || !threeColourAllowed)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				colours[2][c] = (uint8_t)((2 * colours[0][c] + colours[1][c]) / 3);
+				colours[3][c] = (uint8_t)((colours[0][c] + 2 * colours[1][c]) / 3);
+			}
+			colours[2][3] = colours[3][3] = 255;
+		}
+		else
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				colours[2][c] = (uint8_t)((colours[0][c] + colours[1][c]) / 2);
+				colours[3][c] = 0;
+			}
+			colours[2][3] = 255;
+			colours[3][3] = 0;
+		}
+	}
+
+	// Returns the squared RGB error. Three-colour blocks only use their three opaque colours.
+	float EncodeBC1(const Block& block, BCQuality quality, bool threeColourAllowed, uint8_t* out)
+	{
+		float e0[4], e1[4];
+		PrincipalEndpoints(block, 0, 3, 0xffff, e0, e1);
+
+		float bestError = FLT_MAX;
+		uint16_t best0 = 0, best1 = 0;
+		uint8_t bestIndices[TEXELS] = {};
+		const int passes = RefinePasses(quality);
+		const int modes = quality == BCQualityHigh && threeColourAllowed ? 2 : 1;
+
+		for (int mode = 0; mode < modes; ++mode)
+		{
+			float a[4], b[4];
+			std::copy(e0, e0 + 4, a);
+			std::copy(e1, e1 + 4, b);
+			for (int pass = 0; pass <= passes; ++pass)
+			{
+				uint16_t c0 = Quantize565(a);
+				uint16_t c1 = Quantize565(b);
+				if (mode == 0 ? c0 < c1 : c0 > c1)
+				{
+					std::swap(c0, c1);
+					std::swap(a, b);
+				}
+
+				uint8_t colours[4][4];
+				BC1Colours(c0, c1, threeColourAllowed, colours);
+				const bool threeColour = threeColourAllowed && c0 <= c1;
+				Palette palette;
+				palette.count = threeColour ? 3 : 4;
+				for (int i = 0; i < palette.count; ++i)
+				{
+					for (int c = 0; c < 3; ++c)
+						palette.entry[i][c] = colours[i][c];
+				}
+
+				uint8_t indices[TEXELS];
+				float errors[TEXELS];
+				FitIndices(block, 0, 3, palette, indices, errors);
+				const float error = SumErrors(errors, 0xffff);
+				if (error < bestError)
+				{
+					bestError = error;
+					best0 = c0;
+					best1 = c1;
+					std::copy(indices, indices + TEXELS, bestIndices);
+				}
+				else if (pass > 0)
+				{
+					break;
+				}
+
+				float weight[TEXELS];
+				for (int t = 0; t < TEXELS; ++t)
+					weight[t] = threeColour ? BC1_WEIGHTS3[indices[t]] : BC1_WEIGHTS4[indices[t]];
+				if (pass == passes || !RefineEndpoints(block, 0, 3, 0xffff, weight, a, b))
+					break;
+			}
+		}
+
+		uint32_t bits = 0;
+		for (int t = 0; t < TEXELS; ++t)
+			bits |= (uint32_t)bestIndices[t] << (2 * t);
+		out[0] = (uint8_t)best0;
+		out[1] = (uint8_t)(best0 >> 8);
+		out[2] = (uint8_t)best1;
+		out[3] = (uint8_t)(best1 >> 8);
+		memcpy(out + 4, &bits, 4);
+		return bestError;
+	}
+
+	void DecodeBC1(const uint8_t* in, bool threeColourAllowed, uint8_t texels[TEXELS][4])
+	{
+		const uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8));
+		const uint16_t c1 = (uint16_t)(in[2] | (in[3] << 8));
+		uint32_t bits;
+		memcpy(&bits, in + 4, 4);
+
+		uint8_t colours[4][4];
+		BC1Colours(c0, c1, threeColourAllowed, colours);
+		for (int t = 0; t < TEXELS; ++t)
+			memcpy(texels[t], colours[(bits >> (2 * t)) & 3], 4);
+	}
+
+	// --- BC4 ---
+
+	// e0 > e1 gives eight interpolated values; otherwise six plus 0 and 255
+	void BC4Values(int e0, int e1, uint8_t values[8])
+	{
+		values[0] = (uint8_t)e0;
+		values[1] = (uint8_t)e1;
+		if (e0 > e1)
+		{
+			for (int k = 2; k < 8; ++k)
+				values[k] = (uint8_t)(((8 - k) * e0 + (k - 1) * e1 + 3) / 7);
+		}
+		else
+		{
+			for (int k = 2; k < 6; ++k)
+				values[k] = (uint8_t)(((6 - k) * e0 + (k - 1) * e1 + 2) / 5);
+			values[6] = 0;
+			values[7] = 255;
+		}
+	}
+
+	// One channel of the block; returns its squared error
+	float EncodeBC4(const Block& block, int channel, BCQuality quality, uint8_t* out)
+	{
+		float low = 255.0f, high = 0.0f;
+		float innerLow = 255.0f, innerHigh = 0.0f;
+		for (int t = 0; t < TEXELS; ++t)
+		{
+			const float v = block.channel[channel][t];
+			low = std::min(low, v);
+			high = std::max(high, v);
+			if (v > 0.0f && v < 255.0f)
+			{
+				innerLow = std::min(innerLow, v);
+				innerHigh = std::max(innerHigh, v);
+			}
+		}
+
+		float bestError = FLT_MAX;
+		int best0 = 0, best1 = 0;
+		uint8_t bestIndices[TEXELS] = {};
+		const int passes = RefinePasses(quality);
+		// The six-value palette pays off when a block holds both extremes and something between
+		const int modes = quality == BCQualityHigh && innerLow <= innerHigh ? 2 : 1;
+
+		for (int mode = 0; mode < modes; ++mode)
+		{
+			float a[4] = { mode == 0 ? high : innerLow };
+			float b[4] = { mode == 0 ? low : innerHigh };
+			for (int pass = 0; pass <= passes; ++pass)
+			{
+				int e0 = (int)(Clamp255(a[0]) + 0.5f);
+				int e1 = (int)(Clamp255(b[0]) + 0.5f);
+				if (mode == 0 ? e0 < e1 : e0 > e1)
+				{
+					std::swap(e0, e1);
+					std::swap(a, b);
+				}
+
+				uint8_t values[8];
+				BC4Values(e0, e1, values);
+				Palette palette;
+				palette.count = 8;
+				for (int i = 0; i < 8; ++i)
+					palette.entry[i][0] = values[i];
+
+				uint8_t indices[TEXELS];
+				float errors[TEXELS];
+				FitIndices(block, channel, 1, palette, indices, errors);
+				const float error = SumErrors(errors, 0xffff);
+				if (error < bestError)
+				{
+					bestError = error;
+					best0 = e0;
+					best1 = e1;
+					std::copy(indices, indices + TEXELS, bestIndices);
+				}
+				else if (pass > 0)
+				{
+					break;
+				}
+
+				// Texels on the fixed 0 and 255 of the six-value palette take no part in the fit
+				const bool eightValue = e0 > e1;
+				float weight[TEXELS];
+				uint16_t mask = 0;
+				for (int t = 0; t < TEXELS; ++t)
+				{
+					const int index = indices[t];
+					if (!eightValue && index >= 6)
+						continue;
+					weight[t] = index == 0 ? 0.0f : index == 1 ? 1.0f : (index - 1) / (eightValue ? 7.0f : 5.0f);
+					mask |= 1 << t;
+				}
+				if (pass == passes || !RefineEndpoints(block, channel, 1, mask, weight, a, b))
+					break;
+			}
+		}
+
+		uint64_t bits = 0;
+		for (int t = 0; t < TEXELS; ++t)
+			bits |= (uint64_t)bestIndices[t] << (3 * t);
+		out[0] = (uint8_t)best0;
+		out[1] = (uint8_t)best1;
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (uint8_t)(bits >> (8 * i));
+		return bestError;
+	}
+
+	void DecodeBC4(const uint8_t* in, uint8_t texels[TEXELS][4], int channel)
+	{
+		uint8_t values[8];
+		BC4Values(in[0], in[1], values);
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; ++i)
+			bits |= (uint64_t)in[2 + i] << (8 * i);
+		for (int t = 0; t < TEXELS; ++t)
+			texels[t][channel] = values[(bits >> (3 * t)) & 7];
+	}
+
+	// --- BC7 ---
+
+	struct BitWriter
+	{
+		uint8_t*	out;
+		int			position;
+
+		explicit BitWriter(uint8_t* block) : out(block), position(0) { memset(out, 0, 16); }
+
+		void Write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; ++i, ++position)
+			{
+				if (value & (1u << i))
+					out[position >> 3] |= (uint8_t)(1 << (position & 7));
+			}
+		}
+	};
+
+	struct BitReader
+	{
+		const uint8_t*	in;
+		int				position;
+
+		explicit BitReader(const uint8_t* block) : in(block), position(0) {}
+
+		uint32_t Read(int bits)
+		{
+			uint32_t value = 0;
+			for (int i = 0; i < bits; ++i, ++position)
+				value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+			return value;
+		}
+	};
+
+	// Mode 6: one subset, 7-bit RGBA endpoints each with its own p-bit, 4-bit indices
+	void QuantizeMode6(const float e[4], int q[4], int& p)
+	{
+		float bestError = FLT_MAX;
+		for (int bit = 0; bit < 2; ++bit)
+		{
+			int candidate[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				candidate[c] = std::min(std::max((int)((e[c] - bit) * 0.5f + 0.5f), 0), 127);
+				const float difference = (float)((candidate[c] << 1) | bit) - e[c];
+				error += difference * difference;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				std::copy(candidate, candidate + 4, q);
+				p = bit;
+			}
+		}
+	}
+
+	float EncodeMode6(const Block& block, BCQuality quality, uint8_t* out)
+	{
+		float a[4], b[4];
+		PrincipalEndpoints(block, 0, 4, 0xffff, a, b);
+
+		float bestError = FLT_MAX;
+		int best0[4] = {}, best1[4] = {};
+		int bestP0 = 0, bestP1 = 0;
+		uint8_t bestIndices[TEXELS] = {};
+		const int passes = RefinePasses(quality);
+
+		for (int pass = 0; pass <= passes; ++pass)
+		{
+			int q0[4], q1[4], p0, p1;
+			QuantizeMode6(a, q0, p0);
+			QuantizeMode6(b, q1, p1);
+
+			Palette palette;
+			palette.count = 16;
+			for (int i = 0; i < 16; ++i)
+			{
+				for (int c = 0; c < 4; ++c)
+					palette.entry[i][c] = (float)Interpolate((q0[c] << 1) | p0, (q1[c] << 1) | p1, WEIGHTS4[i]);
+			}
+
+			uint8_t indices[TEXELS];
+			float errors[TEXELS];
+			FitIndices(block, 0, 4, palette, indices, errors);
+			const float error = SumErrors(errors, 0xffff);
+			if (error < bestError)
+			{
+				bestError = error;
+				std::copy(q0, q0 + 4, best0);
+				std::copy(q1, q1 + 4, best1);
+				bestP0 = p0;
+				bestP1 = p1;
+				std::copy(indices, indices + TEXELS, bestIndices);
+			}
+			else if (pass > 0)
+			{
+				break;
+			}
+
+			float weight[TEXELS];
+			for (int t = 0; t < TEXELS; ++t)
+				weight[t] = WEIGHTS4[indices[t]] / 64.0f;
+			if (pass == passes || !RefineEndpoints(block, 0, 4, 0xffff, weight, a, b))
+				break;
+		}
+
+		// Texel 0's index is stored without its top bit; swapping the ends clears it
+		if (bestIndices[0] & 8)
+		{
+			std::swap(best0, best1);
+			std::swap(bestP0, bestP1);
+			for (int t = 0; t < TEXELS; ++t)
+				bestIndices[t] = (uint8_t)(15 - bestIndices[t]);
+		}
+
+		BitWriter writer(out);
+		writer.Write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			writer.Write(best0[c], 7);
+			writer.Write(best1[c], 7);
+		}
+		writer.Write(bestP0, 1);
+		writer.Write(bestP1, 1);
+		for (int t = 0; t < TEXELS; ++t)
+			writer.Write(bestIndices[t], t == 0 ? 3 : 4);
+		return bestError;
+	}
+
+	// Mode 1: two subsets, 6-bit RGB endpoints with a p-bit shared per subset, 3-bit indices
+	inline int Mode1Value(int q, int p)
+	{
+		const int v = (q << 1) | p;
+		return (v << 1) | (v >> 6);
+	}
+
+	void QuantizeMode1(const float a[4], const float b[4], int qa[3], int qb[3], int& p)
+	{
+		float bestError = FLT_MAX;
+		for (int bit = 0; bit < 2; ++bit)
+		{
+			int candidate[2][3];
+			float error = 0.0f;
+			for (int end = 0; end < 2; ++end)
+			{
+				const float* e = end == 0 ? a : b;
+				for (int c = 0; c < 3; ++c)
+				{
+					const int estimate = (int)((e[c] * (127.0f / 255.0f) - bit) * 0.5f + 0.5f);
+					float nearest = FLT_MAX;
+					for (int q = std::max(estimate - 1, 0); q <= std::min(estimate + 1, 63); ++q)
+					{
+						const float difference = std::fabs(Mode1Value(q, bit) - e[c]);
+						if (difference < nearest)
+						{
+							nearest = difference;
+							candidate[end][c] = q;
+						}
+					}
+					error += nearest * nearest;
+				}
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				std::copy(candidate[0], candidate[0] + 3, qa);
+				std::copy(candidate[1], candidate[1] + 3, qb);
+				p = bit;
+			}
+		}
+	}
+
+	struct Mode1Fit
+	{
+		int					q[2][2][3];		// [subset][end][channel]
+		int					p[2];
+		uint8_t				indices[TEXELS];
+		float				error;
+	};
+
+	void FitMode1(const Block& block, int partition, int passes, Mode1Fit& fit)
+	{
+		const uint16_t masks[2] = { (uint16_t)~PARTITIONS2[partition], PARTITIONS2[partition] };
+		fit.error = 0.0f;
+		for (int subset = 0; subset < 2; ++subset)
+		{
+			float a[4], b[4];
+			PrincipalEndpoints(block, 0, 3, masks[subset], a, b);
+
+			float bestError = FLT_MAX;
+			for (int pass = 0; pass <= passes; ++pass)
+			{
+				int qa[3], qb[3], p = 0;
+				QuantizeMode1(a, b, qa, qb, p);
+
+				Palette palette;
+				palette.count = 8;
+				for (int i = 0; i < 8; ++i)
+				{
+					for (int c = 0; c < 3; ++c)
+						palette.entry[i][c] = (float)Interpolate(Mode1Value(qa[c], p), Mode1Value(qb[c], p), WEIGHTS3[i]);
+				}
+
+				uint8_t indices[TEXELS];
+				float errors[TEXELS];
+				FitIndices(block, 0, 3, palette, indices, errors);
+				const float error = SumErrors(errors, masks[subset]);
+				if (error < bestError)
+				{
+					bestError = error;
+					std::copy(qa, qa + 3, fit.q[subset][0]);
+					std::copy(qb, qb + 3, fit.q[subset][1]);
+					fit.p[subset] = p;
+					for (int t = 0; t < TEXELS; ++t)
+					{
+						if (masks[subset] & (1 << t))
+							fit.indices[t] = indices[t];
+					}
+				}
+				else if (pass > 0)
+				{
+					break;
+				}
+
+				float weight[TEXELS];
+				for (int t = 0; t < TEXELS; ++t)
+					weight[t] = WEIGHTS3[indices[t]] / 64.0f;
+				if (pass == passes || !RefineEndpoints(block, 0, 3, masks[subset], weight, a, b))
+					break;
+			}
+			fit.error += bestError;
+		}
+	}
+
+	void PackMode1(int partition, Mode1Fit& fit, uint8_t* out)
+	{
+		const uint16_t subsetMask = PARTITIONS2[partition];
+		const int anchors[2] = { 0, ANCHORS2[partition] };
+		for (int subset = 0; subset < 2; ++subset)
+		{
+			if (!(fit.indices[anchors[subset]] & 4))
+				continue;
+			std::swap(fit.q[subset][0], fit.q[subset][1]);
+			for (int t = 0; t < TEXELS; ++t)
+			{
+				if (((subsetMask >> t) & 1) == subset)
+					fit.indices[t] = (uint8_t)(7 - fit.indices[t]);
+			}
+		}
+
+		BitWriter writer(out);
+		writer.Write(1 << 1, 2);
+		writer.Write(partition, 6);
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int subset = 0; subset < 2; ++subset)
+			{
+				writer.Write(fit.q[subset][0][c], 6);
+				writer.Write(fit.q[subset][1][c], 6);
+			}
+		}
+		writer.Write(fit.p[0], 1);
+		writer.Write(fit.p[1], 1);
+		for (int t = 0; t < TEXELS; ++t)
+			writer.Write(fit.indices[t], t == anchors[0] || t == anchors[1] ? 2 : 3);
+	}
+
+	// Squared RGB distance of the texels in mask from their best-fit line, before quantisation
+	float LineResidual(const Block& block, uint16_t mask)
+	{
+		float e0[4], e1[4];
+		PrincipalEndpoints(block, 0, 3, mask, e0, e1);
+		float axis[3];
+		float length = 0.0f;
+		for (int c = 0; c < 3; ++c)
+		{
+			axis[c] = e1[c] - e0[c];
+			length += axis[c] * axis[c];
+		}
+		const float inverse = length > 1e-6f ? 1.0f / length : 0.0f;
+
+		float residual = 0.0f;
+		for (int t = 0; t < TEXELS; ++t)
+		{
+			if (!(mask & (1 << t)))
+				continue;
+			float offset[3];
+			float along = 0.0f;
+			for (int c = 0; c < 3; ++c)
+			{
+				offset[c] = block.channel[c][t] - e0[c];
+				along += offset[c] * axis[c];
+			}
+			along *= inverse;
+			for (int c = 0; c < 3; ++c)
+			{
+				const float away = offset[c] - along * axis[c];
+				residual += away * away;
+			}
+		}
+		return residual;
+	}
+
+	void EncodeBC7(const Block& block, BCQuality quality, uint8_t* out)
+	{
+		const float mode6Error = EncodeMode6(block, quality, out);
+		if (quality != BCQualityHigh || !block.opaque || mode6Error == 0.0f)
+			return;
+
+		// Partitions are ranked by how far their subsets stray from a line, and only the few
+		// most promising are fitted for real
+		const int CANDIDATES = 4;
+		int candidates[CANDIDATES];
+		float candidateErrors[CANDIDATES];
+		std::fill(candidates, candidates + CANDIDATES, 0);
+		std::fill(candidateErrors, candidateErrors + CANDIDATES, FLT_MAX);
+		for (int partition = 0; partition < 64; ++partition)
+		{
+			const float error = LineResidual(block, (uint16_t)~PARTITIONS2[partition]) + LineResidual(block, PARTITIONS2[partition]);
+			for (int i = 0; i < CANDIDATES; ++i)
+			{
+				if (error < candidateErrors[i])
+				{
+					std::copy_backward(candidates + i, candidates + CANDIDATES - 1, candidates + CANDIDATES);
+					std::copy_backward(candidateErrors + i, candidateErrors + CANDIDATES - 1, candidateErrors + CANDIDATES);
+					candidates[i] = partition;
+					candidateErrors[i] = error;
+					break;
+				}
+			}
+		}
+
+		Mode1Fit best = {};
+		best.error = mode6Error;
+		int bestPartition = -1;
+		for (int i = 0; i < CANDIDATES; ++i)
+		{
+			Mode1Fit fit;
+			FitMode1(block, candidates[i], RefinePasses(quality), fit);
+			if (fit.error < best.error)
+			{
+				best = fit;
+				bestPartition = candidates[i];
+			}
+		}
+		if (bestPartition >= 0)
+			PackMode1(bestPartition, best, out);
+	}
+
+	void DecodeBC7(const uint8_t* in, uint8_t texels[TEXELS][4])
+	{
+		BitReader reader(in);
+		if (in[0] & (1 << 6) && !(in[0] & 0x3f))
+		{
+			reader.Read(7);
+			int ends[2][4];
+			for (int c = 0; c < 4; ++c)
+			{
+				ends[0][c] = reader.Read(7) << 1;
+				ends[1][c] = reader.Read(7) << 1;
+			}
+			const int p0 = reader.Read(1);
+			const int p1 = reader.Read(1);
+			for (int c = 0; c < 4; ++c)
+			{
+				ends[0][c] |= p0;
+				ends[1][c] |= p1;
+			}
+			for (int t = 0; t < TEXELS; ++t)
+			{
+				const int index = reader.Read(t == 0 ? 3 : 4);
+				for (int c = 0; c < 4; ++c)
+					texels[t][c] = (uint8_t)Interpolate(ends[0][c], ends[1][c], WEIGHTS4[index]);
+			}
+		}
+		else if ((in[0] & 3) == 2)
+		{
+			reader.Read(2);
+			const int partition = reader.Read(6);
+			int q[2][2][3];
+			for (int c = 0; c < 3; ++c)
+			{
+				for (int subset = 0; subset < 2; ++subset)
+				{
+					q[subset][0][c] = reader.Read(6);
+					q[subset][1][c] = reader.Read(6);
+				}
+			}
+			const int p[2] = { (int)reader.Read(1), (int)reader.Read(1) };
+			const int anchor = ANCHORS2[partition];
+			for (int t = 0; t < TEXELS; ++t)
+			{
+				const int subset = (PARTITIONS2[partition] >> t) & 1;
+				const int index = reader.Read(t == 0 || t == anchor ? 2 : 3);
+				for (int c = 0; c < 3; ++c)
+					texels[t][c] = (uint8_t)Interpolate(Mode1Value(q[subset][0][c], p[subset]), Mode1Value(q[subset][1][c], p[subset]), WEIGHTS3[index]);
+				texels[t][3] = 255;
+			}
+		}
+		else
+		{
+			memset(texels, 0, TEXELS * 4);
+		}
+	}
+
+	void EncodeBlock(const Block& block, BCFormat format, BCQuality quality, uint8_t* out)
+	{
+		switch (format)
+		{
+		case BCFormatBC1:
+			EncodeBC1(block, quality, true, out);
+			break;
+		case BCFormatBC3:
+			EncodeBC4(block, 3, quality, out);
+			EncodeBC1(block, quality, false, out + 8);
+			break;
+		case BCFormatBC4:
+			EncodeBC4(block, 0, quality, out);
+			break;
+		case BCFormatBC5:
+			EncodeBC4(block, 0, quality, out);
+			EncodeBC4(block, 1, quality, out + 8);
+			break;
+		case BCFormatBC7:
+			EncodeBC7(block, quality, out);
+			break;
+		}
+	}
+
+	void DecodeBlock(const uint8_t* in, BCFormat format, uint8_t texels[TEXELS][4])
+	{
+		switch (format)
+		{
+		case BCFormatBC1:
+			DecodeBC1(in, true, texels);
+			break;
+		case BCFormatBC3:
+			DecodeBC1(in + 8, false, texels);
+			DecodeBC4(in, texels, 3);
+			break;
+		case BCFormatBC4:
+			memset(texels, 0, TEXELS * 4);
+			DecodeBC4(in, texels, 0);
+			for (int t = 0; t < TEXELS; ++t)
+				texels[t][3] = 255;
+			break;
+		case BCFormatBC5:
+			memset(texels, 0, TEXELS * 4);
+			DecodeBC4(in, texels, 0);
+			DecodeBC4(in + 8, texels, 1);
+			for (int t = 0; t < TEXELS; ++t)
+				texels[t][3] = 255;
+			break;
+		case BCFormatBC7:
+			DecodeBC7(in, texels);
+			break;
+		}
+	}
+
+	inline float ToSigned(uint8_t v)
+	{
+		return v * (2.0f / 255.0f) - 1.0f;
+	}
+
+	inline uint8_t ToUnsigned(float v)
+	{
+		return (uint8_t)std::min(std::max((v + 1.0f) * 127.5f + 0.5f, 0.0f), 255.0f);
+	}
+
+	// Unit tangent-space vector from an RGB texel; degenerate texels point straight out
+	void UnitNormal(const uint8_t* texel, float normal[3])
+	{
+		normal[0] = ToSigned(texel[0]);
+		normal[1] = ToSigned(texel[1]);
+		normal[2] = std::max(ToSigned(texel[2]), 0.0f);
+		const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length < 1e-6f)
+		{
+			normal[0] = normal[1] = 0.0f;
+			normal[2] = 1.0f;
+			return;
+		}
+		for (int c = 0; c < 3; ++c)
+			normal[c] /= length;
+	}
+}
+
+int BlockCompressor::BlockBytes(BCFormat format)
+{
+	return format == BCFormatBC1 || format == BCFormatBC4 ? 8 : 16;
+}
+
+uint32_t BlockCompressor::DXGIFormat(BCFormat format)
+{
+	switch (format)
+	{
+	case BCFormatBC1: return 71;	// DXGI_FORMAT_BC1_UNORM
+	case BCFormatBC3: return 77;	// DXGI_FORMAT_BC3_UNORM
+	case BCFormatBC4: return 80;	// DXGI_FORMAT_BC4_UNORM
+	case BCFormatBC5: return 83;	// DXGI_FORMAT_BC5_UNORM
+	default: return 98;				// DXGI_FORMAT_BC7_UNORM
+	}
+}
+
+int BlockCompressor::ChannelCount(BCFormat format)
+{
+	switch (format)
+	{
+	case BCFormatBC1: return 3;
+	case BCFormatBC4: return 1;
+	case BCFormatBC5: return 2;
+	default: return 4;
+	}
+}
+
+void BlockCompressor::Compress(const Image& image, BCFormat format, BCQuality quality, CompressedImage& compressed)
+{
+	const int blocksWide = (image.GetWidth() + 3) / 4;
+	const int blocksHigh = (image.GetHeight() + 3) / 4;
+	const int blockBytes = BlockBytes(format);
+
+	compressed.format = format;
+	compressed.width = image.GetWidth();
+	compressed.height = image.GetHeight();
+	compressed.blocks.assign((size_t)blocksWide * blocksHigh * blockBytes, 0);
+	if (image.IsEmpty())
+		return;
+
+	JobSystem::Get().ParallelFor(blocksHigh, 4, [&](int begin, int end)
+	{
+		Block block;
+		for (int blockY = begin; blockY < end; ++blockY)
+		{
+			uint8_t* out = compressed.blocks.data() + (size_t)blockY * blocksWide * blockBytes;
+			for (int blockX = 0; blockX < blocksWide; ++blockX, out += blockBytes)
+			{
+				LoadBlock(image, blockX, blockY, block);
+				EncodeBlock(block, format, quality, out);
+			}
+		}
+	});
+}
+
+void BlockCompressor::Decompress(const CompressedImage& compressed, Image& image)
+{
+	const int blocksWide = (compressed.width + 3) / 4;
+	const int blocksHigh = (compressed.height + 3) / 4;
+	const int blockBytes = BlockBytes(compressed.format);
+	image.Resize(compressed.width, compressed.height);
+
+	for (int blockY = 0; blockY < blocksHigh; ++blockY)
+	{
+		for (int blockX = 0; blockX < blocksWide; ++blockX)
+		{
+			uint8_t texels[TEXELS][4];
+			DecodeBlock(compressed.blocks.data() + ((size_t)blockY * blocksWide + blockX) * blockBytes, compressed.format, texels);
+			for (int y = 0; y < 4 && blockY * 4 + y < compressed.height; ++y)
+			{
+				for (int x = 0; x < 4 && blockX * 4 + x < compressed.width; ++x)
+					memcpy(image.At(blockX * 4 + x, blockY * 4 + y), texels[y * 4 + x], 4);
+			}
+		}
+	}
+}
+
+double BlockCompressor::PSNR(const Image& original, const Image& decoded, BCFormat format)
+{
+	const int channels = ChannelCount(format);
+	const size_t texels = (size_t)original.GetWidth() * original.GetHeight();
+	if (texels == 0 || decoded.GetWidth() != original.GetWidth() || decoded.GetHeight() != original.GetHeight())
+		return 0.0;
+
+	double sum = 0.0;
+	const uint8_t* a = original.GetData();
+	const uint8_t* b = decoded.GetData();
+	for (size_t i = 0; i < texels; ++i, a += 4, b += 4)
+	{
+		for (int c = 0; c < channels; ++c)
+		{
+			const double difference = (double)a[c] - b[c];
+			sum += difference * difference;
+		}
+	}
+
+	const double meanSquared = sum / (texels * channels);
+	if (meanSquared == 0.0)
+		return std::numeric_limits<double>::infinity();
+	return 10.0 * std::log10(255.0 * 255.0 / meanSquared);
+}
+
+void BlockCompressor::CompressNormalMap(const Image& normals, BCQuality quality, CompressedImage& compressed)
+{
+	Image unit(normals.GetWidth(), normals.GetHeight());
+	const size_t texels = (size_t)normals.GetWidth() * normals.GetHeight();
+	for (size_t i = 0; i < texels; ++i)
+	{
+		float normal[3];
+		UnitNormal(normals.GetData() + i * 4, normal);
+		uint8_t* out = unit.GetData() + i * 4;
+		for (int c = 0; c < 3; ++c)
+			out[c] = ToUnsigned(normal[c]);
+		out[3] = 255;
+	}
+	Compress(unit, BCFormatBC5, quality, compressed);
+}
+
+void BlockCompressor::NormalMapError(const Image& original, const CompressedImage& compressed, float& meanDegrees, float& maxDegrees)
+{
+	Image decoded;
+	Decompress(compressed, decoded);
+
+	double sum = 0.0;
+	maxDegrees = 0.0f;
+	const size_t texels = (size_t)original.GetWidth() * original.GetHeight();
+	for (size_t i = 0; i < texels; ++i)
+	{
+		float normal[3];
+		UnitNormal(original.GetData() + i * 4, normal);
+
+		const uint8_t* texel = decoded.GetData() + i * 4;
+		float rebuilt[3] = { ToSigned(texel[0]), ToSigned(texel[1]), 0.0f };
+		rebuilt[2] = std::sqrt(std::max(1.0f - rebuilt[0] * rebuilt[0] - rebuilt[1] * rebuilt[1], 0.0f));
+		const float length = std::sqrt(rebuilt[0] * rebuilt[0] + rebuilt[1] * rebuilt[1] + rebuilt[2] * rebuilt[2]);
+
+		const float cosine = (normal[0] * rebuilt[0] + normal[1] * rebuilt[1] + normal[2] * rebuilt[2]) / length;
+		const float degrees = std::acos(std::min(std::max(cosine, -1.0f), 1.0f)) * (180.0f / 3.14159265f);
+		sum += degrees;
+		maxDegrees = std::max(maxDegrees, degrees);
+	}
+	meanDegrees = texels ? (float)(sum / texels) : 0.0f;
+}
+
+bool BlockCompressor::SaveDDS(const std::string& fileName, const CompressedImage* mips, int mipCount)
+{
+	using namespace DDSFile;
+
+	if (mipCount < 1 || mips[0].blocks.empty())
+		return false;
+
+	Header header = {};
+	header.size = sizeof(Header);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+	header.width = (uint32_t)mips[0].width;
+	header.height = (uint32_t)mips[0].height;
+	header.pitchOrLinearSize = (uint32_t)mips[0].blocks.size();
+	header.caps = DDSCAPS_TEXTURE;
+	if (mipCount > 1)
+	{
+		header.flags |= DDSD_MIPMAPCOUNT;
+		header.mipMapCount = (uint32_t)mipCount;
+		header.caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+	header.format.size = sizeof(PixelFormat);
+	header.format.flags = DDPF_FOURCC;
+	header.format.fourCC = MakeFourCC('D', 'X', '1', '0');
+
+	HeaderDX10 extension = {};
+	extension.dxgiFormat = DXGIFormat(mips[0].format);
+	extension.resourceDimension = 3;		// D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	extension.arraySize = 1;
+
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	file.write((const char*)&MAGIC, 4);
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&extension, sizeof(extension));
+	for (int mip = 0; mip < mipCount; ++mip)
+		file.write((const char*)mips[mip].blocks.data(), mips[mip].blocks.size());
+	return (bool)file;
+}
+
+bool BlockCompressor::CompressFile(const std::string& inputFile, const std::string& outputFile, BCFormat format, BCQuality quality, const MipSettings& mipSettings, double* psnr)
+{
+	Image image;
+	if (!ImageIO::LoadDDS(inputFile, image))
+		return false;
+
+	std::vector<Image> mips;
+	MipGenerator::Generate(image, mipSettings, mips);
+
+	std::vector<CompressedImage> levels(mips.size());
+	const bool normalMap = mipSettings.normalMap && format == BCFormatBC5;
+	for (size_t mip = 0; mip < mips.size(); ++mip)
+	{
+		if (normalMap)
+			CompressNormalMap(mips[mip], quality, levels[mip]);
+		else
+			Compress(mips[mip], format, quality, levels[mip]);
+	}
+
+	if (psnr)
+	{
+		Image decoded;
+		Decompress(levels[0], decoded);
+		*psnr = PSNR(mips[0], decoded, format);
+	}
+	return SaveDDS(outputFile, levels.data(), (int)levels.size());
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+#include "MipGenerator.h"
+
+enum BCFormat
+{
+	BCFormatBC1 = 0,			// opaque RGB, 4 bits per texel
+	BCFormatBC3 = 1,			// RGB as BC1 plus BC4 alpha, 8 bits per texel
+	BCFormatBC4 = 2,			// one channel (heights, masks), 4 bits per texel
+	BCFormatBC5 = 3,			// two channels (tangent-space normal X and Y), 8 bits per texel
+	BCFormatBC7 = 4,			// RGBA at near-RGBA8 quality, 8 bits per texel
+};
+
+enum BCQuality
+{
+	BCQualityFast = 0,			// principal-axis endpoints as they fall; BC7 mode 6 only
+	BCQualityBalanced = 1,		// endpoints refined by least squares once
+	BCQualityHigh = 2,			// refined until no better; BC1 and BC4 also try their second palette
+								// mode and opaque BC7 blocks the 64 two-subset partitions of mode 1
+};
+
+// A single mip level in 4x4 blocks, row by row. Edge blocks of sizes that are not a multiple
+// of four repeat the last row and column.
+struct CompressedImage
+{
+	BCFormat				format = BCFormatBC1;
+	int						width = 0;
+	int						height = 0;
+	std::vector<uint8_t>	blocks;
+};
+
+// Block compression for the texture importer and the offline tools.
+//
+// Blocks are fitted in float and every candidate is scored against the palette the decoder
+// will actually produce, so the chosen indices are the true nearest entries; that search runs
+// four texels at a time in SSE. Rows of blocks are split across the job system.
+namespace BlockCompressor
+{
+	int			BlockBytes(BCFormat format);
+	// The DXGI_FORMAT value of the UNORM variant, as written to DX10 DDS headers
+	uint32_t	DXGIFormat(BCFormat format);
+	// Channels the format stores and PSNR is measured over (R, RG, RGB or RGBA)
+	int			ChannelCount(BCFormat format);
+
+	void		Compress(const Image& image, BCFormat format, BCQuality quality, CompressedImage& compressed);
+	// BC4 decodes to (r, 0, 0, 1) and BC5 to (r, g, 0, 1), as the sampler returns them. BC7
+	// decodes the two modes Compress writes (1 and 6); other modes come back black.
+	void		Decompress(const CompressedImage& compressed, Image& image);
+
+	// Peak signal-to-noise ratio in dB over the format's channels; infinite when identical
+	double		PSNR(const Image& original, const Image& decoded, BCFormat format);
+
+	// Tangent-space normal map to BC5. Only X and Y are kept and CalcBumpMap rebuilds Z, so each
+	// texel is renormalised first (Z facing out) for the rebuilt vector to be the one meant.
+	void		CompressNormalMap(const Image& normals, BCQuality quality, CompressedImage& compressed);
+	// Mean and largest angle, in degrees, between a normal map and what a shader rebuilds from it
+	void		NormalMapError(const Image& original, const CompressedImage& compressed, float& meanDegrees, float& maxDegrees);
+
+	// Writes a DX10 DDS that DDSTextureLoader reads directly
+	bool		SaveDDS(const std::string& fileName, const CompressedImage* mips, int mipCount);
+
+	// Offline path: reads a DDS, builds its mip chain, compresses every level and writes it back
+	// out. psnr, if given, receives the top level's. Normal maps (mipSettings.normalMap) going to
+	// BC5 are compressed through CompressNormalMap.
+	bool		CompressFile(const std::string& inputFile, const std::string& outputFile, BCFormat format, BCQuality quality, const MipSettings& mipSettings, double* psnr = nullptr);
+}
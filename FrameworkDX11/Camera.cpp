@@ -58,6 +58,12 @@ XMFLOAT4 Camera::GetPos()
 	return camera._eye;
 }
 
+void Camera::SetPos(XMFLOAT4 position)
+{
+	camera._eyeVector = XMLoadFloat4(&position);
+	SetViewMatrix();
+}
+
 XMFLOAT4 Camera::GetAt()
 {
 	XMStoreFloat4(&camera._at, camera._atVector);
@@ -24,6 +24,8 @@ public:
 	XMFLOAT4 GetAt();
 	XMFLOAT4 GetUp();
 
+	void SetPos(XMFLOAT4 position);
+
 	void AdjustRotation(float x, float y, float z);
 
 	void Move(float movementSpeed, Direction direction);
@@ -0,0 +1,212 @@
+#include "ConeStepMap.h"
+#include "ImageIO.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+#include <vector>
+
+namespace
+{
+	const float CONVERGED_STEP = 1.0f / 256.0f;	// in depth; finer than the map can resolve
+	const float MIN_CONE = 1e-5f;				// keeps vertical rays stepping through closed cones
+
+	inline uint8_t ToByte(float v)
+	{
+		return (uint8_t)std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f);
+	}
+
+	// Offsets on the square ring at each distance, padded to a multiple of four by repeating
+	// the first entry so the SSE loop needs no tail
+	struct RingOffsets
+	{
+		std::vector<int>		start;		// first offset of ring r, r = 1..; start[0] is unused
+		std::vector<int>		x;
+		std::vector<int>		y;
+		std::vector<float>		length;
+
+		explicit RingOffsets(int maxRadius)
+		{
+			start.assign(maxRadius + 2, 0);
+			for (int r = 1; r <= maxRadius; ++r)
+			{
+				start[r] = (int)x.size();
+				for (int oy = -r; oy <= r; ++oy)
+				{
+					const int step = (oy == -r || oy == r) ? 1 : 2 * r;
+					for (int ox = -r; ox <= r; ox += step)
+						Add(ox, oy);
+				}
+				while ((x.size() - start[r]) % 4)
+					Add(x[start[r]], y[start[r]]);
+			}
+			start[maxRadius + 1] = (int)x.size();
+		}
+
+		void Add(int ox, int oy)
+		{
+			x.push_back(ox);
+			y.push_back(oy);
+			length.push_back(std::sqrt((float)(ox * ox + oy * oy)));
+		}
+	};
+
+	// Walks the ray from the top of the texel at t through the surface point at offset o and on
+	// downwards until it leaves the solid again. The relaxed cone may reach up to that exit point
+	// but not past it. Returns the limiting ratio in texels per unit depth, or limit when the
+	// exit lies below the apex.
+	float RelaxedRatio(const DepthField& depth, int tx, int ty, float apex, int ox, int oy, float length, float surface, float limit)
+	{
+		const float stepDepth = surface / length;	// one texel along the ray per step
+		const float scale = 1.0f / surface;
+
+		for (float z = surface + stepDepth; z < apex; z += stepDepth)
+		{
+			const float t = z * scale;
+			const int sx = tx + (int)std::floor(ox * t + 0.5f);
+			const int sy = ty + (int)std::floor(oy * t + 0.5f);
+			if (depth.At(sx, sy) > z)
+				return std::min(length * t / (apex - z), limit);
+		}
+		return limit;
+	}
+}
+
+void ConeStepMap::Bake(const Image& depth, const ConeStepSettings& settings, Image& coneMap)
+{
+	const int size = settings.size;
+	DepthField field;
+	if (depth.GetWidth() == size && depth.GetHeight() == size)
+		field.Load(depth);
+	else
+		field.Load(depth.Resampled(size, size));
+
+	const int maxRadius = std::max(size / 2, 1);
+	const RingOffsets rings(maxRadius);
+	const float limit = settings.maxRatio * size;
+	const float minSurface = 0.5f / 255.0f;
+
+	coneMap.Resize(size, size);
+	JobSystem::Get().ParallelFor(size, 4, [&](int begin, int end)
+	{
+		alignas(16) float surface[4];
+		alignas(16) float bound[4];
+
+		for (int y = begin; y < end; ++y)
+		{
+			uint8_t* out = coneMap.GetRow(y);
+			for (int x = 0; x < size; ++x)
+			{
+				const float apex = field.GetRow(y)[x];
+				float best = limit;
+
+				// Nothing further than r can narrow the cone below r / apex, so the search stops
+				// at the first ring that cannot improve on the best ratio so far
+				for (int r = 1; r <= maxRadius && r < best * apex; ++r)
+				{
+					const __m128 apex4 = _mm_set1_ps(apex);
+					for (int i = rings.start[r]; i < rings.start[r + 1]; i += 4)
+					{
+						for (int k = 0; k < 4; ++k)
+							surface[k] = field.At(x + rings.x[i + k], y + rings.y[i + k]);
+
+						// Any cone through a point above the apex is at least this narrow
+						const __m128 surface4 = _mm_load_ps(surface);
+						const __m128 rise = _mm_sub_ps(apex4, surface4);
+						const __m128 above = _mm_cmpgt_ps(rise, _mm_setzero_ps());
+						const __m128 ratio = _mm_div_ps(_mm_loadu_ps(&rings.length[i]), _mm_max_ps(rise, _mm_set1_ps(1e-6f)));
+						const __m128 candidate = _mm_and_ps(above, _mm_cmplt_ps(ratio, _mm_set1_ps(best)));
+						if (!_mm_movemask_ps(candidate))
+							continue;
+
+						if (!settings.relaxed)
+						{
+							_mm_store_ps(bound, _mm_or_ps(_mm_and_ps(candidate, ratio), _mm_andnot_ps(candidate, _mm_set1_ps(best))));
+							best = std::min(std::min(bound[0], bound[1]), std::min(std::min(bound[2], bound[3]), best));
+							continue;
+						}
+
+						const int mask = _mm_movemask_ps(candidate);
+						for (int k = 0; k < 4; ++k)
+						{
+							if (mask & (1 << k))
+								best = RelaxedRatio(field, x, y, apex, rings.x[i + k], rings.y[i + k], rings.length[i + k], std::max(surface[k], minSurface), best);
+						}
+					}
+				}
+
+				out[x * 4 + 0] = ToByte(apex);
+				out[x * 4 + 1] = ToByte(std::sqrt(best / limit));
+				out[x * 4 + 2] = 0;
+				out[x * 4 + 3] = 255;
+			}
+		}
+	});
+}
+
+ParallaxTraceResult ConeStepMap::Trace(const DepthField& coneDepth, const DepthField& coneRatio, const DepthField& depth, const ConeStepSettings& settings, const ParallaxRay& ray)
+{
+	const float rayRatio = std::sqrt(ray.du * ray.du + ray.dv * ray.dv);
+
+	float z = 0.0f;
+	float step = 0.0f;
+	float previousHeight = 0.0f;
+	int fetches = 0;
+	for (int i = 0; i < settings.coneSteps; ++i)
+	{
+		const float u = ray.u + ray.du * z;
+		const float v = ray.v + ray.dv * z;
+		const float ratio = coneRatio.Sample(u, v);
+		const float height = coneDepth.Sample(u, v) - z;
+		++fetches;
+		if (height <= 0.0f)
+		{
+			// Stepped through the surface: place the hit on the line between the last two samples
+			if (step > 0.0f)
+				z -= step * height / (height - previousHeight);
+			break;
+		}
+
+		const float cone = std::max(ratio * ratio * settings.maxRatio, MIN_CONE);
+		step = cone * height / (rayRatio + cone);
+		previousHeight = height;
+		z += step;
+		if (step < CONVERGED_STEP)
+		{
+			step = 0.0f;
+			break;
+		}
+	}
+
+	// Refine within half a step either way against the full resolution depth. Rays that stop on
+	// the top surface or have already converged need no refinement.
+	float range = step * 0.5f;
+	for (int i = 0; i < settings.binarySteps && step > 0.0f; ++i)
+	{
+		range *= 0.5f;
+		if (z < depth.Sample(ray.u + ray.du * z, ray.v + ray.dv * z))
+			z += range;
+		else
+			z -= range;
+		++fetches;
+	}
+
+	ParallaxTraceResult result;
+	result.depth = z;
+	result.u = ray.u + ray.du * z;
+	result.v = ray.v + ray.dv * z;
+	result.fetches = fetches;
+	return result;
+}
+
+bool ConeStepMap::BakeFile(const std::string& depthFile, const std::string& coneFile, const ConeStepSettings& settings)
+{
+	Image depth;
+	if (!ImageIO::LoadDDS(depthFile, depth))
+		return false;
+
+	Image coneMap;
+	Bake(depth, settings, coneMap);
+	return ImageIO::SaveDDS(coneFile, &coneMap, 1);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+#include "Image.h"
+#include "ParallaxReference.h"
+
+struct ConeStepSettings
+{
+	int				size = 256;				// baked resolution; the height map is resampled to it
+	bool			relaxed = true;			// relaxed cones may contain the surface, see below
+	float			maxRatio = 1.0f;		// widest cone, in texture widths per unit of depth
+	int				coneSteps = 8;			// shader loop lengths, mirrored by Trace
+	int				binarySteps = 4;
+};
+
+// Cone step maps for the parallax modes. Every texel stores the widest cone standing on its
+// surface point that a view ray can safely step into, so the shader skips empty space in a few
+// large steps instead of marching fixed layers.
+//
+// A conservative cone contains no surface at all and the march only ever approaches the hit. A
+// relaxed cone (Policarpo and Oliveira) only guarantees that a ray entering from above crosses
+// the surface once inside it: the march may step below the surface, so it finishes with a
+// binary search between its last two positions. Relaxed cones are much wider and need fewer steps.
+//
+// Bake writes depth to red and sqrt(ratio / maxRatio) to green; the square root spends the
+// 8 bits on the narrow cones where precision matters. Texels are baked in parallel on the job
+// system, testing four neighbours at a time with SSE.
+namespace ConeStepMap
+{
+	void Bake(const Image& depth, const ConeStepSettings& settings, Image& coneMap);
+
+	// Mirrors ParallaxConeStepMapping in shader.fx, reading depth and cone ratio from the baked
+	// map and refining against the full resolution depth
+	ParallaxTraceResult Trace(const DepthField& coneDepth, const DepthField& coneRatio, const DepthField& depth, const ConeStepSettings& settings, const ParallaxRay& ray);
+
+	// Offline path: reads a DDS depth map and writes the cone map
+	bool BakeFile(const std::string& depthFile, const std::string& coneFile, const ConeStepSettings& settings);
+}
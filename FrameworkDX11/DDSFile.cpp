@@ -0,0 +1,34 @@
+#include "DDSFile.h"
+
+#include <cstring>
+
+bool DDSFile::Parse(const uint8_t* data, size_t size, Layout& layout)
+{
+	layout = Layout();
+	if (!data || size < sizeof(uint32_t) + sizeof(Header))
+		return false;
+
+	uint32_t magic;
+	memcpy(&magic, data, sizeof(magic));
+	if (magic != MAGIC)
+		return false;
+
+	// The header structs are packed, so reading them in place is fine at any alignment
+	const Header* header = reinterpret_cast<const Header*>(data + sizeof(uint32_t));
+	if (header->size != sizeof(Header) || header->format.size != sizeof(PixelFormat))
+		return false;
+
+	size_t offset = sizeof(uint32_t) + sizeof(Header);
+	if ((header->format.flags & DDPF_FOURCC) && header->format.fourCC == MakeFourCC('D', 'X', '1', '0'))
+	{
+		if (size < offset + sizeof(HeaderDX10))
+			return false;
+		layout.dx10 = reinterpret_cast<const HeaderDX10*>(data + offset);
+		offset += sizeof(HeaderDX10);
+	}
+
+	layout.header = header;
+	layout.bits = data + offset;
+	layout.bitSize = size - offset;
+	return true;
+}
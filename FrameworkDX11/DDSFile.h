@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// DDS container layout shared by ImageIO and DDSTextureLoader.
+//
+// Parse validates the magic number, the header sizes and the optional DX10 extension against
+// the data actually present, then points into the data in place: nothing is copied, so a
+// memory-mapped file feeds its mip surfaces straight to texture creation.
+namespace DDSFile
+{
+	const uint32_t MAGIC = 0x20534444;			// "DDS "
+
+	const uint32_t DDSD_CAPS = 0x1;
+	const uint32_t DDSD_HEIGHT = 0x2;
+	const uint32_t DDSD_WIDTH = 0x4;
+	const uint32_t DDSD_PITCH = 0x8;
+	const uint32_t DDSD_PIXELFORMAT = 0x1000;
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	const uint32_t DDSD_LINEARSIZE = 0x80000;
+
+	const uint32_t DDPF_ALPHAPIXELS = 0x1;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDPF_RGB = 0x40;
+	const uint32_t DDPF_LUMINANCE = 0x20000;
+
+	const uint32_t DDSCAPS_COMPLEX = 0x8;
+	const uint32_t DDSCAPS_TEXTURE = 0x1000;
+	const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+	constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+	{
+		return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+	}
+
+#pragma pack(push, 1)
+	struct PixelFormat
+	{
+		uint32_t	size;
+		uint32_t	flags;
+		uint32_t	fourCC;
+		uint32_t	rgbBitCount;
+		uint32_t	rBitMask;
+		uint32_t	gBitMask;
+		uint32_t	bBitMask;
+		uint32_t	aBitMask;
+	};
+
+	struct Header
+	{
+		uint32_t	size;
+		uint32_t	flags;
+		uint32_t	height;
+		uint32_t	width;
+		uint32_t	pitchOrLinearSize;
+		uint32_t	depth;
+		uint32_t	mipMapCount;
+		uint32_t	reserved1[11];
+		PixelFormat	format;
+		uint32_t	caps;
+		uint32_t	caps2;
+		uint32_t	caps3;
+		uint32_t	caps4;
+		uint32_t	reserved2;
+	};
+
+	struct HeaderDX10
+	{
+		uint32_t	dxgiFormat;
+		uint32_t	resourceDimension;
+		uint32_t	miscFlag;
+		uint32_t	arraySize;
+		uint32_t	miscFlags2;
+	};
+#pragma pack(pop)
+
+	struct Layout
+	{
+		const Header*		header = nullptr;
+		const HeaderDX10*	dx10 = nullptr;			// nullptr for legacy headers
+		const uint8_t*		bits = nullptr;			// surface data, mip by mip for each array slice
+		size_t				bitSize = 0;
+	};
+
+	// data must stay alive (and mapped) for as long as the layout is used
+	bool Parse(const uint8_t* data, size_t size, Layout& layout);
+}
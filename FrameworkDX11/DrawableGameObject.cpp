@@ -1,4 +1,11 @@
 #include "DrawableGameObject.h"
+#include "ConeStepMap.h"
+#include "HorizonBaker.h"
+#include "ImageIO.h"
+#include "ImageTexture.h"
+#include "MaxHeightPyramid.h"
+
+#include <algorithm>
 
 using namespace std;
 using namespace DirectX;
@@ -11,6 +18,7 @@ DrawableGameObject::DrawableGameObject()
 	m_pIndexBuffer = nullptr;
 	m_pTextureResourceView = nullptr;
 	m_pSamplerLinear = nullptr;
+	m_position = XMFLOAT3(0.0f, 0.0f, 0.0f);
 
 	// Initialize the world matrix
 	XMStoreFloat4x4(&m_World, XMMatrixIdentity());
@@ -36,6 +44,22 @@ void DrawableGameObject::cleanup()
 		m_pTextureResourceView->Release();
 	m_pTextureResourceView = nullptr;
 
+	m_texture.Reset();
+	m_normalTexture.Reset();
+	m_displacementTexture.Reset();
+
+	if (m_pConeStepTextureResourceView)
+		m_pConeStepTextureResourceView->Release();
+	m_pConeStepTextureResourceView = nullptr;
+
+	if (m_pMaxHeightTextureResourceView)
+		m_pMaxHeightTextureResourceView->Release();
+	m_pMaxHeightTextureResourceView = nullptr;
+
+	if (m_pHorizonTextureResourceView)
+		m_pHorizonTextureResourceView->Release();
+	m_pHorizonTextureResourceView = nullptr;
+
 	if (m_pSamplerLinear)
 		m_pSamplerLinear->Release();
 	m_pSamplerLinear = nullptr;
@@ -45,7 +69,7 @@ void DrawableGameObject::cleanup()
 	m_pMaterialConstantBuffer = nullptr;
 }
 
-HRESULT DrawableGameObject::initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext)
+HRESULT DrawableGameObject::initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext, TextureCache& textures)
 {
 	// Create vertex buffer
 	SimpleVertex vertices[] =
@@ -206,16 +230,54 @@ HRESULT DrawableGameObject::initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceConte
 	// Set primitive topology
 	pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	// load and setup textures
-	hr = CreateDDSTextureFromFile(pd3dDevice, L"Resources\\Brick Textures\\color.dds", nullptr, &m_pTextureResourceView);
+	// load and setup textures; each shows a neutral placeholder until its file is in, and files
+	// other objects already use are shared rather than loaded again
+	m_texture = textures.Acquire(L"Resources\\Brick Textures\\color.dds", TexturePlaceholder::White);
+
+	// Only the height map shipped: derive the normal map from it
+	m_normalTexture = textures.Acquire(L"Resources\\Brick Textures\\normals.dds", TexturePlaceholder::FlatNormal, [pd3dDevice]()
+	{
+		NormalMapSettings normalSettings;
+		NormalMapGenerator::GetResourcePreset("displacement.dds", normalSettings);
+		ID3D11ShaderResourceView* generated = nullptr;
+		CreateNormalMapFromHeight(pd3dDevice, "Resources\\Brick Textures\\displacement.dds", normalSettings, &generated);
+		return generated;
+	});
+
+	m_displacementTexture = textures.Acquire(L"Resources\\Brick Textures\\displacement.dds", TexturePlaceholder::FlatHeight);
+
+	// Relaxed cone map for the cone step parallax mode
+	Image displacement;
+	if (!ImageIO::LoadDDS("Resources\\Brick Textures\\displacement.dds", displacement))
+		return E_FAIL;
+
+	Image coneMap;
+	ConeStepMap::Bake(displacement, ConeStepSettings(), coneMap);
+	hr = CreateTextureFromImage(pd3dDevice, coneMap, false, &m_pConeStepTextureResourceView);
 	if (FAILED(hr))
 		return hr;
-	
-	hr = CreateDDSTextureFromFile(pd3dDevice, L"Resources\\Brick Textures\\normals.dds", nullptr, &m_pNormalTextureResourceView);
+
+	// Max-height mip chain for the quadtree parallax mode
+	vector<Image> maxHeightLevels;
+	MaxHeightPyramid::Build(displacement, maxHeightLevels);
+	hr = CreateTextureFromMips(pd3dDevice, maxHeightLevels.data(), (int)maxHeightLevels.size(), &m_pMaxHeightTextureResourceView);
 	if (FAILED(hr))
 		return hr;
 
-	hr = CreateDDSTextureFromFile(pd3dDevice, L"Resources\\Brick Textures\\displacement.dds", nullptr, &m_pDisplacementTextureResourceView);
+	// Horizon angles for parallax self-shadowing, each slice with its own mip chain
+	vector<Image> horizonSlices;
+	HorizonBaker::BakeParallaxHorizons(displacement, ParallaxReference::HEIGHT_SCALE, horizonSlices);
+	vector<Image> horizonMips;
+	int horizonMipCount = 0;
+	for (const Image& slice : horizonSlices)
+	{
+		const size_t first = horizonMips.size();
+		horizonMips.push_back(slice);
+		while (horizonMips.back().GetWidth() > 1 || horizonMips.back().GetHeight() > 1)
+			horizonMips.push_back(horizonMips.back().HalfSize());
+		horizonMipCount = (int)(horizonMips.size() - first);
+	}
+	hr = CreateTextureArrayFromImages(pd3dDevice, horizonMips.data(), (int)horizonSlices.size(), horizonMipCount, &m_pHorizonTextureResourceView);
 	if (FAILED(hr))
 		return hr;
 
@@ -260,7 +322,7 @@ void DrawableGameObject::update(float t)
 	// Cube:  Rotate around origin
 	//XMMATRIX mSpin = XMMatrixRotationY(cummulativeTime);
 
-	XMMATRIX mTranslate = XMMatrixTranslation(0.0f, 0.0f, 0.0f);
+	XMMATRIX mTranslate = XMMatrixTranslation(m_position.x, m_position.y, m_position.z);
 	XMMATRIX world = mTranslate;
 	//XMMATRIX world = mTranslate;
 	XMStoreFloat4x4(&m_World, world);
@@ -268,14 +330,39 @@ void DrawableGameObject::update(float t)
 	
 }
 
+void DrawableGameObject::RequestTextureDetail(TextureCache& textures, const XMFLOAT4& eye, float pixelsPerUnit)
+{
+	// Each face is 2 units across with the whole texture on it; measured from the nearest the
+	// cube's surface can be, so that no face looking at the camera is under-resolved
+	const float halfDiagonal = 1.7320508f;
+	float dx = eye.x - m_position.x;
+	float dy = eye.y - m_position.y;
+	float dz = eye.z - m_position.z;
+	float distance = max(sqrtf(dx * dx + dy * dy + dz * dz) - halfDiagonal, 0.1f);
+	float screenTexels = 2.0f * pixelsPerUnit / distance;
+
+	textures.RequestDetail(m_texture, screenTexels);
+	textures.RequestDetail(m_normalTexture, screenTexels);
+	textures.RequestDetail(m_displacementTexture, screenTexels);
+}
+
 void DrawableGameObject::draw(ID3D11DeviceContext* pContext)
 {
 	pContext->UpdateSubresource(m_pMaterialConstantBuffer, 0, nullptr, &m_material, 0, 0);
-	pContext->PSSetShaderResources(0, 1, &m_pTextureResourceView);
-	pContext->PSSetShaderResources(1, 1, &m_pNormalTextureResourceView);
-	pContext->PSSetShaderResources(2, 1, &m_pDisplacementTextureResourceView);
+	ID3D11ShaderResourceView* textures[] = { m_pTextureResourceView ? m_pTextureResourceView : m_texture.Get(), m_normalTexture.Get(), m_displacementTexture.Get() };
+	pContext->PSSetShaderResources(0, 3, textures);
+	pContext->PSSetShaderResources(7, 1, &m_pConeStepTextureResourceView);
+	pContext->PSSetShaderResources(8, 1, &m_pMaxHeightTextureResourceView);
+	pContext->PSSetShaderResources(9, 1, &m_pHorizonTextureResourceView);
 	pContext->PSSetSamplers(0, 1, &m_pSamplerLinear);
 
+	// Other drawables bind their own buffers, so rebind ours every draw
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+	pContext->IASetVertexBuffers(0, 1, &m_pVertexBuffer, &stride, &offset);
+	pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
 	pContext->DrawIndexed(NUM_VERTICES, 0, 0);
 }
 
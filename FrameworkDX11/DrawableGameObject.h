@@ -7,19 +7,13 @@
 #include "DDSTextureLoader.h"
 #include "resource.h"
 #include <iostream>
+#include "SimpleVertex.h"
 #include "structures.h"
+#include "TextureCache.h"
 
 
 using namespace DirectX;
 
-struct SimpleVertex
-{
-	XMFLOAT3 Pos;
-	XMFLOAT3 Normal;
-	XMFLOAT2 TexCoord;
-	XMFLOAT3 tangent;
-	XMFLOAT3 biTangent;
-};
 class DrawableGameObject
 {
 public:
@@ -28,18 +22,32 @@ public:
 
 	void cleanup();
 
-	HRESULT								initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext);
+	// The colour, normal and height maps stream in through textures; placeholders show until then
+	HRESULT								initMesh(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext, TextureCache& textures);
 	void								update(float t);
 	void								draw(ID3D11DeviceContext* pContext);
+	// Asks textures for the detail the cube needs seen from eye; pixelsPerUnit is the projected
+	// size of one world unit at distance one
+	void								RequestTextureDetail(TextureCache& textures, const XMFLOAT4& eye, float pixelsPerUnit);
 	ID3D11Buffer*						getVertexBuffer() { return m_pVertexBuffer; }
 	ID3D11Buffer*						getIndexBuffer() { return m_pIndexBuffer; }
 	ID3D11ShaderResourceView**			getTextureResourceView() { return &m_pTextureResourceView; 	}
-	void SetTextureResourceView(ID3D11ShaderResourceView* textureRV) { m_pTextureResourceView = textureRV; };
+	// Draws with textureRV in place of the object's own colour map; nullptr restores it
+	void SetTextureResourceView(ID3D11ShaderResourceView* textureRV)
+	{
+		// Holds its own reference, so swapping views every frame neither leaks nor double-releases
+		if (textureRV)
+			textureRV->AddRef();
+		if (m_pTextureResourceView)
+			m_pTextureResourceView->Release();
+		m_pTextureResourceView = textureRV;
+	};
 	XMFLOAT4X4*							getTransform() { return &m_World; }
 	ID3D11SamplerState**				getTextureSamplerState() { return &m_pSamplerLinear; }
 	void SetMaterialConstantBuffer(ID3D11DeviceContext* pContext) { pContext->UpdateSubresource(m_pMaterialConstantBuffer, 0, nullptr, &m_material, 0, 0); };
 	ID3D11Buffer*						getMaterialConstantBuffer() { return m_pMaterialConstantBuffer;}
 	void								setPosition(XMFLOAT3 position);
+	XMFLOAT3							getPosition() { return m_position; }
 
 	void CalculateTangentBinormalLH(SimpleVertex v0, SimpleVertex v1, SimpleVertex v2, XMFLOAT3& normal, XMFLOAT3& tangent, XMFLOAT3& binormal);
 	void CalculateModelVectors(SimpleVertex* vertices, int vertexCount);
@@ -52,8 +60,12 @@ private:
 	ID3D11Buffer*						m_pVertexBuffer;
 	ID3D11Buffer*						m_pIndexBuffer;
 	ID3D11ShaderResourceView*			m_pTextureResourceView;
-	ID3D11ShaderResourceView*			m_pNormalTextureResourceView;
-	ID3D11ShaderResourceView*			m_pDisplacementTextureResourceView;
+	TextureHandle						m_texture;
+	TextureHandle						m_normalTexture;
+	TextureHandle						m_displacementTexture;
+	ID3D11ShaderResourceView*			m_pConeStepTextureResourceView = nullptr;
+	ID3D11ShaderResourceView*			m_pMaxHeightTextureResourceView = nullptr;
+	ID3D11ShaderResourceView*			m_pHorizonTextureResourceView = nullptr;
 	ID3D11SamplerState *				m_pSamplerLinear;
 	ID3D11Buffer*						m_pMaterialConstantBuffer = nullptr;
 	XMFLOAT3							m_position;
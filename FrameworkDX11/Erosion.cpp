@@ -0,0 +1,323 @@
+#include "Erosion.h"
+#include "JobSystem.h"
+#include "TerrainGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	struct BrushTap
+	{
+		int		dx;
+		int		dy;
+		float	weight;
+	};
+
+	std::vector<BrushTap> BuildErosionBrush(int radius)
+	{
+		std::vector<BrushTap> brush;
+		float weightSum = 0.0f;
+		for (int dy = -radius; dy <= radius; ++dy)
+		{
+			for (int dx = -radius; dx <= radius; ++dx)
+			{
+				float distance = std::sqrt((float)(dx * dx + dy * dy));
+				if (distance > radius)
+					continue;
+
+				float weight = 1.0f - distance / (radius + 1.0f);
+				brush.push_back({ dx, dy, weight });
+				weightSum += weight;
+			}
+		}
+
+		for (BrushTap& tap : brush)
+			tap.weight /= weightSum;
+		return brush;
+	}
+
+	struct Region
+	{
+		int x0, y0, x1, y1;	// inclusive
+	};
+
+	inline void HeightAndGradient(const Heightfield& heightfield, float posX, float posY, float& height, float& gradientX, float& gradientY)
+	{
+		int nodeX = (int)posX;
+		int nodeY = (int)posY;
+		float u = posX - nodeX;
+		float v = posY - nodeY;
+
+		float h00 = heightfield.At(nodeX, nodeY);
+		float h10 = heightfield.At(nodeX + 1, nodeY);
+		float h01 = heightfield.At(nodeX, nodeY + 1);
+		float h11 = heightfield.At(nodeX + 1, nodeY + 1);
+
+		gradientX = (h10 - h00) * (1.0f - v) + (h11 - h01) * v;
+		gradientY = (h01 - h00) * (1.0f - u) + (h11 - h10) * u;
+		height = h00 * (1.0f - u) * (1.0f - v) + h10 * u * (1.0f - v) + h01 * (1.0f - u) * v + h11 * u * v;
+	}
+
+	void SimulateTile(Heightfield& heightfield, const HydraulicErosionSettings& settings, const std::vector<BrushTap>& brush,
+		const Region& spawn, const Region& region, int64_t dropletCount, uint64_t streamSeed)
+	{
+		RandomStream random(streamSeed);
+		const float spawnWidth = (float)(spawn.x1 - spawn.x0 + 1);
+		const float spawnHeight = (float)(spawn.y1 - spawn.y0 + 1);
+		const int r = settings.erosionRadius;
+
+		// A droplet is valid while its bilinear footprint and erosion brush stay inside the region
+		const float minX = (float)(region.x0 + r);
+		const float minY = (float)(region.y0 + r);
+		const float maxX = (float)(region.x1 - r);
+		const float maxY = (float)(region.y1 - r);
+
+		for (int64_t droplet = 0; droplet < dropletCount; ++droplet)
+		{
+			float posX = spawn.x0 + random.NextFloat() * spawnWidth;
+			float posY = spawn.y0 + random.NextFloat() * spawnHeight;
+			float dirX = 0.0f;
+			float dirY = 0.0f;
+			float speed = 1.0f;
+			float water = 1.0f;
+			float sediment = 0.0f;
+
+			for (int step = 0; step < settings.maxLifetime; ++step)
+			{
+				if (posX < minX || posY < minY || posX >= maxX || posY >= maxY)
+					break;
+
+				int nodeX = (int)posX;
+				int nodeY = (int)posY;
+				float cellOffsetX = posX - nodeX;
+				float cellOffsetY = posY - nodeY;
+
+				float height, gradientX, gradientY;
+				HeightAndGradient(heightfield, posX, posY, height, gradientX, gradientY);
+
+				dirX = dirX * settings.inertia - gradientX * (1.0f - settings.inertia);
+				dirY = dirY * settings.inertia - gradientY * (1.0f - settings.inertia);
+				float length = std::sqrt(dirX * dirX + dirY * dirY);
+				if (length < 1e-6f)
+					break;
+				dirX /= length;
+				dirY /= length;
+				posX += dirX;
+				posY += dirY;
+
+				if (posX < minX || posY < minY || posX >= maxX || posY >= maxY)
+					break;
+
+				float newHeight, unusedX, unusedY;
+				HeightAndGradient(heightfield, posX, posY, newHeight, unusedX, unusedY);
+				float deltaHeight = newHeight - height;
+
+				float capacity = std::max(-deltaHeight * speed * water * settings.sedimentCapacityFactor, settings.minSedimentCapacity);
+
+				if (sediment > capacity || deltaHeight > 0.0f)
+				{
+					// Uphill: fill the pit behind us; otherwise drop a fraction of the surplus
+					float amount = deltaHeight > 0.0f ? std::min(deltaHeight, sediment) : (sediment - capacity) * settings.depositSpeed;
+					sediment -= amount;
+
+					heightfield.At(nodeX, nodeY) += amount * (1.0f - cellOffsetX) * (1.0f - cellOffsetY);
+					heightfield.At(nodeX + 1, nodeY) += amount * cellOffsetX * (1.0f - cellOffsetY);
+					heightfield.At(nodeX, nodeY + 1) += amount * (1.0f - cellOffsetX) * cellOffsetY;
+					heightfield.At(nodeX + 1, nodeY + 1) += amount * cellOffsetX * cellOffsetY;
+				}
+				else
+				{
+					float amount = std::min((capacity - sediment) * settings.erodeSpeed, -deltaHeight);
+					for (const BrushTap& tap : brush)
+						heightfield.At(nodeX + tap.dx, nodeY + tap.dy) -= amount * tap.weight;
+					sediment += amount;
+				}
+
+				speed = std::sqrt(std::max(0.0f, speed * speed - deltaHeight * settings.gravity));
+				water *= 1.0f - settings.evaporateSpeed;
+			}
+		}
+	}
+
+	double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+ErosionStats Erosion::Hydraulic(Heightfield& heightfield, const HydraulicErosionSettings& settings, JobSystem* jobs)
+{
+	ErosionStats stats;
+	const int width = heightfield.GetWidth();
+	const int height = heightfield.GetHeight();
+	if (width < 4 || height < 4 || settings.dropletCount <= 0)
+		return stats;
+
+	auto start = std::chrono::steady_clock::now();
+	JobSystem& pool = jobs ? *jobs : JobSystem::Get();
+
+	const std::vector<BrushTap> brush = BuildErosionBrush(settings.erosionRadius);
+	const int tileSize = std::max(settings.tileSize, 16);
+	const int halo = settings.maxLifetime + settings.erosionRadius + 2;
+	const int tilesX = (width + tileSize - 1) / tileSize;
+	const int tilesY = (height + tileSize - 1) / tileSize;
+
+	// Tiles k apart along an axis have disjoint halo regions
+	const int k = std::min(1 + (2 * halo + tileSize - 1) / tileSize, std::max(tilesX, tilesY));
+
+	// Droplets are shared out by tile area with exact integer rounding, so the total is preserved
+	const int64_t totalCells = (int64_t)width * height;
+	std::vector<int64_t> tileDroplets(tilesX * tilesY);
+	int64_t cellsBefore = 0;
+	for (int ty = 0; ty < tilesY; ++ty)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			int64_t cells = (int64_t)(std::min(width, (tx + 1) * tileSize) - tx * tileSize) * (std::min(height, (ty + 1) * tileSize) - ty * tileSize);
+			int64_t first = (int64_t)((double)settings.dropletCount * cellsBefore / totalCells);
+			int64_t last = (int64_t)((double)settings.dropletCount * (cellsBefore + cells) / totalCells);
+			tileDroplets[ty * tilesX + tx] = last - first;
+			cellsBefore += cells;
+		}
+	}
+
+	std::vector<int> phaseTiles;
+	for (int phaseY = 0; phaseY < k; ++phaseY)
+	{
+		for (int phaseX = 0; phaseX < k; ++phaseX)
+		{
+			phaseTiles.clear();
+			for (int ty = phaseY; ty < tilesY; ty += k)
+				for (int tx = phaseX; tx < tilesX; tx += k)
+					phaseTiles.push_back(ty * tilesX + tx);
+
+			if (phaseTiles.empty())
+				continue;
+
+			pool.ParallelFor((int)phaseTiles.size(), 1, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+				{
+					int tile = phaseTiles[i];
+					int tx = tile % tilesX;
+					int ty = tile / tilesX;
+
+					Region spawn;
+					spawn.x0 = tx * tileSize;
+					spawn.y0 = ty * tileSize;
+					spawn.x1 = std::min(width, spawn.x0 + tileSize) - 1;
+					spawn.y1 = std::min(height, spawn.y0 + tileSize) - 1;
+
+					Region region;
+					region.x0 = std::max(0, spawn.x0 - halo);
+					region.y0 = std::max(0, spawn.y0 - halo);
+					region.x1 = std::min(width - 1, spawn.x1 + halo);
+					region.y1 = std::min(height - 1, spawn.y1 + halo);
+
+					uint64_t streamSeed = ((uint64_t)settings.seed << 32) | HashUInt((uint32_t)tile + 1);
+					SimulateTile(heightfield, settings, brush, spawn, region, tileDroplets[tile], streamSeed);
+				}
+			});
+
+			stats.phases++;
+		}
+	}
+
+	stats.droplets = settings.dropletCount;
+	stats.tiles = tilesX * tilesY;
+	stats.seconds = SecondsSince(start);
+	stats.dropletsPerSecond = stats.seconds > 0.0 ? stats.droplets / stats.seconds : 0.0;
+	return stats;
+}
+
+ErosionStats Erosion::Thermal(Heightfield& heightfield, const ThermalErosionSettings& settings, JobSystem* jobs)
+{
+	ErosionStats stats;
+	const int width = heightfield.GetWidth();
+	const int height = heightfield.GetHeight();
+	if (width < 2 || height < 2)
+		return stats;
+
+	auto start = std::chrono::steady_clock::now();
+	JobSystem& pool = jobs ? *jobs : JobSystem::Get();
+
+	const float talus = settings.talusSlope * heightfield.GetCellSize();
+	const int dx[4] = { -1, 1, 0, 0 };
+	const int dy[4] = { 0, 0, -1, 1 };
+
+	Heightfield next(width, height, heightfield.GetCellSize());
+	std::vector<float> outflowScale((size_t)width * height);
+
+	// Total height in excess of the talus that cell (x, y) could shed to its 4 neighbours
+	auto excess = [&](const Heightfield& source, int x, int y, float& steepest)
+	{
+		float h = source.At(x, y);
+		float total = 0.0f;
+		steepest = 0.0f;
+		for (int n = 0; n < 4; ++n)
+		{
+			int nx = x + dx[n];
+			int ny = y + dy[n];
+			if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+				continue;
+
+			float difference = h - source.At(nx, ny);
+			steepest = std::max(steepest, difference);
+			total += std::max(0.0f, difference - talus);
+		}
+		return total;
+	};
+
+	for (int iteration = 0; iteration < settings.iterations; ++iteration)
+	{
+		// Pass 1: how much each cell sheds, per unit of excess
+		pool.ParallelFor(height, 16, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					float steepest;
+					float total = excess(heightfield, x, y, steepest);
+					float moved = total > 0.0f ? settings.rate * (steepest - talus) * 0.5f : 0.0f;
+					outflowScale[(size_t)y * width + x] = total > 0.0f ? moved / total : 0.0f;
+				}
+			}
+		});
+
+		// Pass 2: gather, so no two threads write the same cell
+		pool.ParallelFor(height, 16, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					float steepest;
+					float h = heightfield.At(x, y);
+					float result = h - outflowScale[(size_t)y * width + x] * excess(heightfield, x, y, steepest);
+
+					for (int n = 0; n < 4; ++n)
+					{
+						int nx = x + dx[n];
+						int ny = y + dy[n];
+						if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+							continue;
+
+						float difference = heightfield.At(nx, ny) - h;
+						result += outflowScale[(size_t)ny * width + nx] * std::max(0.0f, difference - talus);
+					}
+
+					next.At(x, y) = result;
+				}
+			}
+		});
+
+		std::swap(heightfield, next);
+	}
+
+	stats.seconds = SecondsSince(start);
+	return stats;
+}
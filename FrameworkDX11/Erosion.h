@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Heightfield.h"
+
+class JobSystem;
+
+struct HydraulicErosionSettings
+{
+	int64_t		dropletCount = 1000000;
+	uint32_t	seed = 1337;
+	int			maxLifetime = 48;			// steps; a droplet moves at most one cell per step
+	int			erosionRadius = 3;			// cells
+	float		inertia = 0.05f;
+	float		sedimentCapacityFactor = 4.0f;
+	float		minSedimentCapacity = 0.01f;
+	float		erodeSpeed = 0.3f;
+	float		depositSpeed = 0.3f;
+	float		evaporateSpeed = 0.02f;
+	float		gravity = 4.0f;
+	int			tileSize = 128;				// droplets spawn inside a tile and stay inside its halo
+};
+
+struct ThermalErosionSettings
+{
+	int			iterations = 40;
+	float		talusSlope = 0.7f;			// rise over run above which material slides
+	float		rate = 0.5f;
+};
+
+struct ErosionStats
+{
+	int64_t		droplets = 0;
+	int			tiles = 0;
+	int			phases = 0;
+	double		seconds = 0.0;
+	double		dropletsPerSecond = 0.0;
+};
+
+// Erosion passes over a Heightfield.
+//
+// Hydraulic erosion partitions the heightfield into tiles. Each tile owns a halo wide enough to
+// contain every droplet spawned in it, and tiles whose halos could overlap are never run at the
+// same time: tiles are scheduled in phases of (tx % k, ty % k). Each tile seeds its own random
+// stream, so the result is identical for any number of worker threads.
+//
+// Both passes run on jobs, or on JobSystem::Get() when that is null.
+namespace Erosion
+{
+	ErosionStats Hydraulic(Heightfield& heightfield, const HydraulicErosionSettings& settings, JobSystem* jobs = nullptr);
+
+	// Jacobi-style update (read old, write new) so rows can be processed in parallel deterministically
+	ErosionStats Thermal(Heightfield& heightfield, const ThermalErosionSettings& settings, JobSystem* jobs = nullptr);
+}
@@ -0,0 +1,391 @@
+#include "HeightPyramid.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	const float RAY_INFINITY = std::numeric_limits<float>::infinity();
+
+	// Bilinear height of four grid-space points at once
+	inline __m128 Bilinear4(const Heightfield& heightfield, __m128 gx, __m128 gz)
+	{
+		const int width = heightfield.GetWidth();
+		const int height = heightfield.GetHeight();
+		const __m128 zero = _mm_setzero_ps();
+
+		gx = _mm_min_ps(_mm_max_ps(gx, zero), _mm_set1_ps((float)(width - 1)));
+		gz = _mm_min_ps(_mm_max_ps(gz, zero), _mm_set1_ps((float)(height - 1)));
+
+		// Inputs are non-negative so truncation is floor; keep the far edge inside the last cell
+		__m128 x0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gx)), _mm_set1_ps((float)(width - 2)));
+		__m128 z0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gz)), _mm_set1_ps((float)(height - 2)));
+		__m128 fx = _mm_sub_ps(gx, x0);
+		__m128 fz = _mm_sub_ps(gz, z0);
+
+		alignas(16) int ix[4];
+		alignas(16) int iz[4];
+		_mm_store_si128((__m128i*)ix, _mm_cvttps_epi32(x0));
+		_mm_store_si128((__m128i*)iz, _mm_cvttps_epi32(z0));
+
+		alignas(16) float h00[4], h10[4], h01[4], h11[4];
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			const float* row = heightfield.GetRow(iz[lane]) + ix[lane];
+			h00[lane] = row[0];
+			h10[lane] = row[1];
+			h01[lane] = row[width];
+			h11[lane] = row[width + 1];
+		}
+
+		__m128 a = _mm_load_ps(h00);
+		__m128 b = _mm_load_ps(h10);
+		__m128 c = _mm_load_ps(h01);
+		__m128 d = _mm_load_ps(h11);
+		__m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fx));
+		__m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), fx));
+		return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fz));
+	}
+
+	// Möller-Trumbore; returns the ray parameter or infinity
+	float IntersectTriangle(const float* origin, const float* direction, const float* v0, const float* v1, const float* v2)
+	{
+		float e1[3] = { v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2] };
+		float e2[3] = { v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2] };
+		float p[3] = { direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2], direction[0] * e2[1] - direction[1] * e2[0] };
+		float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+		if (std::fabs(det) < 1e-12f)
+			return RAY_INFINITY;
+
+		float invDet = 1.0f / det;
+		float s[3] = { origin[0] - v0[0], origin[1] - v0[1], origin[2] - v0[2] };
+		float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+		if (u < -1e-5f || u > 1.0f + 1e-5f)
+			return RAY_INFINITY;
+
+		float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+		float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * invDet;
+		if (v < -1e-5f || u + v > 1.0f + 1e-5f)
+			return RAY_INFINITY;
+
+		return (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+	}
+}
+
+HeightPyramid::HeightPyramid()
+	: m_heightfield(nullptr)
+{
+}
+
+void HeightPyramid::Build(const Heightfield& heightfield)
+{
+	m_heightfield = &heightfield;
+	m_levels.clear();
+	if (heightfield.GetWidth() < 2 || heightfield.GetHeight() < 2)
+		return;
+
+	Level base;
+	base.width = heightfield.GetWidth() - 1;
+	base.height = heightfield.GetHeight() - 1;
+	base.minHeights.resize((size_t)base.width * base.height);
+	base.maxHeights.resize((size_t)base.width * base.height);
+	m_levels.push_back(std::move(base));
+
+	for (int z = 0; z < m_levels[0].height; ++z)
+		for (int x = 0; x < m_levels[0].width; ++x)
+			BuildCell(x, z);
+
+	while (m_levels.back().width > 1 || m_levels.back().height > 1)
+	{
+		Level parent;
+		parent.width = (m_levels.back().width + 1) / 2;
+		parent.height = (m_levels.back().height + 1) / 2;
+		parent.minHeights.resize((size_t)parent.width * parent.height);
+		parent.maxHeights.resize((size_t)parent.width * parent.height);
+		m_levels.push_back(std::move(parent));
+
+		int level = (int)m_levels.size() - 1;
+		for (int z = 0; z < m_levels[level].height; ++z)
+			for (int x = 0; x < m_levels[level].width; ++x)
+				BuildParent(level, x, z);
+	}
+}
+
+void HeightPyramid::UpdateRegion(int x0, int z0, int x1, int z1)
+{
+	if (m_levels.empty())
+		return;
+
+	// A sample touches the cells on either side of it
+	int cellX0 = std::max(x0 - 1, 0);
+	int cellZ0 = std::max(z0 - 1, 0);
+	int cellX1 = std::min(x1, m_levels[0].width - 1);
+	int cellZ1 = std::min(z1, m_levels[0].height - 1);
+	if (cellX1 < cellX0 || cellZ1 < cellZ0)
+		return;
+
+	for (int z = cellZ0; z <= cellZ1; ++z)
+		for (int x = cellX0; x <= cellX1; ++x)
+			BuildCell(x, z);
+
+	for (int level = 1; level < (int)m_levels.size(); ++level)
+	{
+		cellX0 /= 2;
+		cellZ0 /= 2;
+		cellX1 /= 2;
+		cellZ1 /= 2;
+		for (int z = cellZ0; z <= cellZ1; ++z)
+			for (int x = cellX0; x <= cellX1; ++x)
+				BuildParent(level, x, z);
+	}
+}
+
+void HeightPyramid::BuildCell(int cellX, int cellZ)
+{
+	const float* row = m_heightfield->GetRow(cellZ) + cellX;
+	const float* nextRow = row + m_heightfield->GetWidth();
+
+	Level& base = m_levels[0];
+	size_t index = (size_t)cellZ * base.width + cellX;
+	base.minHeights[index] = std::min(std::min(row[0], row[1]), std::min(nextRow[0], nextRow[1]));
+	base.maxHeights[index] = std::max(std::max(row[0], row[1]), std::max(nextRow[0], nextRow[1]));
+}
+
+void HeightPyramid::BuildParent(int level, int cellX, int cellZ)
+{
+	const Level& child = m_levels[level - 1];
+	Level& parent = m_levels[level];
+
+	float minHeight = RAY_INFINITY;
+	float maxHeight = -RAY_INFINITY;
+	int x1 = std::min(cellX * 2 + 1, child.width - 1);
+	int z1 = std::min(cellZ * 2 + 1, child.height - 1);
+	for (int z = cellZ * 2; z <= z1; ++z)
+	{
+		for (int x = cellX * 2; x <= x1; ++x)
+		{
+			size_t index = (size_t)z * child.width + x;
+			minHeight = std::min(minHeight, child.minHeights[index]);
+			maxHeight = std::max(maxHeight, child.maxHeights[index]);
+		}
+	}
+
+	size_t index = (size_t)cellZ * parent.width + cellX;
+	parent.minHeights[index] = minHeight;
+	parent.maxHeights[index] = maxHeight;
+}
+
+void HeightPyramid::GetRange(int level, int cellX, int cellZ, float& minHeight, float& maxHeight) const
+{
+	const Level& l = m_levels[level];
+	size_t index = (size_t)cellZ * l.width + cellX;
+	minHeight = l.minHeights[index];
+	maxHeight = l.maxHeights[index];
+}
+
+bool HeightPyramid::IntersectCell(int cellX, int cellZ, const float* origin, const float* direction, float tMin, float tMax, TerrainRayHit& hit) const
+{
+	const float* row = m_heightfield->GetRow(cellZ) + cellX;
+	const float* nextRow = row + m_heightfield->GetWidth();
+	float x0 = (float)cellX;
+	float z0 = (float)cellZ;
+
+	// Same diagonal split as the terrain mesh: (00, 01, 11) and (00, 11, 10)
+	float v00[3] = { x0, row[0], z0 };
+	float v10[3] = { x0 + 1.0f, row[1], z0 };
+	float v01[3] = { x0, nextRow[0], z0 + 1.0f };
+	float v11[3] = { x0 + 1.0f, nextRow[1], z0 + 1.0f };
+
+	// The nearer triangle crossed within [tMin, tMax]; the other one's plane can cross the ray
+	// behind the origin or before this node
+	const float slack = 1e-4f;
+	float t0 = IntersectTriangle(origin, direction, v00, v01, v11);
+	float t1 = IntersectTriangle(origin, direction, v00, v11, v10);
+	if (!(t0 >= tMin - slack && t0 <= tMax + slack))
+		t0 = RAY_INFINITY;
+	if (!(t1 >= tMin - slack && t1 <= tMax + slack))
+		t1 = RAY_INFINITY;
+	bool first = t0 <= t1;
+	float t = first ? t0 : t1;
+	if (t == RAY_INFINITY)
+		return false;
+
+	// Triangle normal in world space (grid x/z scaled back by the cell size)
+	const float cellSize = m_heightfield->GetCellSize();
+	const float* a = v00;
+	const float* b = first ? v01 : v11;
+	const float* c = first ? v11 : v10;
+	float e1[3] = { (b[0] - a[0]) * cellSize, b[1] - a[1], (b[2] - a[2]) * cellSize };
+	float e2[3] = { (c[0] - a[0]) * cellSize, c[1] - a[1], (c[2] - a[2]) * cellSize };
+	XMFLOAT3 normal(e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]);
+	float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+	if (normal.y < 0.0f)
+		length = -length;
+
+	hit.distance = t;
+	hit.position = XMFLOAT3((origin[0] + direction[0] * t) * cellSize, origin[1] + direction[1] * t, (origin[2] + direction[2] * t) * cellSize);
+	hit.normal = XMFLOAT3(normal.x / length, normal.y / length, normal.z / length);
+	hit.cellX = cellX;
+	hit.cellZ = cellZ;
+	return true;
+}
+
+bool HeightPyramid::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainRayHit& hit) const
+{
+	if (m_levels.empty())
+		return false;
+
+	// Work in grid space; scaling x and z leaves the ray parameter in world units
+	const float invCellSize = 1.0f / m_heightfield->GetCellSize();
+	const float o[3] = { origin.x * invCellSize, origin.y, origin.z * invCellSize };
+	const float d[3] = { direction.x * invCellSize, direction.y, direction.z * invCellSize };
+	const float extent[3] = { (float)(m_heightfield->GetWidth() - 1), 0.0f, (float)(m_heightfield->GetHeight() - 1) };
+
+	const int top = (int)m_levels.size() - 1;
+	float rootMin, rootMax;
+	GetRange(top, 0, 0, rootMin, rootMax);
+
+	// Clip against the terrain bounding box
+	float tEnter = 0.0f;
+	float tExit = maxDistance;
+	const float boxMin[3] = { 0.0f, rootMin, 0.0f };
+	const float boxMax[3] = { extent[0], rootMax, extent[2] };
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (d[axis] == 0.0f)
+		{
+			if (o[axis] < boxMin[axis] || o[axis] > boxMax[axis])
+				return false;
+			continue;
+		}
+
+		float inv = 1.0f / d[axis];
+		float tNear = (boxMin[axis] - o[axis]) * inv;
+		float tFar = (boxMax[axis] - o[axis]) * inv;
+		if (tNear > tFar)
+			std::swap(tNear, tFar);
+		tEnter = std::max(tEnter, tNear);
+		tExit = std::min(tExit, tFar);
+	}
+	if (tEnter > tExit)
+		return false;
+
+	const float invX = d[0] != 0.0f ? 1.0f / d[0] : RAY_INFINITY;
+	const float invZ = d[2] != 0.0f ? 1.0f / d[2] : RAY_INFINITY;
+	const float epsilon = 1e-4f * m_heightfield->GetCellSize();
+
+	int level = top;
+	float t = tEnter;
+	int visited = 0;
+	const int maxSteps = 8 * (m_heightfield->GetWidth() + m_heightfield->GetHeight()) * (top + 1);
+
+	while (t <= tExit && visited < maxSteps)
+	{
+		visited++;
+
+		const Level& l = m_levels[level];
+		const float size = (float)(1 << level);
+		float px = o[0] + d[0] * t;
+		float pz = o[2] + d[2] * t;
+		int cellX = std::min(std::max((int)std::floor(px / size), 0), l.width - 1);
+		int cellZ = std::min(std::max((int)std::floor(pz / size), 0), l.height - 1);
+
+		// Where the ray leaves this node's footprint
+		float x0 = cellX * size;
+		float z0 = cellZ * size;
+		float x1 = std::min(x0 + size, extent[0]);
+		float z1 = std::min(z0 + size, extent[2]);
+		float exitX = d[0] > 0.0f ? (x1 - o[0]) * invX : (d[0] < 0.0f ? (x0 - o[0]) * invX : RAY_INFINITY);
+		float exitZ = d[2] > 0.0f ? (z1 - o[2]) * invZ : (d[2] < 0.0f ? (z0 - o[2]) * invZ : RAY_INFINITY);
+		float tNodeExit = std::min(std::min(exitX, exitZ), tExit);
+
+		float y0 = o[1] + d[1] * t;
+		float y1 = o[1] + d[1] * tNodeExit;
+		size_t index = (size_t)cellZ * l.width + cellX;
+		bool overlaps = std::min(y0, y1) <= l.maxHeights[index] && std::max(y0, y1) >= l.minHeights[index];
+
+		if (overlaps && level > 0)
+		{
+			level--;
+			continue;
+		}
+
+		if (overlaps && IntersectCell(cellX, cellZ, o, d, t, tNodeExit, hit))
+		{
+			hit.nodesVisited = visited;
+			return true;
+		}
+
+		// Step past the node and try a coarser level again
+		t = std::max(tNodeExit, t) + epsilon;
+		if (level < top)
+			level++;
+	}
+
+	return false;
+}
+
+void HeightPyramid::SampleHeights(const float* x, const float* z, float* heights, int count) const
+{
+	const __m128 invCellSize = _mm_set1_ps(1.0f / m_heightfield->GetCellSize());
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 gx = _mm_mul_ps(_mm_loadu_ps(x + i), invCellSize);
+		__m128 gz = _mm_mul_ps(_mm_loadu_ps(z + i), invCellSize);
+		_mm_storeu_ps(heights + i, Bilinear4(*m_heightfield, gx, gz));
+	}
+	for (; i < count; ++i)
+		heights[i] = SampleHeight(x[i], z[i]);
+}
+
+void HeightPyramid::SampleNormals(const float* x, const float* z, XMFLOAT3* normals, int count) const
+{
+	const float cellSize = m_heightfield->GetCellSize();
+	const __m128 invCellSize = _mm_set1_ps(1.0f / cellSize);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 twoCells = _mm_set1_ps(2.0f * cellSize);
+
+	for (int i = 0; i < count; i += 4)
+	{
+		// Pad the final group by repeating the last point
+		alignas(16) float px[4], pz[4];
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			int source = std::min(i + lane, count - 1);
+			px[lane] = x[source];
+			pz[lane] = z[source];
+		}
+
+		__m128 gx = _mm_mul_ps(_mm_load_ps(px), invCellSize);
+		__m128 gz = _mm_mul_ps(_mm_load_ps(pz), invCellSize);
+
+		// Central differences one cell either side
+		__m128 left = Bilinear4(*m_heightfield, _mm_sub_ps(gx, one), gz);
+		__m128 right = Bilinear4(*m_heightfield, _mm_add_ps(gx, one), gz);
+		__m128 down = Bilinear4(*m_heightfield, gx, _mm_sub_ps(gz, one));
+		__m128 up = Bilinear4(*m_heightfield, gx, _mm_add_ps(gz, one));
+
+		__m128 nx = _mm_sub_ps(left, right);
+		__m128 nz = _mm_sub_ps(down, up);
+		__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(twoCells, twoCells)), _mm_mul_ps(nz, nz));
+		__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+		alignas(16) float outX[4], outY[4], outZ[4];
+		_mm_store_ps(outX, _mm_mul_ps(nx, invLength));
+		_mm_store_ps(outY, _mm_mul_ps(twoCells, invLength));
+		_mm_store_ps(outZ, _mm_mul_ps(nz, invLength));
+
+		for (int lane = 0; lane < 4 && i + lane < count; ++lane)
+			normals[i + lane] = XMFLOAT3(outX[lane], outY[lane], outZ[lane]);
+	}
+}
+
+float HeightPyramid::SampleHeight(float x, float z) const
+{
+	const float invCellSize = 1.0f / m_heightfield->GetCellSize();
+	return m_heightfield->SampleBilinear(x * invCellSize, z * invCellSize);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Heightfield.h"
+
+using namespace DirectX;
+
+struct TerrainRayHit
+{
+	float		distance;
+	XMFLOAT3	position;
+	XMFLOAT3	normal;
+	int			cellX;
+	int			cellZ;
+	int			nodesVisited;
+};
+
+// Hierarchical min/max pyramid over a Heightfield.
+//
+// Level 0 stores the height range of each grid cell (the quad between four samples), every
+// higher level the range of a 2x2 block below it. Rays descend the pyramid only where their
+// height interval overlaps a node's range, so flat open areas are skipped many cells at a time.
+// All positions are in heightfield-local space: x = column * cellSize, z = row * cellSize.
+class HeightPyramid
+{
+public:
+	HeightPyramid();
+
+	void Build(const Heightfield& heightfield);
+
+	// Refreshes the nodes covering samples [x0, x1] x [z0, z1] after the heightfield was edited
+	void UpdateRegion(int x0, int z0, int x1, int z1);
+
+	int GetLevelCount() const { return (int)m_levels.size(); }
+	int GetLevelWidth(int level) const { return m_levels[level].width; }
+	int GetLevelHeight(int level) const { return m_levels[level].height; }
+	void GetRange(int level, int cellX, int cellZ, float& minHeight, float& maxHeight) const;
+
+	// Finds the first crossing of the terrain mesh within maxDistance, in units of direction.
+	// The surface is hit from either side: a ray starting below it hits where it first comes up
+	// through it, or misses if it never does. The hit normal always faces up.
+	bool Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainRayHit& hit) const;
+
+	// Batched queries; positions are laid out as separate x and z arrays so four points are
+	// evaluated per SSE instruction. Points outside the terrain are clamped to its edge.
+	void SampleHeights(const float* x, const float* z, float* heights, int count) const;
+	void SampleNormals(const float* x, const float* z, XMFLOAT3* normals, int count) const;
+
+	float SampleHeight(float x, float z) const;
+
+private:
+	struct Level
+	{
+		int					width;
+		int					height;
+		std::vector<float>	minHeights;
+		std::vector<float>	maxHeights;
+	};
+
+	void BuildCell(int cellX, int cellZ);
+	void BuildParent(int level, int cellX, int cellZ);
+	bool IntersectCell(int cellX, int cellZ, const float* origin, const float* direction, float tMin, float tMax, TerrainRayHit& hit) const;
+
+	const Heightfield*					m_heightfield;
+	std::vector<Level>					m_levels;
+};
@@ -0,0 +1,68 @@
+#include "Heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+
+Heightfield::Heightfield()
+	: m_width(0)
+	, m_height(0)
+	, m_cellSize(1.0f)
+{
+}
+
+Heightfield::Heightfield(int width, int height, float cellSize)
+	: m_width(0)
+	, m_height(0)
+	, m_cellSize(cellSize)
+{
+	Resize(width, height);
+}
+
+void Heightfield::Resize(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_heights.assign((size_t)width * height, 0.0f);
+}
+
+void Heightfield::Fill(float value)
+{
+	std::fill(m_heights.begin(), m_heights.end(), value);
+}
+
+float Heightfield::AtClamped(int x, int y) const
+{
+	x = std::min(std::max(x, 0), m_width - 1);
+	y = std::min(std::max(y, 0), m_height - 1);
+	return At(x, y);
+}
+
+float Heightfield::SampleBilinear(float x, float y) const
+{
+	x = std::min(std::max(x, 0.0f), (float)(m_width - 1));
+	y = std::min(std::max(y, 0.0f), (float)(m_height - 1));
+
+	int x0 = (int)x;
+	int y0 = (int)y;
+	int x1 = std::min(x0 + 1, m_width - 1);
+	int y1 = std::min(y0 + 1, m_height - 1);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	float top = At(x0, y0) + (At(x1, y0) - At(x0, y0)) * fx;
+	float bottom = At(x0, y1) + (At(x1, y1) - At(x0, y1)) * fx;
+	return top + (bottom - top) * fy;
+}
+
+void Heightfield::GetMinMax(float& minHeight, float& maxHeight) const
+{
+	if (m_heights.empty())
+	{
+		minHeight = maxHeight = 0.0f;
+		return;
+	}
+
+	auto range = std::minmax_element(m_heights.begin(), m_heights.end());
+	minHeight = *range.first;
+	maxHeight = *range.second;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// A regular grid of terrain heights. Sample (x, y) sits at world position
+// (x * cellSize, height, y * cellSize); heights are stored in world units.
+class Heightfield
+{
+public:
+	Heightfield();
+	Heightfield(int width, int height, float cellSize = 1.0f);
+
+	void Resize(int width, int height);
+	void Fill(float value);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	float GetCellSize() const { return m_cellSize; }
+	void SetCellSize(float cellSize) { m_cellSize = cellSize; }
+
+	float* GetData() { return m_heights.data(); }
+	const float* GetData() const { return m_heights.data(); }
+	float* GetRow(int y) { return m_heights.data() + (size_t)y * m_width; }
+	const float* GetRow(int y) const { return m_heights.data() + (size_t)y * m_width; }
+
+	float At(int x, int y) const { return m_heights[(size_t)y * m_width + x]; }
+	float& At(int x, int y) { return m_heights[(size_t)y * m_width + x]; }
+	float AtClamped(int x, int y) const;
+
+	// x and y are in grid units, not world units
+	float SampleBilinear(float x, float y) const;
+
+	void GetMinMax(float& minHeight, float& maxHeight) const;
+
+private:
+	int									m_width;
+	int									m_height;
+	float								m_cellSize;
+	std::vector<float>					m_heights;
+};
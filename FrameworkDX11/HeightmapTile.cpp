@@ -0,0 +1,277 @@
+#include "HeightmapTile.h"
+#include "LZCodec.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	// FNV-1a a word at a time, so checking a tile costs little next to decoding it
+	uint64_t Checksum(const HeightmapTileHeader& header, const uint8_t* planes, size_t size)
+	{
+		const uint64_t prime = 1099511628211ull;
+		uint64_t hash = 14695981039346656037ull;
+		const uint8_t* headerBytes = reinterpret_cast<const uint8_t*>(&header);
+		for (size_t i = 0; i < offsetof(HeightmapTileHeader, checksum); ++i)
+		{
+			hash ^= headerBytes[i];
+			hash *= prime;
+		}
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			memcpy(&word, planes + i, sizeof(word));
+			hash ^= word;
+			hash *= prime;
+		}
+		for (; i < size; ++i)
+		{
+			hash ^= planes[i];
+			hash *= prime;
+		}
+		return hash;
+	}
+
+	inline uint16_t ZigZagEncode(uint16_t residual)
+	{
+		return (uint16_t)((residual << 1) ^ (uint16_t)((int16_t)residual >> 15));
+	}
+
+	inline uint16_t ZigZagDecode(uint16_t value)
+	{
+		return (uint16_t)((value >> 1) ^ (uint16_t)(0 - (value & 1)));
+	}
+}
+
+bool HeightmapTileCodec::Encode(const Heightfield& source, std::vector<uint8_t>& output)
+{
+	const int width = source.GetWidth();
+	const int height = source.GetHeight();
+	if (width <= 0 || height <= 0)
+		return false;
+
+	const size_t count = (size_t)width * height;
+
+	float minHeight, maxHeight;
+	source.GetMinMax(minHeight, maxHeight);
+	float range = maxHeight - minHeight;
+	float scale = range > 0.0f ? 65535.0f / range : 0.0f;
+
+	m_quantized.resize(count);
+	const float* heights = source.GetData();
+	for (size_t i = 0; i < count; ++i)
+	{
+		float q = (heights[i] - minHeight) * scale + 0.5f;
+		m_quantized[i] = (uint16_t)std::min(std::max(q, 0.0f), 65535.0f);
+	}
+
+	// Gradient prediction with an implicit row and column of zeros outside the tile
+	m_planes.resize(count * 2);
+	uint8_t* lowPlane = m_planes.data();
+	uint8_t* highPlane = m_planes.data() + count;
+	for (int y = 0; y < height; ++y)
+	{
+		const uint16_t* row = m_quantized.data() + (size_t)y * width;
+		const uint16_t* previousRow = y > 0 ? row - width : nullptr;
+		for (int x = 0; x < width; ++x)
+		{
+			uint16_t left = x > 0 ? row[x - 1] : 0;
+			uint16_t up = previousRow ? previousRow[x] : 0;
+			uint16_t upLeft = (previousRow && x > 0) ? previousRow[x - 1] : 0;
+			uint16_t residual = (uint16_t)(row[x] - left - up + upLeft);
+			uint16_t coded = ZigZagEncode(residual);
+
+			size_t index = (size_t)y * width + x;
+			lowPlane[index] = (uint8_t)(coded & 0xFF);
+			highPlane[index] = (uint8_t)(coded >> 8);
+		}
+	}
+
+	HeightmapTileHeader header = {};
+	header.magic = HEIGHTMAP_TILE_MAGIC;
+	header.version = HEIGHTMAP_TILE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.cellSize = source.GetCellSize();
+	header.minHeight = minHeight;
+	header.maxHeight = maxHeight;
+	header.planeSize = (uint32_t)m_planes.size();
+
+	output.resize(sizeof(header) + LZCodec::CompressBound(m_planes.size()));
+	size_t compressedSize = LZCodec::Compress(m_planes.data(), m_planes.size(), output.data() + sizeof(header), output.size() - sizeof(header));
+
+	// Noisy tiles can fail to compress; store those raw so decode cost never exceeds a memcpy
+	if (compressedSize == 0 || compressedSize >= m_planes.size())
+	{
+		memcpy(output.data() + sizeof(header), m_planes.data(), m_planes.size());
+		header.payloadSize = header.planeSize;
+	}
+	else
+	{
+		header.flags |= HeightmapTileLZ;
+		header.payloadSize = (uint32_t)compressedSize;
+	}
+
+	header.checksum = Checksum(header, m_planes.data(), m_planes.size());
+	memcpy(output.data(), &header, sizeof(header));
+	output.resize(sizeof(header) + header.payloadSize);
+	return true;
+}
+
+bool HeightmapTileCodec::DecodePlanes(const uint8_t* data, size_t size, HeightmapTileHeader& header)
+{
+	if (size < sizeof(header))
+		return false;
+
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != HEIGHTMAP_TILE_MAGIC || header.version != HEIGHTMAP_TILE_VERSION)
+		return false;
+	if (header.width == 0 || header.height == 0 || header.width > 16384 || header.height > 16384)
+		return false;
+	if (header.planeSize != header.width * header.height * 2 || header.payloadSize > size - sizeof(header))
+		return false;
+
+	const uint8_t* payload = data + sizeof(header);
+	m_planes.resize(header.planeSize);
+	if (header.flags & HeightmapTileLZ)
+	{
+		if (!LZCodec::Decompress(payload, header.payloadSize, m_planes.data(), m_planes.size()))
+			return false;
+	}
+	else
+	{
+		if (header.payloadSize != header.planeSize)
+			return false;
+		memcpy(m_planes.data(), payload, header.planeSize);
+	}
+	return Checksum(header, m_planes.data(), m_planes.size()) == header.checksum;
+}
+
+void HeightmapTileCodec::Reconstruct(const HeightmapTileHeader& header, uint16_t* quantized)
+{
+	const int width = (int)header.width;
+	const int height = (int)header.height;
+	const size_t count = (size_t)width * height;
+	const uint8_t* lowPlane = m_planes.data();
+	const uint8_t* highPlane = m_planes.data() + count;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* low = lowPlane + (size_t)y * width;
+		const uint8_t* high = highPlane + (size_t)y * width;
+		uint16_t* row = quantized + (size_t)y * width;
+		const uint16_t* previousRow = y > 0 ? row - width : nullptr;
+
+		// Prefix summing the residuals along the row gives the vertical delta to the previous
+		// row; 'carry' holds the running sum broadcast to every lane.
+		__m128i carry = zero;
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			__m128i coded = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(low + x)), _mm_loadl_epi64((const __m128i*)(high + x)));
+			__m128i residual = _mm_xor_si128(_mm_srli_epi16(coded, 1), _mm_sub_epi16(zero, _mm_and_si128(coded, one)));
+
+			residual = _mm_add_epi16(residual, _mm_slli_si128(residual, 2));
+			residual = _mm_add_epi16(residual, _mm_slli_si128(residual, 4));
+			residual = _mm_add_epi16(residual, _mm_slli_si128(residual, 8));
+			__m128i delta = _mm_add_epi16(residual, carry);
+
+			carry = _mm_shufflehi_epi16(delta, _MM_SHUFFLE(3, 3, 3, 3));
+			carry = _mm_unpackhi_epi64(carry, carry);
+
+			if (previousRow)
+				delta = _mm_add_epi16(delta, _mm_loadu_si128((const __m128i*)(previousRow + x)));
+			_mm_storeu_si128((__m128i*)(row + x), delta);
+		}
+
+		uint16_t delta = (uint16_t)_mm_extract_epi16(carry, 7);
+		for (; x < width; ++x)
+		{
+			delta = (uint16_t)(delta + ZigZagDecode((uint16_t)(low[x] | (high[x] << 8))));
+			row[x] = (uint16_t)(delta + (previousRow ? previousRow[x] : 0));
+		}
+	}
+}
+
+bool HeightmapTileCodec::DecodeQuantized(const uint8_t* data, size_t size, std::vector<uint16_t>& output, HeightmapTileHeader& header)
+{
+	if (!DecodePlanes(data, size, header))
+		return false;
+
+	output.resize((size_t)header.width * header.height);
+	Reconstruct(header, output.data());
+	return true;
+}
+
+bool HeightmapTileCodec::Decode(const uint8_t* data, size_t size, Heightfield& output)
+{
+	HeightmapTileHeader header;
+	if (!DecodeQuantized(data, size, m_quantized, header))
+		return false;
+
+	if (output.GetWidth() != (int)header.width || output.GetHeight() != (int)header.height)
+		output.Resize(header.width, header.height);
+	output.SetCellSize(header.cellSize);
+
+	const size_t count = m_quantized.size();
+	const float step = (header.maxHeight - header.minHeight) / 65535.0f;
+	const uint16_t* quantized = m_quantized.data();
+	float* heights = output.GetData();
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 stepV = _mm_set1_ps(step);
+	const __m128 minV = _mm_set1_ps(header.minHeight);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i q = _mm_loadu_si128((const __m128i*)(quantized + i));
+		__m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(q, zero));
+		__m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(q, zero));
+		_mm_storeu_ps(heights + i, _mm_add_ps(minV, _mm_mul_ps(lo, stepV)));
+		_mm_storeu_ps(heights + i + 4, _mm_add_ps(minV, _mm_mul_ps(hi, stepV)));
+	}
+	for (; i < count; ++i)
+		heights[i] = header.minHeight + quantized[i] * step;
+
+	return true;
+}
+
+bool HeightmapTileCodec::SaveToFile(const std::string& fileName, const Heightfield& source)
+{
+	if (!Encode(source, m_fileData))
+		return false;
+
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	file.write((const char*)m_fileData.data(), m_fileData.size());
+	return file.good();
+}
+
+bool HeightmapTileCodec::LoadFromFile(const std::string& fileName, Heightfield& output)
+{
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	std::streamoff size = file.tellg();
+	if (size <= 0)
+		return false;
+
+	m_fileData.resize((size_t)size);
+	file.seekg(0);
+	if (!file.read((char*)m_fileData.data(), size))
+		return false;
+
+	return Decode(m_fileData.data(), m_fileData.size(), output);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Heightfield.h"
+
+// Compressed heightmap tile file (.hmt)
+//
+// Heights are quantised to 16 bits between the tile's min and max, run through a 2D gradient
+// predictor (left + up - upleft), zigzag coded and split into low/high byte planes before the
+// LZ stage. Decoding is the inverse: LZ, then a SIMD prefix sum along each row followed by a
+// vertical add of the previous row, so the whole reconstruction is branch free. A checksum of
+// the header and planes turns away truncated or damaged tiles before any of them is used.
+
+#pragma pack(push, 1)
+struct HeightmapTileHeader
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	flags;
+	uint32_t	width;
+	uint32_t	height;
+	float		cellSize;
+	float		minHeight;
+	float		maxHeight;
+	uint32_t	planeSize;		// bytes of byte-plane data once decompressed (width * height * 2)
+	uint32_t	payloadSize;	// bytes following the header
+	uint64_t	checksum;		// of the header up to here and the decompressed planes
+};
+#pragma pack(pop)
+
+const uint32_t HEIGHTMAP_TILE_MAGIC = 0x31544D48; // "HMT1"
+const uint16_t HEIGHTMAP_TILE_VERSION = 2;
+
+enum HeightmapTileFlags
+{
+	HeightmapTileLZ = 1 << 0,		// payload is LZ compressed, otherwise stored raw
+};
+
+class HeightmapTileCodec
+{
+public:
+	bool Encode(const Heightfield& source, std::vector<uint8_t>& output);
+	bool Decode(const uint8_t* data, size_t size, Heightfield& output);
+
+	// Decodes to 16-bit quantised samples only, for uploading straight to an R16_UNORM texture
+	bool DecodeQuantized(const uint8_t* data, size_t size, std::vector<uint16_t>& output, HeightmapTileHeader& header);
+
+	bool SaveToFile(const std::string& fileName, const Heightfield& source);
+	bool LoadFromFile(const std::string& fileName, Heightfield& output);
+
+private:
+	bool DecodePlanes(const uint8_t* data, size_t size, HeightmapTileHeader& header);
+	void Reconstruct(const HeightmapTileHeader& header, uint16_t* quantized);
+
+	// Scratch buffers are kept between calls so streaming many tiles does not allocate
+	std::vector<uint8_t>				m_planes;
+	std::vector<uint16_t>				m_quantized;
+	std::vector<uint8_t>				m_fileData;
+};
@@ -0,0 +1,200 @@
+#include "HorizonBaker.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	struct HullPoint
+	{
+		float u;		// distance walked along the line
+		float h;
+	};
+
+	inline uint8_t ToUNorm8(float value)
+	{
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return (uint8_t)(value * 255.0f + 0.5f);
+	}
+}
+
+void HorizonBaker::SweepHorizons(const Heightfield& heightfield, float dirX, float dirZ, float* tanHorizon)
+{
+	const int width = heightfield.GetWidth();
+	const int height = heightfield.GetHeight();
+	const float* data = heightfield.GetData();
+
+	// Step one sample along the major axis per iteration and round the minor axis; every sample
+	// then belongs to the line with offset k = minor - round(slope * major)
+	const bool majorX = std::fabs(dirX) >= std::fabs(dirZ);
+	const float majorDir = majorX ? dirX : dirZ;
+	const float minorDir = majorX ? dirZ : dirX;
+	if (majorDir == 0.0f)
+		return;
+
+	const int majorCount = majorX ? width : height;
+	const int minorCount = majorX ? height : width;
+	const size_t majorStride = majorX ? 1 : (size_t)width;
+	const size_t minorStride = majorX ? (size_t)width : 1;
+	const float slope = minorDir / majorDir;
+	const float stepLength = std::sqrt(1.0f + slope * slope) * heightfield.GetCellSize();
+
+	std::vector<int> offsets(majorCount);
+	int minOffset = 0;
+	int maxOffset = 0;
+	for (int i = 0; i < majorCount; ++i)
+	{
+		offsets[i] = (int)std::floor(slope * i + 0.5f);
+		minOffset = std::min(minOffset, offsets[i]);
+		maxOffset = std::max(maxOffset, offsets[i]);
+	}
+
+	// Walk from the far end of the direction back towards its origin, so the hull holds what lies ahead
+	const bool forward = majorDir < 0.0f;
+	const int firstLine = -maxOffset;
+	const int lineCount = (minorCount - 1 - minOffset) - firstLine + 1;
+
+	JobSystem::Get().ParallelFor(lineCount, 64, [&](int begin, int end)
+	{
+		std::vector<HullPoint> hull;
+		hull.reserve(majorCount);
+
+		for (int line = begin; line < end; ++line)
+		{
+			const int k = firstLine + line;
+			hull.clear();
+
+			for (int step = 0; step < majorCount; ++step)
+			{
+				const int major = forward ? step : majorCount - 1 - step;
+				const int minor = k + offsets[major];
+				if (minor < 0 || minor >= minorCount)
+					continue;
+
+				const size_t index = major * majorStride + minor * minorStride;
+				const HullPoint p = { step * stepLength, data[index] };
+
+				// Drop hull points hidden behind the one before them as seen from p
+				while (hull.size() >= 2)
+				{
+					const HullPoint& top = hull[hull.size() - 1];
+					const HullPoint& below = hull[hull.size() - 2];
+					if ((below.h - p.h) * (p.u - top.u) < (top.h - p.h) * (p.u - below.u))
+						break;
+					hull.pop_back();
+				}
+
+				tanHorizon[index] = hull.empty() ? 0.0f : (hull.back().h - p.h) / (p.u - hull.back().u);
+				hull.push_back(p);
+			}
+		}
+	});
+}
+
+void HorizonBaker::BakeParallaxHorizons(const Image& depth, float depthScale, std::vector<Image>& slices)
+{
+	const int width = depth.GetWidth();
+	const int height = depth.GetHeight();
+	const int count = width * height;
+
+	// Heights in texels, tiled three times each way
+	Heightfield tiled(width * 3, height * 3, 1.0f);
+	const float scale = depthScale * width / 255.0f;
+	for (int y = 0; y < tiled.GetHeight(); ++y)
+	{
+		const uint8_t* row = depth.GetRow(y % height);
+		float* out = tiled.GetRow(y);
+		for (int x = 0; x < tiled.GetWidth(); ++x)
+			out[x] = (255 - row[(x % width) * 4]) * scale;
+	}
+
+	slices.assign((PARALLAX_HORIZON_AZIMUTHS + 3) / 4, Image(width, height));
+	std::vector<float> tanHorizon(tiled.GetWidth() * tiled.GetHeight());
+	for (int a = 0; a < PARALLAX_HORIZON_AZIMUTHS; ++a)
+	{
+		const float angle = 2.0f * PI * a / PARALLAX_HORIZON_AZIMUTHS;
+		SweepHorizons(tiled, std::cos(angle), std::sin(angle), tanHorizon.data());
+
+		Image& slice = slices[a / 4];
+		const int channel = a % 4;
+		JobSystem::Get().ParallelFor(count, 16384, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int x = i % width;
+				const int y = i / width;
+				const float t = std::max(tanHorizon[(size_t)(y + height) * tiled.GetWidth() + x + width], 0.0f);
+				slice.At(x, y)[channel] = ToUNorm8(std::atan(t) * (2.0f / PI));
+			}
+		});
+	}
+}
+
+void HorizonBaker::BakeOcclusion(const Heightfield& heightfield, int directions, uint8_t* out, int pixelStride)
+{
+	const int count = heightfield.GetWidth() * heightfield.GetHeight();
+	std::vector<float> tanHorizon(count);
+	std::vector<float> visibility(count, 0.0f);
+	directions = std::max(directions, 1);
+
+	for (int d = 0; d < directions; ++d)
+	{
+		float angle = 2.0f * PI * (d + 0.5f) / directions;
+		SweepHorizons(heightfield, std::cos(angle), std::sin(angle), tanHorizon.data());
+
+		// Cosine-weighted visibility over a slice is 1 - sin(horizon); ground below horizontal counts as open
+		JobSystem::Get().ParallelFor(count, 16384, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				float t = std::max(tanHorizon[i], 0.0f);
+				visibility[i] += 1.0f - t / std::sqrt(1.0f + t * t);
+			}
+		});
+	}
+
+	const float scale = 1.0f / directions;
+	JobSystem::Get().ParallelFor(count, 16384, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			out[(size_t)i * pixelStride] = ToUNorm8(visibility[i] * scale);
+	});
+}
+
+void HorizonBaker::BakeSunShadow(const Heightfield& heightfield, const HorizonBakeSettings& settings, uint8_t* out, int pixelStride)
+{
+	const int count = heightfield.GetWidth() * heightfield.GetHeight();
+	const float horizontal = std::sqrt(settings.sunDirectionX * settings.sunDirectionX + settings.sunDirectionZ * settings.sunDirectionZ);
+	const float elevation = std::atan2(settings.sunDirectionY, horizontal);
+	const float softness = std::max(settings.sunSoftness, 1e-3f);
+
+	// Straight overhead nothing can shadow a heightfield
+	if (horizontal < 1e-6f)
+	{
+		for (int i = 0; i < count; ++i)
+			out[(size_t)i * pixelStride] = settings.sunDirectionY > 0.0f ? 255 : 0;
+		return;
+	}
+
+	std::vector<float> tanHorizon(count);
+	SweepHorizons(heightfield, settings.sunDirectionX, settings.sunDirectionZ, tanHorizon.data());
+
+	JobSystem::Get().ParallelFor(count, 16384, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			float horizon = std::atan(tanHorizon[i]);
+			out[(size_t)i * pixelStride] = ToUNorm8((elevation - horizon) / softness + 0.5f);
+		}
+	});
+}
+
+void HorizonBaker::Bake(const Heightfield& heightfield, const HorizonBakeSettings& settings, uint8_t* rg)
+{
+	BakeOcclusion(heightfield, settings.directions, rg, 2);
+	BakeSunShadow(heightfield, settings, rg + 1, 2);
+}
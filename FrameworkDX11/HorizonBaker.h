@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Heightfield.h"
+#include "Image.h"
+
+const int PARALLAX_HORIZON_AZIMUTHS = 8;
+
+struct HorizonBakeSettings
+{
+	int			directions = 16;			// azimuths averaged for ambient occlusion
+	float		sunDirectionX = 0.5f;		// direction towards the sun; need not be normalised
+	float		sunDirectionY = 0.7f;
+	float		sunDirectionZ = 0.3f;
+	float		sunSoftness = 0.15f;		// radians of elevation over which the shadow fades
+};
+
+// Horizon-angle baking over a Heightfield.
+//
+// For one azimuth every sample lies on exactly one rasterised line running along it. Walking a
+// line towards the viewer while keeping the upper convex hull of the samples already passed
+// gives each sample's horizon in amortised O(1), so a whole direction costs O(N). Lines are
+// independent and are spread across the job system.
+namespace HorizonBaker
+{
+	// Tangent of the horizon elevation seen from each sample looking along (dirX, dirZ).
+	// Negative values mean the ground falls away; samples looking off the edge get 0.
+	void SweepHorizons(const Heightfield& heightfield, float dirX, float dirZ, float* tanHorizon);
+
+	// Cosine-weighted sky visibility, 255 = fully open. Written to every 'pixelStride'-th byte.
+	void BakeOcclusion(const Heightfield& heightfield, int directions, uint8_t* out, int pixelStride);
+
+	// Soft sun visibility from the horizon along the sun's azimuth, 255 = fully lit
+	void BakeSunShadow(const Heightfield& heightfield, const HorizonBakeSettings& settings, uint8_t* out, int pixelStride);
+
+	// Interleaved RG8: R = occlusion, G = sun visibility
+	void Bake(const Heightfield& heightfield, const HorizonBakeSettings& settings, uint8_t* rg);
+
+	// Horizon elevations of a tiling parallax depth texture (depth in red) for
+	// PARALLAX_HORIZON_AZIMUTHS azimuths, azimuth a at angle 2 pi a / 8 from +u towards +v.
+	// Written four to a slice, as elevation / (pi / 2). depthScale is the depth range in texture
+	// widths; the sweep runs over a 3x3 tiling so horizons see across the texture's edges.
+	void BakeParallaxHorizons(const Image& depth, float depthScale, std::vector<Image>& slices);
+}
@@ -0,0 +1,110 @@
+#include "Image.h"
+
+#include <algorithm>
+#include <cmath>
+
+Image::Image()
+	: m_width(0)
+	, m_height(0)
+{
+}
+
+Image::Image(int width, int height)
+	: m_width(0)
+	, m_height(0)
+{
+	Resize(width, height);
+}
+
+void Image::Resize(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_pixels.assign((size_t)width * height * 4, 0);
+}
+
+void Image::Fill(uint32_t rgba)
+{
+	for (size_t i = 0; i < m_pixels.size(); i += 4)
+	{
+		m_pixels[i + 0] = (uint8_t)(rgba);
+		m_pixels[i + 1] = (uint8_t)(rgba >> 8);
+		m_pixels[i + 2] = (uint8_t)(rgba >> 16);
+		m_pixels[i + 3] = (uint8_t)(rgba >> 24);
+	}
+}
+
+Image Image::Resampled(int width, int height, bool wrap) const
+{
+	Image result(width, height);
+	if (IsEmpty() || width <= 0 || height <= 0)
+		return result;
+
+	const float scaleX = (float)m_width / width;
+	const float scaleY = (float)m_height / height;
+
+	for (int y = 0; y < height; ++y)
+	{
+		float sy = (y + 0.5f) * scaleY - 0.5f;
+		int y0 = (int)std::floor(sy);
+		float fy = sy - y0;
+		int ya = (y0 % m_height + m_height) % m_height;
+		int yb = (ya + 1) % m_height;
+		if (!wrap)
+		{
+			ya = std::min(std::max(y0, 0), m_height - 1);
+			yb = std::min(std::max(y0 + 1, 0), m_height - 1);
+		}
+
+		uint8_t* out = result.GetRow(y);
+		for (int x = 0; x < width; ++x)
+		{
+			float sx = (x + 0.5f) * scaleX - 0.5f;
+			int x0 = (int)std::floor(sx);
+			float fx = sx - x0;
+			int xa = (x0 % m_width + m_width) % m_width;
+			int xb = (xa + 1) % m_width;
+			if (!wrap)
+			{
+				xa = std::min(std::max(x0, 0), m_width - 1);
+				xb = std::min(std::max(x0 + 1, 0), m_width - 1);
+			}
+
+			const uint8_t* p00 = At(xa, ya);
+			const uint8_t* p10 = At(xb, ya);
+			const uint8_t* p01 = At(xa, yb);
+			const uint8_t* p11 = At(xb, yb);
+			for (int c = 0; c < 4; ++c)
+			{
+				float top = p00[c] + (p10[c] - p00[c]) * fx;
+				float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+				out[x * 4 + c] = (uint8_t)(top + (bottom - top) * fy + 0.5f);
+			}
+		}
+	}
+	return result;
+}
+
+Image Image::HalfSize() const
+{
+	const int width = std::max(m_width / 2, 1);
+	const int height = std::max(m_height / 2, 1);
+	Image result(width, height);
+	if (IsEmpty())
+		return result;
+
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* row0 = GetRow(std::min(y * 2, m_height - 1));
+		const uint8_t* row1 = GetRow(std::min(y * 2 + 1, m_height - 1));
+		uint8_t* out = result.GetRow(y);
+		for (int x = 0; x < width; ++x)
+		{
+			int xa = std::min(x * 2, m_width - 1) * 4;
+			int xb = std::min(x * 2 + 1, m_width - 1) * 4;
+			for (int c = 0; c < 4; ++c)
+				out[x * 4 + c] = (uint8_t)((row0[xa + c] + row0[xb + c] + row1[xa + c] + row1[xb + c] + 2) >> 2);
+		}
+	}
+	return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// An 8-bit RGBA image in CPU memory, rows top to bottom with no padding.
+// Used by the offline texture tools; nothing here touches D3D.
+class Image
+{
+public:
+	Image();
+	Image(int width, int height);
+
+	void Resize(int width, int height);
+	void Fill(uint32_t rgba);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	bool IsEmpty() const { return m_width == 0 || m_height == 0; }
+	size_t GetPitch() const { return (size_t)m_width * 4; }
+
+	uint8_t* GetData() { return m_pixels.data(); }
+	const uint8_t* GetData() const { return m_pixels.data(); }
+	uint8_t* GetRow(int y) { return m_pixels.data() + (size_t)y * m_width * 4; }
+	const uint8_t* GetRow(int y) const { return m_pixels.data() + (size_t)y * m_width * 4; }
+	uint8_t* At(int x, int y) { return m_pixels.data() + ((size_t)y * m_width + x) * 4; }
+	const uint8_t* At(int x, int y) const { return m_pixels.data() + ((size_t)y * m_width + x) * 4; }
+
+	// Bilinear resample with wrapping, suited to tiling material textures, or with the edge
+	// texels repeated for those that do not tile
+	Image Resampled(int width, int height, bool wrap = true) const;
+
+	// 2x2 box filter; odd edges repeat the last row or column
+	Image HalfSize() const;
+
+private:
+	int									m_width;
+	int									m_height;
+	std::vector<uint8_t>				m_pixels;
+};
@@ -0,0 +1,310 @@
+#include "ImageIO.h"
+#include "AssetFile.h"
+#include "DDSFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+using namespace DDSFile;
+
+namespace
+{
+	// DXGI_FORMAT values we understand in DX10 headers
+	const uint32_t FORMAT_R8G8B8A8_UNORM = 28;
+	const uint32_t FORMAT_R8G8B8A8_UNORM_SRGB = 29;
+	const uint32_t FORMAT_BC1_UNORM = 71;
+	const uint32_t FORMAT_BC1_UNORM_SRGB = 72;
+	const uint32_t FORMAT_BC2_UNORM = 74;
+	const uint32_t FORMAT_BC2_UNORM_SRGB = 75;
+	const uint32_t FORMAT_BC3_UNORM = 77;
+	const uint32_t FORMAT_BC3_UNORM_SRGB = 78;
+	const uint32_t FORMAT_B8G8R8A8_UNORM = 87;
+	const uint32_t FORMAT_B8G8R8A8_UNORM_SRGB = 91;
+
+	enum class Source
+	{
+		Unknown,
+		Masked,
+		BC1,
+		BC2,
+		BC3,
+	};
+
+	// Extracts the channel selected by 'mask' and widens it to 8 bits
+	inline uint8_t ExtractChannel(uint32_t pixel, uint32_t mask)
+	{
+		if (mask == 0)
+			return 0;
+
+		int shift = 0;
+		while (((mask >> shift) & 1) == 0)
+			++shift;
+		uint32_t maximum = mask >> shift;
+		uint32_t value = (pixel & mask) >> shift;
+		return (uint8_t)((value * 255 + maximum / 2) / maximum);
+	}
+
+	void DecodeColorBlock(const uint8_t* block, uint8_t* rgba, bool allowTransparent)
+	{
+		uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+		uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+
+		uint8_t palette[4][4];
+		auto expand = [](uint16_t c, uint8_t* out)
+		{
+			out[0] = (uint8_t)(((c >> 11) & 31) * 255 / 31);
+			out[1] = (uint8_t)(((c >> 5) & 63) * 255 / 63);
+			out[2] = (uint8_t)((c & 31) * 255 / 31);
+			out[3] = 255;
+		};
+		expand(c0, palette[0]);
+		expand(c1, palette[1]);
+
+		if (c0 > c1 || !allowTransparent)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+				palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+			}
+			palette[2][3] = 255;
+			palette[3][3] = 255;
+		}
+		else
+		{
+			for (int c = 0; c < 3; ++c)
+				palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+			palette[2][3] = 255;
+			palette[3][0] = palette[3][1] = palette[3][2] = palette[3][3] = 0;
+		}
+
+		uint32_t indices = (uint32_t)block[4] | ((uint32_t)block[5] << 8) | ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+		for (int i = 0; i < 16; ++i)
+			memcpy(rgba + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+	}
+
+	void DecodeAlphaBlock(const uint8_t* block, uint8_t* rgba)
+	{
+		uint8_t palette[8];
+		palette[0] = block[0];
+		palette[1] = block[1];
+		if (palette[0] > palette[1])
+		{
+			for (int i = 1; i < 7; ++i)
+				palette[i + 1] = (uint8_t)(((7 - i) * palette[0] + i * palette[1] + 3) / 7);
+		}
+		else
+		{
+			for (int i = 1; i < 5; ++i)
+				palette[i + 1] = (uint8_t)(((5 - i) * palette[0] + i * palette[1] + 2) / 5);
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; ++i)
+			indices |= (uint64_t)block[2 + i] << (8 * i);
+		for (int i = 0; i < 16; ++i)
+			rgba[i * 4 + 3] = palette[(indices >> (i * 3)) & 7];
+	}
+
+	bool DecodeBlocks(const uint8_t* data, size_t size, Source source, Image& image)
+	{
+		const int width = image.GetWidth();
+		const int height = image.GetHeight();
+		const int blocksX = (width + 3) / 4;
+		const int blocksY = (height + 3) / 4;
+		const size_t blockSize = source == Source::BC1 ? 8 : 16;
+		if (size < (size_t)blocksX * blocksY * blockSize)
+			return false;
+
+		uint8_t texels[16 * 4];
+		for (int by = 0; by < blocksY; ++by)
+		{
+			for (int bx = 0; bx < blocksX; ++bx)
+			{
+				const uint8_t* block = data + ((size_t)by * blocksX + bx) * blockSize;
+				switch (source)
+				{
+				case Source::BC1:
+					DecodeColorBlock(block, texels, true);
+					break;
+				case Source::BC2:
+					DecodeColorBlock(block + 8, texels, false);
+					for (int i = 0; i < 16; ++i)
+					{
+						uint8_t nibble = (block[i / 2] >> ((i & 1) * 4)) & 15;
+						texels[i * 4 + 3] = (uint8_t)(nibble * 17);
+					}
+					break;
+				default:
+					DecodeColorBlock(block + 8, texels, false);
+					DecodeAlphaBlock(block, texels);
+					break;
+				}
+
+				for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+					for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+						memcpy(image.At(bx * 4 + x, by * 4 + y), texels + (y * 4 + x) * 4, 4);
+			}
+		}
+		return true;
+	}
+}
+
+bool ImageIO::DecodeDDS(const uint8_t* data, size_t size, Image& image)
+{
+	Layout layout;
+	if (!Parse(data, size, layout))
+		return false;
+
+	const Header& header = *layout.header;
+	Source source = Source::Unknown;
+	PixelFormat format = header.format;
+
+	if (layout.dx10)
+	{
+		switch (layout.dx10->dxgiFormat)
+		{
+		case FORMAT_R8G8B8A8_UNORM:
+		case FORMAT_R8G8B8A8_UNORM_SRGB:
+			source = Source::Masked;
+			format.rgbBitCount = 32;
+			format.rBitMask = 0x000000ff;
+			format.gBitMask = 0x0000ff00;
+			format.bBitMask = 0x00ff0000;
+			format.aBitMask = 0xff000000;
+			break;
+		case FORMAT_B8G8R8A8_UNORM:
+		case FORMAT_B8G8R8A8_UNORM_SRGB:
+			source = Source::Masked;
+			format.rgbBitCount = 32;
+			format.rBitMask = 0x00ff0000;
+			format.gBitMask = 0x0000ff00;
+			format.bBitMask = 0x000000ff;
+			format.aBitMask = 0xff000000;
+			break;
+		case FORMAT_BC1_UNORM:
+		case FORMAT_BC1_UNORM_SRGB:
+			source = Source::BC1;
+			break;
+		case FORMAT_BC2_UNORM:
+		case FORMAT_BC2_UNORM_SRGB:
+			source = Source::BC2;
+			break;
+		case FORMAT_BC3_UNORM:
+		case FORMAT_BC3_UNORM_SRGB:
+			source = Source::BC3;
+			break;
+		}
+	}
+	else if (format.flags & DDPF_FOURCC)
+	{
+		if (format.fourCC == MakeFourCC('D', 'X', 'T', '1'))
+			source = Source::BC1;
+		else if (format.fourCC == MakeFourCC('D', 'X', 'T', '2') || format.fourCC == MakeFourCC('D', 'X', 'T', '3'))
+			source = Source::BC2;
+		else if (format.fourCC == MakeFourCC('D', 'X', 'T', '4') || format.fourCC == MakeFourCC('D', 'X', 'T', '5'))
+			source = Source::BC3;
+	}
+	else if (format.flags & (DDPF_RGB | DDPF_LUMINANCE))
+	{
+		if (format.rgbBitCount == 8 || format.rgbBitCount == 16 || format.rgbBitCount == 24 || format.rgbBitCount == 32)
+			source = Source::Masked;
+	}
+
+	if (source == Source::Unknown || header.width == 0 || header.height == 0)
+		return false;
+
+	image.Resize((int)header.width, (int)header.height);
+	if (source != Source::Masked)
+		return DecodeBlocks(layout.bits, layout.bitSize, source, image);
+
+	const int bytesPerPixel = format.rgbBitCount / 8;
+	const size_t pitch = ((size_t)header.width * format.rgbBitCount + 7) / 8;
+	if (layout.bitSize < pitch * header.height)
+		return false;
+
+	const bool luminance = (format.flags & DDPF_LUMINANCE) != 0;
+	const bool hasAlpha = (format.flags & DDPF_ALPHAPIXELS) != 0 && format.aBitMask != 0;
+	for (uint32_t y = 0; y < header.height; ++y)
+	{
+		const uint8_t* row = layout.bits + pitch * y;
+		uint8_t* out = image.GetRow((int)y);
+		for (uint32_t x = 0; x < header.width; ++x)
+		{
+			uint32_t pixel = 0;
+			memcpy(&pixel, row + x * bytesPerPixel, bytesPerPixel);
+
+			if (luminance)
+			{
+				uint8_t l = ExtractChannel(pixel, format.rBitMask);
+				out[x * 4 + 0] = l;
+				out[x * 4 + 1] = l;
+				out[x * 4 + 2] = l;
+			}
+			else
+			{
+				out[x * 4 + 0] = ExtractChannel(pixel, format.rBitMask);
+				out[x * 4 + 1] = ExtractChannel(pixel, format.gBitMask);
+				out[x * 4 + 2] = ExtractChannel(pixel, format.bBitMask);
+			}
+			out[x * 4 + 3] = hasAlpha ? ExtractChannel(pixel, format.aBitMask) : 255;
+		}
+	}
+	return true;
+}
+
+bool ImageIO::LoadDDS(const std::string& fileName, Image& image)
+{
+	// Decoded straight out of the mapping, of the file or its package; never copied first
+	AssetFile file;
+	if (!file.Open(fileName))
+		return false;
+
+	return DecodeDDS(file.GetData(), file.GetSize(), image);
+}
+
+bool ImageIO::SaveDDS(const std::string& fileName, const Image& image)
+{
+	return SaveDDS(fileName, &image, 1);
+}
+
+bool ImageIO::SaveDDS(const std::string& fileName, const Image* mips, int mipCount)
+{
+	if (mipCount < 1 || mips[0].IsEmpty())
+		return false;
+
+	Header header = {};
+	header.size = sizeof(Header);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PITCH | DDSD_PIXELFORMAT;
+	header.width = (uint32_t)mips[0].GetWidth();
+	header.height = (uint32_t)mips[0].GetHeight();
+	header.pitchOrLinearSize = (uint32_t)mips[0].GetPitch();
+	header.caps = DDSCAPS_TEXTURE;
+	if (mipCount > 1)
+	{
+		header.flags |= DDSD_MIPMAPCOUNT;
+		header.mipMapCount = (uint32_t)mipCount;
+		header.caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+
+	header.format.size = sizeof(PixelFormat);
+	header.format.flags = DDPF_RGB | DDPF_ALPHAPIXELS;
+	header.format.rgbBitCount = 32;
+	header.format.rBitMask = 0x000000ff;
+	header.format.gBitMask = 0x0000ff00;
+	header.format.bBitMask = 0x00ff0000;
+	header.format.aBitMask = 0xff000000;
+
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	file.write((const char*)&MAGIC, 4);
+	file.write((const char*)&header, sizeof(header));
+	for (int mip = 0; mip < mipCount; ++mip)
+		file.write((const char*)mips[mip].GetData(), mips[mip].GetPitch() * mips[mip].GetHeight());
+	return (bool)file;
+}
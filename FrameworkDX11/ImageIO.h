@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+#include "Image.h"
+
+// Reading and writing DDS files as CPU images.
+//
+// LoadDDS decodes the top mip of 8-bit luminance, 24/32-bit RGB(A) mask formats and BC1-BC3
+// (legacy FourCC or DX10 header) to RGBA8. SaveDDS writes an uncompressed RGBA8 file with a
+// full mip chain when 'mips' holds one, so the result loads straight through DDSTextureLoader.
+namespace ImageIO
+{
+	bool LoadDDS(const std::string& fileName, Image& image);
+	bool DecodeDDS(const uint8_t* data, size_t size, Image& image);
+
+	bool SaveDDS(const std::string& fileName, const Image& image);
+	bool SaveDDS(const std::string& fileName, const Image* mips, int mipCount);
+}
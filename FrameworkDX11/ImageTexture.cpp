@@ -0,0 +1,196 @@
+#include "ImageTexture.h"
+#include "ImageIO.h"
+#include "MipGenerator.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	// Bits per texel, or per block texel for the compressed formats
+	size_t BitsPerTexel(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		case DXGI_FORMAT_R32G32B32A32_UINT:
+			return 128;
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		case DXGI_FORMAT_R16G16B16A16_UNORM:
+		case DXGI_FORMAT_R32G32_FLOAT:
+			return 64;
+		case DXGI_FORMAT_R16G16_FLOAT:
+		case DXGI_FORMAT_R16G16_UNORM:
+		case DXGI_FORMAT_R32_FLOAT:
+			return 32;
+		case DXGI_FORMAT_R8G8_UNORM:
+		case DXGI_FORMAT_R16_FLOAT:
+		case DXGI_FORMAT_R16_UNORM:
+		case DXGI_FORMAT_B5G6R5_UNORM:
+			return 16;
+		case DXGI_FORMAT_R8_UNORM:
+		case DXGI_FORMAT_A8_UNORM:
+		case DXGI_FORMAT_BC2_UNORM:
+		case DXGI_FORMAT_BC2_UNORM_SRGB:
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC5_UNORM:
+		case DXGI_FORMAT_BC5_SNORM:
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return 8;
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_UNORM:
+		case DXGI_FORMAT_BC4_SNORM:
+			return 4;
+		default:
+			return 32;
+		}
+	}
+
+	bool IsBlockCompressed(DXGI_FORMAT format)
+	{
+		return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) || (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+	}
+}
+
+HRESULT CreateTextureFromImage(ID3D11Device* pd3dDevice, const Image& image, bool generateMips, ID3D11ShaderResourceView** ppView)
+{
+	if (image.IsEmpty())
+		return E_INVALIDARG;
+
+	if (!generateMips)
+		return CreateTextureFromMips(pd3dDevice, &image, 1, ppView);
+
+	vector<Image> mips;
+	mips.push_back(image);
+	while (mips.back().GetWidth() > 1 || mips.back().GetHeight() > 1)
+		mips.push_back(mips.back().HalfSize());
+	return CreateTextureFromMips(pd3dDevice, mips.data(), (int)mips.size(), ppView);
+}
+
+HRESULT CreateTextureFromMips(ID3D11Device* pd3dDevice, const Image* mips, int mipCount, ID3D11ShaderResourceView** ppView)
+{
+	if (mipCount < 1 || mips[0].IsEmpty())
+		return E_INVALIDARG;
+
+	vector<D3D11_SUBRESOURCE_DATA> data(mipCount);
+	for (int i = 0; i < mipCount; ++i)
+	{
+		data[i].pSysMem = mips[i].GetData();
+		data[i].SysMemPitch = (UINT)mips[i].GetPitch();
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = mips[0].GetWidth();
+	desc.Height = mips[0].GetHeight();
+	desc.MipLevels = (UINT)data.size();
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT hr = pd3dDevice->CreateTexture2D(&desc, data.data(), &texture);
+	if (FAILED(hr))
+		return hr;
+
+	hr = pd3dDevice->CreateShaderResourceView(texture, nullptr, ppView);
+	texture->Release();
+	return hr;
+}
+
+HRESULT CreateTextureFromBlocks(ID3D11Device* pd3dDevice, const CompressedImage* mips, int mipCount, ID3D11ShaderResourceView** ppView)
+{
+	if (mipCount < 1 || mips[0].blocks.empty() || mips[0].width % 4 != 0 || mips[0].height % 4 != 0)
+		return E_INVALIDARG;
+
+	vector<D3D11_SUBRESOURCE_DATA> data(mipCount);
+	for (int i = 0; i < mipCount; ++i)
+	{
+		data[i].pSysMem = mips[i].blocks.data();
+		data[i].SysMemPitch = (UINT)(((mips[i].width + 3) / 4) * BlockCompressor::BlockBytes(mips[i].format));
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = mips[0].width;
+	desc.Height = mips[0].height;
+	desc.MipLevels = (UINT)data.size();
+	desc.ArraySize = 1;
+	desc.Format = (DXGI_FORMAT)BlockCompressor::DXGIFormat(mips[0].format);
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT hr = pd3dDevice->CreateTexture2D(&desc, data.data(), &texture);
+	if (FAILED(hr))
+		return hr;
+
+	hr = pd3dDevice->CreateShaderResourceView(texture, nullptr, ppView);
+	texture->Release();
+	return hr;
+}
+
+HRESULT CreateTextureArrayFromImages(ID3D11Device* pd3dDevice, const Image* images, int arraySize, int mipCount, ID3D11ShaderResourceView** ppView)
+{
+	if (arraySize < 1 || mipCount < 1 || images[0].IsEmpty())
+		return E_INVALIDARG;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = images[0].GetWidth();
+	desc.Height = images[0].GetHeight();
+	desc.MipLevels = mipCount;
+	desc.ArraySize = arraySize;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	vector<D3D11_SUBRESOURCE_DATA> data((size_t)arraySize * mipCount);
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		data[i].pSysMem = images[i].GetData();
+		data[i].SysMemPitch = (UINT)images[i].GetPitch();
+	}
+
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT hr = pd3dDevice->CreateTexture2D(&desc, data.data(), &texture);
+	if (FAILED(hr))
+		return hr;
+
+	hr = pd3dDevice->CreateShaderResourceView(texture, nullptr, ppView);
+	texture->Release();
+	return hr;
+}
+
+HRESULT CreateNormalMapFromHeight(ID3D11Device* pd3dDevice, const std::string& heightFile, const NormalMapSettings& settings, ID3D11ShaderResourceView** ppView)
+{
+	Image height;
+	if (!ImageIO::LoadDDS(heightFile, height))
+		return E_FAIL;
+
+	Image normals;
+	NormalMapGenerator::GenerateNormalMap(height, settings, normals);
+
+	MipSettings mipSettings = MipSettings::NormalMap();
+	mipSettings.wrap = settings.wrap;
+	std::vector<Image> mips;
+	MipGenerator::Generate(normals, mipSettings, mips);
+	return CreateTextureFromMips(pd3dDevice, mips.data(), (int)mips.size(), ppView);
+}
+
+size_t TextureLevelBytes(DXGI_FORMAT format, UINT width, UINT height)
+{
+	size_t w = width;
+	size_t h = height;
+	if (IsBlockCompressed(format))
+	{
+		w = (w + 3) & ~(size_t)3;
+		h = (h + 3) & ~(size_t)3;
+	}
+	return w * h * BitsPerTexel(format) / 8;
+}
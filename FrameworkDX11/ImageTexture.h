@@ -0,0 +1,26 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <string>
+
+#include "BlockCompressor.h"
+#include "Image.h"
+#include "NormalMapGenerator.h"
+
+// Uploads a CPU image as an immutable RGBA8 texture, optionally with a box-filtered mip chain
+HRESULT CreateTextureFromImage(ID3D11Device* pd3dDevice, const Image& image, bool generateMips, ID3D11ShaderResourceView** ppView);
+
+// Uploads a prepared mip chain, each level half the size of the one before
+HRESULT CreateTextureFromMips(ID3D11Device* pd3dDevice, const Image* mips, int mipCount, ID3D11ShaderResourceView** ppView);
+
+// Uploads a block-compressed mip chain; the top level must be a multiple of four texels
+HRESULT CreateTextureFromBlocks(ID3D11Device* pd3dDevice, const CompressedImage* mips, int mipCount, ID3D11ShaderResourceView** ppView);
+
+// Uploads an RGBA8 texture array; images holds each slice's mipCount levels in turn
+HRESULT CreateTextureArrayFromImages(ID3D11Device* pd3dDevice, const Image* images, int arraySize, int mipCount, ID3D11ShaderResourceView** ppView);
+
+// Load-time normal map generation for texture sets that only ship a height map
+HRESULT CreateNormalMapFromHeight(ID3D11Device* pd3dDevice, const std::string& heightFile, const NormalMapSettings& settings, ID3D11ShaderResourceView** ppView);
+
+// Approximate video memory of one mip level; block formats round up to whole blocks
+size_t TextureLevelBytes(DXGI_FORMAT format, UINT width, UINT height);
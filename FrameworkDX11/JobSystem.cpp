@@ -0,0 +1,131 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <memory>
+
+JobSystem::JobSystem(unsigned workerCount)
+{
+	if (workerCount == 0)
+	{
+		// Leave one hardware thread for the render thread
+		unsigned hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	for (unsigned i = 0; i < workerCount; ++i)
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
+
+void JobSystem::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(std::move(job));
+	}
+	m_wake.notify_one();
+}
+
+void JobSystem::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return m_queue.empty() && m_busy == 0; });
+}
+
+void JobSystem::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+			if (m_quit && m_queue.empty())
+				return;
+
+			job = std::move(m_queue.front());
+			m_queue.pop_front();
+			m_busy++;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_busy--;
+			if (m_busy == 0 && m_queue.empty())
+				m_idle.notify_all();
+		}
+	}
+}
+
+void JobSystem::ParallelFor(int count, int batchSize, const std::function<void(int, int)>& fn)
+{
+	if (count <= 0)
+		return;
+
+	batchSize = std::max(batchSize, 1);
+	const int batchCount = (count + batchSize - 1) / batchSize;
+	if (batchCount == 1)
+	{
+		fn(0, count);
+		return;
+	}
+
+	// Helpers may start after the caller has already drained every batch, so the shared
+	// state must outlive this call
+	struct SharedState
+	{
+		std::atomic<int> nextBatch{ 0 };
+		std::atomic<int> finishedBatches{ 0 };
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	std::shared_ptr<SharedState> state = std::make_shared<SharedState>();
+	const std::function<void(int, int)>* body = &fn;
+
+	auto runBatches = [state, body, count, batchSize, batchCount]()
+	{
+		for (;;)
+		{
+			int batch = state->nextBatch.fetch_add(1);
+			if (batch >= batchCount)
+				return;
+
+			int begin = batch * batchSize;
+			(*body)(begin, std::min(begin + batchSize, count));
+
+			if (state->finishedBatches.fetch_add(1) + 1 == batchCount)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->done.notify_all();
+			}
+		}
+	};
+
+	int helpers = std::min((int)m_workers.size(), batchCount - 1);
+	for (int i = 0; i < helpers; ++i)
+		Submit(runBatches);
+
+	runBatches();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->done.wait(lock, [&state, batchCount] { return state->finishedBatches.load() == batchCount; });
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads shared by the CPU-side terrain and texture tools.
+//
+// ParallelFor hands out batches of indices through an atomic counter; the calling thread
+// takes batches too, so nesting a ParallelFor inside a job cannot deadlock the pool.
+class JobSystem
+{
+public:
+	explicit JobSystem(unsigned workerCount = 0);
+	~JobSystem();
+
+	static JobSystem& Get();
+
+	unsigned GetWorkerCount() const { return (unsigned)m_workers.size(); }
+
+	// Fire and forget; use WaitIdle or your own completion flag to synchronise
+	void Submit(std::function<void()> job);
+	void WaitIdle();
+
+	// Calls fn(begin, end) for consecutive ranges covering [0, count) and returns once all have run
+	void ParallelFor(int count, int batchSize, const std::function<void(int, int)>& fn);
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread>			m_workers;
+	std::deque<std::function<void()>>	m_queue;
+	std::mutex							m_mutex;
+	std::condition_variable				m_wake;
+	std::condition_variable				m_idle;
+	int									m_busy = 0;
+	bool								m_quit = false;
+};
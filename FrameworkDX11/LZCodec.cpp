@@ -0,0 +1,201 @@
+#include "LZCodec.h"
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const size_t MIN_MATCH = 4;
+	const size_t MAX_OFFSET = 65535;
+	const int HASH_BITS = 14;
+
+	inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t Hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	// Writes the 255-run continuation bytes for a length that did not fit in its nibble.
+	inline bool WriteLength(uint8_t*& op, const uint8_t* opEnd, size_t length)
+	{
+		while (length >= 255)
+		{
+			if (op >= opEnd)
+				return false;
+			*op++ = 255;
+			length -= 255;
+		}
+		if (op >= opEnd)
+			return false;
+		*op++ = (uint8_t)length;
+		return true;
+	}
+
+	inline bool ReadLength(const uint8_t*& ip, const uint8_t* ipEnd, size_t& length)
+	{
+		uint8_t extra;
+		do
+		{
+			if (ip >= ipEnd)
+				return false;
+			extra = *ip++;
+			length += extra;
+		} while (extra == 255);
+		return true;
+	}
+
+	bool EmitSequence(uint8_t*& op, const uint8_t* opEnd, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength)
+	{
+		if (op >= opEnd)
+			return false;
+
+		uint8_t* token = op++;
+		*token = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+		if (literalLength >= 15 && !WriteLength(op, opEnd, literalLength - 15))
+			return false;
+
+		if ((size_t)(opEnd - op) < literalLength)
+			return false;
+		memcpy(op, literals, literalLength);
+		op += literalLength;
+
+		// The last sequence of a block carries literals only
+		if (matchLength == 0)
+			return true;
+
+		if (opEnd - op < 2)
+			return false;
+		*op++ = (uint8_t)(offset & 0xFF);
+		*op++ = (uint8_t)(offset >> 8);
+
+		size_t code = matchLength - MIN_MATCH;
+		*token |= (uint8_t)(code >= 15 ? 15 : code);
+		if (code >= 15 && !WriteLength(op, opEnd, code - 15))
+			return false;
+
+		return true;
+	}
+}
+
+size_t LZCodec::CompressBound(size_t srcSize)
+{
+	return srcSize + srcSize / 255 + 16;
+}
+
+size_t LZCodec::Compress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity)
+{
+	std::vector<int32_t> table((size_t)1 << HASH_BITS, -1);
+
+	uint8_t* op = dst;
+	const uint8_t* opEnd = dst + dstCapacity;
+	size_t ip = 0;
+	size_t anchor = 0;
+
+	while (ip + MIN_MATCH <= srcSize)
+	{
+		uint32_t sequence = Read32(src + ip);
+		uint32_t h = Hash(sequence);
+		int32_t candidate = table[h];
+		table[h] = (int32_t)ip;
+
+		if (candidate < 0 || ip - candidate > MAX_OFFSET || Read32(src + candidate) != sequence)
+		{
+			ip++;
+			continue;
+		}
+
+		size_t matchLength = MIN_MATCH;
+		while (ip + matchLength < srcSize && src[candidate + matchLength] == src[ip + matchLength])
+			matchLength++;
+
+		if (!EmitSequence(op, opEnd, src + anchor, ip - anchor, ip - candidate, matchLength))
+			return 0;
+
+		// Seed the table inside long runs so the next match can chain off them
+		if (matchLength > MIN_MATCH && ip + matchLength - 2 + MIN_MATCH <= srcSize)
+			table[Hash(Read32(src + ip + matchLength - 2))] = (int32_t)(ip + matchLength - 2);
+
+		ip += matchLength;
+		anchor = ip;
+	}
+
+	if (!EmitSequence(op, opEnd, src + anchor, srcSize - anchor, 0, 0))
+		return 0;
+
+	return op - dst;
+}
+
+bool LZCodec::Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+	const uint8_t* ip = src;
+	const uint8_t* ipEnd = src + srcSize;
+	uint8_t* op = dst;
+	uint8_t* opEnd = dst + dstSize;
+
+	while (ip < ipEnd)
+	{
+		uint8_t token = *ip++;
+
+		size_t literalLength = token >> 4;
+		if (literalLength == 15 && !ReadLength(ip, ipEnd, literalLength))
+			return false;
+		if ((size_t)(ipEnd - ip) < literalLength || (size_t)(opEnd - op) < literalLength)
+			return false;
+		if (literalLength <= 16 && ipEnd - ip >= 16 && opEnd - op >= 16)
+			memcpy(op, ip, 16);	// fixed size copy of short runs; the over-read/write is rewritten later
+		else
+			memcpy(op, ip, literalLength);
+		ip += literalLength;
+		op += literalLength;
+
+		if (ip == ipEnd)
+			break;
+
+		if (ipEnd - ip < 2)
+			return false;
+		size_t offset = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst))
+			return false;
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength))
+			return false;
+		matchLength += MIN_MATCH;
+		if ((size_t)(opEnd - op) < matchLength)
+			return false;
+
+		const uint8_t* match = op - offset;
+		if (offset >= 8 && (size_t)(opEnd - op) >= matchLength + 8)
+		{
+			// 8 byte steps may overshoot by up to 7 bytes, which the next sequence overwrites
+			uint8_t* copyEnd = op + matchLength;
+			do
+			{
+				memcpy(op, match, 8);
+				op += 8;
+				match += 8;
+			} while (op < copyEnd);
+			op = copyEnd;
+		}
+		else if (offset >= matchLength)
+		{
+			memcpy(op, match, matchLength);
+			op += matchLength;
+		}
+		else
+		{
+			// Overlapping copy repeats the last 'offset' bytes
+			for (size_t i = 0; i < matchLength; ++i)
+				*op++ = match[i];
+		}
+	}
+
+	return op == opEnd;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Small byte-oriented LZ77 codec in the spirit of LZ4. It trades ratio for decode speed:
+// each sequence is a token byte, a run of literals and a (offset, length) back reference.
+namespace LZCodec
+{
+	// Worst case size of Compress output for srcSize input bytes.
+	size_t CompressBound(size_t srcSize);
+
+	// Returns the number of bytes written to dst, or 0 if dstCapacity is too small.
+	size_t Compress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstCapacity);
+
+	// dstSize must be the exact decompressed size. Returns false on malformed input.
+	bool Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only view of a whole file through the OS page cache (a file mapping on Windows, mmap
+// elsewhere). Nothing is copied: pages are faulted in as the data is touched and the view stays
+// valid until Close or destruction.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::string& fileName);
+#ifdef _WIN32
+	bool Open(const wchar_t* fileName);
+#endif
+	void Close();
+
+	bool IsOpen() const { return m_data != nullptr; }
+	const uint8_t* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	const uint8_t*		m_data;
+	size_t				m_size;
+#ifdef _WIN32
+	void*				m_file;
+	void*				m_mapping;
+#endif
+};
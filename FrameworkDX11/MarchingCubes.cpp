@@ -0,0 +1,228 @@
+#include "MarchingCubes.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const int MAX_CASE_TRIANGLES = 12;
+	const int EDGE_SAMPLES = VOXEL_CHUNK_SIZE + 1;
+
+	// Corner i of a cell is offset by (i & 1, (i >> 1) & 1, (i >> 2) & 1); an edge runs from its
+	// lower corner along one axis.
+	struct CubeEdge
+	{
+		int		corner0;
+		int		corner1;
+		int		axis;
+	};
+
+	struct CaseTable
+	{
+		CubeEdge	edges[12];
+		uint8_t		triangleCount[256];
+		uint8_t		triangles[256][MAX_CASE_TRIANGLES * 3];
+
+		CaseTable() { Build(); }
+
+		// Rather than carrying the classic 256-entry table around, derive it from the cube's faces.
+		// On each face the contour segments join the edge crossings so that solid corners are cut
+		// off separately; the rule only looks at the face itself, so two cells sharing a face always
+		// agree and the surface is watertight. The segments chain into closed loops around the cell
+		// which are fanned into triangles, wound to face out of the solid.
+		void Build()
+		{
+			int edgeIndex[8][8];
+			int count = 0;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				for (int corner = 0; corner < 8; ++corner)
+				{
+					if (corner & (1 << axis))
+						continue;
+					edges[count] = { corner, corner | (1 << axis), axis };
+					edgeIndex[corner][corner | (1 << axis)] = count;
+					edgeIndex[corner | (1 << axis)][corner] = count;
+					++count;
+				}
+			}
+
+			// Faces as corner loops, counter-clockwise seen from outside the cell
+			int faces[6][4];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const int u = 1 << ((axis + 1) % 3);
+				const int v = 1 << ((axis + 2) % 3);
+				for (int side = 0; side < 2; ++side)
+				{
+					const int base = side << axis;
+					int* face = faces[axis * 2 + side];
+					face[0] = base;
+					face[1] = base | u;
+					face[2] = base | u | v;
+					face[3] = base | v;
+					if (side == 0)
+						std::swap(face[1], face[3]);
+				}
+			}
+
+			for (int cubeCase = 0; cubeCase < 256; ++cubeCase)
+			{
+				auto solid = [cubeCase](int corner) { return ((cubeCase >> corner) & 1) != 0; };
+
+				// next[e]: where the contour continues after leaving the cell's surface through edge e
+				int next[12];
+				std::fill(next, next + 12, -1);
+				for (const int* face : faces)
+				{
+					for (int k = 0; k < 4; ++k)
+					{
+						if (!solid(face[k]) || solid(face[(k + 1) % 4]))
+							continue;
+
+						// Exit at edge k: pair it with the entry just before the run of solid corners
+						int j = (k + 3) % 4;
+						while (solid(face[j]) || !solid(face[(j + 1) % 4]))
+							j = (j + 3) % 4;
+						next[edgeIndex[face[k]][face[(k + 1) % 4]]] = edgeIndex[face[j]][face[(j + 1) % 4]];
+					}
+				}
+
+				int triangleTotal = 0;
+				bool visited[12] = {};
+				for (int start = 0; start < 12; ++start)
+				{
+					if (next[start] < 0 || visited[start])
+						continue;
+
+					int loop[12];
+					int loopSize = 0;
+					for (int e = start; !visited[e]; e = next[e])
+					{
+						visited[e] = true;
+						loop[loopSize++] = e;
+					}
+
+					for (int i = 1; i + 1 < loopSize; ++i)
+					{
+						uint8_t* triangle = triangles[cubeCase] + triangleTotal * 3;
+						triangle[0] = (uint8_t)loop[0];
+						triangle[1] = (uint8_t)loop[i + 1];
+						triangle[2] = (uint8_t)loop[i];
+						++triangleTotal;
+					}
+				}
+				triangleCount[cubeCase] = (uint8_t)triangleTotal;
+			}
+		}
+	};
+
+	const CaseTable& GetCaseTable()
+	{
+		static const CaseTable table;
+		return table;
+	}
+}
+
+void MarchingCubes::MeshChunk(const VoxelVolume& volume, int chunkX, int chunkY, int chunkZ, VoxelMesh& mesh, MarchingCubesScratch& scratch)
+{
+	mesh.Clear();
+
+	const int baseX = chunkX * VOXEL_CHUNK_SIZE;
+	const int baseY = chunkY * VOXEL_CHUNK_SIZE;
+	const int baseZ = chunkZ * VOXEL_CHUNK_SIZE;
+
+	// Most chunks are entirely air or entirely rock
+	bool anySolid = false;
+	bool anyAir = false;
+	for (int z = 0; z <= VOXEL_CHUNK_SIZE && !(anySolid && anyAir); ++z)
+	{
+		for (int y = 0; y <= VOXEL_CHUNK_SIZE; ++y)
+		{
+			const float* row = volume.GetRow(baseY + y, baseZ + z) + baseX;
+			for (int x = 0; x <= VOXEL_CHUNK_SIZE; ++x)
+			{
+				anySolid |= row[x] < 0.0f;
+				anyAir |= row[x] >= 0.0f;
+			}
+		}
+	}
+	if (!anySolid || !anyAir)
+		return;
+
+	const CaseTable& table = GetCaseTable();
+	const float cellSize = volume.GetCellSize();
+	scratch.edgeVertices.assign((size_t)EDGE_SAMPLES * EDGE_SAMPLES * EDGE_SAMPLES * 3, -1);
+
+	auto edgeVertex = [&](int x, int y, int z, const float* density, int edge) -> uint32_t
+	{
+		const CubeEdge& e = table.edges[edge];
+		const int sx = x + (e.corner0 & 1);
+		const int sy = y + ((e.corner0 >> 1) & 1);
+		const int sz = z + ((e.corner0 >> 2) & 1);
+		int32_t& slot = scratch.edgeVertices[(((size_t)sz * EDGE_SAMPLES + sy) * EDGE_SAMPLES + sx) * 3 + e.axis];
+		if (slot >= 0)
+			return (uint32_t)slot;
+
+		const float d0 = density[e.corner0];
+		const float d1 = density[e.corner1];
+		const float t = d0 / (d0 - d1);
+
+		XMFLOAT3 position((float)sx, (float)sy, (float)sz);
+		(&position.x)[e.axis] += t;
+		position.x *= cellSize;
+		position.y *= cellSize;
+		position.z *= cellSize;
+
+		// Density grows towards the air, so its gradient is the outward normal
+		const int ox = e.axis == 0;
+		const int oy = e.axis == 1;
+		const int oz = e.axis == 2;
+		XMFLOAT3 g0 = volume.GetGradient(baseX + sx, baseY + sy, baseZ + sz);
+		XMFLOAT3 g1 = volume.GetGradient(baseX + sx + ox, baseY + sy + oy, baseZ + sz + oz);
+		XMVECTOR normal = XMVectorLerp(XMLoadFloat3(&g0), XMLoadFloat3(&g1), t);
+		if (XMVectorGetX(XMVector3LengthSq(normal)) < 1e-12f)
+			normal = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, XMVector3Normalize(normal));
+		slot = (int32_t)mesh.positions.size();
+		mesh.positions.push_back(position);
+		mesh.normals.push_back(n);
+		return (uint32_t)slot;
+	};
+
+	float density[8];
+	for (int z = 0; z < VOXEL_CHUNK_SIZE; ++z)
+	{
+		for (int y = 0; y < VOXEL_CHUNK_SIZE; ++y)
+		{
+			const float* row00 = volume.GetRow(baseY + y, baseZ + z) + baseX;
+			const float* row10 = volume.GetRow(baseY + y + 1, baseZ + z) + baseX;
+			const float* row01 = volume.GetRow(baseY + y, baseZ + z + 1) + baseX;
+			const float* row11 = volume.GetRow(baseY + y + 1, baseZ + z + 1) + baseX;
+
+			for (int x = 0; x < VOXEL_CHUNK_SIZE; ++x)
+			{
+				density[0] = row00[x];
+				density[1] = row00[x + 1];
+				density[2] = row10[x];
+				density[3] = row10[x + 1];
+				density[4] = row01[x];
+				density[5] = row01[x + 1];
+				density[6] = row11[x];
+				density[7] = row11[x + 1];
+
+				int cubeCase = 0;
+				for (int corner = 0; corner < 8; ++corner)
+					cubeCase |= (density[corner] < 0.0f) << corner;
+				if (cubeCase == 0 || cubeCase == 255)
+					continue;
+
+				const uint8_t* triangles = table.triangles[cubeCase];
+				for (int i = 0; i < table.triangleCount[cubeCase] * 3; ++i)
+					mesh.indices.push_back(edgeVertex(x, y, z, density, triangles[i]));
+			}
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "VoxelVolume.h"
+
+using namespace DirectX;
+
+// Triangle soup of one chunk. Positions are chunk-local (the chunk's first sample at the origin)
+// so identical content anywhere in the volume produces an identical mesh.
+struct VoxelMesh
+{
+	std::vector<XMFLOAT3>	positions;
+	std::vector<XMFLOAT3>	normals;
+	std::vector<uint32_t>	indices;
+
+	void Clear() { positions.clear(); normals.clear(); indices.clear(); }
+};
+
+// Per-thread scratch for MeshChunk: one vertex slot per cell edge in the chunk
+struct MarchingCubesScratch
+{
+	std::vector<int32_t>	edgeVertices;
+};
+
+namespace MarchingCubes
+{
+	// Meshes the zero crossing inside one VOXEL_CHUNK_SIZE^3 chunk. Every vertex lies on a cell
+	// edge and is created once, then shared by all triangles touching that edge.
+	void MeshChunk(const VoxelVolume& volume, int chunkX, int chunkY, int chunkZ, VoxelMesh& mesh, MarchingCubesScratch& scratch);
+}
@@ -0,0 +1,89 @@
+#include "MaterialShaders.h"
+#include "ShaderCompiler.h"
+
+MaterialShaderCache::MaterialShaderCache()
+{
+	for (int i = 0; i < MATERIAL_SHADER_KEYS; ++i)
+		m_shaders[i] = nullptr;
+}
+
+MaterialShaderCache::~MaterialShaderCache()
+{
+	Cleanup();
+}
+
+HRESULT MaterialShaderCache::Init(ID3D11Device* pd3dDevice, ShaderCache& shaderCache, const std::string& fileName, const std::string& entryPoint, const std::string& profile)
+{
+	Cleanup();
+
+	std::vector<uint32_t> keys;
+	std::vector<ShaderRequest> requests;
+	for (uint32_t mode = 0; mode < (uint32_t)MATERIAL_SHADER_PARALLAX_MODES; ++mode)
+	{
+		for (uint32_t texture = 0; texture < 2; ++texture)
+		{
+			for (uint32_t shadows = 0; shadows < 2; ++shadows)
+			{
+				if (shadows && mode == 0)
+					continue;
+
+				ShaderRequest request;
+				request.file = fileName;
+				request.entryPoint = entryPoint;
+				request.profile = profile;
+				request.defines.push_back({ "PARALLAX_MODE", std::to_string(mode) });
+				request.defines.push_back({ "USE_TEXTURE", texture ? "1" : "0" });
+				request.defines.push_back({ "PARALLAX_SHADOWS", shadows ? "1" : "0" });
+				requests.push_back(request);
+				keys.push_back(mode | (texture ? MATERIAL_SHADER_TEXTURE : 0) | (shadows ? MATERIAL_SHADER_PARALLAX_SHADOWS : 0));
+			}
+		}
+	}
+
+	std::vector<ShaderBytecode> bytecode;
+	if (!shaderCache.Load(requests, bytecode))
+		return E_FAIL;
+
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		HRESULT hr = CreatePixelShader(pd3dDevice, bytecode[i], &m_shaders[keys[i]]);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	return S_OK;
+}
+
+void MaterialShaderCache::Cleanup()
+{
+	for (int i = 0; i < MATERIAL_SHADER_KEYS; ++i)
+	{
+		if (m_shaders[i])
+			m_shaders[i]->Release();
+		m_shaders[i] = nullptr;
+	}
+}
+
+uint32_t MaterialShaderCache::KeyFor(const _Material& material)
+{
+	uint32_t mode = material.choice >= 0 && material.choice < MATERIAL_SHADER_PARALLAX_MODES ? (uint32_t)material.choice : 0;
+	uint32_t key = mode;
+	if (material.UseTexture)
+		key |= MATERIAL_SHADER_TEXTURE;
+	if (material.ParallaxShadows && mode != 0)
+		key |= MATERIAL_SHADER_PARALLAX_SHADOWS;
+	return key;
+}
+
+ID3D11PixelShader* MaterialShaderCache::Get(uint32_t key) const
+{
+	return key < (uint32_t)MATERIAL_SHADER_KEYS ? m_shaders[key] : nullptr;
+}
+
+int MaterialShaderCache::GetShaderCount() const
+{
+	int count = 0;
+	for (int i = 0; i < MATERIAL_SHADER_KEYS; ++i)
+		count += m_shaders[i] != nullptr;
+	return count;
+}
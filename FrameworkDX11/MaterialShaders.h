@@ -0,0 +1,46 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+
+#include "ShaderCache.h"
+#include "structures.h"
+
+// Material features the pixel shader is specialised on, packed into a permutation key
+enum MaterialShaderFeature : uint32_t
+{
+	MATERIAL_SHADER_PARALLAX_MASK		= 0x7,		// Material.choice: 0 normals, 1 steep, 2 occlusion, 3 cone step, 4 quadtree
+	MATERIAL_SHADER_TEXTURE				= 1 << 3,
+	MATERIAL_SHADER_PARALLAX_SHADOWS	= 1 << 4,
+};
+
+const int MATERIAL_SHADER_PARALLAX_MODES = 5;
+const int MATERIAL_SHADER_KEYS = 1 << 5;
+
+// One pixel shader per material feature combination, compiled from the same entry point with
+// PARALLAX_MODE, USE_TEXTURE and PARALLAX_SHADOWS defined, so each draws without the branches
+// (and the registers) of the modes it doesn't use. Every reachable permutation is loaded up
+// front through the shader cache, so switching modes only swaps the bound shader.
+class MaterialShaderCache
+{
+public:
+	MaterialShaderCache();
+	~MaterialShaderCache();
+
+	HRESULT					Init(ID3D11Device* pd3dDevice, ShaderCache& shaderCache, const std::string& fileName, const std::string& entryPoint, const std::string& profile);
+	void					Cleanup();
+
+	// Features that change the shader; shadows only count with a parallax mode
+	static uint32_t			KeyFor(const _Material& material);
+
+	// nullptr for keys that don't name a permutation
+	ID3D11PixelShader*		Get(uint32_t key) const;
+	ID3D11PixelShader*		Get(const _Material& material) const { return Get(KeyFor(material)); }
+
+	int						GetShaderCount() const;
+
+private:
+	ID3D11PixelShader*		m_shaders[MATERIAL_SHADER_KEYS];
+};
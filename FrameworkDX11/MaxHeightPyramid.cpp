@@ -0,0 +1,163 @@
+#include "MaxHeightPyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	// Moves a position lying on a cell boundary into the cell the ray is heading for
+	const float BOUNDARY_NUDGE = 1e-3f;
+
+	inline float Nudge(float direction)
+	{
+		return direction > 0.0f ? BOUNDARY_NUDGE : (direction < 0.0f ? -BOUNDARY_NUDGE : 0.0f);
+	}
+
+	// Depth at which a ray from origin moving by direction per unit depth leaves [cell, cell + size)
+	inline float ExitDepth(float origin, float direction, int cell, int size)
+	{
+		if (direction > 0.0f)
+			return ((cell + 1) * (float)size - origin) / direction;
+		if (direction < 0.0f)
+			return (cell * (float)size - origin) / direction;
+		return std::numeric_limits<float>::max();
+	}
+}
+
+void MaxHeightPyramid::Build(const Image& depth, std::vector<Image>& levels)
+{
+	DepthField base;
+	base.Load(depth);
+
+	std::vector<DepthField> fields;
+	Build(base, fields);
+
+	levels.resize(fields.size());
+	for (size_t i = 0; i < fields.size(); ++i)
+	{
+		const DepthField& field = fields[i];
+		Image& level = levels[i];
+		level.Resize(field.GetWidth(), field.GetHeight());
+		for (int y = 0; y < field.GetHeight(); ++y)
+		{
+			const float* in = field.GetRow(y);
+			uint8_t* out = level.GetRow(y);
+			for (int x = 0; x < field.GetWidth(); ++x)
+			{
+				const uint8_t value = (uint8_t)(in[x] * 255.0f + 0.5f);
+				out[x * 4 + 0] = value;
+				out[x * 4 + 1] = value;
+				out[x * 4 + 2] = value;
+				out[x * 4 + 3] = 255;
+			}
+		}
+	}
+}
+
+void MaxHeightPyramid::Build(const DepthField& depth, std::vector<DepthField>& levels)
+{
+	levels.assign(1, depth);
+	while (levels.back().GetWidth() > 1 || levels.back().GetHeight() > 1)
+	{
+		const DepthField& below = levels.back();
+		DepthField level;
+		level.Resize(std::max(below.GetWidth() / 2, 1), std::max(below.GetHeight() / 2, 1));
+		for (int y = 0; y < level.GetHeight(); ++y)
+		{
+			float* out = level.GetRow(y);
+			for (int x = 0; x < level.GetWidth(); ++x)
+			{
+				out[x] = std::min(std::min(below.At(x * 2, y * 2), below.At(x * 2 + 1, y * 2)),
+					std::min(below.At(x * 2, y * 2 + 1), below.At(x * 2 + 1, y * 2 + 1)));
+			}
+		}
+		levels.push_back(level);
+	}
+}
+
+ParallaxTraceResult MaxHeightPyramid::Trace(const std::vector<DepthField>& levels, const MaxHeightTraceSettings& settings, const ParallaxRay& ray)
+{
+	const DepthField& base = levels[0];
+	const int top = (int)levels.size() - 1;
+
+	// Work in level 0 texels
+	const float originX = ray.u * base.GetWidth();
+	const float originY = ray.v * base.GetHeight();
+	const float directionX = ray.du * base.GetWidth();
+	const float directionY = ray.dv * base.GetHeight();
+	const float nudgeX = Nudge(directionX);
+	const float nudgeY = Nudge(directionY);
+
+	ParallaxTraceResult result;
+	result.depth = 0.0f;
+	result.u = ray.u;
+	result.v = ray.v;
+	result.fetches = 1;
+
+	// Most of a typical map is its top surface: settle that with a single fetch
+	if (base.At((int)std::floor(originX), (int)std::floor(originY)) <= 0.0f)
+		return result;
+
+	// Start with cells a quarter of the ray's footprint: coarser ones rarely let it skip anything
+	const float footprint = std::max(std::fabs(directionX), std::fabs(directionY));
+	int level = std::max(std::min((int)std::ceil(std::log2(std::max(footprint, 1.0f))) - 2, top), 0);
+	float z = 0.0f;
+
+	while (result.fetches < settings.maxSteps)
+	{
+		const int cellSize = 1 << level;
+		const int cellX = (int)std::floor((originX + directionX * z + nudgeX) / cellSize);
+		const int cellY = (int)std::floor((originY + directionY * z + nudgeY) / cellSize);
+		const float highest = levels[level].At(cellX, cellY);
+		++result.fetches;
+
+		if (z >= highest)
+		{
+			// Inside the cell's bounds: look closer, or stop against a texel's side
+			if (level == 0)
+				break;
+			--level;
+			continue;
+		}
+
+		const float exitX = ExitDepth(originX, directionX, cellX, cellSize);
+		const float exitY = ExitDepth(originY, directionY, cellY, cellSize);
+		const float exit = std::min(exitX, exitY);
+		if (highest <= exit)
+		{
+			// Down onto the cell's highest point; at level 0 that is the texel's top
+			z = highest;
+			if (level == 0)
+				break;
+			--level;
+		}
+		else
+		{
+			// Over the cell without touching it. Climb only into a new parent cell: the old
+			// parent already sent the ray down here.
+			const bool newParent = exitX <= exitY ? ((cellX + (directionX > 0.0f ? 1 : -1)) >> 1) != (cellX >> 1)
+				: ((cellY + (directionY > 0.0f ? 1 : -1)) >> 1) != (cellY >> 1);
+			z = exit;
+			if (newParent)
+				level = std::min(level + 1, top);
+		}
+	}
+
+	// The pyramid sees square texels; settle the last texel of travel on the filtered surface
+	float range = std::min(z, 1.0f / std::max(footprint, 1.0f)) * 0.5f;
+	z -= range;
+	for (int i = 0; i < settings.refineSteps; ++i, ++result.fetches)
+	{
+		range *= 0.5f;
+		if (z < levels[0].Sample(ray.u + ray.du * z, ray.v + ray.dv * z))
+			z += range;
+		else
+			z -= range;
+	}
+
+	result.depth = z;
+	result.u = ray.u + ray.du * z;
+	result.v = ray.v + ray.dv * z;
+	return result;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include "Image.h"
+#include "ParallaxReference.h"
+
+struct MaxHeightTraceSettings
+{
+	int				maxSteps = 64;			// shader loop limits, mirrored by Trace
+	int				refineSteps = 2;		// filtered samples bisecting the last texel
+};
+
+// Max-height mip chains for quadtree displacement mapping. Level 0 is the depth texture itself;
+// each texel of level n + 1 holds the smallest depth (the highest point) of the 2x2 texels below
+// it, so a ray above a texel's value cannot hit anything in the area it covers.
+//
+// The traversal starts at a level a quarter as wide as the ray's footprint. While the ray is
+// above the current cell it jumps either down to the cell's highest point (and descends a level)
+// or across the cell boundary (climbing a level when it enters a new parent); below it, it
+// descends. Reaching level 0 below the surface is the hit, which a couple of filtered samples
+// then refine. Levels wrap like the tiling texture, so sizes must be powers of two.
+namespace MaxHeightPyramid
+{
+	// Levels down to 1x1 as RGBA8 (depth replicated into every channel), ready for upload
+	void Build(const Image& depth, std::vector<Image>& levels);
+	void Build(const DepthField& depth, std::vector<DepthField>& levels);
+
+	// Mirrors ParallaxQuadtreeMapping in shader.fx on nearest-texel fetches
+	ParallaxTraceResult Trace(const std::vector<DepthField>& levels, const MaxHeightTraceSettings& settings, const ParallaxRay& ray);
+}
@@ -0,0 +1,333 @@
+#include "MipGenerator.h"
+#include "ImageIO.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	// A float RGBA level, interleaved like Image
+	struct Level
+	{
+		int					width = 0;
+		int					height = 0;
+		std::vector<float>	texels;
+	};
+
+	// The source texels one destination texel takes, already wrapped or clamped, and their weights
+	struct Tap
+	{
+		std::vector<int>	sources;
+		std::vector<float>	weights;
+	};
+
+	float SrgbToLinear(float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	inline uint8_t ToByte(float v)
+	{
+		return (uint8_t)std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f);
+	}
+
+	// Linear to 8-bit sRGB against the linear values halfway between neighbouring codes, which
+	// rounds exactly as the curve would without a pow per channel. A coarse table gives the
+	// lowest code a value can have and the boundaries finish the job in a step or two.
+	struct SrgbEncoder
+	{
+		static const int	TABLE_SIZE = 4096;
+		float				boundaries[256];
+		uint8_t				first[TABLE_SIZE];
+
+		SrgbEncoder()
+		{
+			for (int i = 0; i < 255; ++i)
+				boundaries[i] = SrgbToLinear((i + 0.5f) / 255.0f);
+			boundaries[255] = 2.0f;
+
+			int code = 0;
+			for (int i = 0; i < TABLE_SIZE; ++i)
+			{
+				while (boundaries[code] < (float)i / TABLE_SIZE)
+					++code;
+				first[i] = (uint8_t)code;
+			}
+		}
+
+		uint8_t operator()(float linear) const
+		{
+			linear = std::min(std::max(linear, 0.0f), 1.0f);
+			int code = first[std::min((int)(linear * TABLE_SIZE), TABLE_SIZE - 1)];
+			while (linear > boundaries[code])
+				++code;
+			return (uint8_t)code;
+		}
+	};
+
+	// Zeroth-order modified Bessel function of the first kind, for the Kaiser window
+	float BesselI0(float x)
+	{
+		float sum = 1.0f;
+		float term = 1.0f;
+		const float halfSquared = x * x * 0.25f;
+		for (int k = 1; k < 32; ++k)
+		{
+			term *= halfSquared / ((float)k * k);
+			sum += term;
+			if (term < sum * 1e-7f)
+				break;
+		}
+		return sum;
+	}
+
+	float Sinc(float x)
+	{
+		if (std::fabs(x) < 1e-5f)
+			return 1.0f;
+		return std::sin(PI * x) / (PI * x);
+	}
+
+	float Kaiser(float t, const MipSettings& settings)
+	{
+		const float r = t / settings.kaiserWidth;
+		if (r <= -1.0f || r >= 1.0f)
+			return 0.0f;
+		return Sinc(t) * BesselI0(settings.kaiserAlpha * std::sqrt(1.0f - r * r)) / BesselI0(settings.kaiserAlpha);
+	}
+
+	inline int Address(int i, int size, bool wrap)
+	{
+		if (wrap)
+			return (i % size + size) % size;
+		return std::min(std::max(i, 0), size - 1);
+	}
+
+	// Weights for shrinking sourceSize texels to destinationSize along one axis. Distances are
+	// measured in destination texels, so the filter's width follows the ratio.
+	std::vector<Tap> BuildTaps(int sourceSize, int destinationSize, const MipSettings& settings)
+	{
+		const float scale = (float)sourceSize / destinationSize;
+		const float support = settings.filter == MipFilterKaiser ? settings.kaiserWidth * scale : 0.5f * scale;
+
+		std::vector<Tap> taps(destinationSize);
+		for (int i = 0; i < destinationSize; ++i)
+		{
+			const float centre = (i + 0.5f) * scale;
+			Tap& tap = taps[i];
+			const int first = (int)std::floor(centre - support);
+			const int last = (int)std::ceil(centre + support);
+
+			float total = 0.0f;
+			for (int s = first; s < last; ++s)
+			{
+				float weight;
+				if (settings.filter == MipFilterKaiser)
+				{
+					weight = Kaiser((s + 0.5f - centre) / scale, settings);
+				}
+				else
+				{
+					// Box: the part of source texel s inside the destination texel's footprint
+					const float low = std::max((float)s, centre - support);
+					const float high = std::min((float)(s + 1), centre + support);
+					weight = std::max(high - low, 0.0f);
+				}
+				if (weight == 0.0f)
+					continue;
+				tap.sources.push_back(Address(s, sourceSize, settings.wrap));
+				tap.weights.push_back(weight);
+				total += weight;
+			}
+			for (float& weight : tap.weights)
+				weight /= total;
+		}
+		return taps;
+	}
+
+	Level Downsample(const Level& source, const MipSettings& settings)
+	{
+		Level result;
+		result.width = std::max(source.width / 2, 1);
+		result.height = std::max(source.height / 2, 1);
+		result.texels.assign((size_t)result.width * result.height * 4, 0.0f);
+
+		// Rows first, into a buffer that is already narrow
+		const std::vector<Tap> horizontal = BuildTaps(source.width, result.width, settings);
+		std::vector<float> narrow((size_t)result.width * source.height * 4, 0.0f);
+		JobSystem::Get().ParallelFor(source.height, 16, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; ++y)
+			{
+				const float* row = source.texels.data() + (size_t)y * source.width * 4;
+				float* out = narrow.data() + (size_t)y * result.width * 4;
+				for (int x = 0; x < result.width; ++x)
+				{
+					const Tap& tap = horizontal[x];
+					float sum[4] = {};
+					for (size_t k = 0; k < tap.weights.size(); ++k)
+					{
+						const float* texel = row + (size_t)tap.sources[k] * 4;
+						for (int c = 0; c < 4; ++c)
+							sum[c] += texel[c] * tap.weights[k];
+					}
+					for (int c = 0; c < 4; ++c)
+						out[x * 4 + c] = sum[c];
+				}
+			}
+		});
+
+		// Then columns, a whole destination row at a time so the inner loop runs along memory
+		const std::vector<Tap> vertical = BuildTaps(source.height, result.height, settings);
+		const size_t rowFloats = (size_t)result.width * 4;
+		JobSystem::Get().ParallelFor(result.height, 4, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; ++y)
+			{
+				const Tap& tap = vertical[y];
+				float* out = result.texels.data() + (size_t)y * rowFloats;
+				for (size_t k = 0; k < tap.weights.size(); ++k)
+				{
+					const float* row = narrow.data() + (size_t)tap.sources[k] * rowFloats;
+					const float weight = tap.weights[k];
+					for (size_t i = 0; i < rowFloats; ++i)
+						out[i] += row[i] * weight;
+				}
+			}
+		});
+		return result;
+	}
+
+	Level Decode(const Image& image, const MipSettings& settings)
+	{
+		float toFloat[256];
+		for (int i = 0; i < 256; ++i)
+		{
+			const float c = i / 255.0f;
+			toFloat[i] = settings.normalMap ? c * 2.0f - 1.0f : settings.srgb ? SrgbToLinear(c) : c;
+		}
+
+		Level level;
+		level.width = image.GetWidth();
+		level.height = image.GetHeight();
+		level.texels.resize((size_t)level.width * level.height * 4);
+		const uint8_t* in = image.GetData();
+		for (size_t i = 0; i < level.texels.size(); i += 4)
+		{
+			level.texels[i + 0] = toFloat[in[i + 0]];
+			level.texels[i + 1] = toFloat[in[i + 1]];
+			level.texels[i + 2] = toFloat[in[i + 2]];
+			level.texels[i + 3] = in[i + 3] / 255.0f;
+		}
+		return level;
+	}
+
+	Image Encode(const Level& level, const MipSettings& settings, float alphaScale)
+	{
+		static const SrgbEncoder toSrgb;
+		Image image(level.width, level.height);
+		uint8_t* out = image.GetData();
+		JobSystem::Get().ParallelFor(level.height, 16, [&](int begin, int end)
+		{
+			for (size_t i = (size_t)begin * level.width * 4; i < (size_t)end * level.width * 4; i += 4)
+			{
+				const float* texel = level.texels.data() + i;
+				if (settings.normalMap)
+				{
+					// Filtering shortens the vectors; the chain keeps them short, the output does not
+					float length = std::sqrt(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+					float inverse = length > 1e-6f ? 1.0f / length : 0.0f;
+					float z = length > 1e-6f ? texel[2] * inverse : 1.0f;
+					out[i + 0] = ToByte(texel[0] * inverse * 0.5f + 0.5f);
+					out[i + 1] = ToByte(texel[1] * inverse * 0.5f + 0.5f);
+					out[i + 2] = ToByte(z * 0.5f + 0.5f);
+				}
+				else
+				{
+					for (int c = 0; c < 3; ++c)
+						out[i + c] = settings.srgb ? toSrgb(texel[c]) : ToByte(texel[c]);
+				}
+				out[i + 3] = ToByte(texel[3] * alphaScale);
+			}
+		});
+		return image;
+	}
+
+	float Coverage(const Level& level, float cutoff, float alphaScale)
+	{
+		size_t covered = 0;
+		for (size_t i = 3; i < level.texels.size(); i += 4)
+		{
+			if (level.texels[i] * alphaScale > cutoff)
+				++covered;
+		}
+		return (float)covered / (level.texels.size() / 4);
+	}
+
+	// Castano's coverage-preserving scale: a level's alpha is scaled until as many texels pass
+	// the cutoff as in mip 0, so alpha-tested foliage does not thin out in the distance
+	float FindAlphaScale(const Level& level, float cutoff, float target)
+	{
+		float low = 0.0f;
+		float high = 4.0f;
+		float scale = 1.0f;
+		for (int i = 0; i < 12; ++i)
+		{
+			scale = (low + high) * 0.5f;
+			if (Coverage(level, cutoff, scale) < target)
+				low = scale;
+			else
+				high = scale;
+		}
+		return scale;
+	}
+}
+
+void MipGenerator::Generate(const Image& image, const MipSettings& settings, std::vector<Image>& mips)
+{
+	mips.clear();
+	if (image.IsEmpty())
+		return;
+
+	mips.push_back(image);
+	Level level = Decode(image, settings);
+	const float coverage = settings.alphaCutoff > 0.0f ? Coverage(level, settings.alphaCutoff, 1.0f) : 0.0f;
+
+	while (level.width > 1 || level.height > 1)
+	{
+		level = Downsample(level, settings);
+		const float alphaScale = settings.alphaCutoff > 0.0f ? FindAlphaScale(level, settings.alphaCutoff, coverage) : 1.0f;
+		mips.push_back(Encode(level, settings, alphaScale));
+	}
+}
+
+float MipGenerator::AlphaCoverage(const Image& image, float cutoff)
+{
+	if (image.IsEmpty())
+		return 0.0f;
+
+	size_t covered = 0;
+	const size_t texels = (size_t)image.GetWidth() * image.GetHeight();
+	const uint8_t* data = image.GetData();
+	for (size_t i = 0; i < texels; ++i)
+	{
+		if (data[i * 4 + 3] / 255.0f > cutoff)
+			++covered;
+	}
+	return (float)covered / texels;
+}
+
+bool MipGenerator::GenerateFile(const std::string& inputFile, const std::string& outputFile, const MipSettings& settings)
+{
+	Image image;
+	if (!ImageIO::LoadDDS(inputFile, image))
+		return false;
+
+	std::vector<Image> mips;
+	Generate(image, settings, mips);
+	return ImageIO::SaveDDS(outputFile, mips.data(), (int)mips.size());
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Image.h"
+
+enum MipFilter
+{
+	MipFilterBox = 0,
+	MipFilterKaiser = 1,		// windowed sinc: keeps detail a box blurs away without aliasing
+};
+
+struct MipSettings
+{
+	MipFilter		filter = MipFilterKaiser;
+	float			kaiserWidth = 3.0f;			// filter radius, in texels of the level being made
+	float			kaiserAlpha = 4.0f;			// window shape; higher rings less and blurs more
+	bool			srgb = true;				// RGB is gamma encoded: filter it in linear light
+	bool			normalMap = false;			// RGB holds a unit vector: filter it, then renormalise
+	float			alphaCutoff = 0.0f;			// alpha-tested: keep mip 0's coverage above this in every level
+	bool			wrap = true;				// tiling texture: filter across the opposite edge
+
+	// Presets for the kinds of texture in Resources
+	static MipSettings Colour() { return MipSettings(); }
+	static MipSettings Linear() { MipSettings settings; settings.srgb = false; return settings; }
+	static MipSettings NormalMap() { MipSettings settings; settings.srgb = false; settings.normalMap = true; return settings; }
+};
+
+// Full mip chains for the texture importer and the offline tools.
+//
+// Every level is filtered from the one above in 32-bit float, with rows and then columns split
+// across the job system, and only quantised to 8 bits on output, so rounding does not build up
+// down the chain. Non-power-of-two levels use the same polyphase filter with a non-integer ratio.
+namespace MipGenerator
+{
+	// mips[0] is a copy of image; the chain ends at 1x1
+	void Generate(const Image& image, const MipSettings& settings, std::vector<Image>& mips);
+
+	// Fraction of texels whose alpha is above the cutoff
+	float AlphaCoverage(const Image& image, float cutoff);
+
+	// Offline path: reads a DDS and writes it back out with a full mip chain
+	bool GenerateFile(const std::string& inputFile, const std::string& outputFile, const MipSettings& settings);
+}
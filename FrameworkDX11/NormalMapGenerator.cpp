@@ -0,0 +1,228 @@
+#include "NormalMapGenerator.h"
+#include "ImageIO.h"
+#include "JobSystem.h"
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	inline uint8_t ToByte(float v)
+	{
+		return (uint8_t)std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f);
+	}
+
+	// Heights as floats in [0, 1], one per texel
+	std::vector<float> ReadHeights(const Image& image, bool invert)
+	{
+		const int width = image.GetWidth();
+		const int height = image.GetHeight();
+		std::vector<float> heights((size_t)width * height);
+		for (int y = 0; y < height; ++y)
+		{
+			const uint8_t* row = image.GetRow(y);
+			float* out = heights.data() + (size_t)y * width;
+			for (int x = 0; x < width; ++x)
+			{
+				float h = row[x * 4] * (1.0f / 255.0f);
+				out[x] = invert ? 1.0f - h : h;
+			}
+		}
+		return heights;
+	}
+
+	inline int Address(int i, int size, bool wrap)
+	{
+		if (wrap)
+			return (i % size + size) % size;
+		return std::min(std::max(i, 0), size - 1);
+	}
+
+	// Box average of radius r along rows, then along columns
+	void BoxBlur(const std::vector<float>& source, int width, int height, int radius, bool wrap, std::vector<float>& result)
+	{
+		std::vector<float> horizontal(source.size());
+		const float scale = 1.0f / (2 * radius + 1);
+
+		JobSystem::Get().ParallelFor(height, 16, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; ++y)
+			{
+				const float* row = source.data() + (size_t)y * width;
+				float sum = 0.0f;
+				for (int i = -radius; i <= radius; ++i)
+					sum += row[Address(i, width, wrap)];
+				for (int x = 0; x < width; ++x)
+				{
+					horizontal[(size_t)y * width + x] = sum * scale;
+					sum += row[Address(x + radius + 1, width, wrap)] - row[Address(x - radius, width, wrap)];
+				}
+			}
+		});
+
+		result.resize(source.size());
+		JobSystem::Get().ParallelFor(width, 16, [&](int begin, int end)
+		{
+			for (int x = begin; x < end; ++x)
+			{
+				float sum = 0.0f;
+				for (int i = -radius; i <= radius; ++i)
+					sum += horizontal[(size_t)Address(i, height, wrap) * width + x];
+				for (int y = 0; y < height; ++y)
+				{
+					result[(size_t)y * width + x] = sum * scale;
+					sum += horizontal[(size_t)Address(y + radius + 1, height, wrap) * width + x] - horizontal[(size_t)Address(y - radius, height, wrap) * width + x];
+				}
+			}
+		});
+	}
+
+	bool SaveWithMips(const std::string& fileName, const Image& image, const MipSettings& mipSettings)
+	{
+		std::vector<Image> mips;
+		MipGenerator::Generate(image, mipSettings, mips);
+		return ImageIO::SaveDDS(fileName, mips.data(), (int)mips.size());
+	}
+}
+
+void NormalMapGenerator::GenerateNormalMap(const Image& height, const NormalMapSettings& settings, Image& normals)
+{
+	const int width = height.GetWidth();
+	const int rows = height.GetHeight();
+	const std::vector<float> heights = ReadHeights(height, settings.invertHeight);
+	normals.Resize(width, rows);
+
+	// Smoothing weights across the derivative; both kernels are normalised to a unit slope
+	const float side = settings.filter == NormalFilterScharr ? 3.0f : 1.0f;
+	const float centre = settings.filter == NormalFilterScharr ? 10.0f : 2.0f;
+	const float scale = settings.strength / (2.0f * (2.0f * side + centre));
+	const float greenSign = settings.flipGreen ? -1.0f : 1.0f;
+
+	JobSystem::Get().ParallelFor(rows, 16, [&](int begin, int end)
+	{
+		for (int y = begin; y < end; ++y)
+		{
+			const float* up = heights.data() + (size_t)Address(y - 1, rows, settings.wrap) * width;
+			const float* mid = heights.data() + (size_t)y * width;
+			const float* down = heights.data() + (size_t)Address(y + 1, rows, settings.wrap) * width;
+			uint8_t* out = normals.GetRow(y);
+
+			for (int x = 0; x < width; ++x)
+			{
+				const int l = Address(x - 1, width, settings.wrap);
+				const int r = Address(x + 1, width, settings.wrap);
+
+				float dx = side * (up[r] - up[l]) + centre * (mid[r] - mid[l]) + side * (down[r] - down[l]);
+				float dy = side * (down[l] - up[l]) + centre * (down[x] - up[x]) + side * (down[r] - up[r]);
+
+				// Rows run down the texture, so a slope along +row tilts the normal towards -y in tangent space
+				float nx = -dx * scale;
+				float ny = dy * scale * greenSign;
+				float invLength = 1.0f / std::sqrt(nx * nx + ny * ny + 1.0f);
+
+				out[x * 4 + 0] = ToByte(nx * invLength * 0.5f + 0.5f);
+				out[x * 4 + 1] = ToByte(ny * invLength * 0.5f + 0.5f);
+				out[x * 4 + 2] = ToByte(invLength * 0.5f + 0.5f);
+				out[x * 4 + 3] = height.GetRow(y)[x * 4];
+			}
+		}
+	});
+}
+
+void NormalMapGenerator::GenerateDetailMap(const Image& height, const NormalMapSettings& settings, Image& detail)
+{
+	const int width = height.GetWidth();
+	const int rows = height.GetHeight();
+	const std::vector<float> heights = ReadHeights(height, settings.invertHeight);
+	detail.Resize(width, rows);
+
+	// Cavity occlusion: how far a texel sits below its surroundings at three scales
+	const int radius = std::max(settings.occlusionRadius, 1);
+	std::vector<float> blurred[3];
+	for (int level = 0; level < 3; ++level)
+		BoxBlur(heights, width, rows, radius << level, settings.wrap, blurred[level]);
+
+	JobSystem::Get().ParallelFor(rows, 16, [&](int begin, int end)
+	{
+		for (int y = begin; y < end; ++y)
+		{
+			const float* up = heights.data() + (size_t)Address(y - 1, rows, settings.wrap) * width;
+			const float* mid = heights.data() + (size_t)y * width;
+			const float* down = heights.data() + (size_t)Address(y + 1, rows, settings.wrap) * width;
+			uint8_t* out = detail.GetRow(y);
+
+			for (int x = 0; x < width; ++x)
+			{
+				const float h = mid[x];
+				const float laplacian = mid[Address(x - 1, width, settings.wrap)] + mid[Address(x + 1, width, settings.wrap)] + up[x] + down[x] - 4.0f * h;
+
+				float cavity = 0.0f;
+				for (int level = 0; level < 3; ++level)
+					cavity += std::max(blurred[level][(size_t)y * width + x] - h, 0.0f);
+
+				out[x * 4 + 0] = ToByte(0.5f - laplacian * settings.curvatureScale);
+				out[x * 4 + 1] = ToByte(1.0f - cavity * settings.occlusionStrength / 3.0f);
+				out[x * 4 + 2] = 0;
+				out[x * 4 + 3] = 255;
+			}
+		}
+	});
+}
+
+bool NormalMapGenerator::GetResourcePreset(const std::string& heightFile, NormalMapSettings& settings)
+{
+	struct Preset
+	{
+		const char*	name;
+		bool		invertHeight;
+		bool		flipGreen;
+		float		strength;
+	};
+
+	// Fitted against the shipped maps; all agree to within a few degrees on average
+	static const Preset presets[] =
+	{
+		{ "displacement.dds", true, true, 11.0f },		// Brick Textures
+		{ "Crate_DISP.dds", false, true, 45.0f },
+		{ "rock_height.dds", true, false, 32.0f },
+	};
+
+	settings = NormalMapSettings();
+	for (const Preset& preset : presets)
+	{
+		const size_t length = strlen(preset.name);
+		if (heightFile.size() >= length && heightFile.compare(heightFile.size() - length, length, preset.name) == 0)
+		{
+			settings.invertHeight = preset.invertHeight;
+			settings.flipGreen = preset.flipGreen;
+			settings.strength = preset.strength;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool NormalMapGenerator::GenerateFiles(const std::string& heightFile, const std::string& normalFile, const std::string& detailFile, const NormalMapSettings& settings)
+{
+	Image height;
+	if (!ImageIO::LoadDDS(heightFile, height))
+		return false;
+
+	Image output;
+	GenerateNormalMap(height, settings, output);
+	MipSettings mipSettings = MipSettings::NormalMap();
+	mipSettings.wrap = settings.wrap;
+	if (!SaveWithMips(normalFile, output, mipSettings))
+		return false;
+
+	if (detailFile.empty())
+		return true;
+
+	GenerateDetailMap(height, settings, output);
+	mipSettings = MipSettings::Linear();
+	mipSettings.wrap = settings.wrap;
+	return SaveWithMips(detailFile, output, mipSettings);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+#include "Image.h"
+
+enum NormalMapFilter
+{
+	NormalFilterSobel = 0,
+	NormalFilterScharr = 1,		// better rotational symmetry, slightly sharper
+};
+
+// How to read the height texture and encode the result. Shipped texture sets disagree on
+// conventions, so both the height sign and the green channel can be flipped.
+struct NormalMapSettings
+{
+	NormalMapFilter	filter = NormalFilterScharr;
+	float			strength = 4.0f;			// slope scale; height 0..1 over one texel times this
+	bool			invertHeight = false;		// treat the texture as depth rather than height
+	bool			flipGreen = false;			// +y down (DirectX style) instead of up
+	bool			wrap = true;				// tiling texture: sample across the opposite edge
+	float			curvatureScale = 8.0f;
+	int				occlusionRadius = 4;		// texels; averaged over radius, 2x and 4x
+	float			occlusionStrength = 6.0f;
+};
+
+// Derives tangent-space maps from a height texture (height in the red channel).
+//
+// GenerateNormalMap writes the encoded normal to RGB and copies the height to alpha, so one
+// texture can feed both normal and parallax mapping. GenerateDetailMap writes convexity to red
+// (0.5 = flat) and cavity occlusion to green. Rows are processed in parallel on the job system.
+namespace NormalMapGenerator
+{
+	void GenerateNormalMap(const Image& height, const NormalMapSettings& settings, Image& normals);
+	void GenerateDetailMap(const Image& height, const NormalMapSettings& settings, Image& detail);
+
+	// Conventions and strengths that reproduce the normal maps shipped in Resources, matched by
+	// the height file's name. Returns false (and the defaults) for unknown files.
+	bool GetResourcePreset(const std::string& heightFile, NormalMapSettings& settings);
+
+	// Offline path: reads a DDS height map and writes the generated maps with full mip chains.
+	// detailFile may be empty.
+	bool GenerateFiles(const std::string& heightFile, const std::string& normalFile, const std::string& detailFile, const NormalMapSettings& settings);
+}
@@ -0,0 +1,211 @@
+#include "ParallaxQuality.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	struct SceneCamera
+	{
+		float		eyeHeight;
+		float		forwardY, forwardZ;
+		float		upY, upZ;
+		float		tanHalfX, tanHalfY;
+		int			width, height;
+
+		// Ground hit of the ray through a pixel position; false above the horizon
+		bool Hit(float px, float py, float& x, float& z, float& distance) const
+		{
+			const float sx = (2.0f * px / width - 1.0f) * tanHalfX;
+			const float sy = (1.0f - 2.0f * py / height) * tanHalfY;
+			const float dx = sx;
+			const float dy = forwardY + sy * upY;
+			const float dz = forwardZ + sy * upZ;
+			if (dy >= -1e-4f)
+				return false;
+
+			const float t = eyeHeight / -dy;
+			x = dx * t;
+			z = dz * t;
+			distance = t * std::sqrt(dx * dx + dy * dy + dz * dz);
+			return true;
+		}
+	};
+}
+
+float ParallaxQuality::LayerCount(const ParallaxQualitySettings& settings, float texels, float lod)
+{
+	const float layers = texels * std::exp2(-std::max(lod, 0.0f)) * settings.qualityScale;
+	return std::min(std::max(layers, settings.minLayers), settings.maxLayers);
+}
+
+float ParallaxQuality::DistanceFade(const ParallaxQualitySettings& settings, float distance)
+{
+	const float range = std::max(settings.fadeEnd - settings.fadeStart, 1e-3f);
+	return std::min(std::max((settings.fadeEnd - distance) / range, 0.0f), 1.0f);
+}
+
+ParallaxTraceResult ParallaxQuality::TraceAdaptive(const DepthField& depth, const ParallaxQualitySettings& settings, const ParallaxRay& ray, float lod)
+{
+	ParallaxTraceResult result;
+	result.u = ray.u;
+	result.v = ray.v;
+	result.depth = 0.0f;
+	result.fetches = 0;
+
+	// Faded out entirely: plain normal mapping
+	if (ray.du == 0.0f && ray.dv == 0.0f)
+		return result;
+
+	const float tx = ray.du * depth.GetWidth();
+	const float ty = ray.dv * depth.GetHeight();
+	const float numLayers = LayerCount(settings, std::sqrt(tx * tx + ty * ty), lod);
+	const float layerHeight = 1.0f / numLayers;
+
+	float currentLayerHeight = 0.0f;
+	float heightFromTexture = depth.Sample(ray.u, ray.v);
+	int fetches = 1;
+
+	// Starting on the top surface there is nothing to march or refine
+	if (heightFromTexture <= 0.0f)
+	{
+		result.fetches = fetches;
+		return result;
+	}
+
+	while (heightFromTexture > currentLayerHeight && currentLayerHeight < 1.0f)
+	{
+		currentLayerHeight += layerHeight;
+		heightFromTexture = depth.Sample(ray.u + ray.du * currentLayerHeight, ray.v + ray.dv * currentLayerHeight);
+		++fetches;
+	}
+
+	const float previousLayer = std::max(currentLayerHeight - layerHeight, 0.0f);
+	const float nextH = heightFromTexture - currentLayerHeight;
+	const float prevH = depth.Sample(ray.u + ray.du * previousLayer, ray.v + ray.dv * previousLayer) - previousLayer;
+	++fetches;
+
+	const float weight = nextH != prevH ? nextH / (nextH - prevH) : 0.0f;
+	const float hit = previousLayer * weight + currentLayerHeight * (1.0f - weight);
+
+	result.depth = hit;
+	result.u = ray.u + ray.du * hit;
+	result.v = ray.v + ray.dv * hit;
+	result.fetches = fetches;
+	return result;
+}
+
+ParallaxSceneBenchmark ParallaxQuality::BenchmarkScene(const DepthField& depth, const ParallaxQualitySettings& settings, int width, int height)
+{
+	const float TILE_SIZE = 2.0f;			// world units per repeat of the texture
+	const float pitch = 20.0f * PI / 180.0f;
+	const float fovY = 60.0f * PI / 180.0f;
+
+	SceneCamera camera;
+	camera.eyeHeight = 1.7f;
+	camera.forwardY = -std::sin(pitch);
+	camera.forwardZ = std::cos(pitch);
+	camera.upY = std::cos(pitch);
+	camera.upZ = std::sin(pitch);
+	camera.tanHalfY = std::tan(fovY * 0.5f);
+	camera.tanHalfX = camera.tanHalfY * width / height;
+	camera.width = width;
+	camera.height = height;
+
+	const float texelsX = (float)depth.GetWidth();
+	const float texelsY = (float)depth.GetHeight();
+
+	ParallaxSceneBenchmark benchmark;
+	double layerTotal = 0.0;
+	double fetchTotal = 0.0;
+	double errorTotal = 0.0;
+	double fixedFetchTotal = 0.0;
+	double fixedErrorTotal = 0.0;
+	int marching = 0;
+	int fadedOut = 0;
+	std::mutex mutex;
+
+	JobSystem::Get().ParallelFor(height, 4, [&](int begin, int end)
+	{
+		double layers = 0.0, fetches = 0.0, errors = 0.0, fixedFetches = 0.0, fixedErrors = 0.0;
+		int pixels = 0, rowMarching = 0, rowFaded = 0;
+
+		for (int py = begin; py < end; ++py)
+		{
+			for (int px = 0; px < width; ++px)
+			{
+				float x, z, distance, x1, z1, x2, z2, unused;
+				if (!camera.Hit(px + 0.5f, py + 0.5f, x, z, distance))
+					continue;
+				++pixels;
+
+				// Mip level from the screen-space footprint, as CalculateLevelOfDetail would pick it
+				float lod = 0.0f;
+				if (camera.Hit(px + 1.5f, py + 0.5f, x1, z1, unused) && camera.Hit(px + 0.5f, py - 0.5f, x2, z2, unused))
+				{
+					const float ax = (x1 - x) * texelsX / TILE_SIZE, az = (z1 - z) * texelsY / TILE_SIZE;
+					const float bx = (x2 - x) * texelsX / TILE_SIZE, bz = (z2 - z) * texelsY / TILE_SIZE;
+					const float footprint = std::max(ax * ax + az * az, bx * bx + bz * bz);
+					lod = 0.5f * std::log2(std::max(footprint, 1e-8f));
+				}
+
+				// Tangent space: +u along world x, +v along world z, the normal up
+				const float ex = -x, ey = camera.eyeHeight, ez = -z;
+				const float length = std::sqrt(ex * ex + ey * ey + ez * ez);
+				const float u = x / TILE_SIZE + 0.5f;
+				const float v = z / TILE_SIZE;
+
+				const float fade = DistanceFade(settings, distance);
+				const ParallaxRay ray = ParallaxReference::MakeRay(u, v, ex / length, ez / length, ey / length, ParallaxReference::HEIGHT_SCALE * fade);
+				if (fade > 0.0f)
+				{
+					const float tx = ray.du * texelsX, ty = ray.dv * texelsY;
+					layers += LayerCount(settings, std::sqrt(tx * tx + ty * ty), lod);
+					++rowMarching;
+				}
+				else
+				{
+					++rowFaded;
+				}
+
+				const ParallaxTraceResult traced = TraceAdaptive(depth, settings, ray, lod);
+				const ParallaxTraceResult exact = fade > 0.0f ? ParallaxReference::TraceExact(depth, ray) : traced;
+				// Errors in texels of the mip the pixel samples, which is what shows on screen
+				const float mipScale = std::exp2(-std::max(lod, 0.0f));
+				fetches += traced.fetches;
+				errors += mipScale * std::hypot((traced.u - exact.u) * texelsX, (traced.v - exact.v) * texelsY);
+
+				const ParallaxRay fixedRay = ParallaxReference::MakeRay(u, v, ex / length, ez / length, ey / length);
+				const ParallaxTraceResult fixed = ParallaxReference::TraceLinear(depth, fixedRay);
+				const ParallaxTraceResult fixedExact = ParallaxReference::TraceExact(depth, fixedRay);
+				fixedFetches += fixed.fetches;
+				fixedErrors += mipScale * std::hypot((fixed.u - fixedExact.u) * texelsX, (fixed.v - fixedExact.v) * texelsY);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		benchmark.pixels += pixels;
+		marching += rowMarching;
+		fadedOut += rowFaded;
+		layerTotal += layers;
+		fetchTotal += fetches;
+		errorTotal += errors;
+		fixedFetchTotal += fixedFetches;
+		fixedErrorTotal += fixedErrors;
+	});
+
+	if (benchmark.pixels == 0)
+		return benchmark;
+
+	benchmark.fadedOut = (float)fadedOut / benchmark.pixels;
+	benchmark.averageLayers = marching > 0 ? (float)(layerTotal / marching) : 0.0f;
+	benchmark.averageFetches = (float)(fetchTotal / benchmark.pixels);
+	benchmark.averageError = (float)(errorTotal / benchmark.pixels);
+	benchmark.fixedAverageFetches = (float)(fixedFetchTotal / benchmark.pixels);
+	benchmark.fixedAverageError = (float)(fixedErrorTotal / benchmark.pixels);
+	return benchmark;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ParallaxReference.h"
+
+// Global parallax quality, fed to the shader through ParallaxPropertiesConstantBuffer
+struct ParallaxQualitySettings
+{
+	float			qualityScale = 2.0f;	// layers per texel the ray crosses at the sampled mip
+	float			minLayers = 4.0f;
+	float			maxLayers = 32.0f;
+	float			fadeStart = 15.0f;		// world distance where the relief starts to flatten
+	float			fadeEnd = 25.0f;		// beyond this, plain normal mapping
+};
+
+struct ParallaxSceneBenchmark
+{
+	int				pixels = 0;				// pixels covering the ground
+	float			fadedOut = 0.0f;		// fraction past fadeEnd, taking no parallax fetches
+	float			averageLayers = 0.0f;	// over the pixels still marching
+	float			averageFetches = 0.0f;
+	float			averageError = 0.0f;	// from the exact intersection, in texels of the sampled mip
+	float			fixedAverageFetches = 0.0f;	// the same pixels with the fixed 5 to 20 layers
+	float			fixedAverageError = 0.0f;
+};
+
+// Adaptive layer counts for the layered parallax modes. A layer per texel crossed is enough not
+// to step over features, so the count follows the ray's length in texels at the mip the pixel
+// actually samples: fewer layers in the distance and looking straight on, more up close at
+// grazing angles. With distance the relief flattens out entirely, after which a pixel costs
+// what plain normal mapping does.
+namespace ParallaxQuality
+{
+	// Mirror ParallaxLayerCount and ParallaxFade in shader.fx
+	float LayerCount(const ParallaxQualitySettings& settings, float texels, float lod);
+	float DistanceFade(const ParallaxQualitySettings& settings, float distance);
+
+	// ParallaxOcclusionMapping with the adaptive layer count; the ray carries the faded scale
+	ParallaxTraceResult TraceAdaptive(const DepthField& depth, const ParallaxQualitySettings& settings, const ParallaxRay& ray, float lod);
+
+	// A width x height view over a ground plane tiled with the texture every two units, seen
+	// from eye height and pitched 20 degrees down, each pixel traced as the shader would
+	ParallaxSceneBenchmark BenchmarkScene(const DepthField& depth, const ParallaxQualitySettings& settings, int width = 320, int height = 180);
+}
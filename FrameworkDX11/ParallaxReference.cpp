@@ -0,0 +1,233 @@
+#include "ParallaxReference.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace
+{
+	inline int Wrap(int i, int size)
+	{
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+
+	const float PI = 3.14159265358979f;
+}
+
+DepthField::DepthField()
+	: m_width(0), m_height(0)
+{
+}
+
+void DepthField::Load(const Image& image, int channel)
+{
+	Resize(image.GetWidth(), image.GetHeight());
+	for (int y = 0; y < m_height; ++y)
+	{
+		const uint8_t* row = image.GetRow(y);
+		float* out = GetRow(y);
+		for (int x = 0; x < m_width; ++x)
+			out[x] = row[x * 4 + channel] * (1.0f / 255.0f);
+	}
+}
+
+void DepthField::Resize(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_values.assign((size_t)width * height, 0.0f);
+}
+
+float DepthField::At(int x, int y) const
+{
+	return m_values[(size_t)Wrap(y, m_height) * m_width + Wrap(x, m_width)];
+}
+
+float DepthField::Sample(float u, float v) const
+{
+	const float x = u * m_width - 0.5f;
+	const float y = v * m_height - 0.5f;
+	const float fx = std::floor(x);
+	const float fy = std::floor(y);
+	const int x0 = (int)fx;
+	const int y0 = (int)fy;
+	const float tx = x - fx;
+	const float ty = y - fy;
+
+	const float top = At(x0, y0) + (At(x0 + 1, y0) - At(x0, y0)) * tx;
+	const float bottom = At(x0, y0 + 1) + (At(x0 + 1, y0 + 1) - At(x0, y0 + 1)) * tx;
+	return top + (bottom - top) * ty;
+}
+
+ParallaxRay ParallaxReference::MakeRay(float u, float v, float viewX, float viewY, float viewZ, float heightScale)
+{
+	ParallaxRay ray;
+	ray.u = u;
+	ray.v = v;
+	ray.du = -heightScale * viewX;
+	ray.dv = -heightScale * viewY;
+	ray.viewZ = viewZ;
+	return ray;
+}
+
+ParallaxTraceResult ParallaxReference::TraceExact(const DepthField& depth, const ParallaxRay& ray)
+{
+	// Quarter-texel steps along the ray's footprint are fine enough not to step over a feature
+	const float texels = std::sqrt(ray.du * ray.du + ray.dv * ray.dv) * std::max(depth.GetWidth(), depth.GetHeight());
+	const int steps = std::max((int)(texels * 4.0f), 256);
+	const float stepDepth = 1.0f / steps;
+
+	float previous = 0.0f;
+	float current = 0.0f;
+	int fetches = 1;
+	for (int i = 0; i <= steps; ++i, ++fetches)
+	{
+		current = i * stepDepth;
+		if (depth.Sample(ray.u + ray.du * current, ray.v + ray.dv * current) <= current)
+			break;
+		previous = current;
+	}
+
+	for (int i = 0; i < 16; ++i, ++fetches)
+	{
+		const float middle = (previous + current) * 0.5f;
+		if (depth.Sample(ray.u + ray.du * middle, ray.v + ray.dv * middle) <= middle)
+			current = middle;
+		else
+			previous = middle;
+	}
+
+	ParallaxTraceResult result;
+	result.depth = current;
+	result.u = ray.u + ray.du * current;
+	result.v = ray.v + ray.dv * current;
+	result.fetches = fetches;
+	return result;
+}
+
+ParallaxTraceResult ParallaxReference::TraceLinear(const DepthField& depth, const ParallaxRay& ray)
+{
+	const float minLayers = 5.0f;
+	const float maxLayers = 20.0f;
+	const float numLayers = maxLayers + (minLayers - maxLayers) * std::fabs(ray.viewZ);
+	const float layerHeight = 1.0f / numLayers;
+
+	float currentLayerHeight = 0.0f;
+	float heightFromTexture = depth.Sample(ray.u, ray.v);
+	int fetches = 1;
+	while (heightFromTexture > currentLayerHeight)
+	{
+		currentLayerHeight += layerHeight;
+		heightFromTexture = depth.Sample(ray.u + ray.du * currentLayerHeight, ray.v + ray.dv * currentLayerHeight);
+		++fetches;
+	}
+
+	// Interpolate between the layers either side of the crossing
+	const float previousLayer = std::max(currentLayerHeight - layerHeight, 0.0f);
+	const float nextH = heightFromTexture - currentLayerHeight;
+	const float prevH = depth.Sample(ray.u + ray.du * previousLayer, ray.v + ray.dv * previousLayer) - previousLayer;
+	++fetches;
+
+	const float weight = nextH != prevH ? nextH / (nextH - prevH) : 0.0f;
+	const float hit = previousLayer * weight + currentLayerHeight * (1.0f - weight);
+
+	ParallaxTraceResult result;
+	result.depth = hit;
+	result.u = ray.u + ray.du * hit;
+	result.v = ray.v + ray.dv * hit;
+	result.fetches = fetches;
+	return result;
+}
+
+ParallaxBenchmark ParallaxReference::Benchmark(const DepthField& depth, const ParallaxTracer& tracer, int gridSize)
+{
+	const int AZIMUTHS = 8;
+	const int ELEVATIONS = 5;
+	const int directions = AZIMUTHS * ELEVATIONS;
+
+	float viewX[directions];
+	float viewY[directions];
+	float viewZ[directions];
+	for (int e = 0; e < ELEVATIONS; ++e)
+	{
+		const float elevation = (15.0f + 15.0f * e) * PI / 180.0f;
+		for (int a = 0; a < AZIMUTHS; ++a)
+		{
+			const float azimuth = (a + 0.5f) * 2.0f * PI / AZIMUTHS;
+			viewX[e * AZIMUTHS + a] = std::cos(elevation) * std::cos(azimuth);
+			viewY[e * AZIMUTHS + a] = std::cos(elevation) * std::sin(azimuth);
+			viewZ[e * AZIMUTHS + a] = std::sin(elevation);
+		}
+	}
+
+	ParallaxBenchmark benchmark;
+	double fetchTotal = 0.0;
+	double errorTotal = 0.0;
+	int convergedTotal = 0;
+	std::mutex mutex;
+	const float texelsX = (float)depth.GetWidth();
+	const float texelsY = (float)depth.GetHeight();
+
+	JobSystem::Get().ParallelFor(gridSize, 1, [&](int begin, int end)
+	{
+		double fetches = 0.0;
+		double errors = 0.0;
+		int maxFetches = 0;
+		float maxError = 0.0f;
+		int converged = 0;
+
+		for (int y = begin; y < end; ++y)
+		{
+			for (int x = 0; x < gridSize; ++x)
+			{
+				for (int d = 0; d < directions; ++d)
+				{
+					const ParallaxRay ray = MakeRay((x + 0.5f) / gridSize, (y + 0.5f) / gridSize, viewX[d], viewY[d], viewZ[d]);
+					const ParallaxTraceResult exact = TraceExact(depth, ray);
+					const ParallaxTraceResult traced = tracer(ray);
+
+					const float ex = (traced.u - exact.u) * texelsX;
+					const float ey = (traced.v - exact.v) * texelsY;
+					const float error = std::sqrt(ex * ex + ey * ey);
+
+					fetches += traced.fetches;
+					errors += error;
+					maxFetches = std::max(maxFetches, traced.fetches);
+					maxError = std::max(maxError, error);
+					converged += error <= 1.0f;
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		fetchTotal += fetches;
+		errorTotal += errors;
+		convergedTotal += converged;
+		benchmark.maxFetches = std::max(benchmark.maxFetches, maxFetches);
+		benchmark.maxError = std::max(benchmark.maxError, maxError);
+	});
+
+	benchmark.rays = gridSize * gridSize * directions;
+	benchmark.averageFetches = (float)(fetchTotal / benchmark.rays);
+	benchmark.averageError = (float)(errorTotal / benchmark.rays);
+	benchmark.converged = (float)convergedTotal / benchmark.rays;
+	return benchmark;
+}
+
+void ParallaxReference::StepCounts(const ParallaxTracer& tracer, float viewX, float viewY, float viewZ, int size, std::vector<int>& counts)
+{
+	counts.assign((size_t)size * size, 0);
+	JobSystem::Get().ParallelFor(size, 4, [&](int begin, int end)
+	{
+		for (int y = begin; y < end; ++y)
+		{
+			for (int x = 0; x < size; ++x)
+			{
+				const ParallaxRay ray = MakeRay((x + 0.5f) / size, (y + 0.5f) / size, viewX, viewY, viewZ);
+				counts[(size_t)y * size + x] = tracer(ray).fetches;
+			}
+		}
+	});
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "Image.h"
+
+// One channel of a displacement texture as floats in [0, 1], sampled like samLinear in the
+// shader: bilinear between texel centres, wrapping at the edges. The parallax modes read the
+// value as depth below the surface, so 0 is the top and 1 the bottom.
+class DepthField
+{
+public:
+	DepthField();
+
+	void Load(const Image& image, int channel = 0);
+	void Resize(int width, int height);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	float* GetRow(int y) { return m_values.data() + (size_t)y * m_width; }
+	const float* GetRow(int y) const { return m_values.data() + (size_t)y * m_width; }
+
+	float At(int x, int y) const;
+	float Sample(float u, float v) const;
+
+private:
+	int						m_width;
+	int						m_height;
+	std::vector<float>		m_values;
+};
+
+// A view ray through the displacement volume: texture coordinates where it enters the top and
+// how far they move per unit of depth, as the shader's ParallaxOcclusionMapping sets it up.
+struct ParallaxRay
+{
+	float			u;
+	float			v;
+	float			du;
+	float			dv;
+	float			viewZ;		// tangent-space view direction z, used for the layer count
+};
+
+struct ParallaxTraceResult
+{
+	float			u;
+	float			v;
+	float			depth;
+	int				fetches;	// texture samples the shader would take
+};
+
+struct ParallaxBenchmark
+{
+	int				rays = 0;
+	float			averageFetches = 0.0f;
+	int				maxFetches = 0;
+	float			averageError = 0.0f;	// texels from the exact intersection
+	float			maxError = 0.0f;
+	float			converged = 0.0f;		// fraction of rays within one texel of it
+};
+
+typedef std::function<ParallaxTraceResult(const ParallaxRay& ray)> ParallaxTracer;
+
+// CPU mirrors of the shader's parallax traversals, so the cost and accuracy of each mode can be
+// measured without a GPU. Fetch counts follow the shader loops sample for sample.
+namespace ParallaxReference
+{
+	const float HEIGHT_SCALE = 0.2f;		// ParallaxOcclusionMapping's height_scale
+
+	// viewDirection is the tangent-space direction from the surface to the eye
+	ParallaxRay MakeRay(float u, float v, float viewX, float viewY, float viewZ, float heightScale = HEIGHT_SCALE);
+
+	// Fine march plus bisection; the ground truth the other traversals are scored against
+	ParallaxTraceResult TraceExact(const DepthField& depth, const ParallaxRay& ray);
+
+	// ParallaxOcclusionMapping: 5 to 20 layers by view angle, then a linear fit between the last two
+	ParallaxTraceResult TraceLinear(const DepthField& depth, const ParallaxRay& ray);
+
+	// Traces a grid of texture coordinates from a fan of view directions (8 azimuths, elevations
+	// from 15 to 75 degrees) on the job system and scores the tracer against TraceExact.
+	ParallaxBenchmark Benchmark(const DepthField& depth, const ParallaxTracer& tracer, int gridSize = 64);
+
+	// Per-pixel fetch counts over a size x size grid of texture coordinates seen from one
+	// direction, row by row; a headless stand-in for a step count heat map
+	void StepCounts(const ParallaxTracer& tracer, float viewX, float viewY, float viewZ, int size, std::vector<int>& counts);
+}
@@ -0,0 +1,199 @@
+#include "Scatter.h"
+#include "TerrainGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	inline float HashToUnit(uint32_t value)
+	{
+		return (HashUInt(value) >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+void ScatterGenerator::Init(const Heightfield& heightfield, const ScatterSettings& settings)
+{
+	m_heightfield = &heightfield;
+	m_settings = settings;
+	m_settings.patternTiles = std::max(m_settings.patternTiles, 1);
+	m_settings.minDistance = std::max(m_settings.minDistance, m_settings.tileSize * 1e-3f);
+
+	const float extentX = (heightfield.GetWidth() - 1) * heightfield.GetCellSize();
+	const float extentZ = (heightfield.GetHeight() - 1) * heightfield.GetCellSize();
+	m_tilesX = (int)std::ceil(extentX / m_settings.tileSize);
+	m_tilesZ = (int)std::ceil(extentZ / m_settings.tileSize);
+
+	GeneratePattern();
+}
+
+void ScatterGenerator::GeneratePattern()
+{
+	const float period = m_settings.tileSize * m_settings.patternTiles;
+	const float radius = m_settings.minDistance;
+	const int gridSize = std::max((int)(period / (radius / std::sqrt(2.0f))), 1);
+	const float cellSize = period / gridSize;
+
+	// Bridson with wrap-around distances; each grid cell holds at most one point
+	std::vector<int> grid((size_t)gridSize * gridSize, -1);
+	std::vector<XMFLOAT2> points;
+	std::vector<int> active;
+	RandomStream random(m_settings.seed);
+
+	auto wrap = [period](float v) { v = std::fmod(v, period); return v < 0.0f ? v + period : v; };
+	auto cellOf = [&](float v) { return std::min((int)(v / cellSize), gridSize - 1); };
+	auto insert = [&](const XMFLOAT2& p)
+	{
+		grid[(size_t)cellOf(p.y) * gridSize + cellOf(p.x)] = (int)points.size();
+		active.push_back((int)points.size());
+		points.push_back(p);
+	};
+
+	insert(XMFLOAT2(random.NextFloat() * period, random.NextFloat() * period));
+	while (!active.empty())
+	{
+		size_t slot = random.NextUInt() % active.size();
+		const XMFLOAT2 centre = points[active[slot]];
+
+		bool placed = false;
+		for (int attempt = 0; attempt < m_settings.attempts && !placed; ++attempt)
+		{
+			float angle = random.NextFloat() * 2.0f * PI;
+			float distance = radius * (1.0f + random.NextFloat());
+			XMFLOAT2 candidate(wrap(centre.x + std::cos(angle) * distance), wrap(centre.y + std::sin(angle) * distance));
+
+			int cx = cellOf(candidate.x);
+			int cz = cellOf(candidate.y);
+			bool clear = true;
+			for (int dz = -2; dz <= 2 && clear; ++dz)
+			{
+				for (int dx = -2; dx <= 2 && clear; ++dx)
+				{
+					int neighbour = grid[(size_t)((cz + dz + gridSize) % gridSize) * gridSize + (cx + dx + gridSize) % gridSize];
+					if (neighbour < 0)
+						continue;
+
+					float ox = std::fabs(points[neighbour].x - candidate.x);
+					float oz = std::fabs(points[neighbour].y - candidate.y);
+					ox = std::min(ox, period - ox);
+					oz = std::min(oz, period - oz);
+					clear = ox * ox + oz * oz >= radius * radius;
+				}
+			}
+
+			if (clear)
+			{
+				insert(candidate);
+				placed = true;
+			}
+		}
+
+		if (!placed)
+		{
+			active[slot] = active.back();
+			active.pop_back();
+		}
+	}
+
+	// Bucket by pattern tile so BuildTile touches only its own points
+	const int tiles = m_settings.patternTiles;
+	const float invTile = 1.0f / m_settings.tileSize;
+	auto tileOf = [&](const XMFLOAT2& p) { return std::min((int)(p.y * invTile), tiles - 1) * tiles + std::min((int)(p.x * invTile), tiles - 1); };
+
+	m_patternTileStart.assign((size_t)tiles * tiles + 1, 0);
+	for (const XMFLOAT2& p : points)
+		++m_patternTileStart[tileOf(p) + 1];
+	for (size_t i = 1; i < m_patternTileStart.size(); ++i)
+		m_patternTileStart[i] += m_patternTileStart[i - 1];
+
+	m_pattern.resize(points.size());
+	std::vector<uint32_t> cursor(m_patternTileStart.begin(), m_patternTileStart.end() - 1);
+	for (const XMFLOAT2& p : points)
+		m_pattern[cursor[tileOf(p)]++] = p;
+}
+
+void ScatterGenerator::BuildTile(int tileX, int tileZ, ScatterTile& tile) const
+{
+	const Heightfield& heightfield = *m_heightfield;
+	const float cellSize = heightfield.GetCellSize();
+	const float invCell = 1.0f / cellSize;
+	const float maxX = (heightfield.GetWidth() - 1) * cellSize;
+	const float maxZ = (heightfield.GetHeight() - 1) * cellSize;
+	const float tileSize = m_settings.tileSize;
+
+	tile.m_tileX = tileX;
+	tile.m_tileZ = tileZ;
+	tile.m_originX = tileX * tileSize;
+	tile.m_originZ = tileZ * tileSize;
+	tile.m_instances.clear();
+	tile.m_minHeight = 1e30f;
+	tile.m_maxHeight = -1e30f;
+
+	const int tiles = m_settings.patternTiles;
+	const int patternTile = (tileZ % tiles) * tiles + (tileX % tiles);
+	const float patternOriginX = (tileX % tiles) * tileSize;
+	const float patternOriginZ = (tileZ % tiles) * tileSize;
+	const uint32_t tileSeed = HashUInt(m_settings.seed ^ HashUInt((uint32_t)tileX * 73856093u ^ (uint32_t)tileZ * 19349663u));
+
+	std::vector<ScatterInstance> accepted;
+	for (uint32_t i = m_patternTileStart[patternTile]; i < m_patternTileStart[patternTile + 1]; ++i)
+	{
+		float x = tile.m_originX + m_pattern[i].x - patternOriginX;
+		float z = tile.m_originZ + m_pattern[i].y - patternOriginZ;
+		if (x < 0.0f || z < 0.0f || x > maxX || z > maxZ)
+			continue;
+
+		float gx = x * invCell;
+		float gz = z * invCell;
+		float height = heightfield.SampleBilinear(gx, gz);
+		if (height < m_settings.minHeight || height > m_settings.maxHeight)
+			continue;
+
+		float slopeX = (heightfield.SampleBilinear(gx + 1.0f, gz) - heightfield.SampleBilinear(gx - 1.0f, gz)) * 0.5f * invCell;
+		float slopeZ = (heightfield.SampleBilinear(gx, gz + 1.0f) - heightfield.SampleBilinear(gx, gz - 1.0f)) * 0.5f * invCell;
+		float steepness = 1.0f - 1.0f / std::sqrt(1.0f + slopeX * slopeX + slopeZ * slopeZ);
+		if (steepness > m_settings.maxSteepness)
+			continue;
+
+		// The mask is a density: keep the point with probability mask / 255
+		uint32_t pointSeed = tileSeed ^ HashUInt(i);
+		if (m_settings.mask)
+		{
+			int sx = std::min((int)(gx + 0.5f), heightfield.GetWidth() - 1);
+			int sz = std::min((int)(gz + 0.5f), heightfield.GetHeight() - 1);
+			uint8_t density = m_settings.mask[((size_t)sz * heightfield.GetWidth() + sx) * 4 + m_settings.maskChannel];
+			if (HashToUnit(pointSeed) * 255.0f >= density)
+				continue;
+		}
+
+		ScatterInstance instance;
+		instance.position = XMFLOAT3(x, height, z);
+		instance.scale = m_settings.minScale + (m_settings.maxScale - m_settings.minScale) * HashToUnit(pointSeed + 1);
+		instance.rotation = HashToUnit(pointSeed + 2) * 2.0f * PI;
+		accepted.push_back(instance);
+
+		tile.m_minHeight = std::min(tile.m_minHeight, height);
+		tile.m_maxHeight = std::max(tile.m_maxHeight, height + instance.scale);
+	}
+
+	// Counting sort into the query grid
+	tile.m_gridSize = std::max(1, std::min(16, (int)(tileSize / (m_settings.minDistance * 2.0f))));
+	tile.m_invCellSize = tile.m_gridSize / tileSize;
+	tile.m_cellStart.assign((size_t)tile.m_gridSize * tile.m_gridSize + 1, 0);
+
+	std::vector<int> cells(accepted.size());
+	for (size_t i = 0; i < accepted.size(); ++i)
+	{
+		cells[i] = tile.CellCoord(accepted[i].position.z - tile.m_originZ) * tile.m_gridSize + tile.CellCoord(accepted[i].position.x - tile.m_originX);
+		++tile.m_cellStart[cells[i] + 1];
+	}
+	for (size_t i = 1; i < tile.m_cellStart.size(); ++i)
+		tile.m_cellStart[i] += tile.m_cellStart[i - 1];
+
+	tile.m_instances.resize(accepted.size());
+	std::vector<uint32_t> cursor(tile.m_cellStart.begin(), tile.m_cellStart.end() - 1);
+	for (size_t i = 0; i < accepted.size(); ++i)
+		tile.m_instances[cursor[cells[i]]++] = accepted[i];
+}
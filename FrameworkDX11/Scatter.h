@@ -0,0 +1,119 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "Heightfield.h"
+
+using namespace DirectX;
+
+struct ScatterSettings
+{
+	uint32_t		seed = 7;
+	float			minDistance = 1.0f;			// world units between any two instances
+	float			tileSize = 16.0f;			// world units; instances are generated and stored per tile
+	int				patternTiles = 4;			// the blue-noise pattern repeats every this many tiles
+	int				attempts = 30;				// candidates tried around each active point
+	float			minHeight = -1e9f;			// heightfield units
+	float			maxHeight = 1e9f;
+	float			maxSteepness = 0.3f;		// 1 - normal.y
+	float			minScale = 0.15f;
+	float			maxScale = 0.4f;
+	const uint8_t*	mask = nullptr;				// optional RGBA8 plane, one texel per heightfield sample
+	int				maskChannel = 0;
+};
+
+// Matches the per-instance input layout of VSInstanced
+struct ScatterInstance
+{
+	XMFLOAT3		position;					// heightfield-local
+	float			scale;
+	float			rotation;					// radians about y
+};
+
+// The instances of one tile, bucketed into a uniform grid (counting sort) for radius queries.
+class ScatterTile
+{
+public:
+	int GetTileX() const { return m_tileX; }
+	int GetTileZ() const { return m_tileZ; }
+	const std::vector<ScatterInstance>& GetInstances() const { return m_instances; }
+	void GetHeightRange(float& minHeight, float& maxHeight) const { minHeight = m_minHeight; maxHeight = m_maxHeight; }
+
+	template<class Fn>
+	void ForEachInRadius(float x, float z, float radius, Fn fn) const
+	{
+		if (m_instances.empty())
+			return;
+
+		int cx0 = CellCoord(x - radius - m_originX);
+		int cz0 = CellCoord(z - radius - m_originZ);
+		int cx1 = CellCoord(x + radius - m_originX);
+		int cz1 = CellCoord(z + radius - m_originZ);
+		for (int cz = cz0; cz <= cz1; ++cz)
+		{
+			for (int cx = cx0; cx <= cx1; ++cx)
+			{
+				int cell = cz * m_gridSize + cx;
+				for (uint32_t i = m_cellStart[cell]; i < m_cellStart[cell + 1]; ++i)
+				{
+					const ScatterInstance& instance = m_instances[i];
+					float dx = instance.position.x - x;
+					float dz = instance.position.z - z;
+					if (dx * dx + dz * dz <= radius * radius)
+						fn(instance);
+				}
+			}
+		}
+	}
+
+private:
+	friend class ScatterGenerator;
+
+	int CellCoord(float offset) const
+	{
+		int cell = (int)(offset * m_invCellSize);
+		return cell < 0 ? 0 : (cell >= m_gridSize ? m_gridSize - 1 : cell);
+	}
+
+	int								m_tileX = 0;
+	int								m_tileZ = 0;
+	float							m_originX = 0.0f;
+	float							m_originZ = 0.0f;
+	float							m_invCellSize = 1.0f;
+	int								m_gridSize = 1;
+	float							m_minHeight = 0.0f;
+	float							m_maxHeight = 0.0f;
+	std::vector<ScatterInstance>	m_instances;
+	std::vector<uint32_t>			m_cellStart;
+};
+
+// Poisson-disk scatter over a Heightfield.
+//
+// A single blue-noise pattern is generated with Bridson's algorithm on a torus spanning
+// patternTiles x patternTiles tiles. Distances wrap, so the pattern tiles seamlessly and every
+// terrain tile can be built on its own, in any order and on any thread: BuildTile only reads
+// the pattern and the heightfield. Masks thin the pattern out but never bring points closer.
+class ScatterGenerator
+{
+public:
+	void Init(const Heightfield& heightfield, const ScatterSettings& settings);
+
+	const ScatterSettings& GetSettings() const { return m_settings; }
+	int GetTilesX() const { return m_tilesX; }
+	int GetTilesZ() const { return m_tilesZ; }
+	size_t GetPatternSize() const { return m_pattern.size(); }
+
+	void BuildTile(int tileX, int tileZ, ScatterTile& tile) const;
+
+private:
+	void GeneratePattern();
+
+	const Heightfield*				m_heightfield = nullptr;
+	ScatterSettings					m_settings;
+	int								m_tilesX = 0;
+	int								m_tilesZ = 0;
+	std::vector<XMFLOAT2>			m_pattern;			// sorted by pattern tile
+	std::vector<uint32_t>			m_patternTileStart;
+};
@@ -0,0 +1,301 @@
+#include "ScatterRenderer.h"
+#include "DrawableGameObject.h"
+#include "JobSystem.h"
+#include "Terrain.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace DirectX;
+
+ScatterRenderer::ScatterRenderer()
+{
+}
+
+ScatterRenderer::~ScatterRenderer()
+{
+	Cleanup();
+}
+
+void ScatterRenderer::Cleanup()
+{
+	WaitIdle();
+	for (auto& entry : m_tiles)
+		ReleaseTile(entry.second);
+	m_tiles.clear();
+	m_completed.clear();
+	m_residentInstances = 0;
+
+	if (m_pVertexBuffer)
+		m_pVertexBuffer->Release();
+	m_pVertexBuffer = nullptr;
+
+	if (m_pIndexBuffer)
+		m_pIndexBuffer->Release();
+	m_pIndexBuffer = nullptr;
+
+	if (m_pMaterialConstantBuffer)
+		m_pMaterialConstantBuffer->Release();
+	m_pMaterialConstantBuffer = nullptr;
+
+	m_texture.Reset();
+	m_normalTexture.Reset();
+
+	if (m_pSamplerLinear)
+		m_pSamplerLinear->Release();
+	m_pSamplerLinear = nullptr;
+}
+
+HRESULT ScatterRenderer::Init(ID3D11Device* pd3dDevice, const Terrain& terrain, TextureCache& textures, const ScatterSettings& settings)
+{
+	m_generator.Init(terrain.GetHeightfield(), settings);
+
+	HRESULT hr = CreateMesh(pd3dDevice);
+	if (FAILED(hr))
+		return hr;
+
+	// The terrain's rock textures, shared through the cache
+	m_texture = textures.Acquire(L"Resources\\Rock Textures\\rock_diffuse2.dds", TexturePlaceholder::White);
+	m_normalTexture = textures.Acquire(L"Resources\\Rock Textures\\rock_bump.dds", TexturePlaceholder::FlatNormal);
+
+	D3D11_SAMPLER_DESC sampDesc;
+	ZeroMemory(&sampDesc, sizeof(sampDesc));
+	sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	sampDesc.MinLOD = 0;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	hr = pd3dDevice->CreateSamplerState(&sampDesc, &m_pSamplerLinear);
+	if (FAILED(hr))
+		return hr;
+
+	m_material.Material.Diffuse = XMFLOAT4(0.8f, 0.8f, 0.8f, 1.0f);
+	m_material.Material.Specular = XMFLOAT4(0.1f, 0.1f, 0.1f, 1.0f);
+	m_material.Material.SpecularPower = 8.0f;
+	m_material.Material.UseTexture = true;
+	m_material.Material.choice = 0;
+
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(MaterialPropertiesConstantBuffer);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = 0;
+	return pd3dDevice->CreateBuffer(&bd, nullptr, &m_pMaterialConstantBuffer);
+}
+
+HRESULT ScatterRenderer::CreateMesh(ID3D11Device* pd3dDevice)
+{
+	// A squashed octahedron sunk halfway into the ground reads as a rock; faces are flat shaded
+	const XMFLOAT3 corners[6] =
+	{
+		XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f),
+		XMFLOAT3(0.0f, 0.0f, -1.0f), XMFLOAT3(0.0f, 0.7f, 0.0f), XMFLOAT3(0.0f, -0.7f, 0.0f),
+	};
+	const int faces[8][3] =
+	{
+		{ 4, 1, 0 }, { 4, 2, 1 }, { 4, 3, 2 }, { 4, 0, 3 },
+		{ 5, 0, 1 }, { 5, 1, 2 }, { 5, 2, 3 }, { 5, 3, 0 },
+	};
+	const XMFLOAT2 uvs[3] = { XMFLOAT2(0.5f, 0.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT2(1.0f, 1.0f) };
+
+	vector<SimpleVertex> vertices;
+	vector<WORD> indices;
+	for (const auto& face : faces)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&corners[face[0]]);
+		XMVECTOR p1 = XMLoadFloat3(&corners[face[1]]);
+		XMVECTOR p2 = XMLoadFloat3(&corners[face[2]]);
+		XMVECTOR e1 = p1 - p0;
+		XMVECTOR e2 = p2 - p0;
+		XMVECTOR normal = XMVector3Normalize(XMVector3Cross(e1, e2));
+
+		// Tangent frame from the face's uv gradients
+		float du1 = uvs[1].x - uvs[0].x, dv1 = uvs[1].y - uvs[0].y;
+		float du2 = uvs[2].x - uvs[0].x, dv2 = uvs[2].y - uvs[0].y;
+		float r = 1.0f / (du1 * dv2 - du2 * dv1);
+		XMVECTOR tangent = XMVector3Normalize((e1 * dv2 - e2 * dv1) * r);
+		XMVECTOR binormal = XMVector3Normalize((e2 * du1 - e1 * du2) * r);
+
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			SimpleVertex vertex;
+			vertex.Pos = corners[face[corner]];
+			XMStoreFloat3(&vertex.Normal, normal);
+			vertex.TexCoord = uvs[corner];
+			XMStoreFloat3(&vertex.tangent, tangent);
+			XMStoreFloat3(&vertex.biTangent, binormal);
+			indices.push_back((WORD)vertices.size());
+			vertices.push_back(vertex);
+		}
+	}
+	m_indexCount = (UINT)indices.size();
+
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = (UINT)(sizeof(SimpleVertex) * vertices.size());
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA InitData = {};
+	InitData.pSysMem = vertices.data();
+	HRESULT hr = pd3dDevice->CreateBuffer(&bd, &InitData, &m_pVertexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	bd.ByteWidth = (UINT)(sizeof(WORD) * indices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	InitData.pSysMem = indices.data();
+	return pd3dDevice->CreateBuffer(&bd, &InitData, &m_pIndexBuffer);
+}
+
+void ScatterRenderer::RequestTile(int tileX, int tileZ)
+{
+	const uint64_t key = TileKey(tileX, tileZ);
+	ResidentTile& resident = m_tiles[key];
+	resident.generation = m_nextGeneration++;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		++m_pending;
+	}
+
+	const uint32_t generation = resident.generation;
+	JobSystem::Get().Submit([this, key, tileX, tileZ, generation]()
+	{
+		auto tile = make_shared<ScatterTile>();
+		m_generator.BuildTile(tileX, tileZ, *tile);
+
+		lock_guard<mutex> lock(m_mutex);
+		m_completed.push_back({ key, generation, tile });
+		if (--m_pending == 0)
+			m_idle.notify_all();
+	});
+}
+
+void ScatterRenderer::ReleaseTile(ResidentTile& resident)
+{
+	if (resident.instanceBuffer)
+		resident.instanceBuffer->Release();
+	resident.instanceBuffer = nullptr;
+	if (resident.tile)
+		m_residentInstances -= resident.tile->GetInstances().size();
+	resident.tile.reset();
+}
+
+void ScatterRenderer::Update(ID3D11Device* pd3dDevice, float cameraX, float cameraZ)
+{
+	// Pick up finished tiles, within the per-frame upload budget
+	vector<CompletedTile> completed;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		size_t count = min(m_completed.size(), (size_t)max(m_uploadsPerFrame, 1));
+		completed.assign(m_completed.begin(), m_completed.begin() + count);
+		m_completed.erase(m_completed.begin(), m_completed.begin() + count);
+	}
+
+	for (CompletedTile& done : completed)
+	{
+		auto found = m_tiles.find(done.key);
+		if (found == m_tiles.end() || found->second.generation != done.generation)
+			continue;			// evicted or invalidated while it was being built
+
+		ResidentTile& resident = found->second;
+		ReleaseTile(resident);
+		resident.tile = done.tile;
+		m_residentInstances += done.tile->GetInstances().size();
+
+		const vector<ScatterInstance>& instances = done.tile->GetInstances();
+		if (instances.empty())
+			continue;
+
+		D3D11_BUFFER_DESC bd = {};
+		bd.Usage = D3D11_USAGE_IMMUTABLE;
+		bd.ByteWidth = (UINT)(sizeof(ScatterInstance) * instances.size());
+		bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+		D3D11_SUBRESOURCE_DATA InitData = {};
+		InitData.pSysMem = instances.data();
+		pd3dDevice->CreateBuffer(&bd, &InitData, &resident.instanceBuffer);
+	}
+
+	// Stream tiles in around the camera and drop those well outside the radius
+	const float tileSize = m_generator.GetSettings().tileSize;
+	const float evictRadius = m_streamRadius + tileSize;
+	for (auto it = m_tiles.begin(); it != m_tiles.end();)
+	{
+		float centreX = ((int32_t)(uint32_t)it->first + 0.5f) * tileSize;
+		float centreZ = ((int32_t)(it->first >> 32) + 0.5f) * tileSize;
+		if (fabs(centreX - cameraX) > evictRadius || fabs(centreZ - cameraZ) > evictRadius)
+		{
+			ReleaseTile(it->second);
+			it = m_tiles.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	int x0 = max((int)floor((cameraX - m_streamRadius) / tileSize), 0);
+	int z0 = max((int)floor((cameraZ - m_streamRadius) / tileSize), 0);
+	int x1 = min((int)floor((cameraX + m_streamRadius) / tileSize), m_generator.GetTilesX() - 1);
+	int z1 = min((int)floor((cameraZ + m_streamRadius) / tileSize), m_generator.GetTilesZ() - 1);
+	for (int tz = z0; tz <= z1; ++tz)
+		for (int tx = x0; tx <= x1; ++tx)
+			if (m_tiles.find(TileKey(tx, tz)) == m_tiles.end())
+				RequestTile(tx, tz);
+}
+
+void ScatterRenderer::Invalidate(float minX, float minZ, float maxX, float maxZ)
+{
+	const float tileSize = m_generator.GetSettings().tileSize;
+	int x0 = max((int)floor(minX / tileSize), 0);
+	int z0 = max((int)floor(minZ / tileSize), 0);
+	int x1 = min((int)floor(maxX / tileSize), m_generator.GetTilesX() - 1);
+	int z1 = min((int)floor(maxZ / tileSize), m_generator.GetTilesZ() - 1);
+
+	// Resident tiles keep drawing their old instances until the rebuild arrives
+	for (int tz = z0; tz <= z1; ++tz)
+		for (int tx = x0; tx <= x1; ++tx)
+			if (m_tiles.find(TileKey(tx, tz)) != m_tiles.end())
+				RequestTile(tx, tz);
+}
+
+void ScatterRenderer::WaitIdle()
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_idle.wait(lock, [this]() { return m_pending == 0; });
+}
+
+int ScatterRenderer::GetPendingTileCount()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_pending;
+}
+
+void ScatterRenderer::Draw(ID3D11DeviceContext* pContext)
+{
+	pContext->UpdateSubresource(m_pMaterialConstantBuffer, 0, nullptr, &m_material, 0, 0);
+	pContext->PSSetConstantBuffers(1, 1, &m_pMaterialConstantBuffer);
+	ID3D11ShaderResourceView* textures[2] = { m_texture.Get(), m_normalTexture.Get() };
+	pContext->PSSetShaderResources(0, 2, textures);
+	pContext->PSSetSamplers(0, 1, &m_pSamplerLinear);
+
+	pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	UINT strides[2] = { sizeof(SimpleVertex), sizeof(ScatterInstance) };
+	UINT offsets[2] = { 0, 0 };
+	for (auto& entry : m_tiles)
+	{
+		const ResidentTile& resident = entry.second;
+		if (!resident.instanceBuffer)
+			continue;
+
+		ID3D11Buffer* buffers[2] = { m_pVertexBuffer, resident.instanceBuffer };
+		pContext->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+		pContext->DrawIndexedInstanced(m_indexCount, (UINT)resident.tile->GetInstances().size(), 0, 0, 0);
+	}
+}
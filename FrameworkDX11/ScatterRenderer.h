@@ -0,0 +1,87 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <DirectXMath.h>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Scatter.h"
+#include "TextureCache.h"
+#include "structures.h"
+
+using namespace DirectX;
+
+class Terrain;
+
+// Streams scatter tiles around the camera and draws them instanced.
+//
+// Tiles are built on the job system; the frame only drains finished tiles and creates their
+// instance buffers, at most a few per frame. Draw with VSInstanced and the matching input
+// layout bound, and with the terrain's world transform in the object constant buffer.
+class ScatterRenderer
+{
+public:
+	ScatterRenderer();
+	~ScatterRenderer();
+
+	HRESULT					Init(ID3D11Device* pd3dDevice, const Terrain& terrain, TextureCache& textures, const ScatterSettings& settings);
+	void					Cleanup();
+
+	// cameraX / cameraZ are terrain-local
+	void					Update(ID3D11Device* pd3dDevice, float cameraX, float cameraZ);
+	void					Draw(ID3D11DeviceContext* pContext);
+
+	// Rebuilds tiles overlapping the terrain-local rectangle; call WaitIdle before editing the terrain
+	void					Invalidate(float minX, float minZ, float maxX, float maxZ);
+	void					WaitIdle();
+
+	int						GetResidentTileCount() const { return (int)m_tiles.size(); }
+	size_t					GetResidentInstanceCount() const { return m_residentInstances; }
+	int						GetPendingTileCount();
+
+	float					m_streamRadius = 48.0f;
+	int						m_uploadsPerFrame = 8;
+	MaterialPropertiesConstantBuffer	m_material;
+
+private:
+	struct ResidentTile
+	{
+		std::shared_ptr<ScatterTile>	tile;
+		ID3D11Buffer*					instanceBuffer = nullptr;
+		uint32_t						generation = 0;
+	};
+
+	struct CompletedTile
+	{
+		uint64_t						key;
+		uint32_t						generation;
+		std::shared_ptr<ScatterTile>	tile;
+	};
+
+	static uint64_t			TileKey(int tileX, int tileZ) { return ((uint64_t)(uint32_t)tileZ << 32) | (uint32_t)tileX; }
+	void					RequestTile(int tileX, int tileZ);
+	void					ReleaseTile(ResidentTile& resident);
+	HRESULT					CreateMesh(ID3D11Device* pd3dDevice);
+
+	ScatterGenerator							m_generator;
+	std::unordered_map<uint64_t, ResidentTile>	m_tiles;
+	size_t										m_residentInstances = 0;
+	uint32_t									m_nextGeneration = 1;
+
+	std::mutex									m_mutex;
+	std::condition_variable						m_idle;
+	std::vector<CompletedTile>					m_completed;
+	int											m_pending = 0;
+
+	ID3D11Buffer*								m_pVertexBuffer = nullptr;
+	ID3D11Buffer*								m_pIndexBuffer = nullptr;
+	UINT										m_indexCount = 0;
+	ID3D11Buffer*								m_pMaterialConstantBuffer = nullptr;
+	TextureHandle								m_texture;
+	TextureHandle								m_normalTexture;
+	ID3D11SamplerState*							m_pSamplerLinear = nullptr;
+};
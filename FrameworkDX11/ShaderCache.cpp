@@ -0,0 +1,314 @@
+#include "ShaderCache.h"
+#include "JobSystem.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+
+namespace
+{
+	const uint64_t FNV_OFFSET = 14695981039346656037ull;
+	const uint64_t FNV_PRIME = 1099511628211ull;
+	const int MAX_INCLUDE_DEPTH = 16;
+
+	// FNV-1a; strings are hashed with their length so "ab" + "c" differs from "a" + "bc"
+	uint64_t Hash(uint64_t hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	uint64_t Hash(uint64_t hash, const std::string& text)
+	{
+		const uint64_t length = text.size();
+		hash = Hash(hash, &length, sizeof(length));
+		return Hash(hash, text.data(), text.size());
+	}
+
+	bool ReadFile(const std::string& fileName, std::string& contents)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file)
+			return false;
+		contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	std::string Directory(const std::string& fileName)
+	{
+		size_t slash = fileName.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : fileName.substr(0, slash + 1);
+	}
+
+	// Folds every file reached through #include "..." or #include <...> into the hash, resolved
+	// against the including file's directory as the standard include handler does. An include
+	// that cannot be read only contributes its name; the compile will report it.
+	uint64_t HashIncludes(uint64_t hash, const std::string& fileName, const std::string& source, std::set<std::string>& visited, int depth)
+	{
+		if (depth >= MAX_INCLUDE_DEPTH)
+			return hash;
+
+		size_t position = 0;
+		while ((position = source.find("#include", position)) != std::string::npos)
+		{
+			position += 8;
+			size_t open = source.find_first_of("\"<\n", position);
+			if (open == std::string::npos || source[open] == '\n')
+				continue;
+			size_t close = source.find_first_of(source[open] == '"' ? "\"\n" : ">\n", open + 1);
+			if (close == std::string::npos || source[close] == '\n')
+				continue;
+
+			const std::string path = Directory(fileName) + source.substr(open + 1, close - open - 1);
+			hash = Hash(hash, path);
+			if (!visited.insert(path).second)
+				continue;
+
+			std::string included;
+			if (ReadFile(path, included))
+			{
+				hash = Hash(hash, included);
+				hash = HashIncludes(hash, path, included, visited, depth + 1);
+			}
+		}
+		return hash;
+	}
+
+	uint64_t Checksum(const std::string& identity, uint64_t key, const std::vector<uint8_t>& code)
+	{
+		uint64_t hash = Hash(FNV_OFFSET, identity);
+		hash = Hash(hash, &key, sizeof(key));
+		return Hash(hash, code.data(), code.size());
+	}
+
+	template<typename T>
+	bool Read(const uint8_t*& cursor, const uint8_t* end, T& value)
+	{
+		if ((size_t)(end - cursor) < sizeof(T))
+			return false;
+		memcpy(&value, cursor, sizeof(T));
+		cursor += sizeof(T);
+		return true;
+	}
+
+	template<typename T>
+	void Write(std::vector<uint8_t>& out, const T& value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+}
+
+ShaderCache::ShaderCache(const std::string& cacheFile, const ShaderCompileFunction& compiler, const std::string& compilerTag)
+	: m_cacheFile(cacheFile), m_compiler(compiler), m_compilerTag(compilerTag)
+{
+}
+
+bool ShaderCache::Open()
+{
+	m_entries.clear();
+	m_dirty = false;
+
+	std::string data;
+	if (!ReadFile(m_cacheFile, data))
+		return false;
+
+	const uint8_t* cursor = reinterpret_cast<const uint8_t*>(data.data());
+	const uint8_t* end = cursor + data.size();
+
+	ShaderCacheHeader header;
+	if (!Read(cursor, end, header) || header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION)
+		return false;
+
+	std::vector<Entry> entries;
+	for (uint32_t i = 0; i < header.entryCount; ++i)
+	{
+		Entry entry;
+		uint32_t identityLength = 0;
+		uint32_t codeSize = 0;
+		uint64_t checksum = 0;
+		if (!Read(cursor, end, identityLength) || (size_t)(end - cursor) < identityLength)
+			return false;
+		entry.identity.assign(reinterpret_cast<const char*>(cursor), identityLength);
+		cursor += identityLength;
+
+		if (!Read(cursor, end, entry.key) || !Read(cursor, end, codeSize) || (size_t)(end - cursor) < codeSize)
+			return false;
+		entry.code.assign(cursor, cursor + codeSize);
+		cursor += codeSize;
+
+		// A damaged entry throws the whole file away; it is rebuilt on the next Save
+		if (!Read(cursor, end, checksum) || checksum != Checksum(entry.identity, entry.key, entry.code))
+			return false;
+		entries.push_back(std::move(entry));
+	}
+
+	m_entries.swap(entries);
+	return true;
+}
+
+bool ShaderCache::Save()
+{
+	if (!m_dirty)
+		return true;
+
+	std::vector<uint8_t> out;
+	ShaderCacheHeader header;
+	header.magic = SHADER_CACHE_MAGIC;
+	header.version = SHADER_CACHE_VERSION;
+	header.flags = 0;
+	header.entryCount = (uint32_t)m_entries.size();
+	Write(out, header);
+
+	for (const Entry& entry : m_entries)
+	{
+		Write(out, (uint32_t)entry.identity.size());
+		out.insert(out.end(), entry.identity.begin(), entry.identity.end());
+		Write(out, entry.key);
+		Write(out, (uint32_t)entry.code.size());
+		out.insert(out.end(), entry.code.begin(), entry.code.end());
+		Write(out, Checksum(entry.identity, entry.key, entry.code));
+	}
+
+	// Written aside and renamed over the old cache in one step, so an interrupted save leaves
+	// either the old cache or the new one. Windows' rename() will not replace a file, and
+	// removing it first would leave a moment with no cache at all.
+	const std::string temporary = m_cacheFile + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(out.data()), out.size());
+		if (!file)
+			return false;
+	}
+#ifdef _WIN32
+	if (!MoveFileExA(temporary.c_str(), m_cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+		return false;
+#else
+	if (std::rename(temporary.c_str(), m_cacheFile.c_str()) != 0)
+		return false;
+#endif
+
+	m_dirty = false;
+	return true;
+}
+
+std::string ShaderCache::Identity(const ShaderRequest& request)
+{
+	std::string identity = request.file + "|" + request.entryPoint + "|" + request.profile;
+	for (const ShaderDefine& define : request.defines)
+		identity += "|" + define.name + "=" + define.value;
+	return identity;
+}
+
+bool ShaderCache::ComputeKey(const ShaderRequest& request, uint64_t& key, std::string& source) const
+{
+	if (!ReadFile(request.file, source))
+		return false;
+
+	uint64_t hash = Hash(FNV_OFFSET, Identity(request));
+	hash = Hash(hash, m_compilerTag);
+	hash = Hash(hash, source);
+
+	std::set<std::string> visited;
+	key = HashIncludes(hash, request.file, source, visited, 0);
+	return true;
+}
+
+ShaderCache::Entry* ShaderCache::Find(const std::string& identity)
+{
+	for (Entry& entry : m_entries)
+	{
+		if (entry.identity == identity)
+			return &entry;
+	}
+	return nullptr;
+}
+
+bool ShaderCache::Load(const std::vector<ShaderRequest>& requests, std::vector<ShaderBytecode>& results)
+{
+	results.assign(requests.size(), ShaderBytecode());
+
+	JobSystem::Get().ParallelFor((int)requests.size(), 1, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			const ShaderRequest& request = requests[i];
+			ShaderBytecode& result = results[i];
+			const std::string identity = Identity(request);
+
+			uint64_t key = 0;
+			std::string source;
+			const bool readable = ComputeKey(request, key, source);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				const Entry* entry = Find(identity);
+				if (entry && (!readable || entry->key == key))
+				{
+					result.code = entry->code;
+					result.valid = true;
+					result.fromCache = true;
+					if (readable)
+						m_stats.hits++;
+					else
+						m_stats.fallbacks++;
+					continue;
+				}
+				if (!readable)
+				{
+					result.errors = "cannot read " + request.file;
+					m_stats.failed++;
+					continue;
+				}
+			}
+
+			// Compile outside the lock so misses build side by side
+			result.valid = m_compiler(request, source, result.code, result.errors);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!result.valid)
+			{
+				m_stats.failed++;
+				continue;
+			}
+
+			m_stats.compiled++;
+			m_dirty = true;
+			Entry* entry = Find(identity);
+			if (entry)
+			{
+				m_stats.invalidated++;
+				entry->key = key;
+				entry->code = result.code;
+			}
+			else
+			{
+				Entry added;
+				added.identity = identity;
+				added.key = key;
+				added.code = result.code;
+				m_entries.push_back(std::move(added));
+			}
+		}
+	});
+
+	for (const ShaderBytecode& result : results)
+	{
+		if (!result.valid)
+			return false;
+	}
+	return true;
+}
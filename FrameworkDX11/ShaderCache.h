@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Persistent compiled-shader cache (one .bin file holding every entry)
+//
+// An entry is named by its identity (file, entry point, profile and defines) and stamped with a
+// key hashing that identity together with the source, every file it #includes and the
+// compiler's tag (version and flags). A request whose key matches its entry is a hit; anything
+// else is compiled, and the fresh bytecode replaces the stale entry. If the source cannot be
+// read at all, the last bytecode built for the identity is used as it is.
+//
+// The compiler is a callback so the cache itself is plain C++ and can run without D3D.
+
+#pragma pack(push, 1)
+struct ShaderCacheHeader
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	flags;
+	uint32_t	entryCount;
+};
+#pragma pack(pop)
+
+const uint32_t SHADER_CACHE_MAGIC = 0x43524853; // "SHRC"
+const uint16_t SHADER_CACHE_VERSION = 1;
+
+struct ShaderDefine
+{
+	std::string					name;
+	std::string					value;
+};
+
+struct ShaderRequest
+{
+	std::string					file;
+	std::string					entryPoint;
+	std::string					profile;
+	std::vector<ShaderDefine>	defines;
+};
+
+struct ShaderBytecode
+{
+	bool						valid = false;
+	bool						fromCache = false;
+	std::vector<uint8_t>		code;
+	std::string					errors;
+};
+
+// Compiles source text read from request.file; returns false and fills errors on failure
+typedef std::function<bool(const ShaderRequest& request, const std::string& source, std::vector<uint8_t>& code, std::string& errors)> ShaderCompileFunction;
+
+struct ShaderCacheStats
+{
+	int							hits = 0;
+	int							compiled = 0;
+	int							failed = 0;
+	int							invalidated = 0;	// stale entries replaced by a fresh compile
+	int							fallbacks = 0;		// served from the cache without a readable source
+};
+
+class ShaderCache
+{
+public:
+	// compilerTag goes into every key, so bumping the compiler or its flags invalidates the lot
+	ShaderCache(const std::string& cacheFile, const ShaderCompileFunction& compiler, const std::string& compilerTag);
+
+	// Reads the cache file; false if it is missing or damaged, which just leaves the cache empty
+	bool						Open();
+	// Writes the cache back out if anything changed
+	bool						Save();
+
+	// Resolves every request into results (same order). Misses are compiled in parallel on the
+	// job system. Returns false if any request ended up without bytecode.
+	bool						Load(const std::vector<ShaderRequest>& requests, std::vector<ShaderBytecode>& results);
+
+	const ShaderCacheStats&		GetStats() const { return m_stats; }
+	size_t						GetEntryCount() const { return m_entries.size(); }
+
+	static std::string			Identity(const ShaderRequest& request);
+
+	// Hash of the identity, compiler tag, source and includes; false if the source is unreadable
+	bool						ComputeKey(const ShaderRequest& request, uint64_t& key, std::string& source) const;
+
+private:
+	struct Entry
+	{
+		std::string				identity;
+		uint64_t				key;
+		std::vector<uint8_t>	code;
+	};
+
+	Entry*						Find(const std::string& identity);
+
+	std::string					m_cacheFile;
+	ShaderCompileFunction		m_compiler;
+	std::string					m_compilerTag;
+	std::vector<Entry>			m_entries;
+	ShaderCacheStats			m_stats;
+	bool						m_dirty = false;
+	std::mutex					m_mutex;
+};
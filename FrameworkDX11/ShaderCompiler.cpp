@@ -0,0 +1,70 @@
+#include "ShaderCompiler.h"
+
+namespace
+{
+	DWORD ShaderFlags()
+	{
+		DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
+#ifdef _DEBUG
+		// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
+		// Setting this flag improves the shader debugging experience, but still allows 
+		// the shaders to be optimized and to run exactly the way they will run in 
+		// the release configuration of this program.
+		dwShaderFlags |= D3DCOMPILE_DEBUG;
+
+		// Disable optimizations to further improve shader debugging
+		dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+		return dwShaderFlags;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Helper for compiling shaders with D3DCompile
+//
+// With VS 11, we could load up prebuilt .cso files instead...
+//--------------------------------------------------------------------------------------
+bool CompileShaderSource(const ShaderRequest& request, const std::string& source, std::vector<uint8_t>& code, std::string& errors)
+{
+	std::vector<D3D_SHADER_MACRO> defines;
+	for (const ShaderDefine& define : request.defines)
+		defines.push_back({ define.name.c_str(), define.value.c_str() });
+	defines.push_back({ nullptr, nullptr });
+
+	ID3DBlob* pCodeBlob = nullptr;
+	ID3DBlob* pErrorBlob = nullptr;
+	HRESULT hr = D3DCompile(source.data(), source.size(), request.file.c_str(), defines.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE,
+		request.entryPoint.c_str(), request.profile.c_str(), ShaderFlags(), 0, &pCodeBlob, &pErrorBlob);
+	if (pErrorBlob)
+	{
+		errors.assign(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()), pErrorBlob->GetBufferSize());
+		OutputDebugStringA(errors.c_str());
+		pErrorBlob->Release();
+	}
+	if (FAILED(hr))
+		return false;
+
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pCodeBlob->GetBufferPointer());
+	code.assign(bytes, bytes + pCodeBlob->GetBufferSize());
+	pCodeBlob->Release();
+	return true;
+}
+
+std::string ShaderCompilerTag()
+{
+	return std::string(D3DCOMPILER_DLL_A) + " flags " + std::to_string(ShaderFlags());
+}
+
+HRESULT CreateVertexShader(ID3D11Device* pd3dDevice, const ShaderBytecode& bytecode, ID3D11VertexShader** ppShader)
+{
+	if (!bytecode.valid)
+		return E_FAIL;
+	return pd3dDevice->CreateVertexShader(bytecode.code.data(), bytecode.code.size(), nullptr, ppShader);
+}
+
+HRESULT CreatePixelShader(ID3D11Device* pd3dDevice, const ShaderBytecode& bytecode, ID3D11PixelShader** ppShader)
+{
+	if (!bytecode.valid)
+		return E_FAIL;
+	return pd3dDevice->CreatePixelShader(bytecode.code.data(), bytecode.code.size(), nullptr, ppShader);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <d3dcompiler.h>
+#include <string>
+#include <vector>
+
+#include "ShaderCache.h"
+
+// The D3DCompile side of ShaderCache. Compiles the already loaded source of request.file with
+// its defines; #includes resolve relative to the file. Errors also go to the debugger output.
+bool CompileShaderSource(const ShaderRequest& request, const std::string& source, std::vector<uint8_t>& code, std::string& errors);
+
+// Compiler version and flags, for ShaderCache keys
+std::string ShaderCompilerTag();
+
+// Creates the shader for bytecode out of the cache
+HRESULT CreateVertexShader(ID3D11Device* pd3dDevice, const ShaderBytecode& bytecode, ID3D11VertexShader** ppShader);
+HRESULT CreatePixelShader(ID3D11Device* pd3dDevice, const ShaderBytecode& bytecode, ID3D11PixelShader** ppShader);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+// The vertex of the cube, terrain and voxel meshes, matching the input layout made in InitMesh
+struct SimpleVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexCoord;
+	DirectX::XMFLOAT3 tangent;
+	DirectX::XMFLOAT3 biTangent;
+};
@@ -0,0 +1,164 @@
+#include "SplatMap.h"
+#include "JobSystem.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+
+namespace
+{
+	struct RuleConstants
+	{
+		__m128	minHeight;
+		__m128	maxHeight;
+		__m128	invHeightBlend;
+		__m128	minSteepness;
+		__m128	maxSteepness;
+		__m128	invSteepnessBlend;
+		__m128	curvatureBias;
+		__m128	strength;
+	};
+
+	inline __m128 Saturate(__m128 v)
+	{
+		return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	}
+
+	// Trapezoid: 1 inside [lo, hi], falling to 0 one blend width outside it
+	inline __m128 Band(__m128 v, __m128 lo, __m128 hi, __m128 invBlend)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		__m128 rise = Saturate(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(v, lo), invBlend), one));
+		__m128 fall = Saturate(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(hi, v), invBlend), one));
+		return _mm_min_ps(rise, fall);
+	}
+
+	void GenerateRows(const Heightfield& heightfield, const RuleConstants* rules, int layerCount, uint8_t* const* planes, size_t pitch, int x0, int x1, int yBegin, int yEnd)
+	{
+		const int width = heightfield.GetWidth();
+		const int height = heightfield.GetHeight();
+		const float cellSize = heightfield.GetCellSize();
+		const __m128 invTwoCell = _mm_set1_ps(0.5f / cellSize);
+		const __m128 invCell = _mm_set1_ps(1.0f / cellSize);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 four = _mm_set1_ps(4.0f);
+		const int planeCount = SplatMap::GetPlaneCount(layerCount);
+
+		alignas(16) float centre[4], left[4], right[4], down[4], up[4];
+		alignas(16) float weights[MAX_SPLAT_LAYERS][4];
+		alignas(16) float totals[4];
+
+		for (int y = yBegin; y < yEnd; ++y)
+		{
+			const float* row = heightfield.GetRow(y);
+			const float* rowDown = heightfield.GetRow(std::max(y - 1, 0));
+			const float* rowUp = heightfield.GetRow(std::min(y + 1, height - 1));
+
+			for (int x = x0; x <= x1; x += 4)
+			{
+				__m128 h, l, r, d, u;
+				if (x >= 1 && x + 4 < width)
+				{
+					h = _mm_loadu_ps(row + x);
+					l = _mm_loadu_ps(row + x - 1);
+					r = _mm_loadu_ps(row + x + 1);
+					d = _mm_loadu_ps(rowDown + x);
+					u = _mm_loadu_ps(rowUp + x);
+				}
+				else
+				{
+					// Edge or tail group: clamp neighbours the same way AtClamped does
+					for (int lane = 0; lane < 4; ++lane)
+					{
+						int sx = std::min(x + lane, width - 1);
+						centre[lane] = row[sx];
+						left[lane] = row[std::max(sx - 1, 0)];
+						right[lane] = row[std::min(sx + 1, width - 1)];
+						down[lane] = rowDown[sx];
+						up[lane] = rowUp[sx];
+					}
+					h = _mm_load_ps(centre);
+					l = _mm_load_ps(left);
+					r = _mm_load_ps(right);
+					d = _mm_load_ps(down);
+					u = _mm_load_ps(up);
+				}
+
+				// Steepness = 1 - normal.y of the central-difference normal
+				__m128 gx = _mm_mul_ps(_mm_sub_ps(r, l), invTwoCell);
+				__m128 gz = _mm_mul_ps(_mm_sub_ps(u, d), invTwoCell);
+				__m128 lengthSq = _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gz, gz)));
+				__m128 steepness = _mm_sub_ps(one, _mm_div_ps(one, _mm_sqrt_ps(lengthSq)));
+
+				// Convexity: positive on ridges and peaks, negative in gullies
+				__m128 neighbours = _mm_add_ps(_mm_add_ps(l, r), _mm_add_ps(d, u));
+				__m128 curvature = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(h, four), neighbours), invCell);
+
+				__m128 total = _mm_setzero_ps();
+				for (int layer = 0; layer < layerCount; ++layer)
+				{
+					const RuleConstants& rule = rules[layer];
+					__m128 w = _mm_mul_ps(rule.strength, Band(h, rule.minHeight, rule.maxHeight, rule.invHeightBlend));
+					w = _mm_mul_ps(w, Band(steepness, rule.minSteepness, rule.maxSteepness, rule.invSteepnessBlend));
+					w = _mm_mul_ps(w, _mm_max_ps(_mm_add_ps(one, _mm_mul_ps(rule.curvatureBias, curvature)), _mm_setzero_ps()));
+					_mm_store_ps(weights[layer], w);
+					total = _mm_add_ps(total, w);
+				}
+				_mm_store_ps(totals, total);
+
+				const int lanes = std::min(4, x1 - x + 1);
+				for (int lane = 0; lane < lanes; ++lane)
+				{
+					// Nothing matched: fall back to the first layer
+					float scale = totals[lane] > 1e-6f ? 255.0f / totals[lane] : 0.0f;
+					for (int plane = 0; plane < planeCount; ++plane)
+					{
+						uint8_t* out = planes[plane] + (size_t)y * pitch + (size_t)(x + lane) * 4;
+						for (int c = 0; c < 4; ++c)
+						{
+							int layer = plane * 4 + c;
+							float value = layer < layerCount ? weights[layer][lane] * scale : 0.0f;
+							if (scale == 0.0f && layer == 0)
+								value = 255.0f;
+							out[c] = (uint8_t)std::min(value + 0.5f, 255.0f);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void SplatMap::Generate(const Heightfield& heightfield, const SplatLayerRule* rules, int layerCount, uint8_t* const* planes, size_t pitch)
+{
+	GenerateRegion(heightfield, rules, layerCount, planes, pitch, 0, 0, heightfield.GetWidth() - 1, heightfield.GetHeight() - 1);
+}
+
+void SplatMap::GenerateRegion(const Heightfield& heightfield, const SplatLayerRule* rules, int layerCount, uint8_t* const* planes, size_t pitch, int x0, int y0, int x1, int y1)
+{
+	layerCount = std::min(std::max(layerCount, 1), MAX_SPLAT_LAYERS);
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, heightfield.GetWidth() - 1);
+	y1 = std::min(y1, heightfield.GetHeight() - 1);
+	if (x1 < x0 || y1 < y0)
+		return;
+
+	RuleConstants constants[MAX_SPLAT_LAYERS];
+	for (int layer = 0; layer < layerCount; ++layer)
+	{
+		const SplatLayerRule& rule = rules[layer];
+		constants[layer].minHeight = _mm_set1_ps(rule.minHeight);
+		constants[layer].maxHeight = _mm_set1_ps(rule.maxHeight);
+		constants[layer].invHeightBlend = _mm_set1_ps(1.0f / std::max(rule.heightBlend, 1e-4f));
+		constants[layer].minSteepness = _mm_set1_ps(rule.minSteepness);
+		constants[layer].maxSteepness = _mm_set1_ps(rule.maxSteepness);
+		constants[layer].invSteepnessBlend = _mm_set1_ps(1.0f / std::max(rule.steepnessBlend, 1e-4f));
+		constants[layer].curvatureBias = _mm_set1_ps(rule.curvatureBias);
+		constants[layer].strength = _mm_set1_ps(rule.strength);
+	}
+
+	JobSystem::Get().ParallelFor(y1 - y0 + 1, 16, [&](int begin, int end)
+	{
+		GenerateRows(heightfield, constants, layerCount, planes, pitch, x0, x1, y0 + begin, y0 + end);
+	});
+}
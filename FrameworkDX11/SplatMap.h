@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Heightfield.h"
+
+#define MAX_SPLAT_LAYERS 8
+
+// Where a material layer appears. Heights are heightfield units; steepness is 1 - normal.y,
+// so 0 is flat and 1 is vertical. Each range fades in and out linearly over its blend width.
+struct SplatLayerRule
+{
+	float	minHeight = -1e9f;
+	float	maxHeight = 1e9f;
+	float	heightBlend = 1.0f;
+	float	minSteepness = 0.0f;
+	float	maxSteepness = 1.0f;
+	float	steepnessBlend = 0.05f;
+	float	curvatureBias = 0.0f;		// > 0 favours ridges, < 0 favours gullies
+	float	strength = 1.0f;
+};
+
+// Splat weights for up to MAX_SPLAT_LAYERS layers, one texel per heightfield sample.
+//
+// Weights are packed four layers per RGBA8 plane (plane 0 = layers 0-3, plane 1 = layers 4-7)
+// and normalised to sum to 255. Rows are spread across the job system and each row is
+// evaluated four texels at a time with SSE.
+namespace SplatMap
+{
+	inline int GetPlaneCount(int layerCount) { return (layerCount + 3) / 4; }
+
+	// planes[p] points at the texel (0, 0) of a width x height RGBA8 image with the given pitch
+	void Generate(const Heightfield& heightfield, const SplatLayerRule* rules, int layerCount, uint8_t* const* planes, size_t pitch);
+
+	// Regenerates only samples [x0, x1] x [y0, y1]
+	void GenerateRegion(const Heightfield& heightfield, const SplatLayerRule* rules, int layerCount, uint8_t* const* planes, size_t pitch, int x0, int y0, int x1, int y1);
+}
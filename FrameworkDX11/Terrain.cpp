@@ -0,0 +1,732 @@
+#include "Terrain.h"
+#include "Erosion.h"
+#include "HeightmapTile.h"
+#include "ImageIO.h"
+#include "ImageTexture.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	// Named for everything the generated heights depend on, so a change of settings never picks
+	// up a stale tile. Changes to the generator or erosion code need the old tiles deleted.
+	string HeightmapCacheFile(const TerrainSettings& settings, int samples)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		};
+		const FractalTerrainSettings& fractal = settings.fractal;
+		add(&samples, sizeof(samples));
+		add(&settings.cellSize, sizeof(settings.cellSize));
+		add(&settings.erosionDroplets, sizeof(settings.erosionDroplets));
+		add(&fractal.seed, sizeof(fractal.seed));
+		add(&fractal.octaves, sizeof(fractal.octaves));
+		add(&fractal.baseFrequency, sizeof(fractal.baseFrequency));
+		add(&fractal.lacunarity, sizeof(fractal.lacunarity));
+		add(&fractal.persistence, sizeof(fractal.persistence));
+		add(&fractal.heightScale, sizeof(fractal.heightScale));
+		add(&fractal.ridgeBlend, sizeof(fractal.ridgeBlend));
+
+		char name[40];
+		snprintf(name, sizeof(name), "TerrainCache%016llx.hmt", (unsigned long long)hash);
+		return name;
+	}
+
+	bool LoadHeightmapCache(const string& fileName, int samples, float cellSize, Heightfield& heightfield)
+	{
+		HeightmapTileCodec codec;
+		Heightfield loaded;
+		if (!codec.LoadFromFile(fileName, loaded))
+			return false;
+		if (loaded.GetWidth() != samples || loaded.GetHeight() != samples || loaded.GetCellSize() != cellSize)
+			return false;
+		heightfield = std::move(loaded);
+		return true;
+	}
+
+	// The heights are quantised as the tile stores them, so the run that makes the cache builds
+	// the same terrain as the runs that load it
+	void SaveHeightmapCache(const string& fileName, Heightfield& heightfield)
+	{
+		HeightmapTileCodec codec;
+		vector<uint8_t> tile;
+		if (!codec.Encode(heightfield, tile) || !codec.Decode(tile.data(), tile.size(), heightfield))
+			return;
+
+		ofstream file(fileName, ios::binary | ios::trunc);
+		file.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+	}
+
+	vector<TerrainLayer> DefaultTerrainLayers()
+	{
+		vector<TerrainLayer> layers(3);
+
+		// Flat ground
+		layers[0].diffuse = "Resources\\stone.dds";
+		layers[0].rule.maxSteepness = 0.12f;
+		layers[0].rule.steepnessBlend = 0.06f;
+
+		// Slopes and cliffs
+		layers[1].diffuse = "Resources\\Rock Textures\\rock_diffuse2.dds";
+		layers[1].normal = "Resources\\Rock Textures\\rock_bump.dds";
+		layers[1].height = "Resources\\Rock Textures\\rock_height.dds";
+		layers[1].rule.minSteepness = 0.12f;
+		layers[1].rule.steepnessBlend = 0.06f;
+
+		// Flat high ground and ridges
+		layers[2].diffuse = "Resources\\Brick Textures\\color.dds";
+		layers[2].normal = "Resources\\Brick Textures\\normals.dds";
+		layers[2].height = "Resources\\Brick Textures\\displacement.dds";
+		layers[2].rule.minHeight = 0.7f;
+		layers[2].rule.heightBlend = 0.1f;
+		layers[2].rule.maxSteepness = 0.12f;
+		layers[2].rule.steepnessBlend = 0.06f;
+		layers[2].rule.curvatureBias = 0.5f;
+		layers[2].rule.strength = 2.0f;
+		return layers;
+	}
+
+	// Fits 'source' to size x size and appends the full box-filtered mip chain
+	void AppendMipChain(const Image& source, int size, int mipCount, vector<Image>& mips)
+	{
+		Image level = (source.GetWidth() == size && source.GetHeight() == size) ? source : source.Resampled(size, size);
+		for (int mip = 0; mip < mipCount; ++mip)
+		{
+			Image next = mip + 1 < mipCount ? level.HalfSize() : Image();
+			mips.push_back(std::move(level));
+			level = std::move(next);
+		}
+	}
+}
+
+Terrain::Terrain()
+{
+	XMStoreFloat4x4(&m_World, XMMatrixIdentity());
+}
+
+Terrain::~Terrain()
+{
+	Cleanup();
+}
+
+void Terrain::Cleanup()
+{
+	// First, as its jobs read the splat weights and layers
+	m_virtualTexture.Cleanup();
+
+	for (TerrainChunk& chunk : m_chunks)
+	{
+		if (chunk.vertexBuffer)
+			chunk.vertexBuffer->Release();
+		chunk.vertexBuffer = nullptr;
+	}
+	m_chunks.clear();
+
+	if (m_pIndexBuffer)
+		m_pIndexBuffer->Release();
+	m_pIndexBuffer = nullptr;
+
+	if (m_pMaterialConstantBuffer)
+		m_pMaterialConstantBuffer->Release();
+	m_pMaterialConstantBuffer = nullptr;
+
+	m_texture.Reset();
+	m_normalTexture.Reset();
+	m_displacementTexture.Reset();
+
+	if (m_pSamplerLinear)
+		m_pSamplerLinear->Release();
+	m_pSamplerLinear = nullptr;
+
+	if (m_pHorizonResourceView)
+		m_pHorizonResourceView->Release();
+	m_pHorizonResourceView = nullptr;
+
+	if (m_pHorizonTexture)
+		m_pHorizonTexture->Release();
+	m_pHorizonTexture = nullptr;
+
+	if (m_pTerrainConstantBuffer)
+		m_pTerrainConstantBuffer->Release();
+	m_pTerrainConstantBuffer = nullptr;
+
+	if (m_pLayerDiffuseView)
+		m_pLayerDiffuseView->Release();
+	m_pLayerDiffuseView = nullptr;
+
+	if (m_pLayerNormalView)
+		m_pLayerNormalView->Release();
+	m_pLayerNormalView = nullptr;
+
+	if (m_pSplatView)
+		m_pSplatView->Release();
+	m_pSplatView = nullptr;
+
+	if (m_pSplatTexture)
+		m_pSplatTexture->Release();
+	m_pSplatTexture = nullptr;
+}
+
+HRESULT Terrain::Init(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext, TextureCache& textures, const TerrainSettings& settings)
+{
+	m_settings = settings;
+
+	// Generate and erode the heightfield, unless an earlier run left it in the cache
+	const int samples = settings.chunksPerSide * settings.chunkQuads + 1;
+	const string cacheFile = settings.cacheHeightmap ? HeightmapCacheFile(settings, samples) : string();
+	if (cacheFile.empty() || !LoadHeightmapCache(cacheFile, samples, settings.cellSize, m_heightfield))
+	{
+		m_heightfield = Heightfield(samples, samples, settings.cellSize);
+		GenerateFractalTerrain(m_heightfield, settings.fractal);
+
+		if (settings.erosionDroplets > 0)
+		{
+			HydraulicErosionSettings erosion;
+			erosion.dropletCount = settings.erosionDroplets;
+			erosion.seed = settings.fractal.seed;
+			Erosion::Hydraulic(m_heightfield, erosion);
+			Erosion::Thermal(m_heightfield, ThermalErosionSettings());
+		}
+
+		if (!cacheFile.empty())
+			SaveHeightmapCache(cacheFile, m_heightfield);
+	}
+
+	m_pyramid.Build(m_heightfield);
+
+	// With power of two chunks each chunk is exactly one pyramid node, so its bounds are a lookup
+	m_chunkLevel = -1;
+	if ((settings.chunkQuads & (settings.chunkQuads - 1)) == 0)
+	{
+		int level = 0;
+		while ((1 << level) < settings.chunkQuads)
+			++level;
+		if (level < m_pyramid.GetLevelCount())
+			m_chunkLevel = level;
+	}
+
+	XMStoreFloat4x4(&m_World, XMMatrixTranslation(settings.origin.x, settings.origin.y, settings.origin.z));
+
+	// Chunk vertex buffers
+	std::vector<SimpleVertex> vertices;
+	for (int cz = 0; cz < settings.chunksPerSide; ++cz)
+	{
+		for (int cx = 0; cx < settings.chunksPerSide; ++cx)
+		{
+			TerrainChunk chunk;
+			chunk.x0 = cx * settings.chunkQuads;
+			chunk.z0 = cz * settings.chunkQuads;
+			TerrainMesh::BuildChunkVertices(m_heightfield, settings.cellSize, settings.textureRepeat, chunk.x0, chunk.z0, settings.chunkQuads, vertices);
+			UpdateChunkBounds(chunk);
+
+			D3D11_BUFFER_DESC bd = {};
+			bd.Usage = D3D11_USAGE_DEFAULT;
+			bd.ByteWidth = (UINT)(sizeof(SimpleVertex) * vertices.size());
+			bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+			bd.CPUAccessFlags = 0;
+
+			D3D11_SUBRESOURCE_DATA InitData = {};
+			InitData.pSysMem = vertices.data();
+			HRESULT hr = pd3dDevice->CreateBuffer(&bd, &InitData, &chunk.vertexBuffer);
+			if (FAILED(hr))
+				return hr;
+
+			m_chunks.push_back(chunk);
+		}
+	}
+
+	// One index buffer shared by every chunk. The diagonal split matches HeightPyramid's raycast.
+	const int quads = settings.chunkQuads;
+	const int stride = quads + 1;
+	std::vector<WORD> indices;
+	indices.reserve(quads * quads * 6);
+	for (int z = 0; z < quads; ++z)
+	{
+		for (int x = 0; x < quads; ++x)
+		{
+			WORD v00 = (WORD)(z * stride + x);
+			WORD v10 = (WORD)(v00 + 1);
+			WORD v01 = (WORD)(v00 + stride);
+			WORD v11 = (WORD)(v01 + 1);
+
+			indices.push_back(v00);
+			indices.push_back(v01);
+			indices.push_back(v11);
+
+			indices.push_back(v00);
+			indices.push_back(v11);
+			indices.push_back(v10);
+		}
+	}
+	m_indexCount = (UINT)indices.size();
+
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = (UINT)(sizeof(WORD) * indices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	bd.CPUAccessFlags = 0;
+
+	D3D11_SUBRESOURCE_DATA InitData = {};
+	InitData.pSysMem = indices.data();
+	HRESULT hr = pd3dDevice->CreateBuffer(&bd, &InitData, &m_pIndexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	// load and setup textures; the scattered rocks and the voxel terrain share the same two
+	m_texture = textures.Acquire(L"Resources\\Rock Textures\\rock_diffuse2.dds", TexturePlaceholder::White);
+
+	m_normalTexture = textures.Acquire(L"Resources\\Rock Textures\\rock_bump.dds", TexturePlaceholder::FlatNormal, [pd3dDevice]()
+	{
+		NormalMapSettings normalSettings;
+		NormalMapGenerator::GetResourcePreset("rock_height.dds", normalSettings);
+		ID3D11ShaderResourceView* generated = nullptr;
+		CreateNormalMapFromHeight(pd3dDevice, "Resources\\Rock Textures\\rock_height.dds", normalSettings, &generated);
+		return generated;
+	});
+
+	m_displacementTexture = textures.Acquire(L"Resources\\Rock Textures\\rock_height.dds", TexturePlaceholder::FlatHeight);
+
+	D3D11_SAMPLER_DESC sampDesc;
+	ZeroMemory(&sampDesc, sizeof(sampDesc));
+	sampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+	sampDesc.MaxAnisotropy = 8;
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	sampDesc.MinLOD = 0;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	hr = pd3dDevice->CreateSamplerState(&sampDesc, &m_pSamplerLinear);
+	if (FAILED(hr))
+		return hr;
+
+	m_material.Material.Diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	m_material.Material.Specular = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
+	m_material.Material.SpecularPower = 8.0f;
+	m_material.Material.UseTexture = true;
+	m_material.Material.choice = 0;
+
+	// Create the material constant buffer
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(MaterialPropertiesConstantBuffer);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = 0;
+	hr = pd3dDevice->CreateBuffer(&bd, nullptr, &m_pMaterialConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	// Horizon map: one RG8 texel per heightfield sample
+	const int width = m_heightfield.GetWidth();
+	const int height = m_heightfield.GetHeight();
+	m_horizonTexels.resize((size_t)width * height * 2);
+	HorizonBaker::Bake(m_heightfield, m_horizonSettings, m_horizonTexels.data());
+
+	D3D11_TEXTURE2D_DESC horizonDesc = {};
+	horizonDesc.Width = width;
+	horizonDesc.Height = height;
+	horizonDesc.MipLevels = 1;
+	horizonDesc.ArraySize = 1;
+	horizonDesc.Format = DXGI_FORMAT_R8G8_UNORM;
+	horizonDesc.SampleDesc.Count = 1;
+	horizonDesc.Usage = D3D11_USAGE_DEFAULT;
+	horizonDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA horizonData = {};
+	horizonData.pSysMem = m_horizonTexels.data();
+	horizonData.SysMemPitch = width * 2;
+	hr = pd3dDevice->CreateTexture2D(&horizonDesc, &horizonData, &m_pHorizonTexture);
+	if (FAILED(hr))
+		return hr;
+
+	hr = pd3dDevice->CreateShaderResourceView(m_pHorizonTexture, nullptr, &m_pHorizonResourceView);
+	if (FAILED(hr))
+		return hr;
+
+	// Sample i sits at the centre of texel i
+	float scaleX = 1.0f / (width * settings.cellSize);
+	float scaleZ = 1.0f / (height * settings.cellSize);
+	m_terrainProperties.MapScaleOffset = XMFLOAT4(scaleX, scaleZ, 0.5f / width - settings.origin.x * scaleX, 0.5f / height - settings.origin.z * scaleZ);
+	m_terrainProperties.UseHorizonMap = 1;
+
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(TerrainPropertiesConstantBuffer);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = 0;
+	hr = pd3dDevice->CreateBuffer(&bd, nullptr, &m_pTerrainConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	hr = CreateLayerArrays(pd3dDevice);
+	if (FAILED(hr))
+		return hr;
+
+	hr = CreateSplatMap(pd3dDevice);
+	if (FAILED(hr))
+		return hr;
+
+	hr = CreateVirtualTexture(pd3dDevice);
+	if (FAILED(hr))
+		return hr;
+
+	return hr;
+}
+
+HRESULT Terrain::CreateLayerArrays(ID3D11Device* pd3dDevice)
+{
+	if (m_settings.layers.empty())
+		m_settings.layers = DefaultTerrainLayers();
+	if (m_settings.layers.size() > MAX_SPLAT_LAYERS)
+		m_settings.layers.resize(MAX_SPLAT_LAYERS);
+
+	const int layerCount = (int)m_settings.layers.size();
+	const int size = m_settings.layerTextureSize;
+	int mipCount = 1;
+	while ((size >> mipCount) > 0)
+		++mipCount;
+
+	// Height rules are given relative to the generated terrain
+	float minHeight, maxHeight;
+	m_heightfield.GetMinMax(minHeight, maxHeight);
+	const float range = max(maxHeight - minHeight, 1e-3f);
+
+	vector<Image> diffuse;
+	vector<Image> normals;
+	m_splatRules.clear();
+	for (const TerrainLayer& layer : m_settings.layers)
+	{
+		Image image;
+		if (!ImageIO::LoadDDS(layer.diffuse, image))
+			return E_FAIL;
+		AppendMipChain(image, size, mipCount, diffuse);
+
+		if (layer.normal.empty() || !ImageIO::LoadDDS(layer.normal, image))
+		{
+			if (!layer.height.empty())
+			{
+				// No loadable normal map: generate one from the height map
+				Image height;
+				if (!ImageIO::LoadDDS(layer.height, height))
+					return E_FAIL;
+				NormalMapSettings normalSettings;
+				NormalMapGenerator::GetResourcePreset(layer.height, normalSettings);
+				NormalMapGenerator::GenerateNormalMap(height, normalSettings, image);
+			}
+			else if (layer.normal.empty())
+			{
+				image.Resize(1, 1);
+				image.Fill(0xffff8080);
+			}
+			else
+			{
+				return E_FAIL;
+			}
+		}
+		AppendMipChain(image, size, mipCount, normals);
+
+		SplatLayerRule rule = layer.rule;
+		rule.minHeight = minHeight + rule.minHeight * range;
+		rule.maxHeight = minHeight + rule.maxHeight * range;
+		rule.heightBlend *= range;
+		m_splatRules.push_back(rule);
+	}
+
+	HRESULT hr = CreateTextureArrayFromImages(pd3dDevice, diffuse.data(), layerCount, mipCount, &m_pLayerDiffuseView);
+	if (FAILED(hr))
+		return hr;
+
+	hr = CreateTextureArrayFromImages(pd3dDevice, normals.data(), layerCount, mipCount, &m_pLayerNormalView);
+	if (FAILED(hr))
+		return hr;
+
+	m_layerDiffuse = std::move(diffuse);
+	m_layerNormals = std::move(normals);
+	m_layerMipCount = mipCount;
+	m_terrainProperties.LayerCount = layerCount;
+	return S_OK;
+}
+
+HRESULT Terrain::CreateSplatMap(ID3D11Device* pd3dDevice)
+{
+	const int width = m_heightfield.GetWidth();
+	const int height = m_heightfield.GetHeight();
+	const int layerCount = (int)m_splatRules.size();
+	const int planeCount = SplatMap::GetPlaneCount(layerCount);
+
+	uint8_t* planes[2] = {};
+	vector<D3D11_SUBRESOURCE_DATA> data(planeCount);
+	for (int plane = 0; plane < planeCount; ++plane)
+	{
+		m_splatTexels[plane].resize((size_t)width * height * 4);
+		planes[plane] = m_splatTexels[plane].data();
+		data[plane].pSysMem = planes[plane];
+		data[plane].SysMemPitch = width * 4;
+	}
+	SplatMap::Generate(m_heightfield, m_splatRules.data(), layerCount, planes, (size_t)width * 4);
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = planeCount;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	HRESULT hr = pd3dDevice->CreateTexture2D(&desc, data.data(), &m_pSplatTexture);
+	if (FAILED(hr))
+		return hr;
+
+	return pd3dDevice->CreateShaderResourceView(m_pSplatTexture, nullptr, &m_pSplatView);
+}
+
+HRESULT Terrain::CreateVirtualTexture(ID3D11Device* pd3dDevice)
+{
+	const int width = m_heightfield.GetWidth();
+	const int height = m_heightfield.GetHeight();
+
+	TerrainPageSource source;
+	source.splat[0] = m_splatTexels[0].data();
+	source.splat[1] = m_splatTexels[1].data();
+	source.sampleWidth = width;
+	source.sampleHeight = height;
+	source.textureRepeat = m_settings.textureRepeat;
+	source.layerCount = (int)m_splatRules.size();
+	source.diffuse = m_layerDiffuse.data();
+	source.normals = m_layerNormals.data();
+	source.mipCount = m_layerMipCount;
+
+	// The virtual texture spans the first sample to the last
+	float scaleX = 1.0f / ((width - 1) * m_settings.cellSize);
+	float scaleZ = 1.0f / ((height - 1) * m_settings.cellSize);
+	XMFLOAT4 worldToVirtual(scaleX, scaleZ, -m_settings.origin.x * scaleX, -m_settings.origin.z * scaleZ);
+	return m_virtualTexture.Init(pd3dDevice, source, m_settings.virtualTexture, worldToVirtual);
+}
+
+void Terrain::UploadSplatRegion(ID3D11DeviceContext* pContext, const DirtyRect& samples)
+{
+	if (!m_pSplatTexture)
+		return;
+
+	// Virtual pages filter the weights bilinearly, so one sample either side of the region reaches them
+	const float lastX = (float)(m_heightfield.GetWidth() - 1);
+	const float lastZ = (float)(m_heightfield.GetHeight() - 1);
+	m_virtualTexture.Invalidate((samples.x0 - 1) / lastX, (samples.y0 - 1) / lastZ, (samples.x1 + 1) / lastX, (samples.y1 + 1) / lastZ);
+
+	const int width = m_heightfield.GetWidth();
+	const int layerCount = (int)m_splatRules.size();
+	const int planeCount = SplatMap::GetPlaneCount(layerCount);
+	uint8_t* planes[2] = { m_splatTexels[0].data(), m_splatTexels[1].data() };
+	SplatMap::GenerateRegion(m_heightfield, m_splatRules.data(), layerCount, planes, (size_t)width * 4, samples.x0, samples.y0, samples.x1, samples.y1);
+
+	D3D11_BOX box = {};
+	box.left = samples.x0;
+	box.right = samples.x1 + 1;
+	box.top = samples.y0;
+	box.bottom = samples.y1 + 1;
+	box.front = 0;
+	box.back = 1;
+	for (int plane = 0; plane < planeCount; ++plane)
+	{
+		const uint8_t* first = planes[plane] + ((size_t)samples.y0 * width + samples.x0) * 4;
+		pContext->UpdateSubresource(m_pSplatTexture, plane, &box, first, width * 4, 0);
+	}
+}
+
+void Terrain::BakeHorizons(ID3D11DeviceContext* pContext)
+{
+	if (!m_pHorizonTexture)
+		return;
+
+	HorizonBaker::Bake(m_heightfield, m_horizonSettings, m_horizonTexels.data());
+	pContext->UpdateSubresource(m_pHorizonTexture, 0, nullptr, m_horizonTexels.data(), m_heightfield.GetWidth() * 2, 0);
+}
+
+void Terrain::SetSunPosition(ID3D11DeviceContext* pContext, const XMFLOAT3& position)
+{
+	if (!m_pHorizonTexture)
+		return;
+
+	// Treat the light as directional, seen from the middle of the terrain
+	float extentX = (m_heightfield.GetWidth() - 1) * m_settings.cellSize;
+	float extentZ = (m_heightfield.GetHeight() - 1) * m_settings.cellSize;
+	XMFLOAT3 centre(m_settings.origin.x + extentX * 0.5f, m_settings.origin.y, m_settings.origin.z + extentZ * 0.5f);
+	XMFLOAT3 direction(position.x - centre.x, position.y - centre.y, position.z - centre.z);
+
+	if (direction.x == m_horizonSettings.sunDirectionX && direction.y == m_horizonSettings.sunDirectionY && direction.z == m_horizonSettings.sunDirectionZ)
+		return;
+
+	m_horizonSettings.sunDirectionX = direction.x;
+	m_horizonSettings.sunDirectionY = direction.y;
+	m_horizonSettings.sunDirectionZ = direction.z;
+	HorizonBaker::BakeSunShadow(m_heightfield, m_horizonSettings, m_horizonTexels.data() + 1, 2);
+	pContext->UpdateSubresource(m_pHorizonTexture, 0, nullptr, m_horizonTexels.data(), m_heightfield.GetWidth() * 2, 0);
+}
+
+void Terrain::UpdateChunkBounds(TerrainChunk& chunk) const
+{
+	if (m_chunkLevel >= 0)
+	{
+		m_pyramid.GetRange(m_chunkLevel, chunk.x0 / m_settings.chunkQuads, chunk.z0 / m_settings.chunkQuads, chunk.minHeight, chunk.maxHeight);
+		return;
+	}
+
+	chunk.minHeight = FLT_MAX;
+	chunk.maxHeight = -FLT_MAX;
+	for (int z = chunk.z0; z <= chunk.z0 + m_settings.chunkQuads; ++z)
+	{
+		const float* row = m_heightfield.GetRow(z);
+		for (int x = chunk.x0; x <= chunk.x0 + m_settings.chunkQuads; ++x)
+		{
+			chunk.minHeight = min(chunk.minHeight, row[x]);
+			chunk.maxHeight = max(chunk.maxHeight, row[x]);
+		}
+	}
+}
+
+bool Terrain::ApplyBrush(ID3D11DeviceContext* pContext, float x, float z, const BrushSettings& brush, float deltaTime)
+{
+	BrushSettings local = brush;
+	local.flattenHeight -= m_settings.origin.y;
+
+	DirtyRect changed = ApplyTerrainBrush(m_heightfield, x - m_settings.origin.x, z - m_settings.origin.z, local, deltaTime);
+	if (changed.IsEmpty())
+		return false;
+
+	UpdateRegion(pContext, changed);
+	return true;
+}
+
+void Terrain::UpdateRegion(ID3D11DeviceContext* pContext, const DirtyRect& samples)
+{
+	if (samples.IsEmpty() || m_chunks.empty())
+		return;
+
+	m_pyramid.UpdateRegion(samples.x0, samples.y0, samples.x1, samples.y1);
+
+	// Central differences reach one sample out, so the neighbours' normals change too
+	const int width = m_heightfield.GetWidth();
+	const int height = m_heightfield.GetHeight();
+	const DirtyRect region = samples.Expanded(1, width, height);
+	const int quads = m_settings.chunkQuads;
+	const int stride = quads + 1;
+
+	for (TerrainChunk& chunk : m_chunks)
+	{
+		const DirtyRect vertices = TerrainMesh::GetChunkRegion(samples, width, height, chunk.x0, chunk.z0, quads);
+		if (vertices.IsEmpty())
+			continue;
+
+		UpdateChunkBounds(chunk);
+
+		const int x0 = vertices.x0;
+		const int z0 = vertices.y0;
+		const int columns = vertices.x1 - x0 + 1;
+		const int rows = vertices.y1 - z0 + 1;
+		m_regionVertices.resize((size_t)columns * rows);
+		JobSystem::Get().ParallelFor(rows, 8, [&](int begin, int end)
+		{
+			for (int row = begin; row < end; ++row)
+				for (int column = 0; column < columns; ++column)
+					TerrainMesh::ComputeVertex(m_heightfield, m_settings.cellSize, m_settings.textureRepeat, x0 + column, z0 + row, m_regionVertices[(size_t)row * columns + column]);
+		});
+
+		// Upload just the touched span of each vertex row
+		for (int row = 0; row < rows; ++row)
+		{
+			UINT first = (UINT)((z0 + row - chunk.z0) * stride + (x0 - chunk.x0));
+			D3D11_BOX box = {};
+			box.left = first * sizeof(SimpleVertex);
+			box.right = (first + columns) * sizeof(SimpleVertex);
+			box.top = 0;
+			box.bottom = 1;
+			box.front = 0;
+			box.back = 1;
+			pContext->UpdateSubresource(chunk.vertexBuffer, 0, &box, &m_regionVertices[(size_t)row * columns], 0, 0);
+		}
+	}
+
+	// Splat weights depend on the slope, so they follow the normals' region
+	UploadSplatRegion(pContext, region);
+}
+
+void Terrain::RequestTextureDetail(TextureCache& textures, float screenTexels)
+{
+	textures.RequestDetail(m_texture, screenTexels);
+	textures.RequestDetail(m_normalTexture, screenTexels);
+	textures.RequestDetail(m_displacementTexture, screenTexels);
+}
+
+void Terrain::Draw(ID3D11DeviceContext* pContext)
+{
+	pContext->UpdateSubresource(m_pMaterialConstantBuffer, 0, nullptr, &m_material, 0, 0);
+	pContext->PSSetConstantBuffers(1, 1, &m_pMaterialConstantBuffer);
+	ID3D11ShaderResourceView* textures[4] = { m_texture.Get(), m_normalTexture.Get(), m_displacementTexture.Get(), m_pHorizonResourceView };
+	pContext->PSSetShaderResources(0, 4, textures);
+	ID3D11ShaderResourceView* splatViews[3] = { m_pLayerDiffuseView, m_pLayerNormalView, m_pSplatView };
+	pContext->PSSetShaderResources(4, 3, splatViews);
+	pContext->PSSetSamplers(0, 1, &m_pSamplerLinear);
+
+	pContext->UpdateSubresource(m_pTerrainConstantBuffer, 0, nullptr, &m_terrainProperties, 0, 0);
+	pContext->PSSetConstantBuffers(3, 1, &m_pTerrainConstantBuffer);
+	m_virtualTexture.Bind(pContext);
+
+	pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+	pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+	for (TerrainChunk& chunk : m_chunks)
+	{
+		pContext->IASetVertexBuffers(0, 1, &chunk.vertexBuffer, &stride, &offset);
+		pContext->DrawIndexed(m_indexCount, 0, 0);
+	}
+
+	// Other objects share the pixel shader and must not pick up the horizon map
+	ID3D11Buffer* nullBuffer = nullptr;
+	ID3D11ShaderResourceView* nullViews[4] = {};
+	pContext->PSSetConstantBuffers(3, 1, &nullBuffer);
+	pContext->PSSetShaderResources(3, 4, nullViews);
+	pContext->PSSetConstantBuffers(5, 1, &nullBuffer);
+	pContext->PSSetShaderResources(10, 3, nullViews);
+}
+
+bool Terrain::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainRayHit& hit) const
+{
+	// The terrain transform is a pure translation
+	XMFLOAT3 localOrigin(origin.x - m_settings.origin.x, origin.y - m_settings.origin.y, origin.z - m_settings.origin.z);
+	if (!m_pyramid.Raycast(localOrigin, direction, maxDistance, hit))
+		return false;
+
+	hit.position.x += m_settings.origin.x;
+	hit.position.y += m_settings.origin.y;
+	hit.position.z += m_settings.origin.z;
+	return true;
+}
+
+bool Terrain::GetHeightAt(float x, float z, float& height) const
+{
+	float localX = x - m_settings.origin.x;
+	float localZ = z - m_settings.origin.z;
+	float extentX = (m_heightfield.GetWidth() - 1) * m_settings.cellSize;
+	float extentZ = (m_heightfield.GetHeight() - 1) * m_settings.cellSize;
+	if (localX < 0.0f || localZ < 0.0f || localX > extentX || localZ > extentZ)
+		return false;
+
+	height = m_pyramid.SampleHeight(localX, localZ) + m_settings.origin.y;
+	return true;
+}
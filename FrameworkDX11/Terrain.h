@@ -0,0 +1,148 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+#include "DrawableGameObject.h"
+#include "Heightfield.h"
+#include "HeightPyramid.h"
+#include "HorizonBaker.h"
+#include "NormalMapGenerator.h"
+#include "SplatMap.h"
+#include "TerrainBrush.h"
+#include "TerrainGenerator.h"
+#include "TerrainMesh.h"
+#include "TerrainVirtualTexture.h"
+#include "structures.h"
+
+using namespace DirectX;
+
+// One splat material. Without a loadable normal map the normal is generated from the height map,
+// and with neither it is flat. Heights in the rule are fractions of the generated terrain's height
+// range and are converted to heightfield units when the terrain is built.
+struct TerrainLayer
+{
+	std::string				diffuse;
+	std::string				normal;
+	std::string				height;
+	SplatLayerRule			rule;
+};
+
+struct TerrainSettings
+{
+	int						chunksPerSide = 4;
+	int						chunkQuads = 64;			// quads along a chunk edge; 65x65 vertices fit 16-bit indices
+	float					cellSize = 0.25f;
+	float					textureRepeat = 16.0f;		// cells per texture repeat
+	XMFLOAT3				origin = XMFLOAT3(-32.0f, -5.0f, -32.0f);
+	FractalTerrainSettings	fractal;
+	int						erosionDroplets = 100000;
+	bool					cacheHeightmap = true;		// keep the eroded heights in a .hmt tile named for these settings and load it on later runs
+	std::vector<TerrainLayer>	layers;						// empty = the built-in stone / rock / brick set
+	int						layerTextureSize = 512;
+	VirtualTextureSettings	virtualTexture;
+};
+
+struct TerrainChunk
+{
+	ID3D11Buffer*			vertexBuffer = nullptr;
+	int						x0 = 0;						// first sample column / row covered
+	int						z0 = 0;
+	float					minHeight = 0.0f;
+	float					maxHeight = 0.0f;
+};
+
+// Chunked heightfield terrain drawn with the regular object shaders.
+class Terrain
+{
+public:
+	Terrain();
+	~Terrain();
+
+	HRESULT					Init(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext, TextureCache& textures, const TerrainSettings& settings);
+	void					Cleanup();
+	void					Draw(ID3D11DeviceContext* pContext);
+	// The rock textures tile over ground that runs up to the camera, so screenTexels should be
+	// the size of the view
+	void					RequestTextureDetail(TextureCache& textures, float screenTexels);
+
+	XMFLOAT4X4*				GetTransform() { return &m_World; }
+	const XMFLOAT3&			GetOrigin() const { return m_settings.origin; }
+	const Heightfield&		GetHeightfield() const { return m_heightfield; }
+	const HeightPyramid&	GetPyramid() const { return m_pyramid; }
+
+	// World-space queries
+	bool					Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainRayHit& hit) const;
+	bool					GetHeightAt(float x, float z, float& height) const;
+
+	// Sculpting. x and z are world-space and the brush's flattenHeight is a world height.
+	// Only the vertices, pyramid nodes and chunk bounds around the edit are rebuilt.
+	bool					ApplyBrush(ID3D11DeviceContext* pContext, float x, float z, const BrushSettings& brush, float deltaTime);
+	void					UpdateRegion(ID3D11DeviceContext* pContext, const DirtyRect& samples);
+
+	// Horizon-based ambient occlusion and sun shadow. BakeHorizons redoes both channels,
+	// SetSunPosition only the shadow, and only when the sun has actually moved.
+	void					BakeHorizons(ID3D11DeviceContext* pContext);
+	void					SetSunPosition(ID3D11DeviceContext* pContext, const XMFLOAT3& position);
+	void					SetHorizonMapEnabled(bool enabled) { m_terrainProperties.UseHorizonMap = enabled ? 1 : 0; }
+	bool					IsHorizonMapEnabled() const { return m_terrainProperties.UseHorizonMap != 0; }
+
+	// Splat materials: draw with the PSTerrain pixel shader to blend the layer arrays
+	bool					IsSplatEnabled() const { return m_splatEnabled; }
+	void					SetSplatEnabled(bool enabled) { m_splatEnabled = enabled; }
+	const uint8_t*			GetSplatWeights(int plane) const { return m_splatTexels[plane].data(); }
+
+	// The same materials baked into a virtual texture: draw with PSTerrainVirtual, after drawing
+	// between the virtual texture's BeginFeedback and EndFeedback with PSTerrainFeedback
+	bool					IsVirtualTextureEnabled() const { return m_virtualTextureEnabled; }
+	void					SetVirtualTextureEnabled(bool enabled) { m_virtualTextureEnabled = enabled; }
+	TerrainVirtualTexture&	GetVirtualTexture() { return m_virtualTexture; }
+
+	MaterialPropertiesConstantBuffer	m_material;
+
+private:
+	void					UpdateChunkBounds(TerrainChunk& chunk) const;
+	HRESULT					CreateLayerArrays(ID3D11Device* pd3dDevice);
+	HRESULT					CreateSplatMap(ID3D11Device* pd3dDevice);
+	HRESULT					CreateVirtualTexture(ID3D11Device* pd3dDevice);
+	void					UploadSplatRegion(ID3D11DeviceContext* pContext, const DirtyRect& samples);
+
+	TerrainSettings						m_settings;
+	Heightfield							m_heightfield;
+	HeightPyramid						m_pyramid;
+	std::vector<TerrainChunk>			m_chunks;
+	XMFLOAT4X4							m_World;
+	int									m_chunkLevel = -1;			// pyramid level whose nodes match the chunks, if any
+	std::vector<SimpleVertex>			m_regionVertices;
+
+	HorizonBakeSettings					m_horizonSettings;
+	std::vector<uint8_t>				m_horizonTexels;			// RG8: occlusion, sun visibility
+	TerrainPropertiesConstantBuffer		m_terrainProperties;
+
+	std::vector<SplatLayerRule>			m_splatRules;
+	std::vector<uint8_t>				m_splatTexels[2];			// RGBA8 weights, layers 0-3 and 4-7
+	bool								m_splatEnabled = true;
+
+	std::vector<Image>					m_layerDiffuse;				// the arrays' levels, kept to bake virtual pages from
+	std::vector<Image>					m_layerNormals;
+	int									m_layerMipCount = 0;
+	TerrainVirtualTexture				m_virtualTexture;
+	bool								m_virtualTextureEnabled = true;
+
+	ID3D11Buffer*						m_pIndexBuffer = nullptr;
+	ID3D11Buffer*						m_pMaterialConstantBuffer = nullptr;
+	TextureHandle						m_texture;
+	TextureHandle						m_normalTexture;
+	TextureHandle						m_displacementTexture;
+	ID3D11SamplerState*					m_pSamplerLinear = nullptr;
+	ID3D11Texture2D*					m_pHorizonTexture = nullptr;
+	ID3D11ShaderResourceView*			m_pHorizonResourceView = nullptr;
+	ID3D11Buffer*						m_pTerrainConstantBuffer = nullptr;
+	ID3D11ShaderResourceView*			m_pLayerDiffuseView = nullptr;
+	ID3D11ShaderResourceView*			m_pLayerNormalView = nullptr;
+	ID3D11Texture2D*					m_pSplatTexture = nullptr;
+	ID3D11ShaderResourceView*			m_pSplatView = nullptr;
+	UINT								m_indexCount = 0;
+};
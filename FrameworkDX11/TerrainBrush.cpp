@@ -0,0 +1,102 @@
+#include "TerrainBrush.h"
+#include "JobSystem.h"
+
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	// 1 inside the hard core, easing to 0 at the radius
+	inline float BrushWeight(float distance, float radius, float falloff)
+	{
+		if (distance >= radius)
+			return 0.0f;
+
+		float core = radius * (1.0f - falloff);
+		if (distance <= core)
+			return 1.0f;
+
+		float t = (distance - core) / (radius - core);
+		return 1.0f - t * t * (3.0f - 2.0f * t);
+	}
+}
+
+DirtyRect ApplyTerrainBrush(Heightfield& heightfield, float x, float z, const BrushSettings& settings, float deltaTime)
+{
+	const int width = heightfield.GetWidth();
+	const int height = heightfield.GetHeight();
+	const float cellSize = heightfield.GetCellSize();
+	const float centreX = x / cellSize;
+	const float centreZ = z / cellSize;
+	const float radius = settings.radius / cellSize;
+
+	DirtyRect footprint;
+	footprint.x0 = std::max((int)std::floor(centreX - radius), 0);
+	footprint.y0 = std::max((int)std::floor(centreZ - radius), 0);
+	footprint.x1 = std::min((int)std::ceil(centreX + radius), width - 1);
+	footprint.y1 = std::min((int)std::ceil(centreZ + radius), height - 1);
+	if (footprint.IsEmpty())
+		return footprint;
+
+	// Smoothing needs the untouched neighbours, so snapshot the footprint plus a one sample border
+	DirtyRect source = footprint.Expanded(1, width, height);
+	const int sourceWidth = source.x1 - source.x0 + 1;
+	std::vector<float> snapshot;
+	if (settings.mode == BrushSmooth)
+	{
+		snapshot.resize((size_t)sourceWidth * (source.y1 - source.y0 + 1));
+		for (int sz = source.y0; sz <= source.y1; ++sz)
+			std::copy(heightfield.GetRow(sz) + source.x0, heightfield.GetRow(sz) + source.x1 + 1, snapshot.begin() + (size_t)(sz - source.y0) * sourceWidth);
+	}
+
+	auto snapshotAt = [&](int sx, int sz)
+	{
+		sx = std::min(std::max(sx, source.x0), source.x1);
+		sz = std::min(std::max(sz, source.y0), source.y1);
+		return snapshot[(size_t)(sz - source.y0) * sourceWidth + (sx - source.x0)];
+	};
+
+	const float rate = std::min(settings.strength * deltaTime, 1.0f);
+	const float raiseAmount = settings.strength * deltaTime;
+
+	// Large brushes on big terrains are spread across the workers; small dabs run inline
+	const int rows = footprint.y1 - footprint.y0 + 1;
+	JobSystem::Get().ParallelFor(rows, 32, [&](int begin, int end)
+	{
+		for (int row = begin; row < end; ++row)
+		{
+			int sz = footprint.y0 + row;
+			float* heights = heightfield.GetRow(sz);
+			for (int sx = footprint.x0; sx <= footprint.x1; ++sx)
+			{
+				float dx = sx - centreX;
+				float dz = sz - centreZ;
+				float weight = BrushWeight(std::sqrt(dx * dx + dz * dz), radius, settings.falloff);
+				if (weight <= 0.0f)
+					continue;
+
+				float& h = heights[sx];
+				switch (settings.mode)
+				{
+				case BrushRaise:
+					h += raiseAmount * weight;
+					break;
+				case BrushLower:
+					h -= raiseAmount * weight;
+					break;
+				case BrushSmooth:
+				{
+					float average = (snapshotAt(sx - 1, sz) + snapshotAt(sx + 1, sz) + snapshotAt(sx, sz - 1) + snapshotAt(sx, sz + 1) + snapshotAt(sx, sz) * 4.0f) * 0.125f;
+					h += (average - h) * rate * weight;
+					break;
+				}
+				case BrushFlatten:
+					h += (settings.flattenHeight - h) * rate * weight;
+					break;
+				}
+			}
+		}
+	});
+
+	return footprint;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Heightfield.h"
+
+// Inclusive rectangle of heightfield samples touched by an edit
+struct DirtyRect
+{
+	int x0 = 0;
+	int y0 = 0;
+	int x1 = -1;
+	int y1 = -1;
+
+	bool IsEmpty() const { return x1 < x0 || y1 < y0; }
+
+	void Include(const DirtyRect& other)
+	{
+		if (other.IsEmpty())
+			return;
+		if (IsEmpty())
+		{
+			*this = other;
+			return;
+		}
+		x0 = std::min(x0, other.x0);
+		y0 = std::min(y0, other.y0);
+		x1 = std::max(x1, other.x1);
+		y1 = std::max(y1, other.y1);
+	}
+
+	// Grow by 'border' samples, clipped to a width x height grid
+	DirtyRect Expanded(int border, int width, int height) const
+	{
+		DirtyRect result;
+		if (IsEmpty())
+			return result;
+		result.x0 = std::max(x0 - border, 0);
+		result.y0 = std::max(y0 - border, 0);
+		result.x1 = std::min(x1 + border, width - 1);
+		result.y1 = std::min(y1 + border, height - 1);
+		return result;
+	}
+};
+
+enum BrushMode
+{
+	BrushRaise = 0,
+	BrushLower = 1,
+	BrushSmooth = 2,
+	BrushFlatten = 3,
+};
+
+struct BrushSettings
+{
+	int		mode = BrushRaise;
+	float	radius = 2.0f;			// world units
+	float	strength = 2.0f;		// world units per second at the centre (raise/lower), blend rate otherwise
+	float	falloff = 0.5f;			// 0 = hard edge, 1 = smooth all the way from the centre
+	float	flattenHeight = 0.0f;	// target for BrushFlatten, in heightfield units
+};
+
+// Applies one brush dab centred at heightfield-local (x, z) and returns the samples it changed.
+// Smoothing reads from a snapshot of the footprint, so the result does not depend on the order
+// rows are processed in.
+DirtyRect ApplyTerrainBrush(Heightfield& heightfield, float x, float z, const BrushSettings& settings, float deltaTime);
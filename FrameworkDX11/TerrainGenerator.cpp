@@ -0,0 +1,90 @@
+#include "TerrainGenerator.h"
+#include "JobSystem.h"
+
+#include <cmath>
+
+namespace
+{
+	inline float Fade(float t)
+	{
+		return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+	}
+
+	inline float Gradient(uint32_t seed, int ix, int iy, float dx, float dy)
+	{
+		uint32_t h = HashUInt(seed ^ HashUInt((uint32_t)ix * 73856093u ^ (uint32_t)iy * 19349663u));
+		// 8 unit-ish gradient directions
+		switch (h & 7)
+		{
+		case 0: return dx + dy;
+		case 1: return dx - dy;
+		case 2: return -dx + dy;
+		case 3: return -dx - dy;
+		case 4: return dx;
+		case 5: return -dx;
+		case 6: return dy;
+		default: return -dy;
+		}
+	}
+
+	// Returns roughly [-1, 1]
+	float GradientNoise(uint32_t seed, float x, float y)
+	{
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		int ix = (int)fx;
+		int iy = (int)fy;
+		float dx = x - fx;
+		float dy = y - fy;
+
+		float n00 = Gradient(seed, ix, iy, dx, dy);
+		float n10 = Gradient(seed, ix + 1, iy, dx - 1.0f, dy);
+		float n01 = Gradient(seed, ix, iy + 1, dx, dy - 1.0f);
+		float n11 = Gradient(seed, ix + 1, iy + 1, dx - 1.0f, dy - 1.0f);
+
+		float u = Fade(dx);
+		float v = Fade(dy);
+		float nx0 = n00 + (n10 - n00) * u;
+		float nx1 = n01 + (n11 - n01) * u;
+		return nx0 + (nx1 - nx0) * v;
+	}
+}
+
+void GenerateFractalTerrain(Heightfield& heightfield, const FractalTerrainSettings& settings)
+{
+	const int width = heightfield.GetWidth();
+	const int height = heightfield.GetHeight();
+
+	JobSystem::Get().ParallelFor(height, 8, [&](int begin, int end)
+	{
+		for (int y = begin; y < end; ++y)
+		{
+			float* row = heightfield.GetRow(y);
+			for (int x = 0; x < width; ++x)
+			{
+				float frequency = settings.baseFrequency;
+				float amplitude = 1.0f;
+				float smooth = 0.0f;
+				float ridged = 0.0f;
+				float total = 0.0f;
+
+				for (int octave = 0; octave < settings.octaves; ++octave)
+				{
+					float n = GradientNoise(settings.seed + octave * 1013u, x * frequency, y * frequency);
+					smooth += n * amplitude;
+
+					float r = 1.0f - std::fabs(n);
+					ridged += r * r * amplitude;
+
+					total += amplitude;
+					frequency *= settings.lacunarity;
+					amplitude *= settings.persistence;
+				}
+
+				smooth = smooth / total * 0.5f + 0.5f;
+				ridged = ridged / total;
+				row[x] = (smooth + (ridged - smooth) * settings.ridgeBlend) * settings.heightScale;
+			}
+		}
+	});
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Heightfield.h"
+
+struct FractalTerrainSettings
+{
+	uint32_t	seed = 1;
+	int			octaves = 8;
+	float		baseFrequency = 1.0f / 256.0f;	// cycles per sample at the first octave
+	float		lacunarity = 2.0f;
+	float		persistence = 0.5f;
+	float		heightScale = 60.0f;			// world units
+	float		ridgeBlend = 0.35f;				// 0 = smooth fBm, 1 = fully ridged
+};
+
+// Seeded gradient-noise fBm. Rows are generated in parallel and the output depends only on the
+// settings, never on the number of worker threads.
+void GenerateFractalTerrain(Heightfield& heightfield, const FractalTerrainSettings& settings);
+
+// Small deterministic hash shared by the procedural terrain code
+inline uint32_t HashUInt(uint32_t value)
+{
+	value ^= value >> 16;
+	value *= 0x7feb352d;
+	value ^= value >> 15;
+	value *= 0x846ca68b;
+	value ^= value >> 16;
+	return value;
+}
+
+// Counter-based random stream; each stream is fully determined by its seed
+struct RandomStream
+{
+	explicit RandomStream(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+	uint32_t NextUInt()
+	{
+		// splitmix64
+		uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return (uint32_t)((z ^ (z >> 31)) >> 32);
+	}
+
+	// [0, 1)
+	float NextFloat() { return (NextUInt() >> 8) * (1.0f / 16777216.0f); }
+
+	uint64_t state;
+};
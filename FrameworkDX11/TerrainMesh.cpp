@@ -0,0 +1,63 @@
+#include "TerrainMesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	XMFLOAT3 Normalise(float x, float y, float z)
+	{
+		float scale = 1.0f / sqrt(x * x + y * y + z * z);
+		return XMFLOAT3(x * scale, y * scale, z * scale);
+	}
+}
+
+void TerrainMesh::ComputeVertex(const Heightfield& heightfield, float cellSize, float textureRepeat, int x, int z, SimpleVertex& vertex)
+{
+	const float height = heightfield.At(x, z);
+	float left = heightfield.AtClamped(x - 1, z);
+	float right = heightfield.AtClamped(x + 1, z);
+	float down = heightfield.AtClamped(x, z - 1);
+	float up = heightfield.AtClamped(x, z + 1);
+
+	XMFLOAT3 tangent = Normalise(2.0f * cellSize, right - left, 0.0f);
+	XMFLOAT3 binormal = Normalise(0.0f, up - down, 2.0f * cellSize);
+
+	// binormal x tangent, which points up
+	XMFLOAT3 normal = Normalise(binormal.y * tangent.z - binormal.z * tangent.y,
+		binormal.z * tangent.x - binormal.x * tangent.z,
+		binormal.x * tangent.y - binormal.y * tangent.x);
+
+	vertex.Pos = XMFLOAT3(x * cellSize, height, z * cellSize);
+	vertex.Normal = normal;
+	vertex.TexCoord = XMFLOAT2(x / textureRepeat, z / textureRepeat);
+	vertex.tangent = tangent;
+	vertex.biTangent = binormal;
+}
+
+void TerrainMesh::BuildChunkVertices(const Heightfield& heightfield, float cellSize, float textureRepeat, int x0, int z0, int quads, vector<SimpleVertex>& vertices)
+{
+	const int stride = quads + 1;
+	vertices.resize((size_t)stride * stride);
+	for (int z = 0; z < stride; ++z)
+		for (int x = 0; x < stride; ++x)
+			ComputeVertex(heightfield, cellSize, textureRepeat, x0 + x, z0 + z, vertices[(size_t)z * stride + x]);
+}
+
+DirtyRect TerrainMesh::GetChunkRegion(const DirtyRect& samples, int width, int height, int x0, int z0, int quads)
+{
+	const DirtyRect region = samples.Expanded(1, width, height);
+
+	// Chunks share their border samples, so this is against the inclusive vertex range
+	DirtyRect result;
+	if (region.IsEmpty())
+		return result;
+	result.x0 = max(region.x0, x0);
+	result.y0 = max(region.y0, z0);
+	result.x1 = min(region.x1, x0 + quads);
+	result.y1 = min(region.y1, z0 + quads);
+	return result.IsEmpty() ? DirtyRect() : result;
+}
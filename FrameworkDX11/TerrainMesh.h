@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include "Heightfield.h"
+#include "SimpleVertex.h"
+#include "TerrainBrush.h"
+
+// The terrain's vertices, one per heightfield sample in heightfield-local space. Chunks share
+// their border samples, so a chunk of quads x quads cells has (quads + 1)^2 vertices, row by row.
+// Init builds them with BuildChunkVertices and sculpting recomputes GetChunkRegion's with
+// ComputeVertex, so both paths give the same bits.
+namespace TerrainMesh
+{
+	// Normal and tangent frame from central differences, clamped at the edges
+	void		ComputeVertex(const Heightfield& heightfield, float cellSize, float textureRepeat, int x, int z, SimpleVertex& vertex);
+	void		BuildChunkVertices(const Heightfield& heightfield, float cellSize, float textureRepeat, int x0, int z0, int quads, std::vector<SimpleVertex>& vertices);
+
+	// The samples of the chunk at (x0, z0) whose vertices change when 'samples' of a width x height
+	// field are edited: one further out, as the normals reach that far. Empty when none are.
+	DirtyRect	GetChunkRegion(const DirtyRect& samples, int width, int height, int x0, int z0, int quads);
+}
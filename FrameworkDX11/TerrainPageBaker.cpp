@@ -0,0 +1,140 @@
+#include "TerrainPageBaker.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+	inline int Wrap(int value, int size)
+	{
+		value %= size;
+		return value < 0 ? value + size : value;
+	}
+
+	// Bilinear with wrapping; x and y are in texels with texel centres at +0.5, as the sampler has them
+	void SampleWrapped(const Image& image, float x, float y, float weight, float* out)
+	{
+		const int width = image.GetWidth();
+		const int height = image.GetHeight();
+		x -= 0.5f;
+		y -= 0.5f;
+		float fx = floor(x);
+		float fy = floor(y);
+		float tx = x - fx;
+		float ty = y - fy;
+		int x0 = Wrap((int)fx, width);
+		int y0 = Wrap((int)fy, height);
+		int x1 = x0 + 1 < width ? x0 + 1 : 0;
+		int y1 = y0 + 1 < height ? y0 + 1 : 0;
+
+		const uint8_t* a = image.At(x0, y0);
+		const uint8_t* b = image.At(x1, y0);
+		const uint8_t* c = image.At(x0, y1);
+		const uint8_t* d = image.At(x1, y1);
+		float wa = (1.0f - tx) * (1.0f - ty) * weight;
+		float wb = tx * (1.0f - ty) * weight;
+		float wc = (1.0f - tx) * ty * weight;
+		float wd = tx * ty * weight;
+		for (int channel = 0; channel < 4; ++channel)
+			out[channel] += a[channel] * wa + b[channel] * wb + c[channel] * wc + d[channel] * wd;
+	}
+
+	inline uint8_t ToByte(float value)
+	{
+		return (uint8_t)min(max(value + 0.5f, 0.0f), 255.0f);
+	}
+}
+
+void TerrainPageBaker::Bake(const TerrainPageSource& source, const VirtualTextureLayout& layout, uint32_t page, uint8_t* diffuse, uint8_t* normals)
+{
+	const int mip = VirtualPageMip(page);
+	const int content = layout.GetContentSize();
+	const int firstX = VirtualPageX(page) * content - layout.border;
+	const int firstY = VirtualPageY(page) * content - layout.border;
+
+	// Virtual texture coordinates across one texel of this level, and samples across the same
+	const float texelSpan = (float)(1 << mip) / layout.GetVirtualSize();
+	const float extentX = (float)(source.sampleWidth - 1);
+	const float extentY = (float)(source.sampleHeight - 1);
+
+	// The layer level whose texels come closest to this level's, and the next for trilinear
+	const int layerSize = source.diffuse[0].GetWidth();
+	float footprint = texelSpan * max(extentX, extentY) / source.textureRepeat * layerSize;
+	float lod = min(max(log2(max(footprint, 1e-6f)), 0.0f), (float)(source.mipCount - 1));
+	const int fine = (int)lod;
+	const int coarse = min(fine + 1, source.mipCount - 1);
+	const float blend = lod - fine;
+
+	const int planeCount = (source.layerCount + 3) / 4;
+	const size_t samplePitch = (size_t)source.sampleWidth * 4;
+
+	for (int row = 0; row < layout.pageSize; ++row)
+	{
+		// Texels beyond the edge of the virtual texture only ever fill borders; they repeat the edge
+		float v = min(max((firstY + row + 0.5f) * texelSpan, 0.0f), 1.0f);
+		float sy = v * extentY;
+		int y0 = min((int)sy, source.sampleHeight - 1);
+		int y1 = min(y0 + 1, source.sampleHeight - 1);
+		float ty = sy - y0;
+
+		uint8_t* diffuseRow = diffuse + (size_t)row * layout.pageSize * 4;
+		uint8_t* normalRow = normals + (size_t)row * layout.pageSize * 4;
+		for (int column = 0; column < layout.pageSize; ++column)
+		{
+			float u = min(max((firstX + column + 0.5f) * texelSpan, 0.0f), 1.0f);
+			float sx = u * extentX;
+			int x0 = min((int)sx, source.sampleWidth - 1);
+			int x1 = min(x0 + 1, source.sampleWidth - 1);
+			float tx = sx - x0;
+
+			float weights[8] = {};
+			float total = 0.0f;
+			for (int plane = 0; plane < planeCount; ++plane)
+			{
+				const uint8_t* splat = source.splat[plane];
+				const uint8_t* a = splat + y0 * samplePitch + x0 * 4;
+				const uint8_t* b = splat + y0 * samplePitch + x1 * 4;
+				const uint8_t* c = splat + y1 * samplePitch + x0 * 4;
+				const uint8_t* d = splat + y1 * samplePitch + x1 * 4;
+				for (int channel = 0; channel < 4 && plane * 4 + channel < source.layerCount; ++channel)
+				{
+					float top = a[channel] + (b[channel] - a[channel]) * tx;
+					float bottom = c[channel] + (d[channel] - c[channel]) * tx;
+					weights[plane * 4 + channel] = top + (bottom - top) * ty;
+					total += weights[plane * 4 + channel];
+				}
+			}
+			total = max(total, 0.0001f);
+
+			float colour[4] = {};
+			float bump[4] = {};
+			for (int layer = 0; layer < source.layerCount; ++layer)
+			{
+				if (weights[layer] <= 0.0f)
+					continue;
+				float w = weights[layer] / total;
+
+				for (int level = fine; ; level = coarse)
+				{
+					float levelWeight = level == fine ? w * (1.0f - blend) : w * blend;
+					const Image& diffuseLevel = source.diffuse[layer * source.mipCount + level];
+					const Image& normalLevel = source.normals[layer * source.mipCount + level];
+					float lu = sx / source.textureRepeat;
+					float lv = sy / source.textureRepeat;
+					SampleWrapped(diffuseLevel, lu * diffuseLevel.GetWidth(), lv * diffuseLevel.GetHeight(), levelWeight, colour);
+					SampleWrapped(normalLevel, lu * normalLevel.GetWidth(), lv * normalLevel.GetHeight(), levelWeight, bump);
+					if (level == coarse || blend == 0.0f)
+						break;
+				}
+			}
+
+			for (int channel = 0; channel < 4; ++channel)
+			{
+				diffuseRow[column * 4 + channel] = ToByte(colour[channel]);
+				normalRow[column * 4 + channel] = ToByte(bump[channel]);
+			}
+		}
+	}
+}
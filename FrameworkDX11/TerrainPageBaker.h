@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Image.h"
+#include "VirtualPageManager.h"
+
+// What terrain pages are made from: the splat weights and the layers' mip chains as Terrain
+// keeps them on the CPU
+struct TerrainPageSource
+{
+	const uint8_t*			splat[2] = {};				// RGBA8 weights per heightfield sample, layers 0-3 and 4-7
+	int						sampleWidth = 0;
+	int						sampleHeight = 0;
+	float					textureRepeat = 16.0f;		// samples per repeat of the layer textures
+	int						layerCount = 0;
+	const Image*			diffuse = nullptr;			// layer l level m at l * mipCount + m
+	const Image*			normals = nullptr;
+	int						mipCount = 0;
+};
+
+// Renders pages of the terrain's virtual texture on the CPU, so the pixel shader reads one
+// diffuse and one normal texel where PSTerrain blends up to eight layers of each.
+//
+// The virtual texture covers the heightfield from its first sample to its last. Each texel
+// takes the splat weights bilinearly from the samples around it, as PSTerrain does, and each
+// layer trilinearly from the level of its chain matching the page's texel footprint. Normals are
+// blended still encoded, which equals blending their X and Y decoded since the 2x - 1 is linear;
+// PSTerrainVirtual then rebuilds Z from the blend where PSTerrain rebuilds it per layer, so the
+// two differ a little only where blended layers' normals disagree.
+namespace TerrainPageBaker
+{
+	// diffuse and normals receive layout.pageSize squared RGBA8 texels each, borders included
+	void					Bake(const TerrainPageSource& source, const VirtualTextureLayout& layout, uint32_t page, uint8_t* diffuse, uint8_t* normals);
+}
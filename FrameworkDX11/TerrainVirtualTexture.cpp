@@ -0,0 +1,396 @@
+#include "TerrainVirtualTexture.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	template <typename T>
+	void SafeRelease(T*& resource)
+	{
+		if (resource)
+			resource->Release();
+		resource = nullptr;
+	}
+}
+
+TerrainVirtualTexture::TerrainVirtualTexture()
+{
+}
+
+TerrainVirtualTexture::~TerrainVirtualTexture()
+{
+	Cleanup();
+}
+
+HRESULT TerrainVirtualTexture::Init(ID3D11Device* pd3dDevice, const TerrainPageSource& source, const VirtualTextureSettings& settings, const XMFLOAT4& worldToVirtual)
+{
+	Cleanup();
+
+	const VirtualTextureLayout& layout = settings.layout;
+	if (settings.cacheSize % layout.pageSize != 0 || layout.pageSize % 4 != 0 || settings.cacheSize / layout.pageSize > 256)
+		return E_INVALIDARG;
+
+	m_pd3dDevice = pd3dDevice;
+	m_source = source;
+	m_settings = settings;
+	m_pages.Init(layout, settings.cacheSize / layout.pageSize);
+
+	// Without a tile file every page is baked each time it loads, which still works
+	m_tiles.Create(settings.tileFile);
+
+	const int mipCount = layout.GetMipCount();
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = layout.pagesPerSide;
+	desc.Height = layout.pagesPerSide;
+	desc.MipLevels = mipCount;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	m_pages.UpdatePageTable();
+	vector<D3D11_SUBRESOURCE_DATA> data(mipCount);
+	for (int mip = 0; mip < mipCount; ++mip)
+	{
+		data[mip].pSysMem = m_pages.GetPageTable(mip);
+		data[mip].SysMemPitch = (layout.pagesPerSide >> mip) * 4;
+	}
+	HRESULT hr = pd3dDevice->CreateTexture2D(&desc, data.data(), &m_pPageTable);
+	if (FAILED(hr))
+		return hr;
+	hr = pd3dDevice->CreateShaderResourceView(m_pPageTable, nullptr, &m_pPageTableView);
+	if (FAILED(hr))
+		return hr;
+
+	// The physical cache: one level, filled a page at a time
+	desc.Width = settings.cacheSize;
+	desc.Height = settings.cacheSize;
+	desc.MipLevels = 1;
+	desc.Format = DXGI_FORMAT_BC1_UNORM;
+	hr = pd3dDevice->CreateTexture2D(&desc, nullptr, &m_pPhysicalDiffuse);
+	if (FAILED(hr))
+		return hr;
+	hr = pd3dDevice->CreateShaderResourceView(m_pPhysicalDiffuse, nullptr, &m_pPhysicalDiffuseView);
+	if (FAILED(hr))
+		return hr;
+
+	desc.Format = DXGI_FORMAT_BC5_UNORM;
+	hr = pd3dDevice->CreateTexture2D(&desc, nullptr, &m_pPhysicalNormal);
+	if (FAILED(hr))
+		return hr;
+	hr = pd3dDevice->CreateShaderResourceView(m_pPhysicalNormal, nullptr, &m_pPhysicalNormalView);
+	if (FAILED(hr))
+		return hr;
+
+	const float cacheSize = (float)settings.cacheSize;
+	m_properties.VirtualScaleOffset = worldToVirtual;
+	m_properties.VirtualSize = (float)layout.GetVirtualSize();
+	m_properties.PagesPerSide = layout.pagesPerSide;
+	m_properties.VirtualMipCount = mipCount;
+	m_properties.PhysicalPage = XMFLOAT4(layout.pageSize / cacheSize, layout.border / cacheSize, layout.GetContentSize() / cacheSize, 0.0f);
+
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(VirtualTexturePropertiesConstantBuffer);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = 0;
+	return pd3dDevice->CreateBuffer(&bd, nullptr, &m_pConstantBuffer);
+}
+
+void TerrainVirtualTexture::Cleanup()
+{
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_producing == 0; });
+		m_completed.clear();
+	}
+	m_tiles.Close();
+
+	ReleaseFeedbackTarget();
+	SafeRelease(m_pPageTableView);
+	SafeRelease(m_pPageTable);
+	SafeRelease(m_pPhysicalDiffuseView);
+	SafeRelease(m_pPhysicalDiffuse);
+	SafeRelease(m_pPhysicalNormalView);
+	SafeRelease(m_pPhysicalNormal);
+	SafeRelease(m_pConstantBuffer);
+	m_pd3dDevice = nullptr;
+}
+
+HRESULT TerrainVirtualTexture::CreateFeedbackTarget(UINT width, UINT height)
+{
+	ReleaseFeedbackTarget();
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+	HRESULT hr = m_pd3dDevice->CreateTexture2D(&desc, nullptr, &m_pFeedback);
+	if (FAILED(hr))
+		return hr;
+	hr = m_pd3dDevice->CreateRenderTargetView(m_pFeedback, nullptr, &m_pFeedbackView);
+	if (FAILED(hr))
+		return hr;
+
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (int i = 0; i < FEEDBACK_LATENCY; ++i)
+	{
+		hr = m_pd3dDevice->CreateTexture2D(&desc, nullptr, &m_pFeedbackStaging[i]);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	desc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	desc.CPUAccessFlags = 0;
+	hr = m_pd3dDevice->CreateTexture2D(&desc, nullptr, &m_pFeedbackDepth);
+	if (FAILED(hr))
+		return hr;
+	hr = m_pd3dDevice->CreateDepthStencilView(m_pFeedbackDepth, nullptr, &m_pFeedbackDepthView);
+	if (FAILED(hr))
+		return hr;
+
+	m_feedbackWidth = width;
+	m_feedbackHeight = height;
+	return S_OK;
+}
+
+void TerrainVirtualTexture::ReleaseFeedbackTarget()
+{
+	SafeRelease(m_pFeedbackView);
+	SafeRelease(m_pFeedback);
+	SafeRelease(m_pFeedbackDepthView);
+	SafeRelease(m_pFeedbackDepth);
+	for (int i = 0; i < FEEDBACK_LATENCY; ++i)
+		SafeRelease(m_pFeedbackStaging[i]);
+	m_feedbackWidth = 0;
+	m_feedbackHeight = 0;
+	m_feedbackWritten = 0;
+	m_feedbackRead = 0;
+}
+
+void TerrainVirtualTexture::BeginFeedback(ID3D11DeviceContext* pContext)
+{
+	UINT viewportCount = 1;
+	pContext->RSGetViewports(&viewportCount, &m_savedViewport);
+	pContext->OMGetRenderTargets(1, &m_pSavedTarget, &m_pSavedDepth);
+
+	// Sized from the viewport, so the target follows it without being told
+	UINT width = max((UINT)m_savedViewport.Width / m_settings.feedbackDivisor, 1u);
+	UINT height = max((UINT)m_savedViewport.Height / m_settings.feedbackDivisor, 1u);
+	if ((width != m_feedbackWidth || height != m_feedbackHeight) && FAILED(CreateFeedbackTarget(width, height)))
+		ReleaseFeedbackTarget();
+
+	// Drawn anyway when the target is missing, just into nothing
+	const float clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	if (m_pFeedbackView)
+	{
+		pContext->ClearRenderTargetView(m_pFeedbackView, clear);
+		pContext->ClearDepthStencilView(m_pFeedbackDepthView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	}
+	pContext->OMSetRenderTargets(1, &m_pFeedbackView, m_pFeedbackDepthView);
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (FLOAT)width;
+	viewport.Height = (FLOAT)height;
+	viewport.MaxDepth = 1.0f;
+	pContext->RSSetViewports(1, &viewport);
+
+	// Gradients across the smaller target are divisor times larger than on screen; Bind uploads it
+	m_properties.VirtualLodBias = -log2((float)m_settings.feedbackDivisor);
+}
+
+void TerrainVirtualTexture::EndFeedback(ID3D11DeviceContext* pContext)
+{
+	if (m_pFeedback)
+	{
+		// The oldest copy not yet read back is given up rather than waited for
+		if (m_feedbackWritten - m_feedbackRead >= FEEDBACK_LATENCY)
+			++m_feedbackRead;
+		pContext->CopyResource(m_pFeedbackStaging[m_feedbackWritten % FEEDBACK_LATENCY], m_pFeedback);
+		++m_feedbackWritten;
+	}
+
+	pContext->OMSetRenderTargets(1, &m_pSavedTarget, m_pSavedDepth);
+	pContext->RSSetViewports(1, &m_savedViewport);
+	SafeRelease(m_pSavedTarget);
+	SafeRelease(m_pSavedDepth);
+
+	m_properties.VirtualLodBias = 0.0f;
+}
+
+void TerrainVirtualTexture::ReadFeedback(ID3D11DeviceContext* pContext)
+{
+	// Only copies at least a frame old, and only without stalling for them
+	if (m_feedbackWritten - m_feedbackRead < 2)
+		return;
+
+	ID3D11Texture2D* staging = m_pFeedbackStaging[m_feedbackRead % FEEDBACK_LATENCY];
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(pContext->Map(staging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped)))
+		return;
+
+	m_requests.clear();
+	VirtualFeedback::Analyse(static_cast<const uint8_t*>(mapped.pData), m_feedbackWidth, m_feedbackHeight, mapped.RowPitch, m_settings.layout, m_requests);
+	pContext->Unmap(staging, 0);
+	++m_feedbackRead;
+
+	m_pages.Request(m_requests.data(), (int)m_requests.size());
+}
+
+void TerrainVirtualTexture::Produce(Load& load)
+{
+	const int pageSize = m_settings.layout.pageSize;
+	const size_t pageBytes = (size_t)pageSize * pageSize * 4;
+
+	// Diffuse then normals, RGBA8, as the tile file keeps them
+	vector<uint8_t> texels;
+	if (!m_tiles.Read(load.page, texels) || texels.size() != pageBytes * 2)
+	{
+		texels.resize(pageBytes * 2);
+		TerrainPageBaker::Bake(m_source, m_settings.layout, load.page, texels.data(), texels.data() + pageBytes);
+		m_tiles.Write(load.page, texels.data(), texels.size());
+		load.baked = true;
+	}
+
+	Image diffuse(pageSize, pageSize);
+	Image normals(pageSize, pageSize);
+	memcpy(diffuse.GetData(), texels.data(), pageBytes);
+	memcpy(normals.GetData(), texels.data() + pageBytes, pageBytes);
+	BlockCompressor::Compress(diffuse, BCFormatBC1, BCQualityFast, load.diffuse);
+	BlockCompressor::CompressNormalMap(normals, BCQualityFast, load.normals);
+	load.ok = true;
+}
+
+void TerrainVirtualTexture::Upload(ID3D11DeviceContext* pContext, const Load& load, int slot)
+{
+	const int pageSize = m_settings.layout.pageSize;
+	const int slotsPerSide = m_pages.GetSlotsPerSide();
+
+	D3D11_BOX box = {};
+	box.left = (slot % slotsPerSide) * pageSize;
+	box.right = box.left + pageSize;
+	box.top = (slot / slotsPerSide) * pageSize;
+	box.bottom = box.top + pageSize;
+	box.front = 0;
+	box.back = 1;
+
+	const UINT blocksWide = pageSize / 4;
+	pContext->UpdateSubresource(m_pPhysicalDiffuse, 0, &box, load.diffuse.blocks.data(), blocksWide * BlockCompressor::BlockBytes(BCFormatBC1), 0);
+	pContext->UpdateSubresource(m_pPhysicalNormal, 0, &box, load.normals.blocks.data(), blocksWide * BlockCompressor::BlockBytes(BCFormatBC5), 0);
+}
+
+void TerrainVirtualTexture::Update(ID3D11DeviceContext* pContext)
+{
+	if (!m_pd3dDevice)
+		return;
+
+	ReadFeedback(pContext);
+
+	// A few finished pages a frame; the rest wait, still counted against maxLoads
+	vector<shared_ptr<Load>> ready;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		size_t count = min(m_completed.size(), (size_t)m_settings.maxUploads);
+		ready.assign(m_completed.begin(), m_completed.begin() + count);
+		m_completed.erase(m_completed.begin(), m_completed.begin() + count);
+	}
+
+	for (const shared_ptr<Load>& load : ready)
+	{
+		if (!load->ok)
+		{
+			m_pages.Abandon(load->page);
+			continue;
+		}
+		if (load->baked)
+			++m_baked;
+		else
+			++m_tileReads;
+
+		int slot = m_pages.Complete(load->page);
+		if (slot >= 0)
+			Upload(pContext, *load, slot);
+	}
+
+	m_lastRequested = m_pages.GetRequestedCount();
+	m_loads.clear();
+	m_pages.Plan(m_settings.maxLoads - m_pages.GetPendingCount(), m_loads);
+	for (uint32_t page : m_loads)
+	{
+		auto load = make_shared<Load>();
+		load->page = page;
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			++m_producing;
+		}
+
+		JobSystem::Get().Submit([this, load]()
+		{
+			Produce(*load);
+
+			lock_guard<mutex> lock(m_mutex);
+			m_completed.push_back(load);
+			if (--m_producing == 0)
+				m_idle.notify_all();
+		});
+	}
+
+	if (m_pages.UpdatePageTable())
+	{
+		const VirtualTextureLayout& layout = m_settings.layout;
+		for (int mip = 0; mip < layout.GetMipCount(); ++mip)
+			pContext->UpdateSubresource(m_pPageTable, mip, nullptr, m_pages.GetPageTable(mip), (layout.pagesPerSide >> mip) * 4, 0);
+	}
+}
+
+void TerrainVirtualTexture::Invalidate(float u0, float v0, float u1, float v1)
+{
+	if (!m_pd3dDevice)
+		return;
+
+	// Pages finished from the old texels are still uploaded, then made again as they are stale
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_producing == 0; });
+	}
+
+	m_pages.Invalidate(u0, v0, u1, v1);
+
+	vector<uint32_t> pages;
+	m_pages.GetPagesCovering(u0, v0, u1, v1, pages);
+	for (uint32_t page : pages)
+		m_tiles.Remove(page);
+}
+
+void TerrainVirtualTexture::Bind(ID3D11DeviceContext* pContext)
+{
+	pContext->UpdateSubresource(m_pConstantBuffer, 0, nullptr, &m_properties, 0, 0);
+
+	ID3D11ShaderResourceView* views[3] = { m_pPageTableView, m_pPhysicalDiffuseView, m_pPhysicalNormalView };
+	pContext->PSSetShaderResources(10, 3, views);
+	pContext->PSSetConstantBuffers(5, 1, &m_pConstantBuffer);
+}
+
+size_t TerrainVirtualTexture::GetCacheBytes() const
+{
+	// BC1 is half a byte a texel and BC5 one
+	size_t texels = (size_t)m_settings.cacheSize * m_settings.cacheSize;
+	return texels / 2 + texels;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <DirectXMath.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BlockCompressor.h"
+#include "TerrainPageBaker.h"
+#include "VirtualPageManager.h"
+#include "VirtualTileFile.h"
+#include "structures.h"
+
+struct VirtualTextureSettings
+{
+	VirtualTextureLayout	layout;
+	int						cacheSize = 4096;			// physical texels a side; a whole number of pages
+	int						feedbackDivisor = 8;		// feedback target is the viewport over this
+	int						maxLoads = 8;				// pages being produced or waiting to upload
+	int						maxUploads = 4;				// per frame
+	std::string				tileFile = "TerrainPages.vtf";
+};
+
+// Virtual texturing for the terrain's splat materials.
+//
+// The terrain is textured as one large virtual texture, 7680 texels across by default, whose
+// pages are baked from the splat weights and layers by TerrainPageBaker only once something on
+// screen needs them. Drawing the terrain with PSTerrainFeedback into a small integer target
+// records the page and level each pixel wants; Update reads that back a few frames later,
+// hands it to VirtualPageManager, and has the pages it plans produced on the job system: read
+// from the tile file if baked before, otherwise baked and written there, then transcoded to BC1
+// and BC5. Finished pages are copied into their slot of the physical cache textures, a few a
+// frame, and PSTerrainVirtual finds them through the page table.
+//
+// Pages are baked for this session's terrain, so the tile file is started afresh by Init.
+class TerrainVirtualTexture
+{
+public:
+	TerrainVirtualTexture();
+	~TerrainVirtualTexture();
+
+	// source must outlive the virtual texture; worldToVirtual maps world xz to virtual uv
+	HRESULT					Init(ID3D11Device* pd3dDevice, const TerrainPageSource& source, const VirtualTextureSettings& settings, const DirectX::XMFLOAT4& worldToVirtual);
+	void					Cleanup();
+
+	// Draws between these go to the feedback target; render targets and viewport are put back after
+	void					BeginFeedback(ID3D11DeviceContext* pContext);
+	void					EndFeedback(ID3D11DeviceContext* pContext);
+
+	void					Update(ID3D11DeviceContext* pContext);
+
+	// The source changed under [u0, u1] x [v0, v1]. Waits for pages being produced, which read it.
+	void					Invalidate(float u0, float v0, float u1, float v1);
+
+	// The page table, physical cache and properties, to t10-t12 and b5
+	void					Bind(ID3D11DeviceContext* pContext);
+
+	int						GetResidentPageCount() const { return m_pages.GetResidentCount(); }
+	int						GetSlotCount() const { return m_pages.GetSlotsPerSide() * m_pages.GetSlotsPerSide(); }
+	int						GetPendingPageCount() const { return m_pages.GetPendingCount(); }
+	int						GetRequestedPageCount() const { return m_lastRequested; }
+	int						GetEvictionCount() const { return m_pages.GetEvictionCount(); }
+	int						GetBakedCount() const { return m_baked; }
+	int						GetTileReadCount() const { return m_tileReads; }
+	size_t					GetCacheBytes() const;
+	uint64_t				GetTileFileSize() const { return m_tiles.GetFileSize(); }
+
+private:
+	static const int		FEEDBACK_LATENCY = 3;		// staging textures read back in turn
+
+	struct Load
+	{
+		uint32_t			page;
+		bool				ok = false;
+		bool				baked = false;				// rather than read from the tile file
+		CompressedImage		diffuse;
+		CompressedImage		normals;
+	};
+
+	HRESULT					CreateFeedbackTarget(UINT width, UINT height);
+	void					ReleaseFeedbackTarget();
+	void					ReadFeedback(ID3D11DeviceContext* pContext);
+	void					Produce(Load& load);
+	void					Upload(ID3D11DeviceContext* pContext, const Load& load, int slot);
+
+	ID3D11Device*			m_pd3dDevice = nullptr;
+	TerrainPageSource		m_source;
+	VirtualTextureSettings	m_settings;
+	VirtualPageManager		m_pages;
+	VirtualTileFile			m_tiles;
+	VirtualTexturePropertiesConstantBuffer	m_properties;
+
+	ID3D11Texture2D*		m_pPageTable = nullptr;
+	ID3D11ShaderResourceView*	m_pPageTableView = nullptr;
+	ID3D11Texture2D*		m_pPhysicalDiffuse = nullptr;
+	ID3D11ShaderResourceView*	m_pPhysicalDiffuseView = nullptr;
+	ID3D11Texture2D*		m_pPhysicalNormal = nullptr;
+	ID3D11ShaderResourceView*	m_pPhysicalNormalView = nullptr;
+	ID3D11Buffer*			m_pConstantBuffer = nullptr;
+
+	ID3D11Texture2D*		m_pFeedback = nullptr;
+	ID3D11RenderTargetView*	m_pFeedbackView = nullptr;
+	ID3D11Texture2D*		m_pFeedbackDepth = nullptr;
+	ID3D11DepthStencilView*	m_pFeedbackDepthView = nullptr;
+	ID3D11Texture2D*		m_pFeedbackStaging[FEEDBACK_LATENCY] = {};
+	UINT					m_feedbackWidth = 0;
+	UINT					m_feedbackHeight = 0;
+	uint64_t				m_feedbackWritten = 0;		// frames copied to staging
+	uint64_t				m_feedbackRead = 0;			// and read back or skipped
+
+	// What BeginFeedback replaced
+	ID3D11RenderTargetView*	m_pSavedTarget = nullptr;
+	ID3D11DepthStencilView*	m_pSavedDepth = nullptr;
+	D3D11_VIEWPORT			m_savedViewport = {};
+
+	std::mutex				m_mutex;
+	std::condition_variable	m_idle;
+	std::vector<std::shared_ptr<Load>>	m_completed;
+	int						m_producing = 0;			// submitted and not yet completed
+
+	std::vector<VirtualPageRequest>	m_requests;
+	std::vector<uint32_t>	m_loads;
+	int						m_lastRequested = 0;
+	int						m_baked = 0;
+	int						m_tileReads = 0;
+};
@@ -0,0 +1,247 @@
+#include "TextureAtlas.h"
+#include "ImageIO.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// ImGui compiles its own copy static too, so the two do not clash. Its warnings are silenced as
+// imgui_draw.cpp does, along with the static functions this file never calls.
+#ifdef _MSC_VER
+#pragma warning (push)
+#pragma warning (disable: 4456)                             // declaration of 'xx' hides previous local declaration
+#pragma warning (disable: 4505)                             // unreferenced local function has been removed
+#endif
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-function"        // warning: 'xxxx' defined but not used
+#pragma clang diagnostic ignored "-Wmissing-prototypes"     // warning: no previous prototype for function 'xxxx'
+#pragma clang diagnostic ignored "-Wimplicit-fallthrough"   // warning: this statement may fall through
+#pragma clang diagnostic ignored "-Wcast-qual"              // warning: cast from 'const xxxx *' to 'xxx *' drops const qualifier
+#endif
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"          // warning: 'xxxx' defined but not used
+#pragma GCC diagnostic ignored "-Wtype-limits"              // warning: comparison is always true due to limited range of data type
+#pragma GCC diagnostic ignored "-Wcast-qual"                // warning: cast from type 'const xxxx *' to type 'xxxx *' casts away qualifiers
+#endif
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "ImGui/imstb_rectpack.h"
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif
+#ifdef _MSC_VER
+#pragma warning (pop)
+#endif
+
+using namespace std;
+
+namespace
+{
+	int AlignUp(int value, int alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	int Wrap(int value, int size)
+	{
+		value %= size;
+		return value < 0 ? value + size : value;
+	}
+
+	// Copies one level of a texture to (x, y) of a page level with gutter texels of border
+	void Place(const Image& source, Image& page, int x, int y, int gutter, AtlasGutter mode)
+	{
+		const int width = source.GetWidth();
+		const int height = source.GetHeight();
+		for (int row = -gutter; row < height + gutter; ++row)
+		{
+			int sy = mode == AtlasGutterWrap ? Wrap(row, height) : min(max(row, 0), height - 1);
+			uint8_t* out = page.At(x - gutter, y + row);
+			if (gutter == 0 || mode == AtlasGutterClamp)
+			{
+				const uint8_t* in = source.GetRow(sy);
+				for (int i = 0; i < gutter; ++i, out += 4)
+					memcpy(out, in, 4);
+				memcpy(out, in, (size_t)width * 4);
+				out += (size_t)width * 4;
+				for (int i = 0; i < gutter; ++i, out += 4)
+					memcpy(out, in + (size_t)(width - 1) * 4, 4);
+			}
+			else
+			{
+				for (int column = -gutter; column < width + gutter; ++column, out += 4)
+					memcpy(out, source.At(Wrap(column, width), sy), 4);
+			}
+		}
+	}
+}
+
+int AtlasBuilder::Build(const Image* images, int count, const AtlasSettings& settings, TextureAtlas& atlas)
+{
+	const int unit = 1 << (settings.mipCount - 1);			// one texel of the coarsest level
+	const int gutter = settings.gutter * unit;
+	const int units = settings.pageSize / unit;
+
+	atlas = TextureAtlas();
+	atlas.pageSize = settings.pageSize;
+	atlas.mipCount = settings.mipCount;
+	atlas.entries.resize(count);
+
+	vector<stbrp_rect> remaining;
+	for (int i = 0; i < count; ++i)
+	{
+		AtlasEntry& entry = atlas.entries[i];
+		entry.width = AlignUp(images[i].GetWidth(), unit);
+		entry.height = AlignUp(images[i].GetHeight(), unit);
+
+		stbrp_rect rect = {};
+		rect.id = i;
+		int w = (entry.width + 2 * gutter) / unit;
+		int h = (entry.height + 2 * gutter) / unit;
+		if (images[i].IsEmpty() || w > units || h > units)
+			continue;
+		rect.w = (stbrp_coord)w;
+		rect.h = (stbrp_coord)h;
+		remaining.push_back(rect);
+	}
+
+	// One page at a time with whatever did not fit on the last
+	int placed = 0;
+	vector<stbrp_node> nodes(units);
+	while (!remaining.empty())
+	{
+		stbrp_context context;
+		stbrp_init_target(&context, units, units, nodes.data(), (int)nodes.size());
+		stbrp_pack_rects(&context, remaining.data(), (int)remaining.size());
+
+		vector<stbrp_rect> left;
+		for (const stbrp_rect& rect : remaining)
+		{
+			if (!rect.was_packed)
+			{
+				left.push_back(rect);
+				continue;
+			}
+
+			AtlasEntry& entry = atlas.entries[rect.id];
+			entry.page = atlas.pageCount;
+			entry.x = rect.x * unit + gutter;
+			entry.y = rect.y * unit + gutter;
+			entry.scaleU = (float)entry.width / settings.pageSize;
+			entry.scaleV = (float)entry.height / settings.pageSize;
+			entry.offsetU = (float)entry.x / settings.pageSize;
+			entry.offsetV = (float)entry.y / settings.pageSize;
+			++placed;
+		}
+		if (left.size() == remaining.size())
+			break;
+		remaining.swap(left);
+		++atlas.pageCount;
+	}
+
+	atlas.pages.resize((size_t)atlas.pageCount * settings.mipCount);
+	for (int page = 0; page < atlas.pageCount; ++page)
+	{
+		for (int mip = 0; mip < settings.mipCount; ++mip)
+		{
+			Image& level = atlas.pages[(size_t)page * settings.mipCount + mip];
+			level.Resize(max(settings.pageSize >> mip, 1), max(settings.pageSize >> mip, 1));
+			level.Fill(0);
+		}
+	}
+
+	// Textures cover separate rectangles of every level, so they can be placed in parallel
+	JobSystem::Get().ParallelFor(count, 1, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			const AtlasEntry& entry = atlas.entries[i];
+			if (entry.page < 0)
+				continue;
+
+			// A level of width / 2^m texels only matches the chain when that is a whole number
+			const Image& image = images[i];
+			vector<Image> chain;
+			if (image.GetWidth() != entry.width || image.GetHeight() != entry.height)
+				MipGenerator::Generate(image.Resampled(entry.width, entry.height, settings.gutterMode == AtlasGutterWrap), settings.mipSettings, chain);
+			else
+				MipGenerator::Generate(image, settings.mipSettings, chain);
+			for (int mip = 0; mip < settings.mipCount; ++mip)
+			{
+				const Image& source = chain[min(mip, (int)chain.size() - 1)];
+				Image& level = atlas.pages[(size_t)entry.page * settings.mipCount + mip];
+				Place(source, level, entry.x >> mip, entry.y >> mip, gutter >> mip, settings.gutterMode);
+			}
+		}
+	});
+	return placed;
+}
+
+bool AtlasBuilder::RemapTexCoords(void* vertices, size_t vertexCount, size_t stride, size_t texCoordOffset, const AtlasEntry& entry)
+{
+	uint8_t* bytes = static_cast<uint8_t*>(vertices) + texCoordOffset;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const float* uv = reinterpret_cast<const float*>(bytes + i * stride);
+		if (uv[0] < 0.0f || uv[0] > 1.0f || uv[1] < 0.0f || uv[1] > 1.0f)
+			return false;
+	}
+
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		float* uv = reinterpret_cast<float*>(bytes + i * stride);
+		uv[0] = uv[0] * entry.scaleU + entry.offsetU;
+		uv[1] = uv[1] * entry.scaleV + entry.offsetV;
+	}
+	return true;
+}
+
+void AtlasBuilder::BuildLookupTable(const TextureAtlas& atlas, vector<float>& table)
+{
+	table.clear();
+	table.reserve(atlas.entries.size() * 8);
+	for (const AtlasEntry& entry : atlas.entries)
+	{
+		const float row[8] = { entry.scaleU, entry.scaleV, entry.offsetU, entry.offsetV, (float)entry.page, 0.0f, 0.0f, 0.0f };
+		table.insert(table.end(), row, row + 8);
+	}
+}
+
+bool AtlasBuilder::BuildFile(const vector<string>& inputFiles, const string& outputPrefix, const AtlasSettings& settings)
+{
+	vector<Image> images(inputFiles.size());
+	for (size_t i = 0; i < inputFiles.size(); ++i)
+	{
+		if (!ImageIO::LoadDDS(inputFiles[i], images[i]))
+			return false;
+	}
+
+	TextureAtlas atlas;
+	if (Build(images.data(), (int)images.size(), settings, atlas) != (int)images.size())
+		return false;
+
+	for (int page = 0; page < atlas.pageCount; ++page)
+	{
+		const Image* mips = &atlas.pages[(size_t)page * atlas.mipCount];
+		if (!ImageIO::SaveDDS(outputPrefix + to_string(page) + ".dds", mips, atlas.mipCount))
+			return false;
+	}
+
+	std::ofstream file(outputPrefix + ".txt");
+	file.precision(9);
+	file << "# file page offsetU offsetV scaleU scaleV\n";
+	for (size_t i = 0; i < inputFiles.size(); ++i)
+	{
+		const AtlasEntry& entry = atlas.entries[i];
+		file << inputFiles[i] << ' ' << entry.page << ' ' << entry.offsetU << ' ' << entry.offsetV << ' ' << entry.scaleU << ' ' << entry.scaleV << '\n';
+	}
+	return file.good();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+#include "MipGenerator.h"
+
+enum AtlasGutter
+{
+	AtlasGutterClamp = 0,		// repeat each texture's edge texels: for UVs kept within 0..1
+	AtlasGutterWrap = 1,		// continue from the opposite edge: for tiling with frac() in the shader
+};
+
+struct AtlasSettings
+{
+	int				pageSize = 2048;			// texels a side, a power of two
+	int				mipCount = 5;				// levels per page; placement is aligned so none of them bleeds
+	int				gutter = 1;					// texels around each texture at the smallest level
+	AtlasGutter		gutterMode = AtlasGutterClamp;
+	MipSettings		mipSettings;				// for each texture's own chain
+};
+
+// Where one texture went: atlasUV = uv * scale + offset, on slice 'page' of the array
+struct AtlasEntry
+{
+	int				page = -1;					// -1 when larger than a page less its gutter
+	int				x = 0;						// texels at level 0, gutter excluded
+	int				y = 0;
+	int				width = 0;					// the texture's size rounded up to whole texels of the last level
+	int				height = 0;
+	float			scaleU = 1.0f;
+	float			scaleV = 1.0f;
+	float			offsetU = 0.0f;
+	float			offsetV = 0.0f;
+};
+
+struct TextureAtlas
+{
+	int						pageSize = 0;
+	int						mipCount = 0;
+	int						pageCount = 0;
+	std::vector<Image>		pages;				// page p level m at p * mipCount + m, as CreateTextureArrayFromImages takes them
+	std::vector<AtlasEntry>	entries;			// one per input texture, in input order
+};
+
+// Packs many small textures into the slices of one texture array, so objects with different
+// small materials can share a binding and draw together.
+//
+// Rectangles are placed by stb_rect_pack (the copy vendored with ImGui) in units of the
+// coarsest level's texel. Textures whose size is not a whole number of those units are
+// resampled up to the next one first, so every texture starts and ends on a whole texel of
+// every level, and each level of a page is assembled from that level of every texture's own
+// chain with its gutter rebuilt there. Nothing is ever filtered across two textures, whatever
+// level is sampled.
+namespace AtlasBuilder
+{
+	// Returns how many textures were placed; the rest keep page -1
+	int		Build(const Image* images, int count, const AtlasSettings& settings, TextureAtlas& atlas);
+
+	// Rewrites the texture coordinates of vertexCount vertices, texCoordOffset bytes into each
+	// stride-byte vertex, into entry's rectangle. Coordinates outside 0..1 cannot be moved there
+	// without frac() in the shader, so nothing is changed and false returned if there are any.
+	bool	RemapTexCoords(void* vertices, size_t vertexCount, size_t stride, size_t texCoordOffset, const AtlasEntry& entry);
+
+	// Two float4s per entry, (scaleU, scaleV, offsetU, offsetV) and (page, 0, 0, 0), for a
+	// constant buffer that shaders index by material
+	void	BuildLookupTable(const TextureAtlas& atlas, std::vector<float>& table);
+
+	// Offline path: reads DDS files and writes outputPrefix0.dds, outputPrefix1.dds... with their
+	// chains, plus outputPrefix.txt listing each input's page, offset and scale
+	bool	BuildFile(const std::vector<std::string>& inputFiles, const std::string& outputPrefix, const AtlasSettings& settings);
+}
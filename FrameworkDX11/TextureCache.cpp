@@ -0,0 +1,285 @@
+#include "TextureCache.h"
+#include "ImageTexture.h"
+
+#include <algorithm>
+#include <cwctype>
+
+using namespace std;
+
+namespace
+{
+	uint64_t HashText(const wstring& text)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (wchar_t c : text)
+		{
+			hash ^= (uint64_t)c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
+
+TextureHandle::TextureHandle(TextureCache* cache, TextureCacheEntry* entry)
+	: m_cache(cache), m_entry(entry)
+{
+	if (m_cache)
+		m_cache->AddRef(*m_entry);
+}
+
+TextureHandle::TextureHandle(const TextureHandle& other)
+	: TextureHandle(other.m_cache, other.m_entry)
+{
+}
+
+TextureHandle::TextureHandle(TextureHandle&& other)
+	: m_cache(other.m_cache), m_entry(other.m_entry)
+{
+	other.m_cache = nullptr;
+	other.m_entry = nullptr;
+}
+
+TextureHandle& TextureHandle::operator=(TextureHandle other)
+{
+	swap(m_cache, other.m_cache);
+	swap(m_entry, other.m_entry);
+	return *this;
+}
+
+TextureHandle::~TextureHandle()
+{
+	Reset();
+}
+
+void TextureHandle::Reset()
+{
+	if (m_cache)
+		m_cache->Release(*m_entry);
+	m_cache = nullptr;
+	m_entry = nullptr;
+}
+
+ID3D11ShaderResourceView* TextureHandle::Get() const
+{
+	return m_cache ? m_cache->GetView(*m_entry) : nullptr;
+}
+
+bool TextureHandle::IsLoaded() const
+{
+	return m_cache && m_entry->resident;
+}
+
+TextureCache::TextureCache(TextureLoader& loader, TextureStreamer& streamer)
+	: m_loader(loader), m_streamer(streamer)
+{
+}
+
+TextureCache::~TextureCache()
+{
+	Cleanup();
+}
+
+void TextureCache::Cleanup()
+{
+	for (auto& texture : m_textures)
+	{
+		m_streamer.Remove(texture.second.stream);
+		if (texture.second.view)
+			texture.second.view->Release();
+	}
+	m_textures.clear();
+	m_entries.clear();
+	m_residentBytes = 0;
+}
+
+TextureHandle TextureCache::Acquire(const wstring& fileName, TexturePlaceholder placeholder, const TextureFallback& fallback)
+{
+	const wstring path = CanonicalPath(fileName);
+
+	unique_ptr<Entry>& slot = m_entries[path];
+	if (slot)
+	{
+		++m_hits;
+	}
+	else
+	{
+		slot.reset(new Entry());
+		slot->path = path;
+		slot->fileName = fileName;
+		slot->placeholder = placeholder;
+		slot->fallback = fallback;
+	}
+
+	// New, or evicted since it was last used
+	if (!slot->resident && !slot->loading)
+		Load(*slot);
+
+	return TextureHandle(this, slot.get());
+}
+
+void TextureCache::Load(Entry& entry)
+{
+	entry.loading = true;
+	const wstring path = entry.path;
+	ID3D11ShaderResourceView* placeholder = m_loader.Load(entry.fileName, entry.placeholder,
+		[this, path](ID3D11ShaderResourceView* view, HRESULT hr, uint64_t contentHash, const shared_ptr<TextureStream>& stream)
+	{
+		OnLoaded(path, view, hr, contentHash, stream);
+	});
+
+	// Handles hand out the loader's own placeholder until the texture is in
+	if (placeholder)
+		placeholder->Release();
+}
+
+void TextureCache::OnLoaded(const wstring& path, ID3D11ShaderResourceView* view, HRESULT hr, uint64_t contentHash, const shared_ptr<TextureStream>& stream)
+{
+	// Loading entries are never evicted, so this one is still there
+	Entry& entry = *m_entries[path];
+	entry.loading = false;
+
+	if (FAILED(hr) && entry.fallback)
+	{
+		view = entry.fallback();
+		contentHash = HashText(L"fallback|" + path);
+	}
+	if (!view)
+		return;
+
+	Texture& texture = m_textures[contentHash];
+	if (texture.view)
+	{
+		// Same bytes under another name: share what is already resident
+		view->Release();
+		++m_sharedByContent;
+	}
+	else
+	{
+		texture.view = view;
+		texture.bytes = MeasureTexture(view);
+		m_residentBytes += texture.bytes;
+
+		if (stream)
+		{
+			texture.stream = m_streamer.Add(stream, view, [this, contentHash](ID3D11ShaderResourceView* streamed)
+			{
+				OnStreamed(contentHash, streamed);
+			});
+		}
+	}
+
+	texture.users++;
+	entry.contentHash = contentHash;
+	entry.resident = true;
+}
+
+// Streamed textures are removed from the streamer before their view goes, so this one exists
+void TextureCache::OnStreamed(uint64_t contentHash, ID3D11ShaderResourceView* view)
+{
+	Texture& texture = m_textures[contentHash];
+	m_residentBytes -= texture.bytes;
+	texture.view->Release();
+	texture.view = view;
+	texture.bytes = MeasureTexture(view);
+	m_residentBytes += texture.bytes;
+}
+
+void TextureCache::Evict(Entry& entry)
+{
+	auto found = m_textures.find(entry.contentHash);
+	if (found != m_textures.end() && --found->second.users == 0)
+	{
+		m_streamer.Remove(found->second.stream);
+		m_residentBytes -= found->second.bytes;
+		found->second.view->Release();
+		m_textures.erase(found);
+	}
+	entry.resident = false;
+	++m_evictions;
+}
+
+void TextureCache::Trim()
+{
+	++m_clock;
+	while (m_residentBytes > m_budget)
+	{
+		Entry* oldest = nullptr;
+		for (auto& slot : m_entries)
+		{
+			Entry& entry = *slot.second;
+			if (entry.handles == 0 && entry.resident && (!oldest || entry.released < oldest->released))
+				oldest = &entry;
+		}
+		if (!oldest)
+			return;			// everything left is in use
+		Evict(*oldest);
+	}
+}
+
+void TextureCache::RequestDetail(const TextureHandle& handle, float screenTexels)
+{
+	if (!handle.m_cache || !handle.m_entry->resident)
+		return;
+
+	auto found = m_textures.find(handle.m_entry->contentHash);
+	if (found != m_textures.end() && found->second.stream >= 0)
+		m_streamer.Request(found->second.stream, screenTexels);
+}
+
+ID3D11ShaderResourceView* TextureCache::GetView(const Entry& entry) const
+{
+	if (entry.resident)
+	{
+		auto found = m_textures.find(entry.contentHash);
+		if (found != m_textures.end())
+			return found->second.view;
+	}
+	return m_loader.GetPlaceholder(entry.placeholder);
+}
+
+void TextureCache::AddRef(Entry& entry)
+{
+	entry.handles++;
+}
+
+void TextureCache::Release(Entry& entry)
+{
+	if (--entry.handles == 0)
+		entry.released = m_clock;
+}
+
+wstring TextureCache::CanonicalPath(const wstring& fileName)
+{
+	wstring path = fileName;
+#ifdef _WIN32
+	wchar_t full[MAX_PATH];
+	DWORD length = GetFullPathNameW(fileName.c_str(), MAX_PATH, full, nullptr);
+	if (length > 0 && length < MAX_PATH)
+		path.assign(full, length);
+#endif
+
+	// The file system is case-insensitive and takes either separator
+	for (wchar_t& c : path)
+		c = c == L'/' ? L'\\' : (wchar_t)towlower(c);
+	return path;
+}
+
+size_t TextureCache::MeasureTexture(ID3D11ShaderResourceView* view)
+{
+	ID3D11Resource* resource = nullptr;
+	view->GetResource(&resource);
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT hr = resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&texture));
+	resource->Release();
+	if (FAILED(hr))
+		return 0;
+
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+	texture->Release();
+
+	size_t bytes = 0;
+	for (UINT mip = 0; mip < desc.MipLevels; ++mip)
+		bytes += TextureLevelBytes(desc.Format, max(desc.Width >> mip, 1u), max(desc.Height >> mip, 1u));
+	return bytes * desc.ArraySize;
+}
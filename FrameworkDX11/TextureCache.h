@@ -0,0 +1,129 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+
+class TextureCache;
+struct TextureCacheEntry;
+
+// Builds the texture to use when a file cannot be loaded; returns nullptr to keep the placeholder
+typedef std::function<ID3D11ShaderResourceView*()> TextureFallback;
+
+// Counted reference to a cached texture. Get returns the placeholder until the file is in, so
+// fetch the view when binding rather than keeping it. Release every handle before
+// TextureCache::Cleanup.
+class TextureHandle
+{
+public:
+	TextureHandle() {}
+	TextureHandle(const TextureHandle& other);
+	TextureHandle(TextureHandle&& other);
+	TextureHandle& operator=(TextureHandle other);
+	~TextureHandle();
+
+	ID3D11ShaderResourceView*	Get() const;
+	bool						IsLoaded() const;
+	bool						IsValid() const { return m_cache != nullptr; }
+	void						Reset();
+
+private:
+	friend class TextureCache;
+	TextureHandle(TextureCache* cache, TextureCacheEntry* entry);
+
+	TextureCache*				m_cache = nullptr;
+	TextureCacheEntry*			m_entry = nullptr;
+};
+
+// One canonical path and what it currently shows
+struct TextureCacheEntry
+{
+	std::wstring				path;				// canonical
+	std::wstring				fileName;			// as first asked for, which is what gets opened
+	TexturePlaceholder			placeholder = TexturePlaceholder::White;
+	TextureFallback				fallback;
+	int							handles = 0;
+	bool						loading = false;
+	bool						resident = false;
+	uint64_t					contentHash = 0;
+	uint64_t					released = 0;		// Trim count when the last handle went
+};
+
+// Shared, reference-counted textures on top of TextureLoader.
+//
+// Files are keyed by their canonical path, so every object asking for the same file shares one
+// load and one view. Files that differ by name but hold identical bytes are caught by a content
+// hash taken while the file is read, and share one GPU texture as well. Textures nobody holds a
+// handle to stay cached until the resident total exceeds the budget, then the least recently
+// released go first. Those the loader created from their tail are registered with the
+// streamer, which swaps in views with more or fewer levels as RequestDetail asks.
+class TextureCache
+{
+public:
+	TextureCache(TextureLoader& loader, TextureStreamer& streamer);
+	~TextureCache();
+
+	// Releases every texture; call once all handles are gone
+	void						Cleanup();
+
+	TextureHandle				Acquire(const std::wstring& fileName, TexturePlaceholder placeholder, const TextureFallback& fallback = TextureFallback());
+
+	// Evicts unreferenced textures until the resident total fits the budget; call once a frame
+	void						Trim();
+
+	// Asks for the detail of a texture drawn screenTexels pixels across; call each frame it is drawn
+	void						RequestDetail(const TextureHandle& handle, float screenTexels);
+
+	void						SetBudget(size_t bytes) { m_budget = bytes; }
+	size_t						GetBudget() const { return m_budget; }
+	size_t						GetResidentBytes() const { return m_residentBytes; }
+	int							GetEntryCount() const { return (int)m_entries.size(); }
+	int							GetTextureCount() const { return (int)m_textures.size(); }
+	int							GetHitCount() const { return m_hits; }
+	int							GetSharedByContentCount() const { return m_sharedByContent; }
+	int							GetEvictionCount() const { return m_evictions; }
+
+	static std::wstring			CanonicalPath(const std::wstring& fileName);
+	// Approximate video memory of a 2D texture or array, all mips included
+	static size_t				MeasureTexture(ID3D11ShaderResourceView* view);
+
+private:
+	friend class TextureHandle;
+
+	// One GPU texture, shared by every entry whose file had the same bytes
+	struct Texture
+	{
+		ID3D11ShaderResourceView*	view = nullptr;
+		size_t						bytes = 0;
+		int							users = 0;
+		int							stream = -1;		// TextureStreamer id
+	};
+
+	typedef TextureCacheEntry Entry;
+
+	void						Load(Entry& entry);
+	void						OnLoaded(const std::wstring& path, ID3D11ShaderResourceView* view, HRESULT hr, uint64_t contentHash, const std::shared_ptr<TextureStream>& stream);
+	void						OnStreamed(uint64_t contentHash, ID3D11ShaderResourceView* view);
+	void						Evict(Entry& entry);
+	ID3D11ShaderResourceView*	GetView(const Entry& entry) const;
+	void						AddRef(Entry& entry);
+	void						Release(Entry& entry);
+
+	TextureLoader&				m_loader;
+	TextureStreamer&			m_streamer;
+	std::unordered_map<std::wstring, std::unique_ptr<Entry>>	m_entries;
+	std::unordered_map<uint64_t, Texture>						m_textures;
+
+	size_t						m_budget = 256u << 20;
+	size_t						m_residentBytes = 0;
+	uint64_t					m_clock = 0;
+	int							m_hits = 0;
+	int							m_sharedByContent = 0;
+	int							m_evictions = 0;
+};
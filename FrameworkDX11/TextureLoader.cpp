@@ -0,0 +1,292 @@
+#include "TextureLoader.h"
+#include "DDSFile.h"
+#include "DDSTextureLoader.h"
+#include "ImageTexture.h"
+#include "ImageIO.h"
+#include "JobSystem.h"
+#include "MipGenerator.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	const uint32_t PLACEHOLDER_COLOURS[] =
+	{
+		0xffffffff,			// White
+		0xffff8080,			// FlatNormal: (0.5, 0.5, 1)
+		0xff000000,			// FlatHeight
+	};
+
+	// FNV-1a over the whole file; reading every byte is also what pages the mapping in
+	uint64_t HashContent(const uint8_t* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	MipSettings MipSettingsFor(TexturePlaceholder placeholder)
+	{
+		switch (placeholder)
+		{
+		case TexturePlaceholder::FlatNormal:
+			return MipSettings::NormalMap();
+		case TexturePlaceholder::FlatHeight:
+			return MipSettings::Linear();
+		default:
+			return MipSettings::Colour();
+		}
+	}
+
+	bool CompressionFormat(TexturePlaceholder placeholder, const Image& image, BCQuality quality, BCFormat& format)
+	{
+		switch (placeholder)
+		{
+		case TexturePlaceholder::White:
+		{
+			bool opaque = true;
+			const uint8_t* texel = image.GetData();
+			for (size_t i = 0; opaque && i < (size_t)image.GetWidth() * image.GetHeight(); ++i)
+				opaque = texel[i * 4 + 3] == 255;
+			format = quality == BCQualityHigh ? BCFormatBC7 : opaque ? BCFormatBC1 : BCFormatBC3;
+			return true;
+		}
+		case TexturePlaceholder::FlatNormal:
+			format = BCFormatBC5;
+			return true;
+		case TexturePlaceholder::FlatHeight:
+			format = BCFormatBC4;
+			return true;
+		default:
+			return false;
+		}
+	}
+}
+
+TextureLoader::TextureLoader()
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	Cleanup();
+}
+
+HRESULT TextureLoader::Init(ID3D11Device* pd3dDevice)
+{
+	m_pd3dDevice = pd3dDevice;
+
+	for (int i = 0; i < (int)TexturePlaceholder::COUNT; ++i)
+	{
+		Image image(1, 1);
+		image.Fill(PLACEHOLDER_COLOURS[i]);
+		HRESULT hr = CreateTextureFromImage(pd3dDevice, image, false, &m_placeholders[i]);
+		if (FAILED(hr))
+			return hr;
+	}
+	return S_OK;
+}
+
+void TextureLoader::Cleanup()
+{
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_pending == 0; });
+		m_completed.clear();
+	}
+
+	for (ID3D11ShaderResourceView*& placeholder : m_placeholders)
+	{
+		if (placeholder)
+			placeholder->Release();
+		placeholder = nullptr;
+	}
+	m_pd3dDevice = nullptr;
+}
+
+ID3D11ShaderResourceView* TextureLoader::Load(const wstring& fileName, TexturePlaceholder placeholder, const TextureLoadedCallback& onLoaded)
+{
+	auto request = make_shared<Request>();
+	request->fileName = fileName;
+	request->placeholder = placeholder;
+	request->compress = m_compress;
+	request->quality = m_quality;
+	request->streamTail = m_streamTail;
+	request->onLoaded = onLoaded;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		++m_pending;
+	}
+
+	JobSystem::Get().Submit([this, request]()
+	{
+		Read(*request);
+
+		lock_guard<mutex> lock(m_mutex);
+		m_completed.push_back(request);
+		if (--m_pending == 0)
+			m_idle.notify_all();
+	});
+
+	ID3D11ShaderResourceView* view = m_placeholders[(int)placeholder];
+	if (view)
+		view->AddRef();
+	return view;
+}
+
+void TextureLoader::Read(Request& request)
+{
+	if (!request.file.Open(request.fileName.c_str()))
+	{
+		DWORD error = GetLastError();
+		request.hr = error != ERROR_SUCCESS ? HRESULT_FROM_WIN32(error) : E_FAIL;
+		return;
+	}
+
+	DDSFile::Layout layout;
+	if (!DDSFile::Parse(request.file.GetData(), request.file.GetSize(), layout))
+	{
+		request.hr = E_FAIL;
+		return;
+	}
+
+	// Done here so the disk reads happen on the worker rather than inside CreateTexture2D
+	request.contentHash = HashContent(request.file.GetData(), request.file.GetSize());
+
+	// Single-level uncompressed 2D files would otherwise be minified from mip 0 alone and
+	// shimmer. Anything else (a chain already, cube maps, volumes, block-compressed or DX10
+	// formats, which would come back larger or in a different format) is uploaded as it is.
+	const DDSFile::Header& header = *layout.header;
+	if (header.mipMapCount > 1 || (header.width <= 1 && header.height <= 1) || header.caps2 != 0 || (header.format.flags & DDSFile::DDPF_FOURCC))
+	{
+		// A stored 2D chain streams from the file itself
+		bool single2D = header.caps2 == 0 && (!layout.dx10 || (layout.dx10->resourceDimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D
+			&& layout.dx10->arraySize == 1 && !(layout.dx10->miscFlag & D3D11_RESOURCE_MISC_TEXTURECUBE)));
+		if (request.streamTail > 0 && header.mipMapCount > 1 && single2D)
+		{
+			auto stream = make_shared<TextureStream>();
+			stream->fileName = request.fileName;
+			stream->width = (int)header.width;
+			stream->height = (int)header.height;
+			stream->mipCount = (int)header.mipMapCount;
+			if (stream->SetTail(request.streamTail))
+				request.stream = stream;
+		}
+		return;
+	}
+
+	Image image;
+	if (!ImageIO::DecodeDDS(request.file.GetData(), request.file.GetSize(), image))
+		return;
+
+	MipGenerator::Generate(image, MipSettingsFor(request.placeholder), request.mips);
+	request.file.Close();
+
+	BCFormat format;
+	if (request.compress && image.GetWidth() % 4 == 0 && image.GetHeight() % 4 == 0 && CompressionFormat(request.placeholder, image, request.quality, format))
+	{
+		request.blocks.resize(request.mips.size());
+		for (size_t mip = 0; mip < request.mips.size(); ++mip)
+		{
+			if (format == BCFormatBC5)
+				BlockCompressor::CompressNormalMap(request.mips[mip], request.quality, request.blocks[mip]);
+			else
+				BlockCompressor::Compress(request.mips[mip], format, request.quality, request.blocks[mip]);
+		}
+
+		Image decoded;
+		BlockCompressor::Decompress(request.blocks[0], decoded);
+		request.psnr = BlockCompressor::PSNR(request.mips[0], decoded, format);
+		request.mips.clear();
+	}
+
+	// The chain just built is all there is to stream from, so the stream keeps it in memory
+	if (request.streamTail > 0)
+	{
+		auto stream = make_shared<TextureStream>();
+		stream->width = image.GetWidth();
+		stream->height = image.GetHeight();
+		stream->mipCount = (int)max(request.mips.size(), request.blocks.size());
+		stream->mips.swap(request.mips);
+		stream->blocks.swap(request.blocks);
+		if (stream->SetTail(request.streamTail))
+		{
+			request.stream = stream;
+		}
+		else
+		{
+			request.mips.swap(stream->mips);
+			request.blocks.swap(stream->blocks);
+		}
+	}
+}
+
+int TextureLoader::Update(int maxUploads)
+{
+	vector<shared_ptr<Request>> completed;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		size_t count = min(m_completed.size(), (size_t)max(maxUploads, 1));
+		completed.assign(m_completed.begin(), m_completed.begin() + count);
+		m_completed.erase(m_completed.begin(), m_completed.begin() + count);
+	}
+
+	for (shared_ptr<Request>& request : completed)
+	{
+		ID3D11ShaderResourceView* view = nullptr;
+		HRESULT hr = request->hr;
+		const bool compressed = !request->blocks.empty() || (request->stream && !request->stream->blocks.empty());
+		if (SUCCEEDED(hr) && request->stream)
+			hr = request->stream->Create(m_pd3dDevice, request->file.GetData(), request->file.GetSize(), request->stream->tailMip, &view);
+		else if (SUCCEEDED(hr) && !request->blocks.empty())
+			hr = CreateTextureFromBlocks(m_pd3dDevice, request->blocks.data(), (int)request->blocks.size(), &view);
+		else if (SUCCEEDED(hr) && !request->mips.empty())
+			hr = CreateTextureFromMips(m_pd3dDevice, request->mips.data(), (int)request->mips.size(), &view);
+		else if (SUCCEEDED(hr))
+			hr = CreateDDSTextureFromMemory(m_pd3dDevice, request->file.GetData(), request->file.GetSize(), nullptr, &view);
+		request->file.Close();
+		request->mips.clear();
+
+		if (SUCCEEDED(hr))
+		{
+			++m_loaded;
+			if (compressed)
+			{
+				m_worstPSNR = m_compressed == 0 ? request->psnr : min(m_worstPSNR, request->psnr);
+				++m_compressed;
+			}
+		}
+		else
+		{
+			++m_failed;
+			view = nullptr;
+			request->stream.reset();
+		}
+
+		if (request->onLoaded)
+			request->onLoaded(view, hr, request->contentHash, request->stream);
+		else if (view)
+			view->Release();
+	}
+	return (int)completed.size();
+}
+
+void TextureLoader::SetCompression(bool enabled, BCQuality quality)
+{
+	m_compress = enabled;
+	m_quality = quality;
+}
+
+int TextureLoader::GetPendingCount()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_pending + (int)m_completed.size();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AssetFile.h"
+#include "BlockCompressor.h"
+#include "Image.h"
+#include "TextureStreamer.h"
+
+// What a texture shows until its file has been read and uploaded
+enum class TexturePlaceholder
+{
+	White,			// diffuse: lighting and material colour only
+	FlatNormal,		// tangent-space up, so normal mapping is a no-op
+	FlatHeight,		// zero depth, so parallax mapping is a no-op
+	COUNT,
+};
+
+// Receives the loaded view with one reference owned by the receiver, or nullptr and the error.
+// contentHash identifies the file's bytes, whatever it is called. stream is set when view holds
+// only the tail of the chain, for the receiver to hand to a TextureStreamer.
+typedef std::function<void(ID3D11ShaderResourceView* view, HRESULT hr, uint64_t contentHash, const std::shared_ptr<TextureStream>& stream)> TextureLoadedCallback;
+
+// Asynchronous DDS texture loading.
+//
+// Load returns a placeholder straight away and maps, validates and hashes the file on the job
+// system, which pages all of it in. A file with only its top level gets a mip chain made there
+// too, filtered for what the placeholder says it holds (sRGB colour, normals or height), and
+// block-compressed when compression is on. Update, called on the render thread, creates at most a few
+// textures per frame from the finished files and hands each one to its callback, which swaps
+// it in for the placeholder. TextureCache does that for shared textures. With streaming on, a
+// chain larger than the tail is created with its tail levels only and the rest left to stream.
+class TextureLoader
+{
+public:
+	TextureLoader();
+	~TextureLoader();
+
+	HRESULT						Init(ID3D11Device* pd3dDevice);
+	// Waits for outstanding reads and drops anything not yet uploaded, without calling back
+	void						Cleanup();
+
+	// The returned placeholder carries a reference for the caller
+	ID3D11ShaderResourceView*	Load(const std::wstring& fileName, TexturePlaceholder placeholder, const TextureLoadedCallback& onLoaded);
+
+	// Uploads up to maxUploads finished textures; returns how many it created
+	int							Update(int maxUploads);
+
+	// Compression of imported textures from the next Load on: colour goes to BC1 (BC3 with
+	// alpha; BC7 for either at BCQualityHigh), normal maps to BC5 and heights to BC4.
+	void						SetCompression(bool enabled, BCQuality quality);
+	// Streaming from the next Load on: chains start at the first level no larger than tailSize
+	// texels a side. 0 uploads every level.
+	void						SetStreaming(int tailSize) { m_streamTail = tailSize; }
+
+	ID3D11ShaderResourceView*	GetPlaceholder(TexturePlaceholder placeholder) const { return m_placeholders[(int)placeholder]; }
+	int							GetPendingCount();
+	int							GetLoadedCount() const { return m_loaded; }
+	int							GetFailedCount() const { return m_failed; }
+	int							GetCompressedCount() const { return m_compressed; }
+	// Top-level PSNR of the compressed textures uploaded so far, in dB
+	double						GetWorstPSNR() const { return m_worstPSNR; }
+
+private:
+	struct Request
+	{
+		std::wstring			fileName;
+		TexturePlaceholder		placeholder;
+		TextureLoadedCallback	onLoaded;
+		bool					compress = false;
+		BCQuality				quality = BCQualityBalanced;
+		int						streamTail = 0;
+		AssetFile				file;
+		std::vector<Image>		mips;		// generated for files that ship without a chain
+		std::vector<CompressedImage>	blocks;		// the chain, when compressed
+		double					psnr = 0.0;
+		std::shared_ptr<TextureStream>	stream;		// the chain, when only its tail is uploaded
+		HRESULT					hr = S_OK;
+		uint64_t				contentHash = 0;
+	};
+
+	void						Read(Request& request);
+
+	ID3D11Device*				m_pd3dDevice = nullptr;
+	ID3D11ShaderResourceView*	m_placeholders[(int)TexturePlaceholder::COUNT] = {};
+
+	std::mutex					m_mutex;
+	std::condition_variable		m_idle;
+	std::vector<std::shared_ptr<Request>>	m_completed;
+	int							m_pending = 0;		// submitted and not yet read
+
+	bool						m_compress = false;
+	BCQuality					m_quality = BCQualityBalanced;
+	int							m_streamTail = 0;
+
+	int							m_loaded = 0;
+	int							m_failed = 0;
+	int							m_compressed = 0;
+	double						m_worstPSNR = 0.0;
+};
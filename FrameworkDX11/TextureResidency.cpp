@@ -0,0 +1,263 @@
+#include "TextureResidency.h"
+
+#include <algorithm>
+#include <cmath>
+
+int TextureResidency::Add(const std::vector<size_t>& levelBytes, int tailMip)
+{
+	int id;
+	if (!m_free.empty())
+	{
+		id = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		id = (int)m_textures.size();
+		m_textures.emplace_back();
+	}
+
+	Texture& texture = m_textures[id];
+	texture = Texture();
+	texture.levelBytes = levelBytes;
+	texture.tailMip = std::max(0, std::min(tailMip, (int)levelBytes.size() - 1));
+	texture.residentMip = texture.tailMip;
+	texture.wantedMip = texture.tailMip;
+	texture.lastRequest = m_frame;
+	texture.used = true;
+
+	m_residentBytes += Bytes(texture, texture.residentMip);
+	m_plannedBytes += Bytes(texture, texture.residentMip);
+	return id;
+}
+
+void TextureResidency::Remove(int id)
+{
+	Texture& texture = m_textures[id];
+	if (!texture.used)
+		return;
+
+	m_residentBytes -= Bytes(texture, texture.residentMip);
+	m_plannedBytes -= Bytes(texture, PlannedMip(texture));
+	texture = Texture();
+	m_free.push_back(id);
+}
+
+void TextureResidency::Request(int id, int mip, float priority)
+{
+	Texture& texture = m_textures[id];
+	mip = std::max(0, std::min(mip, texture.tailMip));
+
+	// Several objects can share a texture: the closest decides the level and the largest the priority
+	if (texture.requestedMip < 0 || mip < texture.requestedMip)
+		texture.requestedMip = mip;
+	texture.requestedPriority = std::max(texture.requestedPriority, priority);
+}
+
+void TextureResidency::Complete(int id, int residentMip)
+{
+	Texture& texture = m_textures[id];
+	if (!texture.used || texture.pendingMip < 0)
+		return;
+
+	m_plannedBytes -= Bytes(texture, texture.pendingMip);
+	m_plannedBytes += Bytes(texture, residentMip);
+	m_residentBytes -= Bytes(texture, texture.residentMip);
+	m_residentBytes += Bytes(texture, residentMip);
+	texture.residentMip = residentMip;
+	texture.pendingMip = -1;
+}
+
+void TextureResidency::Plan(size_t budget, int maxChanges, std::vector<ResidencyChange>& changes)
+{
+	++m_frame;
+
+	std::vector<int> loads;
+	for (int id = 0; id < (int)m_textures.size(); ++id)
+	{
+		Texture& texture = m_textures[id];
+		if (!texture.used)
+			continue;
+
+		if (texture.requestedMip >= 0)
+		{
+			texture.wantedMip = texture.requestedMip;
+			texture.priority = texture.requestedPriority;
+			texture.lastRequest = m_frame;
+		}
+		else if (m_frame - texture.lastRequest > STALE_FRAMES)
+		{
+			texture.wantedMip = texture.tailMip;
+			texture.priority = 0.0f;
+		}
+		texture.requestedMip = -1;
+		texture.requestedPriority = 0.0f;
+
+		if (texture.pendingMip < 0 && texture.wantedMip < texture.residentMip)
+			loads.push_back(id);
+	}
+
+	int changeCount = 0;
+
+	// A smaller budget than before gives back what no longer fits, least wanted first, or as much
+	// as the tails allow
+	if (m_plannedBytes > budget)
+		MakeRoom(-1, m_plannedBytes - budget, false, maxChanges, changes, changeCount);
+
+	// The furthest from what they need first, then the largest on screen
+	std::sort(loads.begin(), loads.end(), [this](int a, int b)
+	{
+		const Texture& ta = m_textures[a];
+		const Texture& tb = m_textures[b];
+		int shortfallA = ta.residentMip - ta.wantedMip;
+		int shortfallB = tb.residentMip - tb.wantedMip;
+		if (shortfallA != shortfallB)
+			return shortfallA > shortfallB;
+		return ta.priority > tb.priority;
+	});
+
+	for (int id : loads)
+	{
+		if (changeCount >= maxChanges)
+			break;
+
+		// One level at a time, so every texture asking moves before any gets all of its detail
+		Texture& texture = m_textures[id];
+		if (texture.pendingMip >= 0)
+			continue;
+		int mip = texture.residentMip - 1;
+		size_t growth = Bytes(texture, mip) - Bytes(texture, texture.residentMip);
+		if (m_plannedBytes + growth > budget && !MakeRoom(id, m_plannedBytes + growth - budget, true, maxChanges - changeCount - 1, changes, changeCount))
+			continue;
+		Start(id, mip, changes);
+		++changeCount;
+	}
+}
+
+int TextureResidency::MipForScreenSize(int width, int height, float screenTexels)
+{
+	int size = std::max(width, height);
+	int lastMip = 0;
+	while ((size >> lastMip) > 1)
+		++lastMip;
+
+	if (!(screenTexels > 0.0f))
+		return lastMip;
+	float ratio = (float)size / screenTexels;
+	if (ratio <= 1.0f)
+		return 0;
+	return std::min((int)std::floor(std::log2(ratio)), lastMip);
+}
+
+size_t TextureResidency::GetWantedBytes() const
+{
+	size_t bytes = 0;
+	for (const Texture& texture : m_textures)
+	{
+		if (texture.used)
+			bytes += Bytes(texture, texture.wantedMip);
+	}
+	return bytes;
+}
+
+int TextureResidency::GetPendingCount() const
+{
+	int count = 0;
+	for (const Texture& texture : m_textures)
+	{
+		if (texture.used && texture.pendingMip >= 0)
+			++count;
+	}
+	return count;
+}
+
+size_t TextureResidency::Bytes(const Texture& texture, int mip) const
+{
+	size_t bytes = 0;
+	for (int m = mip; m < (int)texture.levelBytes.size(); ++m)
+		bytes += texture.levelBytes[m];
+	return bytes;
+}
+
+// Something to take levels from to make room for a texture at the given priority: first whatever
+// shows more detail than it was asked for, then anything less visible above its tail. Equal
+// priorities, as among textures gone stale, go least recently requested first.
+int TextureResidency::FindVictim(int exclude, float priority) const
+{
+	auto before = [this](int a, int b)
+	{
+		const Texture& ta = m_textures[a];
+		const Texture& tb = m_textures[b];
+		if (ta.priority != tb.priority)
+			return ta.priority < tb.priority;
+		return ta.lastRequest < tb.lastRequest;
+	};
+
+	int overResolved = -1;
+	int lessVisible = -1;
+	for (int id = 0; id < (int)m_textures.size(); ++id)
+	{
+		const Texture& texture = m_textures[id];
+		if (!texture.used || id == exclude || texture.pendingMip >= 0 || texture.residentMip >= texture.tailMip)
+			continue;
+
+		if (texture.residentMip < texture.wantedMip)
+		{
+			if (overResolved < 0 || before(id, overResolved))
+				overResolved = id;
+		}
+		else if (texture.priority < priority)
+		{
+			if (lessVisible < 0 || before(id, lessVisible))
+				lessVisible = id;
+		}
+	}
+	return overResolved >= 0 ? overResolved : lessVisible;
+}
+
+// Takes levels from victims until bytes are free, as far down as each one's wanted mip if it is
+// over-resolved or its tail otherwise. With allOrNothing, nothing changes unless all of them can
+// be found.
+bool TextureResidency::MakeRoom(int exclude, size_t bytes, bool allOrNothing, int maxChanges, std::vector<ResidencyChange>& changes, int& changeCount)
+{
+	float priority = exclude >= 0 ? m_textures[exclude].priority : INFINITY;
+
+	std::vector<ResidencyChange> drops;
+	size_t freed = 0;
+	while (freed < bytes && (int)drops.size() < maxChanges)
+	{
+		int victim = FindVictim(exclude, priority);
+		if (victim < 0)
+			break;
+
+		Texture& texture = m_textures[victim];
+		int lowest = texture.residentMip < texture.wantedMip ? texture.wantedMip : texture.tailMip;
+		int mip = texture.residentMip;
+		while (mip < lowest && freed + Bytes(texture, texture.residentMip) - Bytes(texture, mip) < bytes)
+			++mip;
+		freed += Bytes(texture, texture.residentMip) - Bytes(texture, mip);
+
+		// Marked in flight so FindVictim passes over it from here on
+		texture.pendingMip = mip;
+		drops.push_back({ victim, mip });
+	}
+
+	for (const ResidencyChange& drop : drops)
+		m_textures[drop.id].pendingMip = -1;
+	if (freed < bytes && allOrNothing)
+		return false;
+
+	for (const ResidencyChange& drop : drops)
+		Start(drop.id, drop.mip, changes);
+	changeCount += (int)drops.size();
+	return freed >= bytes;
+}
+
+void TextureResidency::Start(int id, int mip, std::vector<ResidencyChange>& changes)
+{
+	Texture& texture = m_textures[id];
+	m_plannedBytes -= Bytes(texture, PlannedMip(texture));
+	m_plannedBytes += Bytes(texture, mip);
+	texture.pendingMip = mip;
+	changes.push_back({ id, mip });
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A rebuild for TextureStreamer to carry out: texture id with levels from mip down
+struct ResidencyChange
+{
+	int							id;
+	int							mip;
+};
+
+// Which mip levels of each streamed texture belong in video memory.
+//
+// Each frame, whatever draws with a texture requests the finest level its projected size needs,
+// with the texels it covers on screen as the priority. Plan then moves textures a level at a
+// time towards their requests, the most under-resolved and then the most visible first, while
+// the total fits the budget. Room is made by taking levels back from textures showing more
+// detail than asked for, then from less visible ones, and only when enough can be had; a budget
+// smaller than what is resident takes back as much as it can. Nothing drops below its tail, the
+// coarse levels loaded up front. A texture not requested for a while asks for its tail alone,
+// and of those the least recently requested give up their levels first.
+//
+// Plain C++; TextureStreamer does the D3D side and reports each change back through Complete.
+class TextureResidency
+{
+public:
+	static const int			STALE_FRAMES = 30;
+
+	// levelBytes[m] is the size of level m alone. The texture starts with its tail resident.
+	int							Add(const std::vector<size_t>& levelBytes, int tailMip);
+	void						Remove(int id);
+
+	void						Request(int id, int mip, float priority);
+	// A change from Plan is done, or abandoned if residentMip is still the old level
+	void						Complete(int id, int residentMip);
+
+	// Ends the frame and appends at most maxChanges changes. Changes already in flight count
+	// against the budget at their new size.
+	void						Plan(size_t budget, int maxChanges, std::vector<ResidencyChange>& changes);
+
+	// Level whose texels come closest to one per pixel at screenTexels across the larger side
+	static int					MipForScreenSize(int width, int height, float screenTexels);
+
+	int							GetResidentMip(int id) const { return m_textures[id].residentMip; }
+	int							GetWantedMip(int id) const { return m_textures[id].wantedMip; }
+	bool						IsPending(int id) const { return m_textures[id].pendingMip >= 0; }
+	size_t						GetResidentBytes() const { return m_residentBytes; }
+	size_t						GetWantedBytes() const;
+	int							GetTextureCount() const { return (int)(m_textures.size() - m_free.size()); }
+	int							GetPendingCount() const;
+
+private:
+	struct Texture
+	{
+		std::vector<size_t>		levelBytes;
+		int						tailMip = 0;
+		int						residentMip = 0;
+		int						pendingMip = -1;		// change in flight
+		int						requestedMip = -1;		// this frame's, -1 for none yet
+		float					requestedPriority = 0.0f;
+		int						wantedMip = 0;
+		float					priority = 0.0f;
+		uint64_t				lastRequest = 0;
+		bool					used = false;
+	};
+
+	size_t						Bytes(const Texture& texture, int mip) const;
+	int							PlannedMip(const Texture& texture) const { return texture.pendingMip >= 0 ? texture.pendingMip : texture.residentMip; }
+	int							FindVictim(int exclude, float priority) const;
+	bool						MakeRoom(int exclude, size_t bytes, bool allOrNothing, int maxChanges, std::vector<ResidencyChange>& changes, int& changeCount);
+	void						Start(int id, int mip, std::vector<ResidencyChange>& changes);
+
+	std::vector<Texture>		m_textures;
+	std::vector<int>			m_free;
+	uint64_t					m_frame = 0;
+	size_t						m_residentBytes = 0;
+	size_t						m_plannedBytes = 0;		// resident, with changes in flight at their new size
+};
@@ -0,0 +1,207 @@
+#include "TextureStreamer.h"
+#include "DDSTextureLoader.h"
+#include "ImageTexture.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+using namespace std;
+
+namespace
+{
+	const size_t PAGE_SIZE = 4096;
+}
+
+bool TextureStream::SetTail(int tailSize)
+{
+	tailMip = 0;
+	while (tailMip < mipCount - 1 && max(width >> tailMip, height >> tailMip) > tailSize)
+		++tailMip;
+	if (tailMip == 0)
+		return false;
+
+	// File sources are not inspected for their format, so take them to be compressed too
+	if (!blocks.empty() || !fileName.empty())
+	{
+		for (int mip = 0; mip <= tailMip; ++mip)
+		{
+			if ((width >> mip) % 4 != 0 || (height >> mip) % 4 != 0)
+				return false;
+		}
+	}
+	return true;
+}
+
+HRESULT TextureStream::Create(ID3D11Device* pd3dDevice, const uint8_t* data, size_t size, int firstMip, ID3D11ShaderResourceView** ppView) const
+{
+	if (!blocks.empty())
+		return CreateTextureFromBlocks(pd3dDevice, blocks.data() + firstMip, (int)blocks.size() - firstMip, ppView);
+	if (!mips.empty())
+		return CreateTextureFromMips(pd3dDevice, mips.data() + firstMip, (int)mips.size() - firstMip, ppView);
+
+	// FillInitData skips the levels larger than maxsize on either side
+	size_t maxSize = (size_t)max(max(width >> firstMip, height >> firstMip), 1);
+	return CreateDDSTextureFromMemoryEx(pd3dDevice, data, size, maxSize, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0, false, nullptr, ppView);
+}
+
+TextureStreamer::TextureStreamer()
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	Cleanup();
+}
+
+HRESULT TextureStreamer::Init(ID3D11Device* pd3dDevice)
+{
+	m_pd3dDevice = pd3dDevice;
+	return S_OK;
+}
+
+void TextureStreamer::Cleanup()
+{
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_pending == 0; });
+		m_completed.clear();
+	}
+
+	m_streams.clear();
+	m_residency = TextureResidency();
+	m_pd3dDevice = nullptr;
+}
+
+int TextureStreamer::Add(const shared_ptr<TextureStream>& stream, ID3D11ShaderResourceView* view, const TextureStreamedCallback& onStreamed)
+{
+	ID3D11Resource* resource = nullptr;
+	view->GetResource(&resource);
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT hr = resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&texture));
+	resource->Release();
+	if (FAILED(hr))
+		return -1;
+
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+	texture->Release();
+
+	vector<size_t> levelBytes(stream->mipCount);
+	for (int mip = 0; mip < stream->mipCount; ++mip)
+		levelBytes[mip] = TextureLevelBytes(desc.Format, max(stream->width >> mip, 1), max(stream->height >> mip, 1));
+
+	int id = m_residency.Add(levelBytes, stream->tailMip);
+	if (id >= (int)m_streams.size())
+		m_streams.resize(id + 1);
+
+	Stream& slot = m_streams[id];
+	slot.source = stream;
+	slot.onStreamed = onStreamed;
+	return id;
+}
+
+void TextureStreamer::Remove(int id)
+{
+	if (id < 0 || id >= (int)m_streams.size() || !m_streams[id].source)
+		return;
+
+	m_residency.Remove(id);
+	m_streams[id].source.reset();
+	m_streams[id].onStreamed = nullptr;
+	m_streams[id].generation++;
+}
+
+void TextureStreamer::Request(int id, float screenTexels)
+{
+	if (id < 0 || id >= (int)m_streams.size() || !m_streams[id].source)
+		return;
+
+	const TextureStream& stream = *m_streams[id].source;
+	int mip = TextureResidency::MipForScreenSize(stream.width, stream.height, screenTexels);
+	m_residency.Request(id, mip, screenTexels * screenTexels);
+}
+
+int TextureStreamer::Update(int maxChanges)
+{
+	vector<shared_ptr<Read>> completed;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		completed.swap(m_completed);
+	}
+
+	int rebuilt = 0;
+	for (shared_ptr<Read>& read : completed)
+	{
+		// Removed while the file was being read
+		if (m_streams[read->id].generation != read->generation)
+			continue;
+
+		if (read->file.IsOpen() && Rebuild(read->id, read->mip, read->file.GetData(), read->file.GetSize()))
+			++rebuilt;
+		else
+			m_residency.Complete(read->id, m_residency.GetResidentMip(read->id));
+	}
+
+	vector<ResidencyChange> changes;
+	m_residency.Plan(m_budget, max(maxChanges - rebuilt, 0), changes);
+
+	for (const ResidencyChange& change : changes)
+	{
+		Stream& stream = m_streams[change.id];
+		if (stream.source->fileName.empty())
+		{
+			if (Rebuild(change.id, change.mip, nullptr, 0))
+				++rebuilt;
+			else
+				m_residency.Complete(change.id, m_residency.GetResidentMip(change.id));
+			continue;
+		}
+
+		auto read = make_shared<Read>();
+		read->id = change.id;
+		read->generation = stream.generation;
+		read->mip = change.mip;
+		read->source = stream.source;
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			++m_pending;
+		}
+
+		JobSystem::Get().Submit([this, read]()
+		{
+			// Touching every page does the disk reads here rather than inside CreateTexture2D
+			if (read->file.Open(read->source->fileName.c_str()))
+			{
+				volatile uint8_t sink = 0;
+				for (size_t offset = 0; offset < read->file.GetSize(); offset += PAGE_SIZE)
+					sink ^= read->file.GetData()[offset];
+			}
+
+			lock_guard<mutex> lock(m_mutex);
+			m_completed.push_back(read);
+			if (--m_pending == 0)
+				m_idle.notify_all();
+		});
+	}
+
+	m_rebuilds += rebuilt;
+	return rebuilt;
+}
+
+bool TextureStreamer::Rebuild(int id, int mip, const uint8_t* data, size_t size)
+{
+	Stream& stream = m_streams[id];
+	ID3D11ShaderResourceView* view = nullptr;
+	HRESULT hr = stream.source->Create(m_pd3dDevice, data, size, mip, &view);
+	if (FAILED(hr) || !view)
+		return false;
+
+	m_residency.Complete(id, mip);
+	if (stream.onStreamed)
+		stream.onStreamed(view);
+	else
+		view->Release();
+	return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AssetFile.h"
+#include "BlockCompressor.h"
+#include "Image.h"
+#include "TextureResidency.h"
+
+// Where a streamed texture's levels come from: a DDS file with a stored chain, read again
+// through a mapping whenever the resident range changes, or a chain the importer built, kept in
+// memory. Mip 0 is the top level in both.
+struct TextureStream
+{
+	std::wstring					fileName;		// DDS source; empty for an imported chain
+	std::vector<Image>				mips;
+	std::vector<CompressedImage>	blocks;
+	int								width = 0;
+	int								height = 0;
+	int								mipCount = 0;
+	int								tailMip = 0;	// coarsest resident set starts here
+
+	// Picks the first level no larger than tailSize on either side. Returns false when the
+	// texture is already that small, or block-compressed levels above the tail could not be
+	// a texture's top level (D3D wants those in whole blocks).
+	bool							SetTail(int tailSize);
+
+	// A texture of levels firstMip and below. data is the mapped DDS for file sources.
+	HRESULT							Create(ID3D11Device* pd3dDevice, const uint8_t* data, size_t size, int firstMip, ID3D11ShaderResourceView** ppView) const;
+};
+
+// Receives a texture rebuilt with more or fewer levels, with one reference owned by the receiver
+typedef std::function<void(ID3D11ShaderResourceView* view)> TextureStreamedCallback;
+
+// Texture streaming by mip residency.
+//
+// Textures come in with only their tail levels (TextureLoader creates those), and each frame
+// the renderer requests the detail its objects need from their projected size on screen.
+// Update then plans against the budget with TextureResidency and rebuilds a few textures with
+// one level more, or fewer to make room: file sources are mapped and paged in on the job system
+// and the texture created on the render thread from the mapping, imported chains straight from
+// memory. The new view goes to the owner's callback, which swaps it for the old.
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+	~TextureStreamer();
+
+	HRESULT							Init(ID3D11Device* pd3dDevice);
+	// Waits for outstanding reads and forgets every stream, without calling back
+	void							Cleanup();
+
+	// view is the texture as created from the stream's tail, and is only inspected
+	int								Add(const std::shared_ptr<TextureStream>& stream, ID3D11ShaderResourceView* view, const TextureStreamedCallback& onStreamed);
+	void							Remove(int id);
+
+	// screenTexels is how many pixels the texture spans across at its largest this frame
+	void							Request(int id, float screenTexels);
+
+	// Rebuilds up to maxChanges textures; returns how many it rebuilt
+	int								Update(int maxChanges);
+
+	void							SetBudget(size_t bytes) { m_budget = bytes; }
+	size_t							GetBudget() const { return m_budget; }
+	size_t							GetResidentBytes() const { return m_residency.GetResidentBytes(); }
+	size_t							GetWantedBytes() const { return m_residency.GetWantedBytes(); }
+	int								GetStreamCount() const { return m_residency.GetTextureCount(); }
+	int								GetInFlightCount() const { return m_residency.GetPendingCount(); }
+	int								GetRebuildCount() const { return m_rebuilds; }
+
+private:
+	struct Stream
+	{
+		std::shared_ptr<TextureStream>	source;
+		TextureStreamedCallback		onStreamed;
+		int							generation = 0;		// tells a reused id from the one a read was for
+	};
+
+	struct Read
+	{
+		int							id;
+		int							generation;
+		int							mip;
+		std::shared_ptr<TextureStream>	source;
+		AssetFile					file;
+	};
+
+	// Leaves the residency change for the caller to abandon when creation fails
+	bool							Rebuild(int id, int mip, const uint8_t* data, size_t size);
+
+	ID3D11Device*					m_pd3dDevice = nullptr;
+	TextureResidency				m_residency;
+	std::vector<Stream>				m_streams;
+
+	std::mutex						m_mutex;
+	std::condition_variable			m_idle;
+	std::vector<std::shared_ptr<Read>>	m_completed;
+	int								m_pending = 0;		// submitted and not yet read
+
+	size_t							m_budget = 64u << 20;
+	int								m_rebuilds = 0;
+};
@@ -0,0 +1,311 @@
+#include "VirtualPageManager.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+int VirtualTextureLayout::GetMipCount() const
+{
+	int mipCount = 1;
+	while ((pagesPerSide >> mipCount) > 0)
+		++mipCount;
+	return mipCount;
+}
+
+int VirtualTextureLayout::GetPageCount() const
+{
+	int count = 0;
+	for (int mip = 0; mip < GetMipCount(); ++mip)
+		count += (pagesPerSide >> mip) * (pagesPerSide >> mip);
+	return count;
+}
+
+void VirtualPageManager::Init(const VirtualTextureLayout& layout, int slotsPerSide)
+{
+	*this = VirtualPageManager();
+	m_layout = layout;
+	m_mipCount = layout.GetMipCount();
+	m_slotsPerSide = slotsPerSide;
+
+	size_t start = 0;
+	m_pageTable.resize(m_mipCount);
+	for (int mip = 0; mip < m_mipCount; ++mip)
+	{
+		size_t side = (size_t)(layout.pagesPerSide >> mip);
+		m_mipStart.push_back(start);
+		m_pageTable[mip].assign(side * side * 4, 0);
+		start += side * side;
+	}
+	m_pages.resize(start);
+
+	// Popped from the back, so slot 0 goes first
+	m_slots.resize((size_t)slotsPerSide * slotsPerSide);
+	for (int slot = (int)m_slots.size() - 1; slot >= 0; --slot)
+		m_free.push_back(slot);
+}
+
+VirtualPageManager::Page& VirtualPageManager::At(uint32_t page)
+{
+	int mip = VirtualPageMip(page);
+	return m_pages[m_mipStart[mip] + (size_t)VirtualPageY(page) * (m_layout.pagesPerSide >> mip) + VirtualPageX(page)];
+}
+
+const VirtualPageManager::Page& VirtualPageManager::At(uint32_t page) const
+{
+	int mip = VirtualPageMip(page);
+	return m_pages[m_mipStart[mip] + (size_t)VirtualPageY(page) * (m_layout.pagesPerSide >> mip) + VirtualPageX(page)];
+}
+
+void VirtualPageManager::Request(const VirtualPageRequest* requests, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		int mip = VirtualPageMip(requests[i].page);
+		int x = VirtualPageX(requests[i].page);
+		int y = VirtualPageY(requests[i].page);
+		if (mip >= m_mipCount || x >= (m_layout.pagesPerSide >> mip) || y >= (m_layout.pagesPerSide >> mip))
+			continue;
+
+		// Every page above stands in for this one until it loads, so it counts these texels too
+		for (; mip < m_mipCount; ++mip, x >>= 1, y >>= 1)
+		{
+			uint32_t page = PackVirtualPage(mip, x, y);
+			Page& entry = At(page);
+			if (entry.lastSeen != m_frame)
+			{
+				entry.lastSeen = m_frame;
+				entry.count = 0;
+				m_requested.push_back(page);
+			}
+			entry.count += requests[i].count;
+		}
+	}
+}
+
+void VirtualPageManager::Plan(int maxLoads, vector<uint32_t>& loads)
+{
+	vector<uint32_t> wanted;
+	for (uint32_t page : m_requested)
+	{
+		const Page& entry = At(page);
+		if (!entry.pending && (entry.slot < 0 || entry.stale))
+			wanted.push_back(page);
+	}
+
+	// Coarse pages cover the most and stand in for everything under them, so they go first
+	sort(wanted.begin(), wanted.end(), [this](uint32_t a, uint32_t b)
+	{
+		if (VirtualPageMip(a) != VirtualPageMip(b))
+			return VirtualPageMip(a) > VirtualPageMip(b);
+		return At(a).count > At(b).count;
+	});
+
+	for (size_t i = 0; i < wanted.size() && (int)i < maxLoads; ++i)
+	{
+		Page& entry = At(wanted[i]);
+		entry.pending = true;
+		entry.stale = false;
+		++m_pendingCount;
+		loads.push_back(wanted[i]);
+	}
+
+	m_requested.clear();
+	++m_frame;
+}
+
+// The slot whose page was seen longest ago, other than the top page's. -1 if even that one was
+// seen this frame or the last, since feedback runs a few frames behind what is on screen.
+int VirtualPageManager::FindVictim() const
+{
+	int victim = -1;
+	uint64_t oldest = UINT64_MAX;
+	for (int slot = 0; slot < (int)m_slots.size(); ++slot)
+	{
+		if (!m_slots[slot].used || VirtualPageMip(m_slots[slot].page) == m_mipCount - 1)
+			continue;
+		uint64_t lastSeen = At(m_slots[slot].page).lastSeen;
+		if (lastSeen < oldest)
+		{
+			oldest = lastSeen;
+			victim = slot;
+		}
+	}
+	return (victim < 0 || oldest + 1 >= m_frame) ? -1 : victim;
+}
+
+int VirtualPageManager::Complete(uint32_t page)
+{
+	Page& entry = At(page);
+	if (!entry.pending)
+		return -1;
+	entry.pending = false;
+	--m_pendingCount;
+
+	// A reload of a stale page goes back where it was
+	if (entry.slot >= 0)
+		return entry.slot;
+
+	int slot;
+	if (!m_free.empty())
+	{
+		slot = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		slot = FindVictim();
+		if (slot < 0)
+			return -1;
+
+		Page& victim = At(m_slots[slot].page);
+		victim.slot = -1;
+		victim.stale = false;
+		--m_residentCount;
+		++m_evictions;
+	}
+
+	m_slots[slot].page = page;
+	m_slots[slot].used = true;
+	entry.slot = slot;
+	++m_residentCount;
+	m_tableDirty = true;
+	return slot;
+}
+
+void VirtualPageManager::Abandon(uint32_t page)
+{
+	Page& entry = At(page);
+	if (!entry.pending)
+		return;
+	entry.pending = false;
+	--m_pendingCount;
+}
+
+void VirtualPageManager::Invalidate(float u0, float v0, float u1, float v1)
+{
+	vector<uint32_t> pages;
+	GetPagesCovering(u0, v0, u1, v1, pages);
+	for (uint32_t page : pages)
+	{
+		Page& entry = At(page);
+		if (entry.slot >= 0 || entry.pending)
+			entry.stale = true;
+	}
+}
+
+void VirtualPageManager::GetPagesCovering(float u0, float v0, float u1, float v1, vector<uint32_t>& pages) const
+{
+	const int virtualSize = m_layout.GetVirtualSize();
+	const int content = m_layout.GetContentSize();
+	int x0 = (int)floor(u0 * virtualSize);
+	int y0 = (int)floor(v0 * virtualSize);
+	int x1 = (int)floor(u1 * virtualSize);
+	int y1 = (int)floor(v1 * virtualSize);
+
+	for (int mip = 0; mip < m_mipCount; ++mip)
+	{
+		// Texels at this level, then the pages whose borders reach them
+		const int last = (m_layout.pagesPerSide >> mip) - 1;
+		int px0 = max(((x0 >> mip) - m_layout.border) / content, 0);
+		int py0 = max(((y0 >> mip) - m_layout.border) / content, 0);
+		int px1 = min(((x1 >> mip) + m_layout.border) / content, last);
+		int py1 = min(((y1 >> mip) + m_layout.border) / content, last);
+
+		for (int y = py0; y <= py1; ++y)
+			for (int x = px0; x <= px1; ++x)
+				pages.push_back(PackVirtualPage(mip, x, y));
+	}
+}
+
+bool VirtualPageManager::UpdatePageTable()
+{
+	if (!m_tableDirty)
+		return false;
+	m_tableDirty = false;
+
+	// Top down, so each page not resident takes what its parent points at
+	for (int mip = m_mipCount - 1; mip >= 0; --mip)
+	{
+		const int side = m_layout.pagesPerSide >> mip;
+		uint8_t* table = m_pageTable[mip].data();
+		const uint8_t* parent = mip + 1 < m_mipCount ? m_pageTable[mip + 1].data() : nullptr;
+		for (int y = 0; y < side; ++y)
+		{
+			for (int x = 0; x < side; ++x)
+			{
+				uint8_t* texel = table + ((size_t)y * side + x) * 4;
+				const Page& entry = At(PackVirtualPage(mip, x, y));
+				if (entry.slot >= 0)
+				{
+					texel[0] = (uint8_t)(entry.slot % m_slotsPerSide);
+					texel[1] = (uint8_t)(entry.slot / m_slotsPerSide);
+					texel[2] = (uint8_t)mip;
+					texel[3] = 255;
+				}
+				else if (parent)
+				{
+					const uint8_t* above = parent + ((size_t)(y / 2) * (side / 2) + x / 2) * 4;
+					texel[0] = above[0];
+					texel[1] = above[1];
+					texel[2] = above[2];
+					texel[3] = above[3];
+				}
+				else
+				{
+					texel[0] = texel[1] = texel[3] = 0;
+					texel[2] = (uint8_t)mip;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+int VirtualPageManager::GetSlot(uint32_t page) const
+{
+	return At(page).slot;
+}
+
+bool VirtualPageManager::IsPending(uint32_t page) const
+{
+	return At(page).pending;
+}
+
+bool VirtualPageManager::IsStale(uint32_t page) const
+{
+	return At(page).stale;
+}
+
+void VirtualFeedback::Analyse(const uint8_t* texels, int width, int height, size_t pitch, const VirtualTextureLayout& layout, vector<VirtualPageRequest>& requests)
+{
+	const int mipCount = layout.GetMipCount();
+
+	vector<uint32_t> pages;
+	pages.reserve((size_t)width * height);
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* row = texels + (size_t)y * pitch;
+		for (int x = 0; x < width; ++x)
+		{
+			const uint8_t* texel = row + (size_t)x * 4;
+			if (texel[3] == 0 || texel[2] >= mipCount)
+				continue;
+			int side = layout.pagesPerSide >> texel[2];
+			if (texel[0] >= side || texel[1] >= side)
+				continue;
+			pages.push_back(PackVirtualPage(texel[2], texel[0], texel[1]));
+		}
+	}
+
+	// Neighbouring texels mostly share a page, so sorting leaves long runs to count
+	sort(pages.begin(), pages.end());
+	for (size_t i = 0; i < pages.size();)
+	{
+		size_t end = i + 1;
+		while (end < pages.size() && pages[end] == pages[i])
+			++end;
+		requests.push_back({ pages[i], (int)(end - i) });
+		i = end;
+	}
+}
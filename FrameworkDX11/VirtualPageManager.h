@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Shape of a virtual texture: a square of pagesPerSide pages at mip 0, halving each level down to
+// a single page. Pages are stored pageSize texels a side, of which border on each side repeats the
+// neighbouring pages' texels so bilinear filtering never reads past a page.
+struct VirtualTextureLayout
+{
+	int							pagesPerSide = 64;			// a power of two
+	int							pageSize = 128;
+	int							border = 4;
+
+	int							GetContentSize() const { return pageSize - 2 * border; }
+	int							GetVirtualSize() const { return pagesPerSide * GetContentSize(); }
+	int							GetMipCount() const;
+	int							GetPageCount() const;		// over every level
+};
+
+// A page is named by its level and position in one word: mip in the top byte, then 12 bits of
+// y and 12 of x
+inline uint32_t PackVirtualPage(int mip, int x, int y) { return ((uint32_t)mip << 24) | ((uint32_t)y << 12) | (uint32_t)x; }
+inline int VirtualPageMip(uint32_t page) { return (int)(page >> 24); }
+inline int VirtualPageY(uint32_t page) { return (int)((page >> 12) & 0xFFF); }
+inline int VirtualPageX(uint32_t page) { return (int)(page & 0xFFF); }
+
+// A page seen in the feedback buffer, and in how many of its texels
+struct VirtualPageRequest
+{
+	uint32_t					page;
+	int							count;
+};
+
+// Which pages of a virtual texture are in the physical cache, and where.
+//
+// Each frame the pages the feedback pass saw are requested along with every coarser page above
+// them, so a page always has something resident to fall back to while it loads. Plan picks the
+// pages to load next, coarsest first and then the most seen; when one has been produced Complete
+// gives it a slot, free or else the least recently used, never the single top page, which stays
+// pinned once loaded. A page whose texels change is marked stale by Invalidate and shown as it
+// was until its reload lands in the same slot.
+//
+// The page table has an RGBA8 entry per page of every level: the slot x and y and the level of
+// the page actually resident there, the page itself or its closest resident ancestor, and 255 in
+// alpha once anything is. Shaders read it with Load and need nothing else.
+//
+// Plain C++; TerrainVirtualTexture does the D3D side and the loading.
+class VirtualPageManager
+{
+public:
+	void						Init(const VirtualTextureLayout& layout, int slotsPerSide);
+
+	void						Request(const VirtualPageRequest* requests, int count);
+
+	// Ends the frame and appends at most maxLoads pages to produce
+	void						Plan(int maxLoads, std::vector<uint32_t>& loads);
+
+	// A planned page is ready: returns the slot to upload it to, or -1 to drop it when every slot
+	// holds a page seen this frame
+	int							Complete(uint32_t page);
+	// A planned page could not be produced; it will be planned again while it is still wanted
+	void						Abandon(uint32_t page);
+
+	// Marks stale the loaded pages whose texels, borders included, cover any of [u0, u1] x [v0, v1]
+	// of the virtual texture
+	void						Invalidate(float u0, float v0, float u1, float v1);
+	// Every page over that rectangle at every level, loaded or not
+	void						GetPagesCovering(float u0, float v0, float u1, float v1, std::vector<uint32_t>& pages) const;
+
+	// Rebuilds the page table if any mapping changed since the last call, and says whether it did
+	bool						UpdatePageTable();
+	const uint8_t*				GetPageTable(int mip) const { return m_pageTable[mip].data(); }
+
+	const VirtualTextureLayout&	GetLayout() const { return m_layout; }
+	int							GetSlotsPerSide() const { return m_slotsPerSide; }
+	int							GetSlot(uint32_t page) const;
+	bool						IsPending(uint32_t page) const;
+	bool						IsStale(uint32_t page) const;
+	int							GetResidentCount() const { return m_residentCount; }
+	int							GetPendingCount() const { return m_pendingCount; }
+	int							GetRequestedCount() const { return (int)m_requested.size(); }
+	int							GetEvictionCount() const { return m_evictions; }
+
+private:
+	struct Page
+	{
+		int						slot = -1;
+		int						count = 0;				// this frame's, summed over the pages below
+		uint64_t				lastSeen = 0;
+		bool					pending = false;
+		bool					stale = false;
+	};
+
+	struct Slot
+	{
+		uint32_t				page = 0;
+		bool					used = false;
+	};
+
+	Page&						At(uint32_t page);
+	const Page&					At(uint32_t page) const;
+	int							FindVictim() const;
+
+	VirtualTextureLayout		m_layout;
+	int							m_mipCount = 0;
+	int							m_slotsPerSide = 0;
+	std::vector<size_t>			m_mipStart;				// first page of each level in m_pages
+	std::vector<Page>			m_pages;
+	std::vector<Slot>			m_slots;
+	std::vector<int>			m_free;
+	std::vector<uint32_t>		m_requested;			// this frame's pages, each once
+	std::vector<std::vector<uint8_t>>	m_pageTable;
+	uint64_t					m_frame = 1;
+	bool						m_tableDirty = true;
+	int							m_residentCount = 0;
+	int							m_pendingCount = 0;
+	int							m_evictions = 0;
+};
+
+// Reads back the feedback pass: each texel is RGBA8_UINT (page x, page y, mip, 255), with zero
+// alpha where nothing virtual-textured was drawn.
+namespace VirtualFeedback
+{
+	// Appends each page seen once with the number of texels it was seen in
+	void						Analyse(const uint8_t* texels, int width, int height, size_t pitch, const VirtualTextureLayout& layout, std::vector<VirtualPageRequest>& requests);
+}
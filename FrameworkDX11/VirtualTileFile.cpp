@@ -0,0 +1,240 @@
+#include "VirtualTileFile.h"
+#include "LZCodec.h"
+
+#include <cstring>
+
+using namespace std;
+
+VirtualTileFile::~VirtualTileFile()
+{
+	Close();
+}
+
+bool VirtualTileFile::Create(const string& fileName)
+{
+	Close();
+
+	lock_guard<mutex> lock(m_mutex);
+	m_file.open(fileName, ios::binary | ios::in | ios::out | ios::trunc);
+	if (!m_file.is_open())
+		return false;
+
+	VirtualTileFileHeader header = {};
+	header.magic = VIRTUAL_TILE_FILE_MAGIC;
+	header.version = VIRTUAL_TILE_FILE_VERSION;
+	m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	m_end = sizeof(header);
+	if (!m_file.good())
+	{
+		m_file.close();
+		return false;
+	}
+	return true;
+}
+
+bool VirtualTileFile::Open(const string& fileName)
+{
+	Close();
+
+	lock_guard<mutex> lock(m_mutex);
+	m_file.open(fileName, ios::binary | ios::in | ios::out);
+	if (!m_file.is_open())
+		return false;
+
+	m_file.seekg(0, ios::end);
+	const uint64_t size = (uint64_t)m_file.tellg();
+	m_file.seekg(0);
+
+	VirtualTileFileHeader header;
+	if (size < sizeof(header) || !m_file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.magic != VIRTUAL_TILE_FILE_MAGIC || header.version != VIRTUAL_TILE_FILE_VERSION)
+	{
+		m_file.close();
+		return false;
+	}
+
+	uint64_t offset = sizeof(header);
+	VirtualTileRecord record;
+	while (offset + sizeof(record) <= size)
+	{
+		m_file.seekg(offset);
+		if (!m_file.read(reinterpret_cast<char*>(&record), sizeof(record)))
+			break;
+		uint64_t payload = offset + sizeof(record);
+		if (payload + record.storedSize > size)
+			break;
+
+		// Anything that could not have been written stops the replay there
+		bool removed = (record.flags & VirtualTileRemoved) != 0;
+		bool raw = (record.flags & VirtualTileLZ) == 0;
+		if (removed ? record.storedSize != 0 : (record.rawSize == 0 || record.storedSize == 0 || (raw && record.storedSize != record.rawSize)))
+			break;
+
+		auto found = m_index.find(record.key);
+		if (found != m_index.end())
+		{
+			m_rawBytes -= found->second.rawSize;
+			m_storedBytes -= found->second.storedSize;
+			m_index.erase(found);
+		}
+		if (!(record.flags & VirtualTileRemoved))
+		{
+			m_index[record.key] = { payload, record.flags, record.rawSize, record.storedSize };
+			m_rawBytes += record.rawSize;
+			m_storedBytes += record.storedSize;
+		}
+		offset = payload + record.storedSize;
+	}
+
+	// Whatever follows the last whole record is overwritten by the next append
+	m_file.clear();
+	m_end = offset;
+	return true;
+}
+
+void VirtualTileFile::Close()
+{
+	lock_guard<mutex> lock(m_mutex);
+	if (m_file.is_open())
+		m_file.close();
+	m_file.clear();
+	m_index.clear();
+	m_end = 0;
+	m_rawBytes = 0;
+	m_storedBytes = 0;
+}
+
+bool VirtualTileFile::IsOpen() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_file.is_open();
+}
+
+bool VirtualTileFile::Append(const VirtualTileRecord& record, const uint8_t* payload)
+{
+	m_file.seekp(m_end);
+	m_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+	if (record.storedSize > 0)
+		m_file.write(reinterpret_cast<const char*>(payload), record.storedSize);
+	if (!m_file.good())
+	{
+		m_file.clear();
+		return false;
+	}
+
+	auto found = m_index.find(record.key);
+	if (found != m_index.end())
+	{
+		m_rawBytes -= found->second.rawSize;
+		m_storedBytes -= found->second.storedSize;
+		m_index.erase(found);
+	}
+	if (!(record.flags & VirtualTileRemoved))
+	{
+		m_index[record.key] = { m_end + sizeof(record), record.flags, record.rawSize, record.storedSize };
+		m_rawBytes += record.rawSize;
+		m_storedBytes += record.storedSize;
+	}
+	m_end += sizeof(record) + record.storedSize;
+	return true;
+}
+
+bool VirtualTileFile::Write(uint32_t key, const uint8_t* data, size_t size)
+{
+	vector<uint8_t> compressed(LZCodec::CompressBound(size));
+	size_t compressedSize = LZCodec::Compress(data, size, compressed.data(), compressed.size());
+
+	VirtualTileRecord record = {};
+	record.key = key;
+	record.rawSize = (uint32_t)size;
+
+	// Noise-like tiles can fail to compress; store those raw so reading them is a plain copy
+	const uint8_t* payload = data;
+	if (compressedSize > 0 && compressedSize < size)
+	{
+		record.flags = VirtualTileLZ;
+		record.storedSize = (uint32_t)compressedSize;
+		payload = compressed.data();
+	}
+	else
+	{
+		record.storedSize = (uint32_t)size;
+	}
+
+	lock_guard<mutex> lock(m_mutex);
+	if (!m_file.is_open())
+		return false;
+	return Append(record, payload);
+}
+
+bool VirtualTileFile::Read(uint32_t key, vector<uint8_t>& output)
+{
+	Entry entry;
+	vector<uint8_t> stored;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto found = m_index.find(key);
+		if (found == m_index.end())
+			return false;
+		entry = found->second;
+
+		stored.resize(entry.storedSize);
+		m_file.seekg(entry.offset);
+		if (!m_file.read(reinterpret_cast<char*>(stored.data()), entry.storedSize))
+		{
+			m_file.clear();
+			return false;
+		}
+	}
+
+	output.resize(entry.rawSize);
+	if (entry.flags & VirtualTileLZ)
+		return LZCodec::Decompress(stored.data(), stored.size(), output.data(), output.size());
+
+	if (entry.storedSize != entry.rawSize)
+		return false;
+	memcpy(output.data(), stored.data(), entry.rawSize);
+	return true;
+}
+
+bool VirtualTileFile::Contains(uint32_t key) const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_index.count(key) != 0;
+}
+
+void VirtualTileFile::Remove(uint32_t key)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if (!m_file.is_open() || m_index.count(key) == 0)
+		return;
+
+	VirtualTileRecord record = {};
+	record.key = key;
+	record.flags = VirtualTileRemoved;
+	Append(record, nullptr);
+}
+
+size_t VirtualTileFile::GetTileCount() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_index.size();
+}
+
+uint64_t VirtualTileFile::GetFileSize() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_end;
+}
+
+uint64_t VirtualTileFile::GetRawBytes() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_rawBytes;
+}
+
+uint64_t VirtualTileFile::GetStoredBytes() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_storedBytes;
+}
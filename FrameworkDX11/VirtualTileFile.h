@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tile store for virtual texture pages (.vtf)
+//
+// A header followed by records appended one after another, each a VirtualTileRecord and its
+// payload: the tile's bytes LZ compressed, or stored raw when they do not compress. Tiles are
+// replaced by appending a newer record and removed by appending one with no payload, so nothing
+// already written is ever moved; opening a file replays the records into the in-memory index.
+
+#pragma pack(push, 1)
+struct VirtualTileFileHeader
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	flags;
+};
+
+struct VirtualTileRecord
+{
+	uint32_t	key;
+	uint32_t	flags;
+	uint32_t	rawSize;		// bytes once decompressed
+	uint32_t	storedSize;		// bytes of payload following the record
+};
+#pragma pack(pop)
+
+const uint32_t VIRTUAL_TILE_FILE_MAGIC = 0x31465456; // "VTF1"
+const uint16_t VIRTUAL_TILE_FILE_VERSION = 1;
+
+enum VirtualTileFlags
+{
+	VirtualTileLZ = 1 << 0,			// payload is LZ compressed, otherwise stored raw
+	VirtualTileRemoved = 1 << 1,	// key has no tile from here on
+};
+
+// Reads and writes may come from any thread; compression and decompression run outside the lock.
+class VirtualTileFile
+{
+public:
+	~VirtualTileFile();
+
+	// Starts an empty file, replacing any already there
+	bool						Create(const std::string& fileName);
+	// Opens an existing file for reading and appending. Records are replayed up to the first that
+	// is cut short or malformed, as a crash mid-write leaves the end, and appends go from there.
+	bool						Open(const std::string& fileName);
+	void						Close();
+	bool						IsOpen() const;
+
+	bool						Write(uint32_t key, const uint8_t* data, size_t size);
+	// False if there is no tile for key or it fails to decompress
+	bool						Read(uint32_t key, std::vector<uint8_t>& output);
+	bool						Contains(uint32_t key) const;
+	void						Remove(uint32_t key);
+
+	size_t						GetTileCount() const;
+	uint64_t					GetFileSize() const;
+	uint64_t					GetRawBytes() const;		// of the tiles in the index, before compression
+	uint64_t					GetStoredBytes() const;		// and after
+
+private:
+	struct Entry
+	{
+		uint64_t				offset;						// of the payload
+		uint32_t				flags;
+		uint32_t				rawSize;
+		uint32_t				storedSize;
+	};
+
+	bool						Append(const VirtualTileRecord& record, const uint8_t* payload);
+
+	mutable std::mutex			m_mutex;
+	std::fstream				m_file;
+	std::unordered_map<uint32_t, Entry>	m_index;
+	uint64_t					m_end = 0;
+	uint64_t					m_rawBytes = 0;
+	uint64_t					m_storedBytes = 0;
+};
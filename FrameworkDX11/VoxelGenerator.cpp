@@ -0,0 +1,187 @@
+#include "VoxelGenerator.h"
+#include "JobSystem.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+
+namespace
+{
+	// SSE2 has no 32-bit low multiply; build it from two 32x32->64 multiplies
+	inline __m128i MulLo32(__m128i a, __m128i b)
+	{
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	// Four lanes of HashUInt
+	inline __m128i Hash4(__m128i value)
+	{
+		value = _mm_xor_si128(value, _mm_srli_epi32(value, 16));
+		value = MulLo32(value, _mm_set1_epi32(0x7feb352d));
+		value = _mm_xor_si128(value, _mm_srli_epi32(value, 15));
+		value = MulLo32(value, _mm_set1_epi32((int)0x846ca68b));
+		value = _mm_xor_si128(value, _mm_srli_epi32(value, 16));
+		return value;
+	}
+
+	inline __m128 Floor4(__m128 v)
+	{
+		__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+		return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.0f)));
+	}
+
+	inline __m128 Fade4(__m128 t)
+	{
+		// t^3 (t (6t - 15) + 10)
+		__m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+		return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+	}
+
+	inline __m128 Lerp4(__m128 a, __m128 b, __m128 t)
+	{
+		return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+	}
+
+	inline __m128 Select4(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// Dot product with one of Perlin's 12 cube-edge gradients picked by the corner's hash
+	inline __m128 Gradient4(__m128i seed, __m128i ix, __m128i iy, __m128i iz, __m128 dx, __m128 dy, __m128 dz)
+	{
+		__m128i key = _mm_xor_si128(MulLo32(ix, _mm_set1_epi32(73856093)), MulLo32(iy, _mm_set1_epi32(19349663)));
+		key = _mm_xor_si128(key, MulLo32(iz, _mm_set1_epi32(83492791)));
+		__m128i h = _mm_and_si128(Hash4(_mm_xor_si128(seed, Hash4(key))), _mm_set1_epi32(15));
+
+		__m128 hLess8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+		__m128 hLess4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+		__m128 h12or14 = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+
+		__m128 u = Select4(hLess8, dx, dy);
+		__m128 v = Select4(hLess4, dy, Select4(h12or14, dx, dz));
+
+		__m128 signU = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+		__m128 signV = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+		return _mm_add_ps(_mm_xor_ps(u, signU), _mm_xor_ps(v, signV));
+	}
+
+	// 3D gradient noise for four points; returns roughly [-1, 1]
+	__m128 GradientNoise4(uint32_t seed, __m128 x, __m128 y, __m128 z)
+	{
+		const __m128i seed4 = _mm_set1_epi32((int)seed);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128i oneI = _mm_set1_epi32(1);
+
+		__m128 fx = Floor4(x);
+		__m128 fy = Floor4(y);
+		__m128 fz = Floor4(z);
+		__m128i ix = _mm_cvtps_epi32(fx);
+		__m128i iy = _mm_cvtps_epi32(fy);
+		__m128i iz = _mm_cvtps_epi32(fz);
+		__m128i ix1 = _mm_add_epi32(ix, oneI);
+		__m128i iy1 = _mm_add_epi32(iy, oneI);
+		__m128i iz1 = _mm_add_epi32(iz, oneI);
+		__m128 dx = _mm_sub_ps(x, fx);
+		__m128 dy = _mm_sub_ps(y, fy);
+		__m128 dz = _mm_sub_ps(z, fz);
+		__m128 dx1 = _mm_sub_ps(dx, one);
+		__m128 dy1 = _mm_sub_ps(dy, one);
+		__m128 dz1 = _mm_sub_ps(dz, one);
+
+		__m128 n000 = Gradient4(seed4, ix, iy, iz, dx, dy, dz);
+		__m128 n100 = Gradient4(seed4, ix1, iy, iz, dx1, dy, dz);
+		__m128 n010 = Gradient4(seed4, ix, iy1, iz, dx, dy1, dz);
+		__m128 n110 = Gradient4(seed4, ix1, iy1, iz, dx1, dy1, dz);
+		__m128 n001 = Gradient4(seed4, ix, iy, iz1, dx, dy, dz1);
+		__m128 n101 = Gradient4(seed4, ix1, iy, iz1, dx1, dy, dz1);
+		__m128 n011 = Gradient4(seed4, ix, iy1, iz1, dx, dy1, dz1);
+		__m128 n111 = Gradient4(seed4, ix1, iy1, iz1, dx1, dy1, dz1);
+
+		__m128 u = Fade4(dx);
+		__m128 v = Fade4(dy);
+		__m128 w = Fade4(dz);
+		__m128 nx00 = Lerp4(n000, n100, u);
+		__m128 nx10 = Lerp4(n010, n110, u);
+		__m128 nx01 = Lerp4(n001, n101, u);
+		__m128 nx11 = Lerp4(n011, n111, u);
+		return Lerp4(Lerp4(nx00, nx10, v), Lerp4(nx01, nx11, v), w);
+	}
+}
+
+void GenerateVoxelTerrain(VoxelVolume& volume, const VoxelNoiseSettings& settings)
+{
+	const int samplesX = volume.GetSamplesX();
+	const int samplesY = volume.GetSamplesY();
+	const int samplesZ = volume.GetSamplesZ();
+	const float cellSize = volume.GetCellSize();
+
+	float total = 0.0f;
+	float amplitude = 1.0f;
+	for (int octave = 0; octave < settings.octaves; ++octave)
+	{
+		total += amplitude;
+		amplitude *= settings.persistence;
+	}
+	const __m128 normalise = _mm_set1_ps(settings.heightScale / std::max(total, 1e-6f));
+	const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	// One job per xz column slab; every sample is independent
+	JobSystem::Get().ParallelFor(samplesZ, 2, [&](int begin, int end)
+	{
+		alignas(16) float lanes[4];
+		for (int z = begin; z < end; ++z)
+		{
+			const __m128 pz = _mm_set1_ps(z * cellSize);
+			for (int y = 0; y < samplesY; ++y)
+			{
+				const float localY = y * cellSize;
+				const __m128 py = _mm_set1_ps(localY);
+				float* row = volume.GetRow(y, z);
+
+				for (int x = 0; x < samplesX; x += 4)
+				{
+					__m128 px = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)x), laneOffsets), _mm_set1_ps(cellSize));
+
+					__m128 noise = _mm_setzero_ps();
+					float frequency = settings.baseFrequency;
+					float octaveAmplitude = 1.0f;
+					for (int octave = 0; octave < settings.octaves; ++octave)
+					{
+						__m128 f = _mm_set1_ps(frequency);
+						__m128 n = GradientNoise4(settings.seed + octave * 1013u, _mm_mul_ps(px, f), _mm_mul_ps(py, f), _mm_mul_ps(pz, f));
+						noise = _mm_add_ps(noise, _mm_mul_ps(n, _mm_set1_ps(octaveAmplitude)));
+						frequency *= settings.lacunarity;
+						octaveAmplitude *= settings.persistence;
+					}
+
+					// Negative below the displaced surface
+					__m128 density = _mm_sub_ps(_mm_sub_ps(py, _mm_set1_ps(settings.groundHeight)), _mm_mul_ps(noise, normalise));
+
+					// Tunnels follow the zero set of a second noise field
+					__m128 cf = _mm_set1_ps(settings.caveFrequency);
+					__m128 cave = GradientNoise4(settings.seed ^ 0x9e3779b9u, _mm_mul_ps(px, cf), _mm_mul_ps(py, cf), _mm_mul_ps(pz, cf));
+					cave = _mm_andnot_ps(signMask, cave);
+					__m128 carve = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(settings.caveThreshold), cave), _mm_set1_ps(settings.caveStrength));
+					density = _mm_max_ps(density, carve);
+
+					// Bedrock
+					density = _mm_min_ps(density, _mm_set1_ps(localY - settings.floorHeight));
+
+					if (x + 4 <= samplesX)
+					{
+						_mm_storeu_ps(row + x, density);
+					}
+					else
+					{
+						_mm_store_ps(lanes, density);
+						for (int lane = 0; x + lane < samplesX; ++lane)
+							row[x + lane] = lanes[lane];
+					}
+				}
+			}
+		}
+	});
+}
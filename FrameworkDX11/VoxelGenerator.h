@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+#include "VoxelVolume.h"
+
+struct VoxelNoiseSettings
+{
+	uint32_t	seed = 5;
+	int			octaves = 4;
+	float		baseFrequency = 1.0f / 24.0f;	// cycles per world unit at the first octave
+	float		lacunarity = 2.0f;
+	float		persistence = 0.5f;
+	float		groundHeight = 10.0f;			// local height of the mean surface
+	float		heightScale = 8.0f;				// how far the noise pushes the surface up and down
+	float		caveFrequency = 1.0f / 14.0f;
+	float		caveThreshold = 0.08f;			// tunnels where |cave noise| is below this
+	float		caveStrength = 30.0f;
+	float		floorHeight = 1.0f;				// solid bedrock below this local height
+};
+
+// Fills the volume with a signed distance-like field: 3D fBm around a ground plane, with ridged
+// noise tunnels carved through it. Densities are evaluated four samples at a time with SSE and
+// rows are generated in parallel; the output depends only on the settings.
+void GenerateVoxelTerrain(VoxelVolume& volume, const VoxelNoiseSettings& settings);
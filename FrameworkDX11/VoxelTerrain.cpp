@@ -0,0 +1,363 @@
+#include "VoxelTerrain.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+	inline int FloorDiv(int a, int b)
+	{
+		return (a >= 0 ? a : a - b + 1) / b;
+	}
+
+	// A chunk's mesh reads samples [c * size - 1, c * size + size + 1]
+	inline void ChunkRange(int sample0, int sample1, int chunkCount, int& chunk0, int& chunk1)
+	{
+		chunk0 = max(FloorDiv(sample0 - 2, VOXEL_CHUNK_SIZE), 0);
+		chunk1 = min(FloorDiv(sample1 + 1, VOXEL_CHUNK_SIZE), chunkCount - 1);
+	}
+}
+
+VoxelChunkMesh::~VoxelChunkMesh()
+{
+	if (vertexBuffer)
+		vertexBuffer->Release();
+	if (indexBuffer)
+		indexBuffer->Release();
+}
+
+VoxelTerrain::VoxelTerrain()
+{
+}
+
+VoxelTerrain::~VoxelTerrain()
+{
+	Cleanup();
+}
+
+void VoxelTerrain::Cleanup()
+{
+	m_chunks.clear();
+	m_meshCache.clear();
+
+	if (m_pMaterialConstantBuffer)
+		m_pMaterialConstantBuffer->Release();
+	m_pMaterialConstantBuffer = nullptr;
+
+	m_texture.Reset();
+	m_normalTexture.Reset();
+
+	if (m_pSamplerLinear)
+		m_pSamplerLinear->Release();
+	m_pSamplerLinear = nullptr;
+}
+
+HRESULT VoxelTerrain::Init(ID3D11Device* pd3dDevice, TextureCache& textures, const VoxelTerrainSettings& settings)
+{
+	m_settings = settings;
+
+	m_volume.Resize(settings.chunksX, settings.chunksY, settings.chunksZ, settings.cellSize);
+	GenerateVoxelTerrain(m_volume, settings.noise);
+	m_chunks.assign((size_t)settings.chunksX * settings.chunksY * settings.chunksZ, VoxelChunk());
+
+	// The heightfield terrain's rock textures, shared through the cache
+	m_texture = textures.Acquire(L"Resources\\Rock Textures\\rock_diffuse2.dds", TexturePlaceholder::White);
+	m_normalTexture = textures.Acquire(L"Resources\\Rock Textures\\rock_bump.dds", TexturePlaceholder::FlatNormal);
+
+	D3D11_SAMPLER_DESC sampDesc;
+	ZeroMemory(&sampDesc, sizeof(sampDesc));
+	sampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+	sampDesc.MaxAnisotropy = 8;
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	sampDesc.MinLOD = 0;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	HRESULT hr = pd3dDevice->CreateSamplerState(&sampDesc, &m_pSamplerLinear);
+	if (FAILED(hr))
+		return hr;
+
+	m_material.Material.Diffuse = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	m_material.Material.Specular = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
+	m_material.Material.SpecularPower = 8.0f;
+	m_material.Material.UseTexture = true;
+	m_material.Material.choice = 0;
+
+	// Create the material constant buffer
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DEFAULT;
+	bd.ByteWidth = sizeof(MaterialPropertiesConstantBuffer);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = 0;
+	hr = pd3dDevice->CreateBuffer(&bd, nullptr, &m_pMaterialConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	return Update(pd3dDevice);
+}
+
+HRESULT VoxelTerrain::Update(ID3D11Device* pd3dDevice)
+{
+	m_chunksMeshed = 0;
+	m_cacheHits = 0;
+
+	std::vector<int> dirty;
+	for (size_t i = 0; i < m_chunks.size(); ++i)
+	{
+		if (m_chunks[i].dirty)
+			dirty.push_back((int)i);
+	}
+	if (dirty.empty())
+		return S_OK;
+
+	const int chunksX = m_settings.chunksX;
+	const int chunksY = m_settings.chunksY;
+	auto chunkCoords = [chunksX, chunksY](int index, int& x, int& y, int& z)
+	{
+		x = index % chunksX;
+		y = (index / chunksX) % chunksY;
+		z = index / (chunksX * chunksY);
+	};
+
+	std::vector<uint64_t> hashes(dirty.size());
+	JobSystem::Get().ParallelFor((int)dirty.size(), 1, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			int x, y, z;
+			chunkCoords(dirty[i], x, y, z);
+			hashes[i] = m_volume.HashChunk(x, y, z);
+		}
+	});
+
+	// Content we have seen before comes straight from the cache; each new hash is meshed once
+	struct MeshJob
+	{
+		uint64_t					hash;
+		int							chunk;
+		std::vector<SimpleVertex>	vertices;
+		std::vector<uint32_t>		indices;
+	};
+	std::vector<MeshJob> jobs;
+	std::unordered_map<uint64_t, size_t> jobForHash;
+
+	for (size_t i = 0; i < dirty.size(); ++i)
+	{
+		VoxelChunk& chunk = m_chunks[dirty[i]];
+		chunk.dirty = false;
+		if (chunk.mesh && chunk.hash == hashes[i])
+			continue;
+
+		auto cached = m_meshCache.find(hashes[i]);
+		if (cached != m_meshCache.end())
+		{
+			chunk.mesh = cached->second;
+			chunk.hash = hashes[i];
+			++m_cacheHits;
+		}
+		else if (jobForHash.emplace(hashes[i], jobs.size()).second)
+		{
+			MeshJob job;
+			job.hash = hashes[i];
+			job.chunk = dirty[i];
+			jobs.push_back(std::move(job));
+		}
+	}
+
+	JobSystem::Get().ParallelFor((int)jobs.size(), 1, [&](int begin, int end)
+	{
+		MarchingCubesScratch scratch;
+		VoxelMesh mesh;
+		for (int i = begin; i < end; ++i)
+		{
+			int x, y, z;
+			chunkCoords(jobs[i].chunk, x, y, z);
+			MarchingCubes::MeshChunk(m_volume, x, y, z, mesh, scratch);
+			BuildVertices(mesh, jobs[i].vertices);
+			jobs[i].indices.swap(mesh.indices);
+		}
+	});
+	m_chunksMeshed = (int)jobs.size();
+
+	// Buffer creation stays on the calling thread
+	for (MeshJob& job : jobs)
+	{
+		std::shared_ptr<VoxelChunkMesh> mesh;
+		HRESULT hr = CreateChunkMesh(pd3dDevice, job.vertices, job.indices, mesh);
+		if (FAILED(hr))
+			return hr;
+		m_meshCache[job.hash] = mesh;
+	}
+
+	for (size_t i = 0; i < dirty.size(); ++i)
+	{
+		VoxelChunk& chunk = m_chunks[dirty[i]];
+		if (jobForHash.count(hashes[i]))
+		{
+			chunk.mesh = m_meshCache[hashes[i]];
+			chunk.hash = hashes[i];
+		}
+	}
+
+	TrimCache();
+	return S_OK;
+}
+
+void VoxelTerrain::TrimCache()
+{
+	// Only meshes no chunk is using can go
+	for (auto it = m_meshCache.begin(); it != m_meshCache.end() && (int)m_meshCache.size() > m_settings.meshCacheSize;)
+	{
+		if (it->second.use_count() == 1)
+			it = m_meshCache.erase(it);
+		else
+			++it;
+	}
+}
+
+void VoxelTerrain::BuildVertices(const VoxelMesh& mesh, std::vector<SimpleVertex>& vertices) const
+{
+	// Planar mapping along the dominant normal axis. The chunk's extent is a whole number of
+	// texture repeats, so chunk-local coordinates line up across chunk borders.
+	const float invRepeat = 1.0f / m_settings.textureRepeat;
+	vertices.resize(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); ++i)
+	{
+		const XMFLOAT3& p = mesh.positions[i];
+		const XMFLOAT3& n = mesh.normals[i];
+		const float ax = fabs(n.x);
+		const float ay = fabs(n.y);
+		const float az = fabs(n.z);
+
+		XMVECTOR tangentAxis;
+		XMVECTOR binormalAxis;
+		SimpleVertex& vertex = vertices[i];
+		if (ay >= ax && ay >= az)
+		{
+			vertex.TexCoord = XMFLOAT2(p.x * invRepeat, p.z * invRepeat);
+			tangentAxis = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+			binormalAxis = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		}
+		else if (ax >= az)
+		{
+			vertex.TexCoord = XMFLOAT2(p.z * invRepeat, p.y * invRepeat);
+			tangentAxis = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+			binormalAxis = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+		}
+		else
+		{
+			vertex.TexCoord = XMFLOAT2(p.x * invRepeat, p.y * invRepeat);
+			tangentAxis = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+			binormalAxis = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+		}
+
+		// Project the mapping axes onto the surface
+		XMVECTOR normal = XMLoadFloat3(&n);
+		XMVECTOR tangent = XMVector3Normalize(tangentAxis - normal * XMVectorGetX(XMVector3Dot(tangentAxis, normal)));
+		XMVECTOR binormal = XMVector3Normalize(binormalAxis - normal * XMVectorGetX(XMVector3Dot(binormalAxis, normal)));
+
+		vertex.Pos = p;
+		vertex.Normal = n;
+		XMStoreFloat3(&vertex.tangent, tangent);
+		XMStoreFloat3(&vertex.biTangent, binormal);
+	}
+}
+
+HRESULT VoxelTerrain::CreateChunkMesh(ID3D11Device* pd3dDevice, const std::vector<SimpleVertex>& vertices, const std::vector<uint32_t>& indices, std::shared_ptr<VoxelChunkMesh>& mesh)
+{
+	mesh = std::make_shared<VoxelChunkMesh>();
+	if (indices.empty())
+		return S_OK;
+
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = (UINT)(sizeof(SimpleVertex) * vertices.size());
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = 0;
+
+	D3D11_SUBRESOURCE_DATA InitData = {};
+	InitData.pSysMem = vertices.data();
+	HRESULT hr = pd3dDevice->CreateBuffer(&bd, &InitData, &mesh->vertexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	bd.ByteWidth = (UINT)(sizeof(uint32_t) * indices.size());
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	InitData.pSysMem = indices.data();
+	hr = pd3dDevice->CreateBuffer(&bd, &InitData, &mesh->indexBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	mesh->indexCount = (UINT)indices.size();
+	return S_OK;
+}
+
+void VoxelTerrain::Draw(ID3D11DeviceContext* pContext, ID3D11Buffer* pObjectConstantBuffer, ConstantBuffer& cb)
+{
+	pContext->UpdateSubresource(m_pMaterialConstantBuffer, 0, nullptr, &m_material, 0, 0);
+	pContext->PSSetConstantBuffers(1, 1, &m_pMaterialConstantBuffer);
+	ID3D11ShaderResourceView* textures[2] = { m_texture.Get(), m_normalTexture.Get() };
+	pContext->PSSetShaderResources(0, 2, textures);
+	pContext->PSSetSamplers(0, 1, &m_pSamplerLinear);
+	pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	const float chunkExtent = VOXEL_CHUNK_SIZE * m_settings.cellSize;
+	UINT stride = sizeof(SimpleVertex);
+	UINT offset = 0;
+	for (int z = 0; z < m_settings.chunksZ; ++z)
+	{
+		for (int y = 0; y < m_settings.chunksY; ++y)
+		{
+			for (int x = 0; x < m_settings.chunksX; ++x)
+			{
+				VoxelChunk& chunk = GetChunk(x, y, z);
+				if (!chunk.mesh || chunk.mesh->indexCount == 0)
+					continue;
+
+				XMMATRIX world = XMMatrixTranslation(m_settings.origin.x + x * chunkExtent, m_settings.origin.y + y * chunkExtent, m_settings.origin.z + z * chunkExtent);
+				cb.mWorld = XMMatrixTranspose(world);
+				pContext->UpdateSubresource(pObjectConstantBuffer, 0, nullptr, &cb, 0, 0);
+
+				pContext->IASetVertexBuffers(0, 1, &chunk.mesh->vertexBuffer, &stride, &offset);
+				pContext->IASetIndexBuffer(chunk.mesh->indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+				pContext->DrawIndexed(chunk.mesh->indexCount, 0, 0);
+			}
+		}
+	}
+}
+
+bool VoxelTerrain::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, VoxelRayHit& hit) const
+{
+	XMFLOAT3 localOrigin(origin.x - m_settings.origin.x, origin.y - m_settings.origin.y, origin.z - m_settings.origin.z);
+	if (!m_volume.Raycast(localOrigin, direction, maxDistance, hit))
+		return false;
+
+	hit.position.x += m_settings.origin.x;
+	hit.position.y += m_settings.origin.y;
+	hit.position.z += m_settings.origin.z;
+	return true;
+}
+
+void VoxelTerrain::ApplyBrush(const XMFLOAT3& position, const BrushSettings& brush, float deltaTime)
+{
+	BrushSettings local = brush;
+	local.flattenHeight -= m_settings.origin.y;
+
+	VoxelBox changed = m_volume.ApplyBrush(position.x - m_settings.origin.x, position.y - m_settings.origin.y, position.z - m_settings.origin.z, local, deltaTime);
+	if (changed.IsEmpty())
+		return;
+
+	int cx0, cx1, cy0, cy1, cz0, cz1;
+	ChunkRange(changed.x0, changed.x1, m_settings.chunksX, cx0, cx1);
+	ChunkRange(changed.y0, changed.y1, m_settings.chunksY, cy0, cy1);
+	ChunkRange(changed.z0, changed.z1, m_settings.chunksZ, cz0, cz1);
+	for (int z = cz0; z <= cz1; ++z)
+		for (int y = cy0; y <= cy1; ++y)
+			for (int x = cx0; x <= cx1; ++x)
+				GetChunk(x, y, z).dirty = true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <DirectXMath.h>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "DrawableGameObject.h"
+#include "MarchingCubes.h"
+#include "TerrainBrush.h"
+#include "VoxelGenerator.h"
+#include "VoxelVolume.h"
+#include "structures.h"
+
+using namespace DirectX;
+
+struct VoxelTerrainSettings
+{
+	int						chunksX = 4;
+	int						chunksY = 2;
+	int						chunksZ = 4;
+	float					cellSize = 0.5f;
+	float					textureRepeat = 4.0f;		// world units per texture repeat
+	XMFLOAT3				origin = XMFLOAT3(-32.0f, -10.0f, -32.0f);
+	VoxelNoiseSettings		noise;
+	int						meshCacheSize = 128;		// unreferenced meshes kept around for reuse
+};
+
+// GPU buffers for one chunk mesh. Shared by every chunk whose content hashes the same.
+struct VoxelChunkMesh
+{
+	~VoxelChunkMesh();
+
+	ID3D11Buffer*			vertexBuffer = nullptr;
+	ID3D11Buffer*			indexBuffer = nullptr;
+	UINT					indexCount = 0;
+};
+
+struct VoxelChunk
+{
+	uint64_t						hash = 0;
+	bool							dirty = true;
+	std::shared_ptr<VoxelChunkMesh>	mesh;
+};
+
+// Signed-distance terrain with caves and overhangs, meshed per chunk with marching cubes.
+//
+// Edits only mark the chunks whose samples they touched. Update hashes the dirty chunks, takes
+// meshes for known content from the cache and meshes the rest in parallel on the job system.
+class VoxelTerrain
+{
+public:
+	VoxelTerrain();
+	~VoxelTerrain();
+
+	HRESULT					Init(ID3D11Device* pd3dDevice, TextureCache& textures, const VoxelTerrainSettings& settings);
+	void					Cleanup();
+
+	// Remeshes dirty chunks; cheap when nothing changed
+	HRESULT					Update(ID3D11Device* pd3dDevice);
+
+	// Chunk meshes are chunk-local, so each draw writes its own world matrix into the object
+	// constant buffer; cb supplies the view and projection.
+	void					Draw(ID3D11DeviceContext* pContext, ID3D11Buffer* pObjectConstantBuffer, ConstantBuffer& cb);
+
+	// World-space queries and edits; the brush's flattenHeight is a world height
+	bool					Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, VoxelRayHit& hit) const;
+	void					ApplyBrush(const XMFLOAT3& position, const BrushSettings& brush, float deltaTime);
+
+	const VoxelVolume&		GetVolume() const { return m_volume; }
+	int						GetChunksMeshedLastUpdate() const { return m_chunksMeshed; }
+	int						GetCacheHitsLastUpdate() const { return m_cacheHits; }
+	int						GetCachedMeshCount() const { return (int)m_meshCache.size(); }
+
+	MaterialPropertiesConstantBuffer	m_material;
+
+private:
+	VoxelChunk&				GetChunk(int x, int y, int z) { return m_chunks[((size_t)z * m_settings.chunksY + y) * m_settings.chunksX + x]; }
+	void					BuildVertices(const VoxelMesh& mesh, std::vector<SimpleVertex>& vertices) const;
+	HRESULT					CreateChunkMesh(ID3D11Device* pd3dDevice, const std::vector<SimpleVertex>& vertices, const std::vector<uint32_t>& indices, std::shared_ptr<VoxelChunkMesh>& mesh);
+	void					TrimCache();
+
+	VoxelTerrainSettings				m_settings;
+	VoxelVolume							m_volume;
+	std::vector<VoxelChunk>				m_chunks;
+	std::unordered_map<uint64_t, std::shared_ptr<VoxelChunkMesh>>	m_meshCache;
+	int									m_chunksMeshed = 0;
+	int									m_cacheHits = 0;
+
+	ID3D11Buffer*						m_pMaterialConstantBuffer = nullptr;
+	TextureHandle						m_texture;
+	TextureHandle						m_normalTexture;
+	ID3D11SamplerState*					m_pSamplerLinear = nullptr;
+};
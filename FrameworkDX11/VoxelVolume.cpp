@@ -0,0 +1,262 @@
+#include "VoxelVolume.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	inline float Saturate(float v)
+	{
+		return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+	}
+
+	inline float Lerp(float a, float b, float t)
+	{
+		return a + (b - a) * t;
+	}
+}
+
+VoxelVolume::VoxelVolume()
+	: m_chunksX(0), m_chunksY(0), m_chunksZ(0), m_samplesX(0), m_samplesY(0), m_samplesZ(0), m_cellSize(1.0f)
+{
+}
+
+void VoxelVolume::Resize(int chunksX, int chunksY, int chunksZ, float cellSize)
+{
+	m_chunksX = chunksX;
+	m_chunksY = chunksY;
+	m_chunksZ = chunksZ;
+	m_samplesX = chunksX * VOXEL_CHUNK_SIZE + 1;
+	m_samplesY = chunksY * VOXEL_CHUNK_SIZE + 1;
+	m_samplesZ = chunksZ * VOXEL_CHUNK_SIZE + 1;
+	m_cellSize = cellSize;
+	m_samples.assign((size_t)m_samplesX * m_samplesY * m_samplesZ, 1.0f);
+}
+
+float VoxelVolume::AtClamped(int x, int y, int z) const
+{
+	x = std::min(std::max(x, 0), m_samplesX - 1);
+	y = std::min(std::max(y, 0), m_samplesY - 1);
+	z = std::min(std::max(z, 0), m_samplesZ - 1);
+	return At(x, y, z);
+}
+
+float VoxelVolume::SampleTrilinear(float x, float y, float z) const
+{
+	x = std::min(std::max(x, 0.0f), (float)(m_samplesX - 1));
+	y = std::min(std::max(y, 0.0f), (float)(m_samplesY - 1));
+	z = std::min(std::max(z, 0.0f), (float)(m_samplesZ - 1));
+
+	int x0 = std::min((int)x, m_samplesX - 2);
+	int y0 = std::min((int)y, m_samplesY - 2);
+	int z0 = std::min((int)z, m_samplesZ - 2);
+	float fx = x - x0;
+	float fy = y - y0;
+	float fz = z - z0;
+
+	float c00 = Lerp(At(x0, y0, z0), At(x0 + 1, y0, z0), fx);
+	float c10 = Lerp(At(x0, y0 + 1, z0), At(x0 + 1, y0 + 1, z0), fx);
+	float c01 = Lerp(At(x0, y0, z0 + 1), At(x0 + 1, y0, z0 + 1), fx);
+	float c11 = Lerp(At(x0, y0 + 1, z0 + 1), At(x0 + 1, y0 + 1, z0 + 1), fx);
+	return Lerp(Lerp(c00, c10, fy), Lerp(c01, c11, fy), fz);
+}
+
+XMFLOAT3 VoxelVolume::GetGradient(int x, int y, int z) const
+{
+	// Central differences in grid units, one-sided at the edges
+	return XMFLOAT3(
+		AtClamped(x + 1, y, z) - AtClamped(x - 1, y, z),
+		AtClamped(x, y + 1, z) - AtClamped(x, y - 1, z),
+		AtClamped(x, y, z + 1) - AtClamped(x, y, z - 1));
+}
+
+uint64_t VoxelVolume::HashChunk(int chunkX, int chunkY, int chunkZ) const
+{
+	const int x0 = std::max(chunkX * VOXEL_CHUNK_SIZE - 1, 0);
+	const int y0 = std::max(chunkY * VOXEL_CHUNK_SIZE - 1, 0);
+	const int z0 = std::max(chunkZ * VOXEL_CHUNK_SIZE - 1, 0);
+	const int x1 = std::min(chunkX * VOXEL_CHUNK_SIZE + VOXEL_CHUNK_SIZE + 1, m_samplesX - 1);
+	const int y1 = std::min(chunkY * VOXEL_CHUNK_SIZE + VOXEL_CHUNK_SIZE + 1, m_samplesY - 1);
+	const int z1 = std::min(chunkZ * VOXEL_CHUNK_SIZE + VOXEL_CHUNK_SIZE + 1, m_samplesZ - 1);
+
+	// FNV-1a over 32-bit words; the block's position is left out on purpose so identical
+	// content anywhere in the volume shares one mesh
+	uint64_t hash = 14695981039346656037ull;
+	for (int z = z0; z <= z1; ++z)
+	{
+		for (int y = y0; y <= y1; ++y)
+		{
+			const float* row = GetRow(y, z);
+			for (int x = x0; x <= x1; ++x)
+			{
+				uint32_t bits;
+				memcpy(&bits, &row[x], sizeof(bits));
+				hash = (hash ^ bits) * 1099511628211ull;
+			}
+		}
+	}
+
+	// Chunks on the volume's edge have a clipped apron, which changes their normals
+	uint32_t edges = (x0 == 0) | (y0 == 0) << 1 | (z0 == 0) << 2 |
+		(x1 == m_samplesX - 1) << 3 | (y1 == m_samplesY - 1) << 4 | (z1 == m_samplesZ - 1) << 5;
+	return (hash ^ edges) * 1099511628211ull;
+}
+
+VoxelBox VoxelVolume::ApplyBrush(float x, float y, float z, const BrushSettings& settings, float deltaTime)
+{
+	VoxelBox box;
+	const float radius = std::max(settings.radius, m_cellSize);
+	const float invCell = 1.0f / m_cellSize;
+	const int border = settings.mode == BrushSmooth ? 1 : 2;
+
+	box.x0 = std::max((int)std::floor((x - radius) * invCell) - border, 0);
+	box.y0 = std::max((int)std::floor((y - radius) * invCell) - border, 0);
+	box.z0 = std::max((int)std::floor((z - radius) * invCell) - border, 0);
+	box.x1 = std::min((int)std::ceil((x + radius) * invCell) + border, m_samplesX - 1);
+	box.y1 = std::min((int)std::ceil((y + radius) * invCell) + border, m_samplesY - 1);
+	box.z1 = std::min((int)std::ceil((z + radius) * invCell) + border, m_samplesZ - 1);
+	if (box.IsEmpty())
+		return box;
+
+	const int sizeX = box.x1 - box.x0 + 1;
+	const int sizeY = box.y1 - box.y0 + 1;
+	const int sizeZ = box.z1 - box.z0 + 1;
+	const float rate = Saturate(settings.strength * deltaTime / radius);
+
+	// Smoothing reads a snapshot so the result does not depend on the order slices are processed in
+	if (settings.mode == BrushSmooth)
+	{
+		m_scratch.resize((size_t)sizeX * sizeY * sizeZ);
+		for (int sz = 0; sz < sizeZ; ++sz)
+			for (int sy = 0; sy < sizeY; ++sy)
+				memcpy(&m_scratch[((size_t)sz * sizeY + sy) * sizeX], GetRow(box.y0 + sy, box.z0 + sz) + box.x0, sizeX * sizeof(float));
+	}
+
+	auto snapshot = [&](int sx, int sy, int sz)
+	{
+		sx = std::min(std::max(sx, 0), sizeX - 1);
+		sy = std::min(std::max(sy, 0), sizeY - 1);
+		sz = std::min(std::max(sz, 0), sizeZ - 1);
+		return m_scratch[((size_t)sz * sizeY + sy) * sizeX + sx];
+	};
+
+	JobSystem::Get().ParallelFor(sizeZ, 4, [&](int begin, int end)
+	{
+		for (int sz = begin; sz < end; ++sz)
+		{
+			const float pz = (box.z0 + sz) * m_cellSize - z;
+			for (int sy = 0; sy < sizeY; ++sy)
+			{
+				const float py = (box.y0 + sy) * m_cellSize;
+				float* row = GetRow(box.y0 + sy, box.z0 + sz);
+				for (int sx = 0; sx < sizeX; ++sx)
+				{
+					const float px = (box.x0 + sx) * m_cellSize - x;
+					const float distance = std::sqrt(px * px + (py - y) * (py - y) + pz * pz);
+					float& value = row[box.x0 + sx];
+
+					switch (settings.mode)
+					{
+					case BrushRaise:
+						value = Lerp(value, std::min(value, distance - radius), rate);
+						break;
+					case BrushLower:
+						value = Lerp(value, std::max(value, radius - distance), rate);
+						break;
+					case BrushSmooth:
+					{
+						if (distance >= radius)
+							break;
+						float average = (snapshot(sx - 1, sy, sz) + snapshot(sx + 1, sy, sz) + snapshot(sx, sy - 1, sz) +
+							snapshot(sx, sy + 1, sz) + snapshot(sx, sy, sz - 1) + snapshot(sx, sy, sz + 1)) * (1.0f / 6.0f);
+						float weight = 1.0f - settings.falloff * distance / radius;
+						value = Lerp(snapshot(sx, sy, sz), average, rate * weight);
+						break;
+					}
+					case BrushFlatten:
+						if (distance < radius)
+							value = Lerp(value, py - settings.flattenHeight, rate * (1.0f - settings.falloff * distance / radius));
+						break;
+					}
+				}
+			}
+		}
+	});
+
+	return box;
+}
+
+bool VoxelVolume::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, VoxelRayHit& hit) const
+{
+	const float o[3] = { origin.x, origin.y, origin.z };
+	const float d[3] = { direction.x, direction.y, direction.z };
+	const float extent[3] = { (m_samplesX - 1) * m_cellSize, (m_samplesY - 1) * m_cellSize, (m_samplesZ - 1) * m_cellSize };
+
+	// Clip to the volume's bounds
+	float tNear = 0.0f;
+	float tFar = maxDistance;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (std::fabs(d[axis]) < 1e-8f)
+		{
+			if (o[axis] < 0.0f || o[axis] > extent[axis])
+				return false;
+			continue;
+		}
+		float t0 = (0.0f - o[axis]) / d[axis];
+		float t1 = (extent[axis] - o[axis]) / d[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1);
+	}
+	if (tNear > tFar)
+		return false;
+
+	const float invCell = 1.0f / m_cellSize;
+	auto density = [&](float t)
+	{
+		return SampleTrilinear((o[0] + d[0] * t) * invCell, (o[1] + d[1] * t) * invCell, (o[2] + d[2] * t) * invCell);
+	};
+
+	const float step = m_cellSize * 0.5f;
+	float previousT = tNear;
+	if (density(tNear) <= 0.0f)
+		return false;				// starting inside the ground
+
+	for (float t = tNear + step; previousT < tFar; t += step)
+	{
+		t = std::min(t, tFar);
+		float current = density(t);
+		if (current <= 0.0f)
+		{
+			float lo = previousT;
+			float hi = t;
+			for (int i = 0; i < 8; ++i)
+			{
+				float mid = (lo + hi) * 0.5f;
+				if (density(mid) > 0.0f)
+					lo = mid;
+				else
+					hi = mid;
+			}
+
+			hit.distance = hi;
+			hit.position = XMFLOAT3(o[0] + d[0] * hi, o[1] + d[1] * hi, o[2] + d[2] * hi);
+
+			float gx = hit.position.x * invCell;
+			float gy = hit.position.y * invCell;
+			float gz = hit.position.z * invCell;
+			XMVECTOR normal = XMVectorSet(
+				SampleTrilinear(gx + 0.5f, gy, gz) - SampleTrilinear(gx - 0.5f, gy, gz),
+				SampleTrilinear(gx, gy + 0.5f, gz) - SampleTrilinear(gx, gy - 0.5f, gz),
+				SampleTrilinear(gx, gy, gz + 0.5f) - SampleTrilinear(gx, gy, gz - 0.5f), 0.0f);
+			XMStoreFloat3(&hit.normal, XMVector3Normalize(normal));
+			return true;
+		}
+		previousT = t;
+	}
+	return false;
+}
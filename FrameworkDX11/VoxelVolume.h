@@ -0,0 +1,85 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "TerrainBrush.h"
+
+using namespace DirectX;
+
+const int VOXEL_CHUNK_SIZE = 32;				// cells along a chunk edge
+
+// Inclusive box of voxel samples touched by an edit
+struct VoxelBox
+{
+	int x0 = 0;
+	int y0 = 0;
+	int z0 = 0;
+	int x1 = -1;
+	int y1 = -1;
+	int z1 = -1;
+
+	bool IsEmpty() const { return x1 < x0 || y1 < y0 || z1 < z0; }
+};
+
+struct VoxelRayHit
+{
+	float		distance;
+	XMFLOAT3	position;
+	XMFLOAT3	normal;
+};
+
+// Signed distance samples on a regular grid: negative inside solid ground, positive in air.
+//
+// Sample (x, y, z) sits at local position (x, y, z) * cellSize. The grid is a whole number of
+// chunks plus one sample, so neighbouring chunks share their boundary samples and mesh seamlessly.
+class VoxelVolume
+{
+public:
+	VoxelVolume();
+
+	void Resize(int chunksX, int chunksY, int chunksZ, float cellSize);
+
+	int GetChunksX() const { return m_chunksX; }
+	int GetChunksY() const { return m_chunksY; }
+	int GetChunksZ() const { return m_chunksZ; }
+	int GetSamplesX() const { return m_samplesX; }
+	int GetSamplesY() const { return m_samplesY; }
+	int GetSamplesZ() const { return m_samplesZ; }
+	float GetCellSize() const { return m_cellSize; }
+
+	// x is the contiguous axis
+	float* GetRow(int y, int z) { return m_samples.data() + ((size_t)z * m_samplesY + y) * m_samplesX; }
+	const float* GetRow(int y, int z) const { return m_samples.data() + ((size_t)z * m_samplesY + y) * m_samplesX; }
+
+	float At(int x, int y, int z) const { return m_samples[((size_t)z * m_samplesY + y) * m_samplesX + x]; }
+	float& At(int x, int y, int z) { return m_samples[((size_t)z * m_samplesY + y) * m_samplesX + x]; }
+	float AtClamped(int x, int y, int z) const;
+
+	// x, y and z are in grid units, not world units
+	float SampleTrilinear(float x, float y, float z) const;
+	XMFLOAT3 GetGradient(int x, int y, int z) const;
+
+	// Hash of every sample a chunk's mesh depends on: its own block plus the one-sample apron
+	// used for normals. Equal hashes mean the mesher would produce the same mesh.
+	uint64_t HashChunk(int chunkX, int chunkY, int chunkZ) const;
+
+	// One brush dab centred at local position (x, y, z). Raise adds material, lower carves it,
+	// smooth blurs the field and flatten pulls it towards a plane at flattenHeight (local units).
+	VoxelBox ApplyBrush(float x, float y, float z, const BrushSettings& settings, float deltaTime);
+
+	// Local-space ray against the zero crossing; marches half a cell at a time, then bisects
+	bool Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, VoxelRayHit& hit) const;
+
+private:
+	int									m_chunksX;
+	int									m_chunksY;
+	int									m_chunksZ;
+	int									m_samplesX;
+	int									m_samplesY;
+	int									m_samplesZ;
+	float								m_cellSize;
+	std::vector<float>					m_samples;
+	std::vector<float>					m_scratch;
+};
@@ -17,6 +17,10 @@
 #include "main.h"
 DirectX::XMFLOAT4 g_EyePosition(0.0f, 0.0f, -3.0f, 1.0f);
 
+// Set by WndProc, consumed by Application::Update
+POINT g_leftClickPosition = {};
+bool g_leftClickPending = false;
+
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 
 //--------------------------------------------------------------------------------------
@@ -27,7 +31,25 @@ LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
+
+    // "-pack" bundles everything under Resources into Resources.pak and exits; runs after that
+    // read their assets from the package
+    if (wcsstr(lpCmdLine, L"-pack"))
+    {
+        vector<string> files;
+        string error = "Cannot list every file under Resources";
+        bool packed = AssetPacker::ListFiles("Resources", files) && AssetPacker::Pack(files, "Resources.pak", AssetPackSettings(), nullptr, &error);
+        if (!packed)
+        {
+            // Said on the console it was run from, if any, and to the debugger
+            error = "-pack failed: " + error + "\n";
+            FILE* console = nullptr;
+            if (AttachConsole(ATTACH_PARENT_PROCESS) && freopen_s(&console, "CONOUT$", "w", stderr) == 0)
+                fputs(error.c_str(), stderr);
+            OutputDebugStringA(error.c_str());
+        }
+        return packed ? 0 : 1;
+    }
 
     Application* application = new Application();
 
@@ -105,45 +127,6 @@ HRESULT Application::InitWindow( HINSTANCE hInstance, int nCmdShow )
 }
 
 
-//--------------------------------------------------------------------------------------
-// Helper for compiling shaders with D3DCompile
-//
-// With VS 11, we could load up prebuilt .cso files instead...
-//--------------------------------------------------------------------------------------
-HRESULT CompileShaderFromFile( const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut )
-{
-    HRESULT hr = S_OK;
-
-    DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#ifdef _DEBUG
-    // Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
-    // Setting this flag improves the shader debugging experience, but still allows 
-    // the shaders to be optimized and to run exactly the way they will run in 
-    // the release configuration of this program.
-    dwShaderFlags |= D3DCOMPILE_DEBUG;
-
-    // Disable optimizations to further improve shader debugging
-    dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-
-    ID3DBlob* pErrorBlob = nullptr;
-    hr = D3DCompileFromFile( szFileName, nullptr, nullptr, szEntryPoint, szShaderModel, 
-        dwShaderFlags, 0, ppBlobOut, &pErrorBlob );
-    if( FAILED(hr) )
-    {
-        if( pErrorBlob )
-        {
-            OutputDebugStringA( reinterpret_cast<const char*>( pErrorBlob->GetBufferPointer() ) );
-            pErrorBlob->Release();
-        }
-        return hr;
-    }
-    if( pErrorBlob ) pErrorBlob->Release();
-
-    return S_OK;
-}
-
-
 //--------------------------------------------------------------------------------------
 // Create Direct3D device and swap chain
 //--------------------------------------------------------------------------------------
@@ -357,6 +340,19 @@ HRESULT Application::InitDevice()
     vp.TopLeftY = 0;
     g_pImmediateContext->RSSetViewports( 1, &vp );
 
+	// Assets come from the package when there is one, and from the loose files otherwise
+	AssetPackages::Mount("Resources.pak");
+
+	// Textures read on the job system from here on and upload during Render
+	hr = m_textureLoader.Init(g_pd3dDevice);
+	if (FAILED(hr))
+		return hr;
+	m_textureLoader.SetCompression(m_compressTextures, m_textureQuality);
+	m_textureLoader.SetStreaming(m_textureStreamTail);
+	hr = m_textureStreamer.Init(g_pd3dDevice);
+	if (FAILED(hr))
+		return hr;
+
 	hr = InitMesh();
 	if (FAILED(hr))
 	{
@@ -373,9 +369,37 @@ HRESULT Application::InitDevice()
 		return hr;
 	}
 
-	hr = g_GameObject.initMesh(g_pd3dDevice, g_pImmediateContext);
+	hr = g_GameObject.initMesh(g_pd3dDevice, g_pImmediateContext, m_textureCache);
+	if (FAILED(hr))
+		return hr;
+
+	hr = m_terrain.Init(g_pd3dDevice, g_pImmediateContext, m_textureCache, TerrainSettings());
+	if (FAILED(hr))
+	{
+		MessageBox(nullptr,
+			L"Failed to initialise terrain.", L"Error", MB_OK);
+		return hr;
+	}
+
+	// Rocks on flat ground: the first splat layer doubles as the density mask
+	ScatterSettings scatterSettings;
+	scatterSettings.mask = m_terrain.GetSplatWeights(0);
+	scatterSettings.maskChannel = 0;
+	hr = m_scatter.Init(g_pd3dDevice, m_terrain, m_textureCache, scatterSettings);
+	if (FAILED(hr))
+	{
+		MessageBox(nullptr,
+			L"Failed to initialise scatter.", L"Error", MB_OK);
+		return hr;
+	}
+
+	hr = m_voxelTerrain.Init(g_pd3dDevice, m_textureCache, VoxelTerrainSettings());
 	if (FAILED(hr))
+	{
+		MessageBox(nullptr,
+			L"Failed to initialise voxel terrain.", L"Error", MB_OK);
 		return hr;
+	}
 
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO();
@@ -395,22 +419,35 @@ HRESULT Application::InitDevice()
 
 HRESULT		Application::InitMesh()
 {
-	// Compile the vertex shader
-	ID3DBlob* pVSBlob = nullptr;
-	HRESULT hr = CompileShaderFromFile(L"shader.fx", "QuadVS", "vs_4_0", &pVSBlob);
-	if (FAILED(hr))
+	// Load every shader through the on-disk cache; misses compile side by side on the job system,
+	// and a missing FX file falls back to the last bytecode built from it
+	m_shaderCache.Open();
+
+	enum { QUAD_VS, OBJECT_VS, INSTANCED_VS, TERRAIN_PS, TERRAIN_VIRTUAL_PS, TERRAIN_FEEDBACK_PS, QUAD_PS };
+	vector<ShaderRequest> shaderRequests =
+	{
+		{ "shader.fx", "QuadVS", "vs_4_0", {} },
+		{ "shader.fx", "VS", "vs_4_0", {} },
+		{ "shader.fx", "VSInstanced", "vs_4_0", {} },
+		{ "shader.fx", "PSTerrain", "ps_4_0", {} },
+		{ "shader.fx", "PSTerrainVirtual", "ps_4_0", {} },
+		{ "shader.fx", "PSTerrainFeedback", "ps_4_0", {} },
+		{ "shader.fx", "QuadPS", "ps_4_0", {} },
+	};
+	vector<ShaderBytecode> shaderBytecode;
+	if (!m_shaderCache.Load(shaderRequests, shaderBytecode) ||
+		FAILED(m_materialShaders.Init(g_pd3dDevice, m_shaderCache, "shader.fx", "PS", "ps_4_0")))
 	{
 		MessageBox(nullptr,
 			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-		return hr;
+		return E_FAIL;
 	}
+	m_shaderCache.Save();
 
-    hr = g_pd3dDevice->CreateVertexShader(pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(), nullptr, &_pQuadVS);
-    if (FAILED(hr))
-    {
-        pVSBlob->Release();
-        return hr;
-    }
+	const ShaderBytecode& quadVS = shaderBytecode[QUAD_VS];
+	HRESULT hr = CreateVertexShader(g_pd3dDevice, quadVS, &_pQuadVS);
+	if (FAILED(hr))
+		return hr;
 
     D3D11_INPUT_ELEMENT_DESC layout1[] =
     {
@@ -420,25 +457,15 @@ HRESULT		Application::InitMesh()
     UINT numElements1 = ARRAYSIZE(layout1);
 
     // Create the input layout
-    hr = g_pd3dDevice->CreateInputLayout(layout1, numElements1, pVSBlob->GetBufferPointer(),pVSBlob->GetBufferSize(), &_pQuadLayout);
+    hr = g_pd3dDevice->CreateInputLayout(layout1, numElements1, quadVS.code.data(), quadVS.code.size(), &_pQuadLayout);
     if (FAILED(hr))
         return hr;
 
 	// Create the vertex shader
-    hr = CompileShaderFromFile(L"shader.fx", "VS", "vs_4_0", &pVSBlob);
-    if (FAILED(hr))
-    {
-        MessageBox(nullptr,
-            L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-        return hr;
-    }
-
-	hr = g_pd3dDevice->CreateVertexShader(pVSBlob->GetBufferPointer(), pVSBlob->GetBufferSize(), nullptr, &g_pVertexShader);
+	const ShaderBytecode& objectVS = shaderBytecode[OBJECT_VS];
+	hr = CreateVertexShader(g_pd3dDevice, objectVS, &g_pVertexShader);
 	if (FAILED(hr))
-	{
-		pVSBlob->Release();
 		return hr;
-	}
 
     SCREEN_VERTEX svQuad[] =
     {
@@ -487,42 +514,52 @@ HRESULT		Application::InitMesh()
 	UINT numElements = ARRAYSIZE(layout);
 
 	// Create the input layout
-	hr = g_pd3dDevice->CreateInputLayout(layout, numElements, pVSBlob->GetBufferPointer(),
-		pVSBlob->GetBufferSize(), &g_pVertexLayout);
-	pVSBlob->Release();
+	hr = g_pd3dDevice->CreateInputLayout(layout, numElements, objectVS.code.data(),
+		objectVS.code.size(), &g_pVertexLayout);
+	if (FAILED(hr))
+		return hr;
+
+	// Instanced vertex shader for scattered objects; slot 1 carries one ScatterInstance per instance
+	const ShaderBytecode& instancedVS = shaderBytecode[INSTANCED_VS];
+	hr = CreateVertexShader(g_pd3dDevice, instancedVS, &g_pInstancedVertexShader);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_INPUT_ELEMENT_DESC instancedLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT , D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT , D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "BINORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "INSTANCEPOS", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCEROT", 0, DXGI_FORMAT_R32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	};
+
+	hr = g_pd3dDevice->CreateInputLayout(instancedLayout, ARRAYSIZE(instancedLayout), instancedVS.code.data(),
+		instancedVS.code.size(), &g_pInstancedVertexLayout);
 	if (FAILED(hr))
 		return hr;
 
 	// Set the input layout
 	
 
-	// Compile the pixel shader
-	ID3DBlob* pPSBlob = nullptr;
-	hr = CompileShaderFromFile(L"shader.fx", "PS", "ps_4_0", &pPSBlob);
+	// Create the splat terrain pixel shader
+	hr = CreatePixelShader(g_pd3dDevice, shaderBytecode[TERRAIN_PS], &g_pTerrainPixelShader);
 	if (FAILED(hr))
-	{
-		MessageBox(nullptr,
-			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
 		return hr;
-	}
 
-	// Create the pixel shader
-	hr = g_pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &g_pPixelShader);
-	pPSBlob->Release();
+	// And its virtual-textured version, with the feedback pass that drives it
+	hr = CreatePixelShader(g_pd3dDevice, shaderBytecode[TERRAIN_VIRTUAL_PS], &g_pTerrainVirtualPixelShader);
 	if (FAILED(hr))
 		return hr;
 
-    hr = CompileShaderFromFile(L"shader.fx", "QuadPS", "ps_4_0", &pPSBlob);
-    if (FAILED(hr))
-    {
-        MessageBox(nullptr,
-            L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-        return hr;
-    }
+	hr = CreatePixelShader(g_pd3dDevice, shaderBytecode[TERRAIN_FEEDBACK_PS], &g_pTerrainFeedbackPixelShader);
+	if (FAILED(hr))
+		return hr;
 
     // Create the pixel shader
-    hr = g_pd3dDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, &_pQuadPS);
-    pPSBlob->Release();
+    hr = CreatePixelShader(g_pd3dDevice, shaderBytecode[QUAD_PS], &_pQuadPS);
     if (FAILED(hr))
         return hr;
 
@@ -555,9 +592,14 @@ HRESULT		Application::InitMesh()
 	if (FAILED(hr))
 		return hr;
 
-    hr = CreateDDSTextureFromFile(g_pd3dDevice, L"Resources\\Brick Textures\\color.dds", nullptr, &_pTextureRV);
-    if (FAILED(hr))
-        return hr;
+	// Create the parallax quality constant buffer
+	bd.ByteWidth = sizeof(ParallaxPropertiesConstantBuffer);
+	hr = g_pd3dDevice->CreateBuffer(&bd, nullptr, &g_pParallaxConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+
+    // The cube's own colour map, so this shares its load and its texture
+    m_brickTexture = m_textureCache.Acquire(L"Resources\\Brick Textures\\color.dds", TexturePlaceholder::White);
 
 	return hr;
 }
@@ -591,7 +633,16 @@ HRESULT		Application::InitWorld(int width, int height)
 //--------------------------------------------------------------------------------------
 void Application::CleanupDevice()
 {
+    // Drop loads still in flight before anything they would call back into goes away
+    m_textureLoader.Cleanup();
+    m_textureStreamer.Cleanup();
+    m_brickTexture.Reset();
     g_GameObject.cleanup();
+    m_voxelTerrain.Cleanup();
+    m_scatter.Cleanup();
+    m_terrain.Cleanup();
+    m_textureCache.Cleanup();
+    AssetPackages::UnmountAll();
 
     // Remove any bound render target or depth/stencil buffer
     ID3D11RenderTargetView* nullViews[] = { nullptr };
@@ -604,10 +655,17 @@ void Application::CleanupDevice()
 
     if (g_pLightConstantBuffer)
         g_pLightConstantBuffer->Release();
+    if (g_pParallaxConstantBuffer)
+        g_pParallaxConstantBuffer->Release();
     if (g_pVertexLayout) g_pVertexLayout->Release();
     if( g_pConstantBuffer ) g_pConstantBuffer->Release();
     if( g_pVertexShader ) g_pVertexShader->Release();
-    if( g_pPixelShader ) g_pPixelShader->Release();
+    m_materialShaders.Cleanup();
+    if( g_pInstancedVertexShader ) g_pInstancedVertexShader->Release();
+    if( g_pInstancedVertexLayout ) g_pInstancedVertexLayout->Release();
+    if( g_pTerrainPixelShader ) g_pTerrainPixelShader->Release();
+    if( g_pTerrainVirtualPixelShader ) g_pTerrainVirtualPixelShader->Release();
+    if( g_pTerrainFeedbackPixelShader ) g_pTerrainFeedbackPixelShader->Release();
     if( g_pDepthStencil ) g_pDepthStencil->Release();
     if( g_pDepthStencilView ) g_pDepthStencilView->Release();
     if( g_pRenderTargetView ) g_pRenderTargetView->Release();
@@ -647,8 +705,9 @@ LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam
     {
 	case WM_LBUTTONDOWN:
 	{
-		int xPos = GET_X_LPARAM(lParam);
-		int yPos = GET_Y_LPARAM(lParam);
+		g_leftClickPosition.x = GET_X_LPARAM(lParam);
+		g_leftClickPosition.y = GET_Y_LPARAM(lParam);
+		g_leftClickPending = true;
 		break;
 	}
     case WM_PAINT:
@@ -803,8 +862,44 @@ void Application::Update()
             }
         }
 
+        ClampCameraToTerrain();
         g_View = XMLoadFloat4x4(&camera->camera._view);
     }
+
+    if (m_sculpting)
+    {
+        // Sculpt every frame while the button is held
+        g_leftClickPending = false;
+        if ((GetAsyncKeyState(VK_LBUTTON) & 0x8000) && !ImGui::GetIO().WantCaptureMouse)
+        {
+            POINT cursor = currentMouseMov;
+            ScreenToClient(g_hWnd, &cursor);
+            SculptTerrain(cursor.x, cursor.y, t);
+        }
+        else if (m_sculptStrokeActive)
+        {
+            // Horizons can change far from the brush, so rebake once the stroke is finished
+            m_sculptStrokeActive = false;
+            if (!m_voxelMode)
+                m_terrain.BakeHorizons(g_pImmediateContext);
+        }
+    }
+    else if (g_leftClickPending)
+    {
+        g_leftClickPending = false;
+        if (!ImGui::GetIO().WantCaptureMouse)
+            PickTerrain(g_leftClickPosition.x, g_leftClickPosition.y);
+    }
+
+    m_terrain.SetSunPosition(g_pImmediateContext, XMFLOAT3(LightPosition.x, LightPosition.y, LightPosition.z));
+
+    XMFLOAT4 eye = camera->GetPos();
+    m_scatter.Update(g_pd3dDevice, eye.x - m_terrain.GetOrigin().x, eye.z - m_terrain.GetOrigin().z);
+
+    // Remesh whatever the brush touched this frame
+    if (m_voxelMode)
+        m_voxelTerrain.Update(g_pd3dDevice);
+
     if (GetAsyncKeyState(0x52) & 1) // R
     {
         if (shaderType == "Normals")
@@ -818,6 +913,16 @@ void Application::Update()
             g_GameObject.m_material.Material.choice = 2;
         }
         else if (shaderType == "POM")
+        {
+            shaderType = "Cone Step";
+            g_GameObject.m_material.Material.choice = 3;
+        }
+        else if (shaderType == "Cone Step")
+        {
+            shaderType = "Quadtree";
+            g_GameObject.m_material.Material.choice = 4;
+        }
+        else if (shaderType == "Quadtree")
         {
             shaderType = "Normals";
             g_GameObject.m_material.Material.choice = 0;
@@ -825,6 +930,105 @@ void Application::Update()
     }
 }
 
+//--------------------------------------------------------------------------------------
+// Cast a ray from a client-space cursor position into the terrain
+//--------------------------------------------------------------------------------------
+bool Application::RaycastFromCursor(int x, int y, TerrainRayHit& hit)
+{
+    XMMATRIX world = XMMatrixIdentity();
+    XMVECTOR nearPoint = XMVector3Unproject(XMVectorSet((float)x, (float)y, 0.0f, 0.0f), 0.0f, 0.0f, (float)g_viewWidth, (float)g_viewHeight, 0.0f, 1.0f, g_Projection, g_View, world);
+    XMVECTOR farPoint = XMVector3Unproject(XMVectorSet((float)x, (float)y, 1.0f, 0.0f), 0.0f, 0.0f, (float)g_viewWidth, (float)g_viewHeight, 0.0f, 1.0f, g_Projection, g_View, world);
+
+    XMFLOAT3 origin, direction;
+    XMStoreFloat3(&origin, nearPoint);
+    XMStoreFloat3(&direction, XMVector3Normalize(farPoint - nearPoint));
+
+    if (m_voxelMode)
+    {
+        VoxelRayHit voxelHit;
+        if (!m_voxelTerrain.Raycast(origin, direction, camera->camera._farDepth, voxelHit))
+            return false;
+
+        hit = {};
+        hit.distance = voxelHit.distance;
+        hit.position = voxelHit.position;
+        hit.normal = voxelHit.normal;
+        return true;
+    }
+
+    return m_terrain.Raycast(origin, direction, camera->camera._farDepth, hit);
+}
+
+//--------------------------------------------------------------------------------------
+// Place the cube where the cursor ray lands on the terrain
+//--------------------------------------------------------------------------------------
+void Application::PickTerrain(int x, int y)
+{
+    m_hasTerrainHit = RaycastFromCursor(x, y, m_lastTerrainHit);
+    if (m_hasTerrainHit)
+    {
+        // The cube is 2 units tall, so lift it by half its height to rest on the surface
+        XMFLOAT3 position = m_lastTerrainHit.position;
+        position.y += 1.0f;
+        g_GameObject.setPosition(position);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Apply the sculpt brush under the cursor
+//--------------------------------------------------------------------------------------
+void Application::SculptTerrain(int x, int y, float deltaTime)
+{
+    TerrainRayHit hit;
+    if (!RaycastFromCursor(x, y, hit))
+        return;
+
+    // Flatten towards the height the stroke started on
+    if (!m_sculptStrokeActive)
+    {
+        m_brush.flattenHeight = hit.position.y;
+        m_sculptStrokeActive = true;
+    }
+
+    if (m_voxelMode)
+    {
+        // Sculpt at the hit point itself so overhangs and cave walls can be edited
+        m_voxelTerrain.ApplyBrush(hit.position, m_brush, deltaTime);
+        m_hasTerrainHit = true;
+        m_lastTerrainHit = hit;
+        return;
+    }
+
+    // Scatter jobs read the heightfield, so let them finish before it changes
+    m_scatter.WaitIdle();
+    if (m_terrain.ApplyBrush(g_pImmediateContext, hit.position.x, hit.position.z, m_brush, deltaTime))
+    {
+        float localX = hit.position.x - m_terrain.GetOrigin().x;
+        float localZ = hit.position.z - m_terrain.GetOrigin().z;
+        m_scatter.Invalidate(localX - m_brush.radius, localZ - m_brush.radius, localX + m_brush.radius, localZ + m_brush.radius);
+    }
+    m_hasTerrainHit = true;
+    m_lastTerrainHit = hit;
+}
+
+//--------------------------------------------------------------------------------------
+// Keep the camera above the ground
+//--------------------------------------------------------------------------------------
+void Application::ClampCameraToTerrain()
+{
+    // Caves and overhangs have no single ground height
+    if (m_voxelMode)
+        return;
+
+    XMFLOAT4 eye = camera->GetPos();
+    float ground;
+    if (m_terrain.GetHeightAt(eye.x, eye.z, ground) && eye.y < ground + m_cameraGroundClearance)
+    {
+        eye.y = ground + m_cameraGroundClearance;
+        camera->SetPos(eye);
+    }
+}
+
 //--------------------------------------------------------------------------------------
 // Render a frame
 //--------------------------------------------------------------------------------------
@@ -834,6 +1038,20 @@ void Application::Render()
     //if (t == 0.0f)
     //    return;
 
+    // Swap in whatever textures finished loading, a couple per frame, then stream levels in or
+    // out for the size the cube is on screen. The rock textures the terrain shares with the
+    // scattered rocks and the voxel terrain are wanted at full view size.
+    m_textureLoader.Update(m_textureUploadsPerFrame);
+    g_GameObject.RequestTextureDetail(m_textureCache, camera->GetPos(), camera->camera._projection._22 * 0.5f * g_viewHeight);
+    m_terrain.RequestTextureDetail(m_textureCache, (float)(g_viewWidth > g_viewHeight ? g_viewWidth : g_viewHeight));
+    m_textureStreamer.Update(m_textureStreamChangesPerFrame);
+    m_textureCache.Trim();
+
+    // Terrain pages the feedback pass asked for a few frames ago
+    bool virtualTerrain = !m_voxelMode && m_terrain.IsSplatEnabled() && m_terrain.IsVirtualTextureEnabled();
+    if (virtualTerrain)
+        m_terrain.GetVirtualTexture().Update(g_pImmediateContext);
+
     g_pImmediateContext->IASetInputLayout(g_pVertexLayout);
 
     // Clear the back buffer
@@ -868,8 +1086,18 @@ void Application::Render()
     g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
     g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
 
-    g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
+    g_pImmediateContext->PSSetShader(m_materialShaders.Get(g_GameObject.m_material.Material), nullptr, 0);
     g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+
+    ParallaxPropertiesConstantBuffer parallaxProperties;
+    parallaxProperties.QualityScale = m_parallaxQuality.qualityScale;
+    parallaxProperties.MinLayers = m_parallaxQuality.minLayers;
+    parallaxProperties.MaxLayers = m_parallaxQuality.maxLayers;
+    parallaxProperties.FadeStart = m_parallaxQuality.fadeStart;
+    parallaxProperties.FadeEnd = m_parallaxQuality.fadeEnd;
+    g_pImmediateContext->UpdateSubresource(g_pParallaxConstantBuffer, 0, nullptr, &parallaxProperties, 0, 0);
+    g_pImmediateContext->PSSetConstantBuffers(4, 1, &g_pParallaxConstantBuffer);
+
     g_GameObject.SetMaterialConstantBuffer(g_pImmediateContext);
     ID3D11Buffer* materialCB = g_GameObject.getMaterialConstantBuffer();
     g_pImmediateContext->PSSetConstantBuffers(1, 1, &materialCB);
@@ -879,7 +1107,7 @@ void Application::Render()
         g_pImmediateContext->OMSetRenderTargets(1, &_pRTTRenderTargetView, g_pDepthStencilView);
         g_pImmediateContext->ClearRenderTargetView(_pRTTRenderTargetView, Colors::DarkGreen);
 
-        g_GameObject.SetTextureResourceView(_pTextureRV);
+        g_GameObject.SetTextureResourceView(m_brickTexture.Get());
         g_GameObject.draw(g_pImmediateContext);
     }
     
@@ -891,9 +1119,52 @@ void Application::Render()
     if (textureType == "RTT")
         g_GameObject.SetTextureResourceView(_pRTTShaderResourceView);
     else
-        g_GameObject.SetTextureResourceView(_pTextureRV);
+        g_GameObject.SetTextureResourceView(m_brickTexture.Get());
     g_GameObject.draw(g_pImmediateContext);
 
+    // The world's materials are all textured and normal mapped
+    ID3D11PixelShader* pWorldPixelShader = m_materialShaders.Get(MATERIAL_SHADER_TEXTURE);
+    g_pImmediateContext->PSSetShader(pWorldPixelShader, nullptr, 0);
+
+    // The voxel terrain writes a world matrix per chunk and replaces the heightfield and its scatter
+    if (m_voxelMode)
+    {
+        m_voxelTerrain.Draw(g_pImmediateContext, g_pConstantBuffer, cb1);
+    }
+    else
+    {
+        // Terrain uses the same shaders with its own transform and material
+        XMMATRIX mTerrain = XMLoadFloat4x4(m_terrain.GetTransform());
+        cb1.mWorld = XMMatrixTranspose(mTerrain);
+        g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb1, 0, 0);
+        if (virtualTerrain)
+        {
+            // The pages it needs first, into the small feedback target
+            TerrainVirtualTexture& virtualTexture = m_terrain.GetVirtualTexture();
+            virtualTexture.BeginFeedback(g_pImmediateContext);
+            g_pImmediateContext->PSSetShader(g_pTerrainFeedbackPixelShader, nullptr, 0);
+            m_terrain.Draw(g_pImmediateContext);
+            virtualTexture.EndFeedback(g_pImmediateContext);
+            g_pImmediateContext->PSSetShader(g_pTerrainVirtualPixelShader, nullptr, 0);
+        }
+        else if (m_terrain.IsSplatEnabled())
+        {
+            g_pImmediateContext->PSSetShader(g_pTerrainPixelShader, nullptr, 0);
+        }
+        m_terrain.Draw(g_pImmediateContext);
+        g_pImmediateContext->PSSetShader(pWorldPixelShader, nullptr, 0);
+
+        // Scattered rocks share the terrain's transform
+        if (m_drawScatter)
+        {
+            g_pImmediateContext->IASetInputLayout(g_pInstancedVertexLayout);
+            g_pImmediateContext->VSSetShader(g_pInstancedVertexShader, nullptr, 0);
+            m_scatter.Draw(g_pImmediateContext);
+            g_pImmediateContext->IASetInputLayout(g_pVertexLayout);
+            g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
+        }
+    }
+
 
     /***********************************************
     MARKING SCHEME: Full Screen Quad
@@ -919,7 +1190,7 @@ void Application::Render()
     {
         ImGui::NewFrame();
         static ImVec2 pos(0, 0);
-        static ImVec2 size(400, 125);
+        static ImVec2 size(400, 159);
         ImGui::SetNextWindowPos(pos, ImGuiCond_Always);
         ImGui::SetNextWindowSize(size, ImGuiCond_Always);
         bool open;
@@ -929,13 +1200,18 @@ void Application::Render()
         ImGui::Text("Movement Control Type: %s", currentView.c_str());
         ImGui::Text("Light at: (%.5f)(%.5f)(%.5f)", LightPosition.x, LightPosition.y, LightPosition.z);
         ImGui::Text("Current View: (%.5f)(%.5f)(%.5f)", camera->GetPos().x, camera->GetPos().y, camera->GetPos().z);
-        ImGui::Text("Shader Type: %s", shaderType.c_str());
+        ImGui::Text("Shader Type: %s (permutation %u of %d)", shaderType.c_str(), MaterialShaderCache::KeyFor(g_GameObject.m_material.Material), m_materialShaders.GetShaderCount());
         ImGui::Text("Texture Type: %s", textureType.c_str());
+        ImGui::Text("Textures: %d files, %d unique, %.1f MB, %d loading, %d failed, %d BC (worst %.1f dB)", m_textureCache.GetEntryCount(), m_textureCache.GetTextureCount(), m_textureCache.GetResidentBytes() / (1024.0f * 1024.0f), m_textureLoader.GetPendingCount(), m_textureLoader.GetFailedCount(), m_textureLoader.GetCompressedCount(), m_textureLoader.GetWorstPSNR());
+        ImGui::Text("Streaming: %d textures, %.1f/%.1f MB (wanted %.1f), %d in flight", m_textureStreamer.GetStreamCount(), m_textureStreamer.GetResidentBytes() / (1024.0f * 1024.0f), m_textureStreamer.GetBudget() / (1024.0f * 1024.0f), m_textureStreamer.GetWantedBytes() / (1024.0f * 1024.0f), m_textureStreamer.GetInFlightCount());
+        ImGui::Text("Assets: %d in %d packages, %d opened from them, %d loose", AssetPackages::GetAssetCount(), AssetPackages::GetMountedCount(), AssetFile::GetPackedOpenCount(), AssetFile::GetLooseOpenCount());
+        if (m_hasTerrainHit)
+            ImGui::Text("Terrain Pick: (%.2f)(%.2f)(%.2f) nodes %d", m_lastTerrainHit.position.x, m_lastTerrainHit.position.y, m_lastTerrainHit.position.z, m_lastTerrainHit.nodesVisited);
         ImGui::End();
     }
     {
-        static ImVec2 pos(0, 125);
-        static ImVec2 size(400, 100);
+        static ImVec2 pos(0, 159);
+        static ImVec2 size(400, 200);
         ImGui::SetNextWindowPos(pos, ImGuiCond_Always);
         ImGui::SetNextWindowSize(size, ImGuiCond_Always);
         bool open;
@@ -944,6 +1220,43 @@ void Application::Render()
         ImGui::SliderFloat("Light Position X", &LightPosition.x, -10.0f, 10.0f);
         ImGui::SliderFloat("Light Position Y", &LightPosition.y, -10.0f, 10.0f);
         ImGui::SliderFloat("Light Position Z", &LightPosition.z, -10.0f, 10.0f);
+        bool parallaxShadows = g_GameObject.m_material.Material.ParallaxShadows != 0;
+        if (ImGui::Checkbox("Parallax Self-Shadowing", &parallaxShadows))
+            g_GameObject.m_material.Material.ParallaxShadows = parallaxShadows;
+        ImGui::SliderFloat("Parallax Quality", &m_parallaxQuality.qualityScale, 0.25f, 4.0f);
+        ImGui::SliderFloat("Parallax Max Layers", &m_parallaxQuality.maxLayers, m_parallaxQuality.minLayers, 64.0f);
+        ImGui::SliderFloat("Parallax Fade Start", &m_parallaxQuality.fadeStart, 1.0f, m_parallaxQuality.fadeEnd);
+        ImGui::SliderFloat("Parallax Fade End", &m_parallaxQuality.fadeEnd, m_parallaxQuality.fadeStart, 100.0f);
+        ImGui::End();
+    }
+    {
+        static ImVec2 pos(0, 359);
+        static ImVec2 size(400, 310);
+        ImGui::SetNextWindowPos(pos, ImGuiCond_Always);
+        ImGui::SetNextWindowSize(size, ImGuiCond_Always);
+
+        ImGui::Begin("Terrain");
+        ImGui::Checkbox("Sculpt", &m_sculpting);
+        const char* brushModes[] = { "Raise", "Lower", "Smooth", "Flatten" };
+        ImGui::Combo("Brush", &m_brush.mode, brushModes, IM_ARRAYSIZE(brushModes));
+        ImGui::SliderFloat("Radius", &m_brush.radius, 0.25f, 16.0f);
+        ImGui::SliderFloat("Strength", &m_brush.strength, 0.1f, 10.0f);
+        ImGui::SliderFloat("Falloff", &m_brush.falloff, 0.0f, 1.0f);
+        bool horizonMap = m_terrain.IsHorizonMapEnabled();
+        if (ImGui::Checkbox("Horizon AO / Shadows", &horizonMap))
+            m_terrain.SetHorizonMapEnabled(horizonMap);
+        bool splat = m_terrain.IsSplatEnabled();
+        if (ImGui::Checkbox("Splat Materials", &splat))
+            m_terrain.SetSplatEnabled(splat);
+        bool virtualTexture = m_terrain.IsVirtualTextureEnabled();
+        if (ImGui::Checkbox("Virtual Texture", &virtualTexture))
+            m_terrain.SetVirtualTextureEnabled(virtualTexture);
+        const TerrainVirtualTexture& pages = m_terrain.GetVirtualTexture();
+        ImGui::Text("Pages: %d/%d resident, %d wanted, %d loading, %d baked, %d read, %d evicted", pages.GetResidentPageCount(), pages.GetSlotCount(), pages.GetRequestedPageCount(), pages.GetPendingPageCount(), pages.GetBakedCount(), pages.GetTileReadCount(), pages.GetEvictionCount());
+        ImGui::Checkbox("Scatter", &m_drawScatter);
+        ImGui::Text("Scatter: %d tiles, %d instances, %d pending", m_scatter.GetResidentTileCount(), (int)m_scatter.GetResidentInstanceCount(), m_scatter.GetPendingTileCount());
+        ImGui::Checkbox("Voxel Terrain", &m_voxelMode);
+        ImGui::Text("Voxels: %d meshed, %d cache hits, %d cached", m_voxelTerrain.GetChunksMeshedLastUpdate(), m_voxelTerrain.GetCacheHitsLastUpdate(), m_voxelTerrain.GetCachedMeshCount());
         ImGui::End();
     }
     {
@@ -957,6 +1270,8 @@ void Application::Render()
         ImGui::Text("Change Control Object (Light / Camera) : SPACE");
         ImGui::Text("Change Texture Type : T");
         ImGui::Text("Change Texture Mapping : R");
+        ImGui::Text("Place Cube On Terrain : Left Click");
+        ImGui::Text("Sculpt Terrain (Sculpt ticked) : Hold Left Click");
 
         ImGui::BeginTabBar("Control Types");
         if (ImGui::BeginTabItem("Light"))
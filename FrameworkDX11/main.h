@@ -9,12 +9,22 @@
 #include <DirectXCollision.h>
 #include "DDSTextureLoader.h"
 #include "resource.h"
+#include <cstdio>
 #include <iostream>
 #include <string>
 
+#include "AssetFile.h"
+#include "AssetPackage.h"
 #include "DrawableGameObject.h"
 #include "structures.h"
 #include "Camera.h"
+#include "MaterialShaders.h"
+#include "ParallaxQuality.h"
+#include "ScatterRenderer.h"
+#include "ShaderCompiler.h"
+#include "Terrain.h"
+#include "TextureCache.h"
+#include "VoxelTerrain.h"
 #include "ImGui/imgui.h"
 #include "ImGui/imgui_impl_win32.h"
 #include "ImGui/imgui_impl_dx11.h"
@@ -41,6 +51,10 @@ public:HRESULT		InitWindow(HINSTANCE hInstance, int nCmdShow);
 	  void setupLightForRender();
 	  void Update();
 	  void		Render();
+	  void		PickTerrain(int x, int y);
+	  void		SculptTerrain(int x, int y, float deltaTime);
+	  bool		RaycastFromCursor(int x, int y, TerrainRayHit& hit);
+	  void		ClampCameraToTerrain();
 
 	  vector<DrawableGameObject*> drawablesVector;
 
@@ -64,9 +78,23 @@ private:
 	ID3D11DepthStencilView* g_pDepthStencilView = nullptr;
 	ID3D11VertexShader* g_pVertexShader = nullptr;
 
-	ID3D11PixelShader* g_pPixelShader = nullptr;
+	ShaderCache				m_shaderCache{ "ShaderCache.bin", CompileShaderSource, ShaderCompilerTag() };
+	MaterialShaderCache		m_materialShaders;		// the object pixel shader, one per material feature set
+	TextureLoader			m_textureLoader;
+	TextureStreamer			m_textureStreamer;
+	TextureCache			m_textureCache{ m_textureLoader, m_textureStreamer };
+	int						m_textureUploadsPerFrame = 2;
+	int						m_textureStreamTail = 64;			// texels a side uploaded up front; 0 loads every level
+	int						m_textureStreamChangesPerFrame = 2;
+	bool					m_compressTextures = true;
+	BCQuality				m_textureQuality = BCQualityBalanced;
+	ID3D11PixelShader* g_pTerrainPixelShader = nullptr;
+	ID3D11PixelShader* g_pTerrainVirtualPixelShader = nullptr;
+	ID3D11PixelShader* g_pTerrainFeedbackPixelShader = nullptr;
 
 	ID3D11InputLayout* g_pVertexLayout = nullptr;
+	ID3D11VertexShader* g_pInstancedVertexShader = nullptr;
+	ID3D11InputLayout* g_pInstancedVertexLayout = nullptr;
 
 
 	ID3D11Buffer* _pScreenQuadVB = nullptr;
@@ -79,7 +107,7 @@ private:
 	CD3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc;
 	D3D11_SHADER_RESOURCE_VIEW_DESC shaderResourceViewDesc;
 
-	ID3D11ShaderResourceView* _pTextureRV = nullptr;
+	TextureHandle m_brickTexture;
 
 	ID3D11Texture2D* _pRTTRrenderTargetTexture = nullptr;
 	ID3D11RenderTargetView* _pRTTRenderTargetView = nullptr;
@@ -90,6 +118,9 @@ private:
 
 	ID3D11Buffer* g_pLightConstantBuffer = nullptr;
 
+	ID3D11Buffer* g_pParallaxConstantBuffer = nullptr;
+	ParallaxQualitySettings	m_parallaxQuality;
+
 	XMMATRIX                g_View;
 	XMMATRIX                g_Projection;
 
@@ -98,6 +129,19 @@ private:
 
 	DrawableGameObject		g_GameObject;
 	DrawableGameObject		g_GameObjectFSQ;
+	Terrain					m_terrain;
+	ScatterRenderer			m_scatter;
+	bool					m_drawScatter = true;
+	VoxelTerrain			m_voxelTerrain;
+	bool					m_voxelMode = false;		// draw and sculpt the voxel terrain instead of the heightfield
+
+	bool					m_hasTerrainHit = false;
+	TerrainRayHit			m_lastTerrainHit = {};
+	float					m_cameraGroundClearance = 0.5f;
+
+	bool					m_sculpting = false;
+	bool					m_sculptStrokeActive = false;
+	BrushSettings			m_brush;
 
 	string currentView = "Light";
 	string shaderType = "Normals";
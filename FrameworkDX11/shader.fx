@@ -20,6 +20,16 @@ cbuffer ConstantBuffer : register( b0 )
 Texture2D txDiffuse : register(t0);
 Texture2D txNormal : register(t1);
 Texture2D txParallax : register(t2);
+Texture2D txHorizon : register(t3);
+Texture2DArray txLayerDiffuse : register(t4);
+Texture2DArray txLayerNormal : register(t5);
+Texture2DArray txSplat : register(t6);
+Texture2D txConeStep : register(t7);
+Texture2D txParallaxMax : register(t8);
+Texture2DArray txParallaxHorizon : register(t9);
+Texture2D<uint4> txPageTable : register(t10);
+Texture2D txPhysicalDiffuse : register(t11);
+Texture2D txPhysicalNormal : register(t12);
 SamplerState samLinear : register(s0);
 
 
@@ -47,7 +57,7 @@ struct _Material
 	bool    UseNormal;
 	bool    UseParallax;*/
 
-	float2  Padding;        // 8 bytes
+	int     ParallaxShadows;
 							//----------------------------------- (16 byte boundary)
 };  // Total:               // 80 bytes ( 5 * 16 )
 
@@ -84,6 +94,34 @@ cbuffer LightProperties : register(b2)
 	Light Lights[MAX_LIGHTS];           // 80 * 8 = 640 bytes
 }; 
 
+cbuffer TerrainProperties : register(b3)
+{
+	float4 MapScaleOffset;              // world xz -> uv of the per-sample terrain maps
+	int    UseHorizonMap;               // zero when nothing is bound
+	int    LayerCount;
+	int2   TerrainPadding;
+};
+
+cbuffer ParallaxProperties : register(b4)
+{
+	float  QualityScale;                // layers per texel the view ray crosses
+	float  MinLayers;
+	float  MaxLayers;
+	float  FadeStart;                   // eye distance where the relief starts to flatten
+	float  FadeEnd;                     // plain normal mapping beyond this
+	float3 ParallaxPadding;
+};
+
+cbuffer VirtualTextureProperties : register(b5)
+{
+	float4 VirtualScaleOffset;          // world xz -> virtual texture uv
+	float  VirtualSize;                 // texels across at mip 0
+	int    PagesPerSide;                // at mip 0
+	int    VirtualMipCount;
+	float  VirtualLodBias;              // added to the level the feedback pass picks, for its smaller target
+	float4 PhysicalPage;                // page size, border and content size over the cache size
+};
+
 //--------------------------------------------------------------------------------------
 struct VS_INPUT
 {
@@ -205,16 +243,17 @@ float3x3 computeTBNMatrixB(float3 unitNormal, float3 tangent, float3 binorm)
     return TBN;
 }
 
+// Z is rebuilt from X and Y, so two-channel (BC5) normal maps work. RGBA8 maps are decoded the
+// same way rather than taking the stored blue as Z, which was never remapped from [0, 1].
+float3 DecodeBumpMapXY(float2 bumpMap)
+{
+    float2 xy = (-bumpMap * 2.0f) + 1.0f;
+    return float3(xy, -sqrt(saturate(1.0f - dot(xy, xy))));
+}
+
 float3 CalcBumpMap(float2 texCoords)
 {
-    float3 bumpMap;
-    bumpMap = txNormal.Sample(samLinear, texCoords).rgb;
-	
-    bumpMap.x = (-bumpMap.x * 2.0f) + 1.0f;
-    bumpMap.y = (-bumpMap.y * 2.0f) + 1.0f;
-    bumpMap.z = -bumpMap.z;
-	
-    return bumpMap;
+    return DecodeBumpMapXY(txNormal.Sample(samLinear, texCoords).rg);
 }
 
 LightingResult ComputeLighting(float4 vertexPos, float3 N, float3 lightVectorTS, float3 eyeVectorTS)
@@ -243,6 +282,64 @@ LightingResult ComputeLighting(float4 vertexPos, float3 N, float3 lightVectorTS,
 	return totalResult;
 }
 
+// Baked terrain self-shadowing: x = ambient occlusion, y = sun visibility
+float2 TerrainVisibility(float4 worldPos)
+{
+	if (!UseHorizonMap)
+		return float2(1, 1);
+
+	float2 uv = worldPos.xz * MapScaleOffset.xy + MapScaleOffset.zw;
+	return txHorizon.SampleLevel(samLinear, uv, 0).rg;
+}
+
+// Baked parallax self-shadowing: horizon elevations for 8 azimuths around +u towards +v, four
+// to a slice, interpolated at the light's azimuth. Two fetches whatever the light does; the
+// shadow fades out with the relief.
+float ParallaxSelfShadow(float2 texCoords, float3 lightDirTS, float fade)
+{
+	const float PI = 3.14159265f;
+	const float softness = 0.1f;		// radians of elevation over which the shadow fades
+
+	float azimuth = frac(atan2(lightDirTS.y, lightDirTS.x) / (2.0f * PI)) * 8.0f;
+	int first = (int)azimuth & 7;
+	int second = (first + 1) & 7;
+
+	float4 low = txParallaxHorizon.Sample(samLinear, float3(texCoords, 0));
+	float4 high = txParallaxHorizon.Sample(samLinear, float3(texCoords, 1));
+	float horizonA = dot(low, (float4)(first == int4(0, 1, 2, 3))) + dot(high, (float4)(first == int4(4, 5, 6, 7)));
+	float horizonB = dot(low, (float4)(second == int4(0, 1, 2, 3))) + dot(high, (float4)(second == int4(4, 5, 6, 7)));
+	float horizon = lerp(horizonA, horizonB, frac(azimuth)) * (PI * 0.5f);
+
+	float elevation = atan2(lightDirTS.z, length(lightDirTS.xy));
+	return lerp(1.0f, smoothstep(-softness, softness, elevation - horizon), fade);
+}
+
+//--------------------------------------------------------------------------------------
+// Parallax quality: the layered modes take about a layer per texel the ray crosses at the mip
+// actually sampled, so distant and head-on pixels march less than close grazing ones. The
+// relief flattens out between FadeStart and FadeEnd, past which the pixel skips the march.
+// Mirrored on the CPU by ParallaxQuality.
+//--------------------------------------------------------------------------------------
+float ParallaxLayerCount(float2 p, float2 dx, float2 dy)
+{
+	float width, height;
+	txParallax.GetDimensions(width, height);
+	float2 size = float2(width, height);
+
+	// Mip level from the pixel's footprint, worked out from the gradients so it can sit in flow control
+	float footprint = max(dot(dx * size, dx * size), dot(dy * size, dy * size));
+	float lod = 0.5f * log2(max(footprint, 1e-8f));
+
+	float texels = length(p * size);
+	return clamp(texels * exp2(-max(lod, 0.0f)) * QualityScale, MinLayers, MaxLayers);
+}
+
+float ParallaxFade(float3 worldPos)
+{
+	float distance = length(EyePosition.xyz - worldPos);
+	return saturate((FadeEnd - distance) / max(FadeEnd - FadeStart, 1e-3f));
+}
+
 	/***********************************************
 	MARKING SCHEME: PARALLAX MAPPING
 	DESCRIPTION: SIMPLE PARALLAX MAPPING USING LAYERS AND THE PREVIOUS TEX COORDS
@@ -260,33 +357,35 @@ float2 ParallaxMapping(float2 texcoords, float3 viewDir)
 	MARKING SCHEME: PARALLAX MAPPING
 	DESCRIPTION: PARALLAX STEEP MAPPING USING LAYERS AND THE PREVIOUS TEX COORDS
 	***********************************************/
-float2 ParallaxSteepMapping(float2 texCoords, float3 viewDir)
+float2 ParallaxSteepMapping(float2 texCoords, float3 viewDir, float fade)
 {
-	//Determine the number of layers from angle between V and N
-	float minLayers = 5;
-	float maxLayers = 20;
+	//shift of texture coordinates for each iteration
+	//current texture coords
+	float height_scale = 0.1f * fade;
+	float2 p = viewDir.xy * height_scale;
 
-	float numLayers = lerp(maxLayers, minLayers, abs(dot(float3(0, 0, 1), viewDir)));
+	float2 dx = ddx(texCoords);
+	float2 dy = ddy(texCoords);
+
+	if (fade <= 0.0f)
+		return texCoords;
+
+	//Determine the number of layers from the ray's length in texels at the sampled mip
+	float numLayers = ParallaxLayerCount(p, dx, dy);
 
 	//calculate height of each layer
 	float layerHeight = 1.0f / numLayers;
 	//set initial depth of current layer to 0
 	float currentLayerHeight = 0.0f;
 
-	//shift of texture coordinates for each iteration
-	//current texture coords
-	float height_scale = 0.1f;
-	float2 p = viewDir.xy * height_scale;
 	float2 deltaTexCoords = p / numLayers;
 
 	float2 currentTexCoords = texCoords;
 
-	float2 dx = ddx(texCoords);
-	float2 dy = ddy(texCoords);
-
 	float heightFromTexture = txParallax.SampleGrad(samLinear, currentTexCoords, dx, dy);
 
-	while (heightFromTexture > currentLayerHeight)
+	[loop]
+	while (heightFromTexture > currentLayerHeight && currentLayerHeight < 1.0f)
 	{
 		currentLayerHeight += layerHeight;
 		currentTexCoords -= deltaTexCoords;
@@ -301,27 +400,33 @@ float2 ParallaxSteepMapping(float2 texCoords, float3 viewDir)
 	MARKING SCHEME: PARALLAX MAPPING
 	DESCRIPTION: PARALLAX OCCLUSION MAPPING USING LAYERS AND THE PREVIOUS TEX COORDS
 	***********************************************/
-float2 ParallaxOcclusionMapping(float2 texCoords, float3 normal, float3 viewDir)
+float2 ParallaxOcclusionMapping(float2 texCoords, float3 normal, float3 viewDir, float fade)
 {
-    int minLayers = 5;
-    int maxLayers = 20;
-    float numLayers = lerp(maxLayers, minLayers, abs(dot(float3(0, 0, 1), viewDir)));
-    float layerHeight = 1.0f / numLayers;
-    float currentLayerHeight = 0.0f;
-	
-    float height_scale = 0.2f;
+    float height_scale = 0.2f * fade;
     viewDir.z = -viewDir.z;
     float2 p = height_scale * viewDir.xy;
+
+    float2 dx = ddx(texCoords);
+    float2 dy = ddy(texCoords);
+
+    if (fade <= 0.0f)
+        return texCoords;
+
+    float numLayers = ParallaxLayerCount(p, dx, dy);
+    float layerHeight = 1.0f / numLayers;
+    float currentLayerHeight = 0.0f;
 	
     float2 deltaTexCoords = p / numLayers;
     float2 currentTexCoords = texCoords;
 
-    float2 dx = ddx(texCoords);
-    float2 dy = ddy(texCoords);
+    float heightFromTexture = txParallax.SampleGrad(samLinear, currentTexCoords, dx, dy).x;
 
-    float heightFromTexture = txParallax.Sample(samLinear, currentTexCoords).x;
+    // Starting on the top surface there is nothing to march or refine
+    if (heightFromTexture <= 0.0f)
+        return texCoords;
 	
-    while (heightFromTexture > currentLayerHeight)
+    [loop]
+    while (heightFromTexture > currentLayerHeight && currentLayerHeight < 1.0f)
     {
         currentTexCoords -= deltaTexCoords;
         heightFromTexture = txParallax.SampleGrad(samLinear, currentTexCoords, dx, dy).x;
@@ -331,7 +436,7 @@ float2 ParallaxOcclusionMapping(float2 texCoords, float3 normal, float3 viewDir)
     float2 previousTexCoords = currentTexCoords + deltaTexCoords;
 
     float nextH = heightFromTexture - currentLayerHeight;
-    float prevH = txParallax.Sample(samLinear, previousTexCoords).x - currentLayerHeight + layerHeight;
+    float prevH = txParallax.SampleGrad(samLinear, previousTexCoords, dx, dy).x - currentLayerHeight + layerHeight;
 
     float weight = nextH / (nextH - prevH);
 
@@ -340,6 +445,159 @@ float2 ParallaxOcclusionMapping(float2 texCoords, float3 normal, float3 viewDir)
     return finalTexCoords;
 }
 
+//--------------------------------------------------------------------------------------
+// Relaxed cone step mapping: the same ray as ParallaxOcclusionMapping, but each step goes as
+// far as the cone stored under the ray allows (depth in red, sqrt of the cone ratio in green).
+// A relaxed step may end below the surface; the last step is then refined against the full
+// resolution depth. Mirrored on the CPU by ConeStepMap::Trace.
+//--------------------------------------------------------------------------------------
+float2 ParallaxConeStepMapping(float2 texCoords, float3 viewDir, float fade)
+{
+	const int coneSteps = 8;
+	const int binarySteps = 4;
+
+	float height_scale = 0.2f * fade;
+	float2 p = height_scale * viewDir.xy;
+	float rayRatio = length(p);
+
+	float2 dx = ddx(texCoords);
+	float2 dy = ddy(texCoords);
+
+	if (fade <= 0.0f)
+		return texCoords;
+
+	float depth = 0.0f;
+	float stepSize = 0.0f;
+	float previousHeight = 0.0f;
+
+	[loop]
+	for (int i = 0; i < coneSteps; ++i)
+	{
+		float2 cone = txConeStep.SampleLevel(samLinear, texCoords - p * depth, 0).xy;
+		float height = cone.x - depth;
+		if (height <= 0.0f)
+		{
+			// Stepped through the surface: place the hit on the line between the last two samples
+			if (stepSize > 0.0f)
+				depth -= stepSize * height / (height - previousHeight);
+			break;
+		}
+
+		float ratio = max(cone.y * cone.y, 1e-5f);
+		stepSize = ratio * height / (rayRatio + ratio);
+		previousHeight = height;
+		depth += stepSize;
+		if (stepSize < 1.0f / 256.0f)
+		{
+			stepSize = 0.0f;
+			break;
+		}
+	}
+
+	float range = stepSize * 0.5f;
+	[loop]
+	for (int j = 0; j < binarySteps && stepSize > 0.0f; ++j)
+	{
+		range *= 0.5f;
+		if (depth < txParallax.SampleGrad(samLinear, texCoords - p * depth, dx, dy).x)
+			depth += range;
+		else
+			depth -= range;
+	}
+
+	return texCoords - p * depth;
+}
+
+//--------------------------------------------------------------------------------------
+// Quadtree displacement mapping over the max-height mip chain of txParallax (each texel the
+// smallest depth of the four below it). Above a cell the ray drops onto its highest point and
+// descends, or crosses it and climbs when entering a new parent; below it, it descends. Level 0
+// below the surface is the hit, refined with two filtered samples. Mirrored on the CPU by
+// MaxHeightPyramid::Trace.
+//--------------------------------------------------------------------------------------
+float2 ParallaxQuadtreeMapping(float2 texCoords, float3 viewDir, float fade)
+{
+	const int maxSteps = 64;
+	const int refineSteps = 2;
+
+	float height_scale = 0.2f * fade;
+	float2 p = height_scale * viewDir.xy;
+
+	float2 dx = ddx(texCoords);
+	float2 dy = ddy(texCoords);
+
+	if (fade <= 0.0f)
+		return texCoords;
+
+	uint width, height, levels;
+	txParallaxMax.GetDimensions(0, width, height, levels);
+
+	// Work in level 0 texels
+	float2 origin = texCoords * float2(width, height);
+	float2 direction = -p * float2(width, height);
+	float2 nudge = sign(direction) * 1e-3f;
+
+	if (txParallaxMax.Load(int3((int2)floor(origin) & int2(width - 1, height - 1), 0)).x <= 0.0f)
+		return texCoords;
+
+	float footprint = max(abs(direction.x), abs(direction.y));
+	int top = (int)levels - 1;
+	int level = clamp((int)ceil(log2(max(footprint, 1.0f))) - 2, 0, top);
+	float depth = 0.0f;
+	int fetches = 1;
+
+	[loop]
+	while (fetches < maxSteps)
+	{
+		float cellSize = (float)(1 << level);
+		int2 cell = (int2)floor((origin + direction * depth + nudge) / cellSize);
+		int2 levelSize = max(int2(width >> level, height >> level), 1);
+		float highest = txParallaxMax.Load(int3(cell & (levelSize - 1), level)).x;
+		fetches++;
+
+		if (depth >= highest)
+		{
+			if (level == 0)
+				break;
+			level--;
+			continue;
+		}
+
+		float2 boundary = (float2(cell) + (direction > 0.0f ? 1.0f : 0.0f)) * cellSize;
+		float2 exits = abs(direction) > 0.0f ? (boundary - origin) / direction : 1e30f;
+		float exitDepth = min(exits.x, exits.y);
+		if (highest <= exitDepth)
+		{
+			depth = highest;
+			if (level == 0)
+				break;
+			level--;
+		}
+		else
+		{
+			int2 next = cell + (direction > 0.0f ? 1 : -1);
+			bool newParent = exits.x <= exits.y ? (next.x >> 1) != (cell.x >> 1) : (next.y >> 1) != (cell.y >> 1);
+			depth = exitDepth;
+			if (newParent)
+				level = min(level + 1, top);
+		}
+	}
+
+	float range = min(depth, 1.0f / max(footprint, 1.0f)) * 0.5f;
+	depth -= range;
+	[unroll]
+	for (int i = 0; i < refineSteps; ++i)
+	{
+		range *= 0.5f;
+		if (depth < txParallax.SampleGrad(samLinear, texCoords - p * depth, dx, dy).x)
+			depth += range;
+		else
+			depth -= range;
+	}
+
+	return texCoords - p * depth;
+}
+
 //--------------------------------------------------------------------------------------
 // Vertex Shader
 //--------------------------------------------------------------------------------------
@@ -373,6 +631,35 @@ PS_INPUT VS( VS_INPUT input )
     return output;
 }
 
+struct VS_INSTANCED_INPUT
+{
+	float4 Pos : POSITION;
+	float3 Norm : NORMAL;
+	float2 Tex : TEXCOORD0;
+	float3 tangent : TANGENT;
+	float3 binormal : BINORMAL;
+	float4 instancePosScale : INSTANCEPOS;
+	float instanceRotation : INSTANCEROT;
+};
+
+//--------------------------------------------------------------------------------------
+// Instanced Vertex Shader - places the mesh per instance, then continues as VS
+//--------------------------------------------------------------------------------------
+PS_INPUT VSInstanced(VS_INSTANCED_INPUT input)
+{
+	float s, c;
+	sincos(input.instanceRotation, s, c);
+	float3x3 rotation = float3x3(c, 0, -s, 0, 1, 0, s, 0, c);
+
+	VS_INPUT placed;
+	placed.Pos = float4(mul(input.Pos.xyz * input.instancePosScale.w, rotation) + input.instancePosScale.xyz, 1.0f);
+	placed.Norm = mul(input.Norm, rotation);
+	placed.Tex = input.Tex;
+	placed.tangent = mul(input.tangent, rotation);
+	placed.binormal = mul(input.binormal, rotation);
+	return VS(placed);
+}
+
 QuadVS_Output QuadVS(QuadVS_Input Input)
 {
 	QuadVS_Output output;
@@ -383,7 +670,21 @@ QuadVS_Output QuadVS(QuadVS_Input Input)
 
 //--------------------------------------------------------------------------------------
 // Pixel Shader
+//
+// MaterialShaderCache compiles one PS per material feature combination, with PARALLAX_MODE
+// (Material.choice: 0 normals, 1 steep, 2 occlusion, 3 cone step, 4 quadtree), USE_TEXTURE and
+// PARALLAX_SHADOWS defined as literals so the branches below fold away. Compiled without them
+// the same code branches on the material at runtime.
 //--------------------------------------------------------------------------------------
+#ifndef PARALLAX_MODE
+#define PARALLAX_MODE Material.choice
+#endif
+#ifndef USE_TEXTURE
+#define USE_TEXTURE Material.UseTexture
+#endif
+#ifndef PARALLAX_SHADOWS
+#define PARALLAX_SHADOWS Material.ParallaxShadows
+#endif
 
 float4 PS(PS_INPUT IN) : SV_TARGET
 {
@@ -395,104 +696,172 @@ float4 PS(PS_INPUT IN) : SV_TARGET
     float3 vertexToLightTS = mul(vertexToLight, TBN_inv);
     float3 vertexToEyeTS = mul(vertexToEye, TBN_inv);
 
-	if (Material.choice == 0)
-	{
 	/***********************************************
 	MARKING SCHEME: Normal Mapping
 	DESCRIPTION: Map sampling, normal value decompression, transformation to tangent space
 	***********************************************/
 
-		//Normal Mapping is now enabled always throughout the application this is kept in to keep the original Module handin marking scheme areas the same.
-		
-        LightingResult lit = ComputeLighting(IN.worldPos, normalize(CalcBumpMap(IN.Tex)), vertexToLightTS, vertexToEyeTS);
-		float4 texColor = { 1, 1, 1, 1 };
+	//Normal Mapping is now enabled always throughout the application; the parallax modes only move the texture coordinates it samples at.
+	float2 texCoords = IN.Tex;
+	float fade = 0.0f;
 
+	if (PARALLAX_MODE == 1)
+	{
+		fade = ParallaxFade(IN.worldPos.xyz);
+		texCoords = ParallaxSteepMapping(IN.Tex, vertexToEyeTS, fade);
 
-		float4 emissive = Material.Emissive;
-		float4 ambient = Material.Ambient * GlobalAmbient;
-		float4 diffuse = Material.Diffuse * lit.Diffuse;
-		float4 specular = Material.Specular * lit.Specular;
+		if (texCoords.x >= 1.0 || texCoords.y >= 1.0 || texCoords.x <= 0.0 || texCoords.y <= 0.0)
+			discard;
+	}
+	else if (PARALLAX_MODE >= 2 && PARALLAX_MODE <= 4)
+	{
+		fade = ParallaxFade(IN.worldPos.xyz);
+		if (PARALLAX_MODE == 2)
+			texCoords = ParallaxOcclusionMapping(IN.Tex, IN.Norm, vertexToEyeTS, fade);
+		else if (PARALLAX_MODE == 3)
+			texCoords = ParallaxConeStepMapping(IN.Tex, vertexToEyeTS, fade);
+		else
+			texCoords = ParallaxQuadtreeMapping(IN.Tex, vertexToEyeTS, fade);
 
-		if (Material.UseTexture)
-		{
-			texColor = txDiffuse.Sample(samLinear, IN.Tex);
-		}
+		if (texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
+			discard;
+	}
 
-		float4 finalColor = (emissive + ambient + diffuse + specular) * texColor;
+    LightingResult lit = ComputeLighting(IN.worldPos, normalize(CalcBumpMap(texCoords)), vertexToLightTS, vertexToEyeTS);
+	float4 texColor = { 1, 1, 1, 1 };
 
-		return finalColor;
-	}
-	else if (Material.choice == 1)
+
+	float2 visibility = TerrainVisibility(IN.worldPos);
+	if (PARALLAX_MODE >= 1 && PARALLAX_MODE <= 4 && PARALLAX_SHADOWS)
+		visibility.y *= ParallaxSelfShadow(texCoords, vertexToLightTS, fade);
+	float4 emissive = Material.Emissive;
+	float4 ambient = Material.Ambient * GlobalAmbient * visibility.x;
+	float4 diffuse = Material.Diffuse * lit.Diffuse * visibility.y;
+	float4 specular = Material.Specular * lit.Specular * visibility.y;
+
+	if (USE_TEXTURE)
 	{
+		texColor = txDiffuse.Sample(samLinear, texCoords);
+	}
 
-		
-		//float3 viewDir = normalize(EyePosition - IN.worldPos);
-		float2 texCoords = ParallaxSteepMapping(IN.Tex, vertexToEyeTS);
+	float4 finalColor = (emissive + ambient + diffuse + specular) * texColor;
 
-		if (texCoords.x >= 1.0 || texCoords.y >= 1.0 || texCoords.x <= 0.0 || texCoords.y <= 0.0)
-			discard;
-		
-        LightingResult lit = ComputeLighting(IN.worldPos, normalize(CalcBumpMap(texCoords)), vertexToLightTS, vertexToEyeTS);
-		float4 texColor = { 1, 1, 1, 1 };
+	return finalColor;
+}
 
+//--------------------------------------------------------------------------------------
+// PSTerrain - blends up to 8 material layers from texture arrays by the splat weights
+//--------------------------------------------------------------------------------------
+float4 PSTerrain(PS_INPUT IN) : SV_TARGET
+{
+    float3 vertexToLight = normalize(Lights[0].Position - IN.worldPos).xyz;
+    float3 vertexToEye = normalize(EyePosition - IN.worldPos).xyz;
 
-		float4 emissive = Material.Emissive;
-		float4 ambient = Material.Ambient * GlobalAmbient;
-		float4 diffuse = Material.Diffuse * lit.Diffuse;
-		float4 specular = Material.Specular * lit.Specular;
+    float3x3 TBN_inv = transpose(float3x3(normalize(IN.tangent), normalize(IN.binormal), normalize(IN.Norm)));
 
-		if (Material.UseTexture)
-		{
-			texColor = txDiffuse.Sample(samLinear, texCoords);
-		}
+    float3 vertexToLightTS = mul(vertexToLight, TBN_inv);
+    float3 vertexToEyeTS = mul(vertexToEye, TBN_inv);
 
-		float4 finalColor = (emissive + ambient + diffuse + specular) * texColor;
+    float2 mapUV = IN.worldPos.xz * MapScaleOffset.xy + MapScaleOffset.zw;
+    float4 splat0 = txSplat.SampleLevel(samLinear, float3(mapUV, 0), 0);
+    float4 splat1 = LayerCount > 4 ? txSplat.SampleLevel(samLinear, float3(mapUV, 1), 0) : float4(0, 0, 0, 0);
+    float weights[8] = { splat0.x, splat0.y, splat0.z, splat0.w, splat1.x, splat1.y, splat1.z, splat1.w };
+    float total = max(dot(splat0, 1) + dot(splat1, 1), 0.0001f);
 
-		return finalColor;
-	}
-	else if (Material.choice == 2)
-	{
-		//float3 viewDir = normalize(EyePosition.xyz - IN.worldPos.xyz);
-        float2 texCoords = ParallaxOcclusionMapping(IN.Tex, IN.Norm, vertexToEyeTS);
+    // Gradients are taken up front so layers can be skipped without breaking filtering
+    float2 dx = ddx(IN.Tex);
+    float2 dy = ddy(IN.Tex);
 
-		if (texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
-			discard;
-		
-        LightingResult lit = ComputeLighting(IN.worldPos, normalize(CalcBumpMap(texCoords)), vertexToLightTS, vertexToEyeTS);
-		float4 texColor = { 1, 1, 1, 1 };
+    float4 texColor = { 0, 0, 0, 0 };
+    float3 bump = { 0, 0, 0 };
+    [unroll]
+    for (int i = 0; i < 8; ++i)
+    {
+        if (i < LayerCount && weights[i] > 0.0f)
+        {
+            float w = weights[i] / total;
+            texColor += w * txLayerDiffuse.SampleGrad(samLinear, float3(IN.Tex, i), dx, dy);
+            bump += w * DecodeBumpMapXY(txLayerNormal.SampleGrad(samLinear, float3(IN.Tex, i), dx, dy).rg);
+        }
+    }
 
+    LightingResult lit = ComputeLighting(IN.worldPos, normalize(bump), vertexToLightTS, vertexToEyeTS);
 
-		float4 emissive = Material.Emissive;
-		float4 ambient = Material.Ambient * GlobalAmbient;
-		float4 diffuse = Material.Diffuse * lit.Diffuse;
-		float4 specular = Material.Specular * lit.Specular;
+    float2 visibility = TerrainVisibility(IN.worldPos);
+    float4 emissive = Material.Emissive;
+    float4 ambient = Material.Ambient * GlobalAmbient * visibility.x;
+    float4 diffuse = Material.Diffuse * lit.Diffuse * visibility.y;
+    float4 specular = Material.Specular * lit.Specular * visibility.y;
 
-		if (Material.UseTexture)
-		{
-			texColor = txDiffuse.Sample(samLinear, texCoords);
-		}
+    return (emissive + ambient + diffuse + specular) * texColor;
+}
 
-		float4 finalColor = (emissive + ambient + diffuse + specular) * texColor;
+// Level of the virtual texture a pixel's footprint needs. There is only the one level in the
+// physical cache to filter, so no trilinear blend between levels.
+int VirtualMip(float2 uv)
+{
+    float2 dx = ddx(uv * VirtualSize);
+    float2 dy = ddy(uv * VirtualSize);
+    float lod = 0.5f * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8f)) + VirtualLodBias;
+    return clamp((int)floor(lod), 0, VirtualMipCount - 1);
+}
 
-		return finalColor;
-	}
-    LightingResult lit = ComputeLighting(IN.worldPos, normalize(CalcBumpMap(IN.Tex)), vertexToLightTS, vertexToEyeTS);
-	float4 texColor = { 1, 1, 1, 1 };
+// Where uv lands in the physical cache: through the page table entry for its page at 'mip', which
+// names the page resident in its place, and within that page past its border. z is zero until
+// anything at all is resident.
+float3 VirtualPhysicalUV(float2 uv, int mip)
+{
+    uv = min(saturate(uv), 0.99999f);
+    uint4 entry = txPageTable.Load(int3(uv * (PagesPerSide >> mip), mip));
+    float2 inPage = frac(uv * (PagesPerSide >> entry.z));
+    return float3(entry.xy * PhysicalPage.x + PhysicalPage.y + inPage * PhysicalPage.z, entry.w / 255.0f);
+}
 
+//--------------------------------------------------------------------------------------
+// PSTerrainVirtual - the splat materials as PSTerrain blends them, baked into a virtual texture
+//--------------------------------------------------------------------------------------
+float4 PSTerrainVirtual(PS_INPUT IN) : SV_TARGET
+{
+    float3 vertexToLight = normalize(Lights[0].Position - IN.worldPos).xyz;
+    float3 vertexToEye = normalize(EyePosition - IN.worldPos).xyz;
 
-	float4 emissive = Material.Emissive;
-	float4 ambient = Material.Ambient * GlobalAmbient;
-	float4 diffuse = Material.Diffuse * lit.Diffuse;
-	float4 specular = Material.Specular * lit.Specular;
+    float3x3 TBN_inv = transpose(float3x3(normalize(IN.tangent), normalize(IN.binormal), normalize(IN.Norm)));
 
-	if (Material.UseTexture)
-	{
-		texColor = txDiffuse.Sample(samLinear, IN.Tex);
-	}
+    float3 vertexToLightTS = mul(vertexToLight, TBN_inv);
+    float3 vertexToEyeTS = mul(vertexToEye, TBN_inv);
 
-	float4 finalColor = (emissive + ambient + diffuse + specular) * texColor;
+    float2 uv = IN.worldPos.xz * VirtualScaleOffset.xy + VirtualScaleOffset.zw;
+    float3 physical = VirtualPhysicalUV(uv, VirtualMip(uv));
 
-	return finalColor;
+    // The cache has no mips; its borders keep bilinear filtering inside each page
+    float4 texColor = txPhysicalDiffuse.SampleLevel(samLinear, physical.xy, 0);
+    float3 bump = DecodeBumpMapXY(txPhysicalNormal.SampleLevel(samLinear, physical.xy, 0).rg);
+    if (physical.z == 0.0f)
+    {
+        texColor = float4(0.5f, 0.5f, 0.5f, 1.0f);
+        bump = float3(0.0f, 0.0f, -1.0f);
+    }
+
+    LightingResult lit = ComputeLighting(IN.worldPos, normalize(bump), vertexToLightTS, vertexToEyeTS);
+
+    float2 visibility = TerrainVisibility(IN.worldPos);
+    float4 emissive = Material.Emissive;
+    float4 ambient = Material.Ambient * GlobalAmbient * visibility.x;
+    float4 diffuse = Material.Diffuse * lit.Diffuse * visibility.y;
+    float4 specular = Material.Specular * lit.Specular * visibility.y;
+
+    return (emissive + ambient + diffuse + specular) * texColor;
+}
+
+//--------------------------------------------------------------------------------------
+// PSTerrainFeedback - the virtual page each pixel needs, for TerrainVirtualTexture to read back
+//--------------------------------------------------------------------------------------
+uint4 PSTerrainFeedback(PS_INPUT IN) : SV_TARGET
+{
+    float2 uv = IN.worldPos.xz * VirtualScaleOffset.xy + VirtualScaleOffset.zw;
+    int mip = VirtualMip(uv);
+    int2 page = int2(min(saturate(uv), 0.99999f) * (PagesPerSide >> mip));
+    return uint4(page, mip, 255);
 }
 
 //--------------------------------------------------------------------------------------
@@ -24,6 +24,7 @@ struct _Material
 		, Specular(1.0f, 1.0f, 1.0f, 1.0f)
 		, SpecularPower(128.0f)
 		, UseTexture(false)
+		, ParallaxShadows(0)
 	{}
 
 	DirectX::XMFLOAT4   Emissive;
@@ -38,8 +39,7 @@ struct _Material
 	// Add some padding complete the 16 byte boundary.
 	int                 UseTexture;
 	int                 choice;
-	// Add some padding to complete the 16 byte boundary.
-	float               Padding[1];
+	int                 ParallaxShadows;	// self-shadowing from the parallax horizon map
 	//----------------------------------- (16 byte boundary)
 }; // Total:                                80 bytes (5 * 16)
 
@@ -104,6 +104,66 @@ struct LightPropertiesConstantBuffer
 	Light               Lights[MAX_LIGHTS]; // 80 * 8 bytes
 };  // Total:              672 bytes (42 * 16)
 
+struct TerrainPropertiesConstantBuffer
+{
+	TerrainPropertiesConstantBuffer()
+		: MapScaleOffset(0.0f, 0.0f, 0.0f, 0.0f)
+		, UseHorizonMap(0)
+		, LayerCount(0)
+	{}
+
+	DirectX::XMFLOAT4   MapScaleOffset;		// world xz * scale + offset = uv of per-sample maps
+	//----------------------------------- (16 byte boundary)
+	int                 UseHorizonMap;
+	int                 LayerCount;
+	// Add some padding to complete the 16 byte boundary.
+	int                 Padding[2];
+	//----------------------------------- (16 byte boundary)
+};  // Total:              32 bytes (2 * 16)
+
+struct ParallaxPropertiesConstantBuffer
+{
+	ParallaxPropertiesConstantBuffer()
+		: QualityScale(0.0f)
+		, MinLayers(0.0f)
+		, MaxLayers(0.0f)
+		, FadeStart(0.0f)
+		, FadeEnd(0.0f)
+	{}
+
+	float               QualityScale;		// layers per texel the view ray crosses
+	float               MinLayers;
+	float               MaxLayers;
+	float               FadeStart;			// eye distance where the relief starts to flatten
+	//----------------------------------- (16 byte boundary)
+	float               FadeEnd;			// plain normal mapping beyond this
+	// Add some padding to complete the 16 byte boundary.
+	float               Padding[3];
+	//----------------------------------- (16 byte boundary)
+};  // Total:              32 bytes (2 * 16)
+
+struct VirtualTexturePropertiesConstantBuffer
+{
+	VirtualTexturePropertiesConstantBuffer()
+		: VirtualScaleOffset(0.0f, 0.0f, 0.0f, 0.0f)
+		, VirtualSize(0.0f)
+		, PagesPerSide(0)
+		, VirtualMipCount(0)
+		, VirtualLodBias(0.0f)
+		, PhysicalPage(0.0f, 0.0f, 0.0f, 0.0f)
+	{}
+
+	DirectX::XMFLOAT4   VirtualScaleOffset;	// world xz * scale + offset = virtual texture uv
+	//----------------------------------- (16 byte boundary)
+	float               VirtualSize;		// texels across at mip 0
+	int                 PagesPerSide;		// at mip 0
+	int                 VirtualMipCount;
+	float               VirtualLodBias;		// added to the level the feedback pass picks, for its smaller target
+	//----------------------------------- (16 byte boundary)
+	DirectX::XMFLOAT4   PhysicalPage;		// page size, border and content size over the cache size
+	//----------------------------------- (16 byte boundary)
+};  // Total:              48 bytes (3 * 16)
+
 struct CameraS
 {
 	XMMATRIX camRotationMatrix;
@@ -0,0 +1,277 @@
+// AssetPacker and AssetPackage: files packed and read back are byte for byte what went in, stored
+// or compressed, empty or shared with an identical file; ReadRange returns any range, across
+// blocks or not; AssetFile finds packed files once the package is mounted; packing names the
+// file it could not read; and packages with damaged headers or indexes are refused on opening,
+// while damage past what Open checks never reads outside the mapping.
+#include "TestCheck.h"
+
+#include "AssetFile.h"
+#include "AssetPackage.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const string DIRECTORY = string(TEST_OUTPUT_DIR) + "/";
+	const string SOURCE = DIRECTORY + "Source";
+
+	uint32_t g_random = 12345;
+
+	uint32_t Random()
+	{
+		g_random = g_random * 1664525u + 1013904223u;
+		return g_random >> 8;
+	}
+
+	vector<uint8_t> ReadFile(const string& fileName)
+	{
+		ifstream file(fileName, ios::binary);
+		return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	}
+
+	void WriteFile(const string& fileName, const vector<uint8_t>& data)
+	{
+		ofstream(fileName, ios::binary | ios::trunc).write(reinterpret_cast<const char*>(data.data()), data.size());
+	}
+
+	// Repetitive enough to compress, with some variety between blocks
+	vector<uint8_t> MakeText(size_t size)
+	{
+		const char words[] = "sand grass rock snow ";
+		vector<uint8_t> data(size);
+		for (size_t i = 0; i < size; ++i)
+			data[i] = (uint8_t)(words[i % (sizeof(words) - 1)] + (i / 5000) % 7);
+		return data;
+	}
+
+	vector<uint8_t> MakeNoise(size_t size)
+	{
+		vector<uint8_t> data(size);
+		for (uint8_t& byte : data)
+			byte = (uint8_t)Random();
+		return data;
+	}
+
+	// Whether the package still opens once damage has been done to its bytes
+	bool OpensDamaged(const vector<uint8_t>& package, const function<void(uint8_t* bytes)>& damage)
+	{
+		vector<uint8_t> damaged = package;
+		damage(damaged.data());
+		const string fileName = DIRECTORY + "damaged.pak";
+		WriteFile(fileName, damaged);
+		AssetPackage opened;
+		return opened.Open(fileName);
+	}
+
+	template<typename T>
+	T& At(uint8_t* bytes, uint64_t offset)
+	{
+		return *reinterpret_cast<T*>(bytes + offset);
+	}
+}
+
+int main()
+{
+	mkdir(SOURCE.c_str(), 0755);
+	mkdir((SOURCE + "/Sub").c_str(), 0755);
+	const vector<uint8_t> text = MakeText(300000);			// five blocks of 64 KB, the last partial
+	const vector<uint8_t> noise = MakeNoise(100000);
+	const vector<uint8_t> small = MakeText(1000);
+	WriteFile(SOURCE + "/text.bin", text);
+	WriteFile(SOURCE + "/copy of text.bin", text);
+	WriteFile(SOURCE + "/noise.bin", noise);
+	WriteFile(SOURCE + "/empty.txt", vector<uint8_t>());
+	WriteFile(SOURCE + "/Sub/Small.txt", small);
+
+	vector<string> files;
+	CHECK(AssetPacker::ListFiles(SOURCE, files));
+	const vector<string> listed =
+	{
+		SOURCE + "/Sub/Small.txt", SOURCE + "/copy of text.bin", SOURCE + "/empty.txt", SOURCE + "/noise.bin", SOURCE + "/text.bin",
+	};
+	CHECK(files == listed);
+	files.push_back("Resources/stone.dds");
+
+	const string packageFile = DIRECTORY + "test.pak";
+	AssetPackStats stats;
+	string error;
+	CHECK(AssetPacker::Pack(files, packageFile, AssetPackSettings(), &stats, &error) && error.empty());
+	const vector<uint8_t> stone = ReadFile("Resources/stone.dds");
+	CHECK(stats.assetCount == 6 && stats.duplicateCount == 1 && stats.compressedCount >= 1);
+	CHECK(stats.rawBytes == text.size() + noise.size() + small.size() + stone.size());
+	CHECK(stats.storedBytes < stats.rawBytes && stats.fileSize == ReadFile(packageFile).size());
+
+	// Every file reads back whole, found by any spelling of its name
+	AssetPackage package;
+	CHECK(package.Open(packageFile) && package.GetAssetCount() == 6);
+	const int textAsset = package.Find(SOURCE + "/TEXT.BIN");
+	const int copyAsset = package.Find(SOURCE + "\\copy of text.bin");
+	const int noiseAsset = package.Find(SOURCE + "/noise.bin");
+	const int emptyAsset = package.Find(SOURCE + "/empty.txt");
+	const int smallAsset = package.Find(SOURCE + "/sub/small.txt");
+	const int stoneAsset = package.Find(".\\Resources\\Stone.dds");
+	CHECK(textAsset >= 0 && copyAsset >= 0 && noiseAsset >= 0 && emptyAsset >= 0 && smallAsset >= 0 && stoneAsset >= 0);
+	CHECK(package.Find(SOURCE + "/missing.bin") == -1);
+	CHECK(package.GetName(stoneAsset) == "resources\\stone.dds");
+
+	vector<uint8_t> read;
+	CHECK(package.Read(textAsset, read) && read == text);
+	CHECK(package.Read(copyAsset, read) && read == text);
+	CHECK(package.Read(noiseAsset, read) && read == noise);
+	CHECK(package.Read(emptyAsset, read) && read.empty());
+	CHECK(package.Read(smallAsset, read) && read == small);
+	CHECK(package.Read(stoneAsset, read) && read == stone);
+	CHECK(package.IsCompressed(textAsset) && package.GetStoredSize(textAsset) < text.size() && !package.GetMapped(textAsset));
+	CHECK(package.GetStoredSize(copyAsset) == package.GetStoredSize(textAsset));
+	CHECK(!package.IsCompressed(noiseAsset) && memcmp(package.GetMapped(noiseAsset), noise.data(), noise.size()) == 0);
+	CHECK(package.GetSize(emptyAsset) == 0 && package.GetContentHash(textAsset) == package.GetContentHash(copyAsset));
+
+	// Ranges anywhere, within a block, across several, empty, and to the end
+	{
+		int wrong = 0;
+		const int assets[] = { textAsset, noiseAsset };
+		const vector<uint8_t>* sources[] = { &text, &noise };
+		for (int a = 0; a < 2; ++a)
+		{
+			const vector<uint8_t>& source = *sources[a];
+			for (int i = 0; i < 300; ++i)
+			{
+				size_t offset = Random() % (source.size() + 1);
+				size_t size = i % 3 == 0 ? Random() % 200 : Random() % (source.size() - offset + 1);
+				if (i % 50 == 1)
+					size = source.size() - offset;
+				size = min(size, source.size() - offset);
+				vector<uint8_t> range(size + 1, 0xCD);
+				if (!package.ReadRange(assets[a], offset, size, range.data()) || !equal(range.begin(), range.end() - 1, source.begin() + offset) || range.back() != 0xCD)
+					++wrong;
+			}
+		}
+		CHECK(wrong == 0);
+
+		uint8_t byte;
+		CHECK(package.ReadRange(textAsset, text.size(), 0, &byte));
+		CHECK(!package.ReadRange(textAsset, text.size() + 1, 0, &byte));
+		CHECK(!package.ReadRange(textAsset, text.size() - 1, 2, &byte));
+		CHECK(!package.ReadRange(noiseAsset, 0, noise.size() + 1, &byte));
+		CHECK(!package.ReadRange(emptyAsset, 0, 1, &byte));
+	}
+
+	// The loaders find the packed files once the package is mounted
+	{
+		CHECK(AssetPackages::Mount(packageFile) && AssetPackages::GetMountedCount() == 1);
+		const int packedOpens = AssetFile::GetPackedOpenCount();
+		AssetFile compressed, stored;
+		CHECK(compressed.Open(SOURCE + "/Text.bin") && compressed.IsPacked());
+		CHECK(compressed.GetSize() == text.size() && memcmp(compressed.GetData(), text.data(), text.size()) == 0);
+		CHECK(stored.Open(L"Resources\\stone.dds") && stored.IsPacked());
+		CHECK(stored.GetSize() == stone.size() && memcmp(stored.GetData(), stone.data(), stone.size()) == 0);
+		CHECK(AssetFile::GetPackedOpenCount() == packedOpens + 2);
+		AssetPackages::UnmountAll();
+		CHECK(compressed.Open(SOURCE + "/text.bin") && !compressed.IsPacked());
+	}
+
+	// Packing says which file failed
+	{
+		vector<string> missing = files;
+		missing.insert(missing.begin() + 2, SOURCE + "/missing.bin");
+		CHECK(!AssetPacker::Pack(missing, DIRECTORY + "failed.pak", AssetPackSettings(), nullptr, &error));
+		CHECK(error.find(SOURCE + "/missing.bin") != string::npos);
+
+		vector<string> twice = { SOURCE + "/noise.bin", SOURCE + "/text.bin", SOURCE + "/noise.bin" };
+		error.clear();
+		CHECK(!AssetPacker::Pack(twice, DIRECTORY + "failed.pak", AssetPackSettings(), nullptr, &error));
+		CHECK(error.find("noise.bin") != string::npos);
+
+		AssetPackSettings unaligned;
+		unaligned.alignment = 100;
+		error.clear();
+		CHECK(!AssetPacker::Pack(files, DIRECTORY + "failed.pak", unaligned, nullptr, &error) && !error.empty());
+		CHECK(!AssetPacker::Pack({ SOURCE + "/noise.bin" }, DIRECTORY + "no such directory/failed.pak", AssetPackSettings(), nullptr, &error));
+		CHECK(error.find("no such directory") != string::npos);
+	}
+
+	// Damaged headers and indexes are refused
+	{
+		const vector<uint8_t> bytes = ReadFile(packageFile);
+		const AssetPackageHeader& header = *reinterpret_cast<const AssetPackageHeader*>(bytes.data());
+		CHECK(OpensDamaged(bytes, [](uint8_t*) {}));
+
+		int opened = 0;
+		for (size_t length : { (size_t)0, sizeof(AssetPackageHeader) - 1, sizeof(AssetPackageHeader), (size_t)header.indexOffset, bytes.size() - 1 })
+		{
+			vector<uint8_t> cut(bytes.begin(), bytes.begin() + length);
+			WriteFile(DIRECTORY + "damaged.pak", cut);
+			AssetPackage truncated;
+			opened += truncated.Open(DIRECTORY + "damaged.pak");
+		}
+		CHECK(opened == 0);
+
+		const uint64_t index = header.indexOffset;
+		const uint64_t textEntry = index + textAsset * sizeof(AssetPackageEntry);
+		const uint64_t noiseEntry = index + noiseAsset * sizeof(AssetPackageEntry);
+		const function<void(uint8_t*)> damage[] =
+		{
+			[](uint8_t* b) { At<uint32_t>(b, offsetof(AssetPackageHeader, magic)) ^= 1; },
+			[](uint8_t* b) { At<uint32_t>(b, offsetof(AssetPackageHeader, version)) = 2; },
+			[](uint8_t* b) { At<uint32_t>(b, offsetof(AssetPackageHeader, assetCount)) = 1000000; },
+			[](uint8_t* b) { At<uint32_t>(b, offsetof(AssetPackageHeader, blockSize)) = 0; },
+			[](uint8_t* b) { At<uint32_t>(b, offsetof(AssetPackageHeader, blockSize)) *= 2; },
+			[](uint8_t* b) { At<uint64_t>(b, offsetof(AssetPackageHeader, indexOffset)) += 4; },
+			[](uint8_t* b) { At<uint64_t>(b, offsetof(AssetPackageHeader, indexOffset)) = ~0ull << 3; },
+			[](uint8_t* b) { At<uint64_t>(b, offsetof(AssetPackageHeader, blockTableOffset)) -= 8; },
+			[](uint8_t* b) { At<uint64_t>(b, offsetof(AssetPackageHeader, namesOffset)) += 1u << 20; },
+			[](uint8_t* b) { At<uint64_t>(b, offsetof(AssetPackageHeader, fileSize)) -= 1; },
+			[=](uint8_t* b) { At<uint64_t>(b, noiseEntry + offsetof(AssetPackageEntry, size)) += 1; },
+			[=](uint8_t* b) { At<uint64_t>(b, noiseEntry + offsetof(AssetPackageEntry, offset)) = index; },
+			[=](uint8_t* b) { At<uint64_t>(b, textEntry + offsetof(AssetPackageEntry, storedSize)) += 1; },
+			[=](uint8_t* b) { At<uint64_t>(b, textEntry + offsetof(AssetPackageEntry, size)) += 1u << 16; },
+			[=](uint8_t* b) { At<uint32_t>(b, textEntry + offsetof(AssetPackageEntry, blockCount)) -= 1; },
+			[=](uint8_t* b) { At<uint32_t>(b, textEntry + offsetof(AssetPackageEntry, firstBlock)) += 1000; },
+			[=](uint8_t* b) { At<uint32_t>(b, textEntry + offsetof(AssetPackageEntry, nameOffset)) = 1u << 20; },
+			[=](uint8_t* b) { At<uint64_t>(b, index + offsetof(AssetPackageEntry, nameHash)) = ~0ull; },
+			[=](uint8_t* b)
+			{
+				// A block ending before the one above it
+				const AssetPackageEntry& entry = At<AssetPackageEntry>(b, textEntry);
+				uint64_t* ends = &At<uint64_t>(b, At<uint64_t>(b, offsetof(AssetPackageHeader, blockTableOffset)) + entry.firstBlock * sizeof(uint64_t));
+				swap(ends[1], ends[2]);
+			},
+		};
+		int accepted = 0;
+		for (const auto& harm : damage)
+			accepted += OpensDamaged(bytes, harm);
+		CHECK(accepted == 0);
+
+		// Damage Open cannot see, in compressed blocks or names, may spoil what is read but never
+		// reads past the mapping (run under AddressSanitizer to see that)
+		int exercised = 0;
+		for (uint64_t offset = 0; offset < bytes.size(); offset += 997)
+		{
+			vector<uint8_t> damaged = bytes;
+			damaged[offset] ^= 0x5A;
+			WriteFile(DIRECTORY + "damaged.pak", damaged);
+			AssetPackage opened;
+			if (!opened.Open(DIRECTORY + "damaged.pak"))
+				continue;
+			++exercised;
+			for (int asset = 0; asset < opened.GetAssetCount(); ++asset)
+			{
+				opened.Read(asset, read);
+				opened.Find(opened.GetName(asset));
+			}
+		}
+		CHECK(exercised > 0);
+	}
+
+	return TestResult();
+}
@@ -0,0 +1,140 @@
+// BlockCompressor quality on the shipped textures: every format at every quality setting must
+// reach a PSNR floor a little under what it measures today, and no setting may score below the
+// faster one before it. Colour maps go through BC1 and BC7, where the High setting's mode 1
+// partition search runs; colour with its height map in alpha goes through BC3 and BC7's
+// mode 6 alpha path; height maps go through BC4. Prints the PSNR table.
+#include "TestCheck.h"
+
+#include "BlockCompressor.h"
+#include "ImageIO.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+namespace
+{
+	const BCQuality QUALITIES[] = { BCQualityFast, BCQualityBalanced, BCQualityHigh };
+	const char* const QUALITY_NAMES[] = { "Fast", "Balanced", "High" };
+
+	struct Case
+	{
+		const char*	fileName;
+		const char*	alphaFileName;	// loaded into alpha, resampled to fit; null for opaque
+		BCFormat	format;
+		float		floors[3];		// dB at Fast, Balanced and High
+	};
+
+	// Floors a little under what each texture measures today. A texture's BC1 row comes before
+	// its BC7 one.
+	const Case CASES[] =
+	{
+		{ "Resources/stone.dds", nullptr, BCFormatBC1, { 52.3f, 52.3f, 52.4f } },
+		{ "Resources/stone.dds", nullptr, BCFormatBC7, { 52.5f, 53.2f, 53.2f } },
+		{ "Resources/Rock Textures/rock_diffuse2.dds", nullptr, BCFormatBC1, { 36.2f, 37.6f, 37.8f } },
+		{ "Resources/Rock Textures/rock_diffuse2.dds", nullptr, BCFormatBC7, { 45.8f, 46.1f, 46.6f } },
+		{ "Resources/Brick Textures/color.dds", nullptr, BCFormatBC1, { 36.9f, 37.9f, 38.1f } },
+		{ "Resources/Brick Textures/color.dds", nullptr, BCFormatBC7, { 43.7f, 43.8f, 47.6f } },
+		{ "Resources/Crate Textures/Crate_COLOR.dds", nullptr, BCFormatBC1, { 30.0f, 31.4f, 31.9f } },
+		{ "Resources/Crate Textures/Crate_COLOR.dds", nullptr, BCFormatBC7, { 40.5f, 40.7f, 43.9f } },
+		{ "Resources/Rock Textures/rock_diffuse2.dds", "Resources/Rock Textures/rock_height.dds", BCFormatBC3, { 37.4f, 38.7f, 38.9f } },
+		{ "Resources/Rock Textures/rock_diffuse2.dds", "Resources/Rock Textures/rock_height.dds", BCFormatBC7, { 37.5f, 37.6f, 37.6f } },
+		{ "Resources/Brick Textures/color.dds", "Resources/Brick Textures/displacement.dds", BCFormatBC3, { 38.0f, 38.9f, 39.0f } },
+		{ "Resources/Brick Textures/color.dds", "Resources/Brick Textures/displacement.dds", BCFormatBC7, { 38.1f, 38.2f, 38.2f } },
+		{ "Resources/Crate Textures/Crate_COLOR.dds", "Resources/Crate Textures/Crate_DISP.dds", BCFormatBC3, { 31.2f, 32.7f, 33.0f } },
+		{ "Resources/Crate Textures/Crate_COLOR.dds", "Resources/Crate Textures/Crate_DISP.dds", BCFormatBC7, { 39.4f, 39.5f, 39.6f } },
+		{ "Resources/Rock Textures/rock_height.dds", nullptr, BCFormatBC4, { 42.3f, 43.0f, 43.2f } },
+		{ "Resources/Brick Textures/displacement.dds", nullptr, BCFormatBC4, { 45.4f, 46.3f, 46.7f } },
+		{ "Resources/Crate Textures/Crate_DISP.dds", nullptr, BCFormatBC4, { 55.1f, 55.6f, 55.8f } },
+	};
+
+	const char* FormatName(BCFormat format)
+	{
+		const char* const names[] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+		return names[format];
+	}
+
+	bool Load(const Case& test, Image& image)
+	{
+		if (!ImageIO::LoadDDS(test.fileName, image))
+			return false;
+		if (!test.alphaFileName)
+			return true;
+
+		Image alpha;
+		if (!ImageIO::LoadDDS(test.alphaFileName, alpha))
+			return false;
+		if (alpha.GetWidth() != image.GetWidth() || alpha.GetHeight() != image.GetHeight())
+			alpha = alpha.Resampled(image.GetWidth(), image.GetHeight());
+		for (int y = 0; y < image.GetHeight(); ++y)
+			for (int x = 0; x < image.GetWidth(); ++x)
+				image.At(x, y)[3] = alpha.At(x, y)[0];
+		return true;
+	}
+
+	double CompressedPSNR(const Image& image, BCFormat format, BCQuality quality, CompressedImage& compressed)
+	{
+		BlockCompressor::Compress(image, format, quality, compressed);
+		Image decoded;
+		BlockCompressor::Decompress(compressed, decoded);
+		CHECK(decoded.GetWidth() == image.GetWidth() && decoded.GetHeight() == image.GetHeight());
+		return BlockCompressor::PSNR(image, decoded, format);
+	}
+}
+
+int main()
+{
+	printf("%-52s %-6s %8s %8s %8s\n", "texture", "format", QUALITY_NAMES[0], QUALITY_NAMES[1], QUALITY_NAMES[2]);
+
+	double bc1[3] = {};
+	for (const Case& test : CASES)
+	{
+		Image image;
+		CHECK(Load(test, image));
+		if (image.IsEmpty())
+			continue;
+		const size_t blockCount = (size_t)((image.GetWidth() + 3) / 4) * ((image.GetHeight() + 3) / 4);
+
+		double psnr[3];
+		for (int q = 0; q < 3; ++q)
+		{
+			CompressedImage compressed;
+			psnr[q] = CompressedPSNR(image, test.format, QUALITIES[q], compressed);
+			CHECK(compressed.format == test.format);
+			CHECK(compressed.blocks.size() == blockCount * BlockCompressor::BlockBytes(test.format));
+			CHECK(psnr[q] >= test.floors[q]);
+			if (q > 0)
+				CHECK(psnr[q] >= psnr[q - 1] - 0.01);
+		}
+		printf("%-52s %-6s %8.2f %8.2f %8.2f\n", test.alphaFileName ? (string(test.fileName) + " + alpha").c_str() : test.fileName,
+			FormatName(test.format), psnr[0], psnr[1], psnr[2]);
+
+		// BC7 spends its extra bits well: better than BC1 at every setting
+		if (test.format == BCFormatBC1)
+			memcpy(bc1, psnr, sizeof(bc1));
+		if (test.format == BCFormatBC7 && !test.alphaFileName)
+			for (int q = 0; q < 3; ++q)
+				CHECK(psnr[q] > bc1[q]);
+	}
+
+	// Sizes that are not whole blocks repeat their last row and column into the edge blocks
+	{
+		Image image;
+		CHECK(ImageIO::LoadDDS("Resources/Brick Textures/color.dds", image));
+		Image cropped(37, 21);
+		for (int y = 0; y < cropped.GetHeight(); ++y)
+			memcpy(cropped.GetRow(y), image.At(100, 200 + y), cropped.GetPitch());
+		for (BCFormat format : { BCFormatBC1, BCFormatBC3, BCFormatBC4, BCFormatBC7 })
+		{
+			CompressedImage compressed;
+			double psnr = CompressedPSNR(cropped, format, BCQualityHigh, compressed);
+			CHECK(compressed.width == 37 && compressed.height == 21);
+			CHECK(compressed.blocks.size() == (size_t)10 * 6 * BlockCompressor::BlockBytes(format));
+			CHECK(psnr > 30.0);
+		}
+	}
+
+	return TestResult();
+}
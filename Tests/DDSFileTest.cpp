@@ -0,0 +1,228 @@
+// DDSFile::Parse and MappedFile: every shipped texture maps and parses in place, and headers
+// that are truncated, damaged or missing their DX10 extension are refused before anything
+// reads past the data. ImageIO::DecodeDDS, which sits on both, must refuse surfaces cut short.
+#include "TestCheck.h"
+
+#include "DDSFile.h"
+#include "ImageIO.h"
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace DDSFile;
+
+namespace
+{
+	const char* const SHIPPED_TEXTURES[] =
+	{
+		"Resources/Brick Textures/color.dds",
+		"Resources/Brick Textures/displacement.dds",
+		"Resources/Brick Textures/normals.dds",
+		"Resources/Crate Textures/Crate_COLOR.dds",
+		"Resources/Crate Textures/Crate_DISP.dds",
+		"Resources/Crate Textures/Crate_NRM.dds",
+		"Resources/Rock Textures/rock_bump.dds",
+		"Resources/Rock Textures/rock_height.dds",
+		"Resources/conenormal.dds",
+		"Resources/stone.dds",
+	};
+
+	const uint32_t FORMAT_R8G8B8A8_UNORM = 28;
+	const uint32_t FORMAT_BC1_UNORM = 71;
+	const size_t LEGACY_HEADER_SIZE = sizeof(uint32_t) + sizeof(Header);
+	const size_t DX10_HEADER_SIZE = LEGACY_HEADER_SIZE + sizeof(HeaderDX10);
+
+	// A width x height file with surfaceSize bytes of surface: RGBA8 in a legacy header, or
+	// dxgiFormat behind a DX10 one
+	vector<uint8_t> MakeDDS(uint32_t width, uint32_t height, bool dx10, uint32_t dxgiFormat, size_t surfaceSize)
+	{
+		Header header = {};
+		header.size = sizeof(Header);
+		header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT;
+		header.width = width;
+		header.height = height;
+		header.caps = DDSCAPS_TEXTURE;
+		header.format.size = sizeof(PixelFormat);
+		if (dx10)
+		{
+			header.format.flags = DDPF_FOURCC;
+			header.format.fourCC = MakeFourCC('D', 'X', '1', '0');
+		}
+		else
+		{
+			header.format.flags = DDPF_RGB | DDPF_ALPHAPIXELS;
+			header.format.rgbBitCount = 32;
+			header.format.rBitMask = 0x000000ff;
+			header.format.gBitMask = 0x0000ff00;
+			header.format.bBitMask = 0x00ff0000;
+			header.format.aBitMask = 0xff000000;
+		}
+
+		vector<uint8_t> data(sizeof(uint32_t) + sizeof(Header));
+		memcpy(data.data(), &MAGIC, sizeof(MAGIC));
+		memcpy(data.data() + sizeof(MAGIC), &header, sizeof(header));
+		if (dx10)
+		{
+			HeaderDX10 extension = {};
+			extension.dxgiFormat = dxgiFormat;
+			extension.resourceDimension = 3;	// TEXTURE2D
+			extension.arraySize = 1;
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&extension);
+			data.insert(data.end(), bytes, bytes + sizeof(extension));
+		}
+		for (size_t i = 0; i < surfaceSize; ++i)
+			data.push_back((uint8_t)(i * 7));
+		return data;
+	}
+
+	// Parse of the first size bytes, from a buffer of exactly that size so ASan sees any overrun
+	bool ParsePrefix(const vector<uint8_t>& data, size_t size, Layout& layout)
+	{
+		vector<uint8_t> prefix(data.begin(), data.begin() + size);
+		const bool parsed = Parse(prefix.empty() ? nullptr : prefix.data(), prefix.size(), layout);
+		if (parsed)
+		{
+			CHECK(layout.bits == prefix.data() + (size - layout.bitSize));
+			layout = Layout();
+		}
+		return parsed;
+	}
+
+	bool DecodePrefix(const vector<uint8_t>& data, size_t size)
+	{
+		vector<uint8_t> prefix(data.begin(), data.begin() + size);
+		Image image;
+		return ImageIO::DecodeDDS(prefix.data(), prefix.size(), image);
+	}
+
+	void Corrupt(vector<uint8_t>& data, size_t offset, uint32_t value)
+	{
+		memcpy(data.data() + offset, &value, sizeof(value));
+	}
+}
+
+int main()
+{
+	// MappedFile
+	{
+		MappedFile file;
+		CHECK(!file.Open("Resources/no such file.dds") && !file.IsOpen() && file.GetData() == nullptr && file.GetSize() == 0);
+
+		const string empty = string(TEST_OUTPUT_DIR) + "/empty.dds";
+		ofstream(empty, ios::binary | ios::trunc);
+		CHECK(!file.Open(empty) && !file.IsOpen());
+		CHECK(!file.Open(TEST_OUTPUT_DIR));
+
+		for (const char* fileName : SHIPPED_TEXTURES)
+		{
+			ifstream stream(fileName, ios::binary);
+			const vector<uint8_t> contents((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+
+			// Open on an open file replaces the view
+			CHECK(file.Open(fileName) && file.IsOpen());
+			CHECK(file.GetSize() == contents.size() && memcmp(file.GetData(), contents.data(), contents.size()) == 0);
+
+			Layout layout;
+			CHECK(Parse(file.GetData(), file.GetSize(), layout));
+			CHECK(layout.header && layout.header->width > 0 && layout.header->height > 0);
+			CHECK(layout.bits + layout.bitSize == file.GetData() + file.GetSize());
+			CHECK(layout.bits == file.GetData() + (layout.dx10 ? DX10_HEADER_SIZE : LEGACY_HEADER_SIZE));
+		}
+		file.Close();
+		CHECK(!file.IsOpen() && file.GetData() == nullptr && file.GetSize() == 0);
+		file.Close();
+	}
+
+	// Legacy header: parses from 128 bytes on, decodes once the whole surface is there
+	{
+		const vector<uint8_t> data = MakeDDS(5, 3, false, 0, 5 * 3 * 4);
+		for (size_t size = 0; size <= data.size(); ++size)
+		{
+			Layout layout;
+			CHECK(ParsePrefix(data, size, layout) == (size >= LEGACY_HEADER_SIZE));
+			CHECK(DecodePrefix(data, size) == (size == data.size()));
+		}
+		Layout layout;
+		CHECK(Parse(data.data(), data.size(), layout) && layout.dx10 == nullptr && layout.bitSize == 5 * 3 * 4);
+
+		// At any alignment
+		vector<uint8_t> shifted(data.size() + 1);
+		memcpy(shifted.data() + 1, data.data(), data.size());
+		CHECK(Parse(shifted.data() + 1, data.size(), layout) && layout.header->width == 5);
+		Image image;
+		CHECK(ImageIO::DecodeDDS(shifted.data() + 1, data.size(), image) && image.GetWidth() == 5 && image.GetHeight() == 3);
+		CHECK(memcmp(image.GetData(), data.data() + LEGACY_HEADER_SIZE, data.size() - LEGACY_HEADER_SIZE) == 0);
+	}
+
+	// DX10 header: the extension must be there in full before anything is pointed at
+	{
+		const vector<uint8_t> data = MakeDDS(4, 4, true, FORMAT_R8G8B8A8_UNORM, 4 * 4 * 4);
+		for (size_t size = 0; size <= data.size(); ++size)
+		{
+			Layout layout;
+			CHECK(ParsePrefix(data, size, layout) == (size >= DX10_HEADER_SIZE));
+			CHECK(DecodePrefix(data, size) == (size == data.size()));
+		}
+		Layout layout;
+		CHECK(Parse(data.data(), data.size(), layout) && layout.dx10 && layout.dx10->dxgiFormat == FORMAT_R8G8B8A8_UNORM);
+		CHECK(layout.bitSize == 4 * 4 * 4);
+
+		// Block compressed surfaces are checked against their block count: 3x2 blocks of BC1
+		const vector<uint8_t> blocks = MakeDDS(9, 5, true, FORMAT_BC1_UNORM, 3 * 2 * 8);
+		for (size_t size = DX10_HEADER_SIZE; size <= blocks.size(); ++size)
+			CHECK(DecodePrefix(blocks, size) == (size == blocks.size()));
+
+		// Without the FourCC flag "DX10" is just a legacy header with no format
+		vector<uint8_t> unflagged = data;
+		Corrupt(unflagged, sizeof(uint32_t) + offsetof(Header, format) + offsetof(PixelFormat, flags), 0);
+		CHECK(Parse(unflagged.data(), unflagged.size(), layout) && layout.dx10 == nullptr && layout.bitSize == 4 * 4 * 4 + sizeof(HeaderDX10));
+		CHECK(!DecodePrefix(unflagged, unflagged.size()));
+	}
+
+	// Damaged headers are refused, and a refused parse leaves nothing pointing into the data
+	{
+		const vector<uint8_t> data = MakeDDS(4, 4, false, 0, 4 * 4 * 4);
+		const size_t headerSize = sizeof(uint32_t) + offsetof(Header, size);
+		const size_t formatSize = sizeof(uint32_t) + offsetof(Header, format) + offsetof(PixelFormat, size);
+		const size_t width = sizeof(uint32_t) + offsetof(Header, width);
+		const struct
+		{
+			size_t		offset;
+			uint32_t	value;
+			bool		parses;
+		} damage[] =
+		{
+			{ 0, MakeFourCC('D', 'D', 'S', '1'), false },
+			{ 0, 0, false },
+			{ headerSize, sizeof(Header) - 4, false },
+			{ headerSize, sizeof(Header) + 4, false },
+			{ headerSize, 0xffffffff, false },
+			{ formatSize, 0, false },
+			{ formatSize, sizeof(PixelFormat) * 2, false },
+			{ width, 0, true },		// parses, but there is nothing to decode
+		};
+		for (const auto& d : damage)
+		{
+			vector<uint8_t> damaged = data;
+			Corrupt(damaged, d.offset, d.value);
+			Layout layout;
+			CHECK(Parse(data.data(), data.size(), layout));
+			CHECK(Parse(damaged.data(), damaged.size(), layout) == d.parses);
+			if (!d.parses)
+				CHECK(layout.header == nullptr && layout.dx10 == nullptr && layout.bits == nullptr && layout.bitSize == 0);
+			CHECK(!DecodePrefix(damaged, damaged.size()));
+		}
+
+		Layout layout;
+		CHECK(!Parse(nullptr, 0, layout));
+		CHECK(!Parse(nullptr, data.size(), layout));
+	}
+
+	return TestResult();
+}
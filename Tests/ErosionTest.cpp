@@ -0,0 +1,112 @@
+// Erosion is independent of the thread count: Hydraulic and Thermal run on pools of one to eight
+// workers must leave the heightfield identical bit for bit, on a terrain whose size is not a
+// whole number of erosion tiles. Thermal only moves material, so the total height is kept.
+// Prints hydraulic droplets per second for each pool.
+#include "TestCheck.h"
+
+#include "Erosion.h"
+#include "Heightfield.h"
+#include "JobSystem.h"
+#include "TerrainGenerator.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const int WIDTH = 300;
+	const int HEIGHT = 260;
+
+	Heightfield MakeTerrain()
+	{
+		Heightfield heightfield(WIDTH, HEIGHT, 0.25f);
+		GenerateFractalTerrain(heightfield, FractalTerrainSettings());
+		return heightfield;
+	}
+
+	bool Identical(const Heightfield& a, const Heightfield& b)
+	{
+		return a.GetWidth() == b.GetWidth() && a.GetHeight() == b.GetHeight() &&
+			memcmp(a.GetData(), b.GetData(), sizeof(float) * a.GetWidth() * a.GetHeight()) == 0;
+	}
+
+	bool AllFinite(const Heightfield& heightfield)
+	{
+		for (int y = 0; y < heightfield.GetHeight(); ++y)
+			for (int x = 0; x < heightfield.GetWidth(); ++x)
+				if (!std::isfinite(heightfield.At(x, y)))
+					return false;
+		return true;
+	}
+
+	double Total(const Heightfield& heightfield)
+	{
+		double total = 0.0;
+		for (int y = 0; y < heightfield.GetHeight(); ++y)
+			for (int x = 0; x < heightfield.GetWidth(); ++x)
+				total += heightfield.At(x, y);
+		return total;
+	}
+}
+
+int main()
+{
+	const Heightfield terrain = MakeTerrain();
+	const unsigned workerCounts[] = { 1, 2, 3, 8 };
+
+	HydraulicErosionSettings hydraulic;
+	hydraulic.dropletCount = 100000;
+	ThermalErosionSettings thermal;
+
+	// Hydraulic: the same heights from every pool, and from the same pool twice
+	Heightfield reference = terrain;
+	{
+		ErosionStats stats = Erosion::Hydraulic(reference, hydraulic);
+		CHECK(stats.droplets == hydraulic.dropletCount);
+		CHECK(stats.tiles == 3 * 3);
+		CHECK(!Identical(reference, terrain));
+		CHECK(AllFinite(reference));
+	}
+	for (unsigned workers : workerCounts)
+	{
+		JobSystem jobs(workers);
+		for (int run = 0; run < 2; ++run)
+		{
+			Heightfield eroded = terrain;
+			ErosionStats stats = Erosion::Hydraulic(eroded, hydraulic, &jobs);
+			CHECK(Identical(eroded, reference));
+			if (run == 1)
+				printf("hydraulic, %u workers: %.2f Mdroplets/s\n", workers, stats.dropletsPerSecond / 1e6);
+		}
+	}
+
+	// Another seed erodes differently, so the comparisons above can fail
+	{
+		HydraulicErosionSettings reseeded = hydraulic;
+		reseeded.seed++;
+		Heightfield eroded = terrain;
+		Erosion::Hydraulic(eroded, reseeded);
+		CHECK(!Identical(eroded, reference));
+	}
+
+	// Thermal: the same heights from every pool, and no material made or lost
+	Heightfield slumped = reference;
+	Erosion::Thermal(slumped, thermal);
+	CHECK(!Identical(slumped, reference));
+	CHECK(AllFinite(slumped));
+	CHECK(fabs(Total(slumped) - Total(reference)) < 1e-5 * fabs(Total(reference)));
+	for (unsigned workers : workerCounts)
+	{
+		JobSystem jobs(workers);
+		Heightfield eroded = reference;
+		Erosion::Thermal(eroded, thermal, &jobs);
+		CHECK(Identical(eroded, slumped));
+	}
+
+	return TestResult();
+}
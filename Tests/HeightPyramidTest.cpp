@@ -0,0 +1,328 @@
+// HeightPyramid queries against brute force on a terrain that is neither square nor a power of two.
+// Raycast must find the same first crossing of the terrain mesh as testing every triangle of the
+// grid, for steep rays, grazing rays skimming the surface, rays that pass over or beside the
+// terrain, rays cut short by their maximum distance, and rays that start below the surface, which
+// hit it from underneath where they first come up through it. The batched SSE height and normal
+// queries must match the scalar bilinear sample and its central differences, for counts that are
+// not a whole number of SSE groups and for points off the terrain. Prints nodes visited per ray.
+#include "TestCheck.h"
+
+#include "HeightPyramid.h"
+#include "Heightfield.h"
+#include "TerrainGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const int WIDTH = 150;
+	const int HEIGHT = 97;
+	const float CELL_SIZE = 0.5f;
+	const float MISS = numeric_limits<float>::infinity();
+
+	struct Ray
+	{
+		XMFLOAT3	origin;
+		XMFLOAT3	direction;
+		float		maxDistance;
+	};
+
+	XMFLOAT3 Normalized(float x, float y, float z)
+	{
+		float length = sqrt(x * x + y * y + z * z);
+		return XMFLOAT3(x / length, y / length, z / length);
+	}
+
+	// Height of the terrain mesh, split along the same diagonal: (00, 01, 11) and (00, 11, 10)
+	float MeshHeight(const Heightfield& heightfield, float x, float z)
+	{
+		float gx = x / CELL_SIZE;
+		float gz = z / CELL_SIZE;
+		int cellX = min(max((int)floor(gx), 0), WIDTH - 2);
+		int cellZ = min(max((int)floor(gz), 0), HEIGHT - 2);
+		float fx = gx - cellX;
+		float fz = gz - cellZ;
+		float h00 = heightfield.At(cellX, cellZ);
+		float h10 = heightfield.At(cellX + 1, cellZ);
+		float h01 = heightfield.At(cellX, cellZ + 1);
+		float h11 = heightfield.At(cellX + 1, cellZ + 1);
+		if (fx <= fz)
+			return h00 + (h11 - h01) * fx + (h01 - h00) * fz;
+		return h00 + (h10 - h00) * fx + (h11 - h10) * fz;
+	}
+
+	// Where the ray meets the plane through a, b and c, if that point lies over the triangle in
+	// x and z, within tolerance
+	float IntersectTriangle(const Ray& ray, const double* a, const double* b, const double* c, double tolerance)
+	{
+		const double o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+		const double d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+		const double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		const double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		const double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		double denominator = n[0] * d[0] + n[1] * d[1] + n[2] * d[2];
+		if (denominator == 0.0)
+			return MISS;
+		double t = (n[0] * (a[0] - o[0]) + n[1] * (a[1] - o[1]) + n[2] * (a[2] - o[2])) / denominator;
+
+		// Barycentric coordinates of the point over the triangle's x/z projection
+		double px = o[0] + d[0] * t - a[0];
+		double pz = o[2] + d[2] * t - a[2];
+		double area = e1[0] * e2[2] - e1[2] * e2[0];
+		double u = (px * e2[2] - pz * e2[0]) / area;
+		double v = (e1[0] * pz - e1[2] * px) / area;
+		if (u < -tolerance || v < -tolerance || u + v > 1.0 + tolerance)
+			return MISS;
+		return (float)t;
+	}
+
+	// The nearest crossing of any triangle of the grid within [0, maxDistance], widened by the
+	// tolerance in both position and distance
+	float BruteForce(const Heightfield& heightfield, const Ray& ray, double tolerance)
+	{
+		float nearest = MISS;
+		for (int cellZ = 0; cellZ + 1 < HEIGHT; ++cellZ)
+		{
+			for (int cellX = 0; cellX + 1 < WIDTH; ++cellX)
+			{
+				double x0 = cellX * CELL_SIZE;
+				double z0 = cellZ * CELL_SIZE;
+				double v00[3] = { x0, heightfield.At(cellX, cellZ), z0 };
+				double v10[3] = { x0 + CELL_SIZE, heightfield.At(cellX + 1, cellZ), z0 };
+				double v01[3] = { x0, heightfield.At(cellX, cellZ + 1), z0 + CELL_SIZE };
+				double v11[3] = { x0 + CELL_SIZE, heightfield.At(cellX + 1, cellZ + 1), z0 + CELL_SIZE };
+				for (float t : { IntersectTriangle(ray, v00, v01, v11, tolerance), IntersectTriangle(ray, v00, v11, v10, tolerance) })
+					if (t >= -tolerance && t <= ray.maxDistance + tolerance)
+						nearest = min(nearest, t);
+			}
+		}
+		return nearest;
+	}
+
+	// Raycast against brute force: every exact crossing must be found, and a hit anywhere other
+	// than an exact crossing must at least be one within tolerance
+	struct Comparison
+	{
+		int		rays = 0;
+		int		hits = 0;
+		int		failures = 0;
+		double	nodesVisited = 0.0;
+	};
+
+	void Compare(const HeightPyramid& pyramid, const Heightfield& heightfield, const Ray& ray, Comparison& comparison)
+	{
+		const double tolerance = 1e-3;
+		float exact = BruteForce(heightfield, ray, 0.0);
+		float loose = BruteForce(heightfield, ray, tolerance);
+
+		TerrainRayHit hit;
+		bool found = pyramid.Raycast(ray.origin, ray.direction, ray.maxDistance, hit);
+		bool agrees = found ? loose != MISS && hit.distance >= loose - tolerance && hit.distance <= exact + tolerance : exact == MISS;
+		if (found)
+		{
+			// The hit point is on the ray, on the mesh, in the cell reported and faces up
+			const XMFLOAT3& p = hit.position;
+			agrees = agrees &&
+				fabs(p.x - (ray.origin.x + ray.direction.x * hit.distance)) < tolerance &&
+				fabs(p.y - (ray.origin.y + ray.direction.y * hit.distance)) < tolerance &&
+				fabs(p.z - (ray.origin.z + ray.direction.z * hit.distance)) < tolerance &&
+				fabs(p.y - MeshHeight(heightfield, p.x, p.z)) < 1e-2 &&
+				p.x >= hit.cellX * CELL_SIZE - tolerance && p.x <= (hit.cellX + 1) * CELL_SIZE + tolerance &&
+				p.z >= hit.cellZ * CELL_SIZE - tolerance && p.z <= (hit.cellZ + 1) * CELL_SIZE + tolerance &&
+				hit.normal.y > 0.0f && fabs(hit.normal.x * hit.normal.x + hit.normal.y * hit.normal.y + hit.normal.z * hit.normal.z - 1.0f) < 1e-4f;
+			comparison.hits++;
+			comparison.nodesVisited += hit.nodesVisited;
+		}
+		if (!agrees && comparison.failures++ < 5)
+			printf("ray (%g, %g, %g) + t (%g, %g, %g), max %g: raycast %s %g, brute force %g (%g loose)\n",
+				ray.origin.x, ray.origin.y, ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z, ray.maxDistance,
+				found ? "hit" : "missed", found ? hit.distance : 0.0f, exact, loose);
+		comparison.rays++;
+	}
+
+	void Report(const char* name, const Comparison& comparison)
+	{
+		printf("%-14s %5d rays, %5d hits, %.1f nodes visited per hit\n", name, comparison.rays, comparison.hits,
+			comparison.hits ? comparison.nodesVisited / comparison.hits : 0.0);
+		CHECK(comparison.failures == 0);
+	}
+}
+
+int main()
+{
+	Heightfield heightfield(WIDTH, HEIGHT, CELL_SIZE);
+	FractalTerrainSettings settings;
+	settings.seed = 28;
+	settings.baseFrequency = 1.0f / 64.0f;
+	settings.heightScale = 20.0f;
+	GenerateFractalTerrain(heightfield, settings);
+	float minHeight, maxHeight;
+	heightfield.GetMinMax(minHeight, maxHeight);
+
+	HeightPyramid pyramid;
+	pyramid.Build(heightfield);
+	CHECK(pyramid.GetLevelCount() == 9 && pyramid.GetLevelWidth(0) == WIDTH - 1 && pyramid.GetLevelHeight(0) == HEIGHT - 1);
+
+	const float sizeX = (WIDTH - 1) * CELL_SIZE;
+	const float sizeZ = (HEIGHT - 1) * CELL_SIZE;
+	mt19937 random(28);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+	auto overTerrain = [&](float margin) { return XMFLOAT3(-margin + unit(random) * (sizeX + 2 * margin), 0.0f, -margin + unit(random) * (sizeZ + 2 * margin)); };
+
+	// Steep rays from above, most of which hit, some starting off to the side
+	{
+		Comparison comparison;
+		for (int i = 0; i < 400; ++i)
+		{
+			Ray ray;
+			ray.origin = overTerrain(2.0f);
+			ray.origin.y = maxHeight + unit(random) * 20.0f;
+			ray.direction = Normalized(signedUnit(random), -0.5f - unit(random) * 1.5f, signedUnit(random));
+			ray.maxDistance = 200.0f;
+			Compare(pyramid, heightfield, ray, comparison);
+		}
+		Report("steep", comparison);
+		CHECK(comparison.hits > 250);
+	}
+
+	// Grazing rays just above the surface, close to horizontal either way
+	{
+		Comparison comparison;
+		for (int i = 0; i < 400; ++i)
+		{
+			Ray ray;
+			ray.origin = overTerrain(0.0f);
+			ray.origin.y = MeshHeight(heightfield, ray.origin.x, ray.origin.z) + 0.01f + unit(random) * 0.5f;
+			ray.direction = Normalized(signedUnit(random), signedUnit(random) * 0.02f, signedUnit(random));
+			ray.maxDistance = 200.0f;
+			Compare(pyramid, heightfield, ray, comparison);
+		}
+		Report("grazing", comparison);
+		CHECK(comparison.hits > 100 && comparison.hits < 400);
+	}
+
+	// Misses: over the top, away from the terrain, and cut short before reaching it
+	{
+		Comparison comparison;
+		for (int i = 0; i < 300; ++i)
+		{
+			Ray ray;
+			ray.origin = overTerrain(5.0f);
+			ray.origin.y = maxHeight + 0.1f + unit(random) * 5.0f;
+			ray.maxDistance = 200.0f;
+			if (i % 3 == 0)
+				ray.direction = Normalized(signedUnit(random), unit(random) * 0.5f, signedUnit(random));
+			else if (i % 3 == 1)
+			{
+				ray.origin.x = -1.0f - unit(random) * 10.0f;
+				ray.direction = Normalized(-unit(random), -unit(random), signedUnit(random));
+			}
+			else
+			{
+				ray.direction = Normalized(signedUnit(random), -1.0f, signedUnit(random));
+				ray.maxDistance = (ray.origin.y - maxHeight) * 0.9f;
+			}
+			Compare(pyramid, heightfield, ray, comparison);
+		}
+		Report("misses", comparison);
+		CHECK(comparison.hits == 0);
+	}
+
+	// Along the axes and straight down, where a direction component is exactly zero
+	{
+		Comparison comparison;
+		const XMFLOAT3 directions[] = { Normalized(1, -0.1f, 0), Normalized(-1, -0.1f, 0), Normalized(0, -0.1f, 1), Normalized(0, -0.1f, -1), XMFLOAT3(0, -1, 0), XMFLOAT3(1, 0, 0), XMFLOAT3(0, 0, -1) };
+		for (int i = 0; i < 280; ++i)
+		{
+			Ray ray;
+			ray.origin = overTerrain(i % 2 ? 0.0f : 2.0f);
+			ray.origin.y = minHeight + unit(random) * (maxHeight - minHeight + 5.0f);
+			ray.direction = directions[i % 7];
+			ray.maxDistance = 200.0f;
+			Compare(pyramid, heightfield, ray, comparison);
+		}
+		Report("axis aligned", comparison);
+	}
+
+	// Starting below the surface: the first place the ray comes up through it, or nothing
+	{
+		Comparison comparison;
+		for (int i = 0; i < 400; ++i)
+		{
+			Ray ray;
+			ray.origin = overTerrain(0.0f);
+			ray.origin.y = MeshHeight(heightfield, ray.origin.x, ray.origin.z) - 0.01f - unit(random) * (i % 2 ? 0.5f : 10.0f);
+			ray.direction = Normalized(signedUnit(random), signedUnit(random), signedUnit(random));
+			if (i % 4 == 3)
+			{
+				ray.origin.y = minHeight - 1.0f - unit(random) * 5.0f;
+				ray.direction = Normalized(signedUnit(random), 0.2f + unit(random), signedUnit(random));
+			}
+			ray.maxDistance = 200.0f;
+			Compare(pyramid, heightfield, ray, comparison);
+		}
+		Report("below", comparison);
+		CHECK(comparison.hits > 100);
+	}
+
+	// Batched heights and normals against the scalar sample, on and off the terrain
+	{
+		const int count = 103;
+		vector<float> x(count), z(count), heights(count);
+		vector<XMFLOAT3> normals(count);
+		for (int i = 0; i < count; ++i)
+		{
+			XMFLOAT3 p = overTerrain(i % 5 == 0 ? 10.0f : 0.0f);
+			x[i] = p.x;
+			z[i] = p.z;
+		}
+		x[0] = 0.0f;
+		z[0] = 0.0f;
+		x[1] = sizeX;
+		z[1] = sizeZ;
+		x[2] = sizeX * 0.5f;
+		z[2] = sizeZ;
+
+		for (int n : { count, 4, 3, 1 })
+		{
+			fill(heights.begin(), heights.end(), MISS);
+			fill(normals.begin(), normals.end(), XMFLOAT3(MISS, MISS, MISS));
+			pyramid.SampleHeights(x.data(), z.data(), heights.data(), n);
+			pyramid.SampleNormals(x.data(), z.data(), normals.data(), n);
+			for (int i = 0; i < count; ++i)
+			{
+				if (i >= n)
+				{
+					CHECK(heights[i] == MISS && normals[i].x == MISS);
+					continue;
+				}
+
+				CHECK(fabs(heights[i] - pyramid.SampleHeight(x[i], z[i])) < 1e-4f);
+				float left = pyramid.SampleHeight(x[i] - CELL_SIZE, z[i]);
+				float right = pyramid.SampleHeight(x[i] + CELL_SIZE, z[i]);
+				float down = pyramid.SampleHeight(x[i], z[i] - CELL_SIZE);
+				float up = pyramid.SampleHeight(x[i], z[i] + CELL_SIZE);
+				XMFLOAT3 normal = Normalized(left - right, 2.0f * CELL_SIZE, down - up);
+				CHECK(fabs(normals[i].x - normal.x) < 1e-4f && fabs(normals[i].y - normal.y) < 1e-4f && fabs(normals[i].z - normal.z) < 1e-4f);
+			}
+		}
+
+		// Off the terrain a point takes the height of the nearest edge
+		const float edgeX[] = { -3.0f, sizeX + 3.0f };
+		const float edgeZ[] = { -3.0f, sizeZ * 0.5f };
+		float clamped[2];
+		pyramid.SampleHeights(edgeX, edgeZ, clamped, 2);
+		CHECK(clamped[0] == heightfield.At(0, 0));
+		CHECK(fabs(clamped[1] - heightfield.SampleBilinear(WIDTH - 1, (HEIGHT - 1) * 0.5f)) < 1e-4f);
+	}
+
+	return TestResult();
+}
@@ -0,0 +1,179 @@
+// HeightmapTileCodec: tiles of every shape decode to exactly the 16-bit samples the encoder
+// quantised, through both the LZ and the raw path, re-encoding what was decoded quantises to the
+// same samples again, and a tile read back from its file decodes to the same heights bit for
+// bit. Any truncation or single damaged byte is refused rather than decoded to wrong heights.
+// Prints the time to decode a 256x256 tile.
+#include "TestCheck.h"
+
+#include "HeightmapTile.h"
+#include "Heightfield.h"
+#include "TerrainGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	Heightfield MakeFractal(int width, int height, uint32_t seed)
+	{
+		Heightfield heightfield(width, height, 0.25f);
+		FractalTerrainSettings settings;
+		settings.seed = seed;
+		GenerateFractalTerrain(heightfield, settings);
+		return heightfield;
+	}
+
+	Heightfield MakeNoise(int width, int height, mt19937& random)
+	{
+		Heightfield heightfield(width, height, 1.0f);
+		uniform_real_distribution<float> noise(-100.0f, 100.0f);
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x)
+				heightfield.At(x, y) = noise(random);
+		return heightfield;
+	}
+
+	// The encoder's quantisation, written out plainly
+	vector<uint16_t> Quantise(const Heightfield& heightfield)
+	{
+		float minHeight, maxHeight;
+		heightfield.GetMinMax(minHeight, maxHeight);
+		float scale = maxHeight > minHeight ? 65535.0f / (maxHeight - minHeight) : 0.0f;
+		vector<uint16_t> quantised;
+		for (int y = 0; y < heightfield.GetHeight(); ++y)
+			for (int x = 0; x < heightfield.GetWidth(); ++x)
+				quantised.push_back((uint16_t)min(max((heightfield.At(x, y) - minHeight) * scale + 0.5f, 0.0f), 65535.0f));
+		return quantised;
+	}
+
+	bool Decodes(HeightmapTileCodec& codec, const vector<uint8_t>& tile, size_t size)
+	{
+		Heightfield output;
+		return codec.Decode(tile.data(), size, output);
+	}
+}
+
+int main()
+{
+	mt19937 random(26);
+	HeightmapTileCodec codec;
+
+	// Every shape, including rows shorter than the 8-wide SIMD step and odd tails after it
+	struct Case
+	{
+		Heightfield		heightfield;
+		bool			compressible;
+	};
+	vector<Case> cases;
+	cases.push_back({ MakeFractal(257, 257, 1), true });
+	cases.push_back({ MakeFractal(256, 256, 2), true });
+	cases.push_back({ MakeFractal(13, 100, 3), false });
+	cases.push_back({ MakeFractal(7, 3, 4), false });
+	cases.push_back({ MakeFractal(1, 1, 5), false });
+	cases.push_back({ MakeNoise(64, 48, random), false });
+	cases.push_back({ Heightfield(33, 17, 2.0f), true });
+	cases.back().heightfield.Fill(3.5f);
+
+	for (Case& test : cases)
+	{
+		const Heightfield& source = test.heightfield;
+		vector<uint8_t> tile;
+		CHECK(codec.Encode(source, tile));
+
+		HeightmapTileHeader header;
+		vector<uint16_t> quantised;
+		CHECK(codec.DecodeQuantized(tile.data(), tile.size(), quantised, header));
+		CHECK(quantised == Quantise(source));
+		CHECK((int)header.width == source.GetWidth() && (int)header.height == source.GetHeight());
+		if (test.compressible)
+			CHECK((header.flags & HeightmapTileLZ) && header.payloadSize < header.planeSize);
+		else
+			CHECK(!(header.flags & HeightmapTileLZ) && header.payloadSize == header.planeSize);
+
+		// Heights come back within half a quantisation step
+		Heightfield decoded;
+		CHECK(codec.Decode(tile.data(), tile.size(), decoded));
+		CHECK(decoded.GetWidth() == source.GetWidth() && decoded.GetHeight() == source.GetHeight());
+		CHECK(decoded.GetCellSize() == source.GetCellSize());
+		const float step = (header.maxHeight - header.minHeight) / 65535.0f;
+		float worst = 0.0f;
+		for (int y = 0; y < source.GetHeight(); ++y)
+			for (int x = 0; x < source.GetWidth(); ++x)
+				worst = max(worst, fabs(decoded.At(x, y) - source.At(x, y)));
+		CHECK(worst <= step * 0.5f + fabs(header.maxHeight) * 1e-6f);
+
+		// Decoded heights survive another encode: the same samples, only the top one's float
+		// rounding can move the stored maximum
+		vector<uint8_t> again;
+		vector<uint16_t> requantised;
+		CHECK(codec.Encode(decoded, again));
+		CHECK(codec.DecodeQuantized(again.data(), again.size(), requantised, header));
+		CHECK(requantised == quantised);
+	}
+
+	// Truncated anywhere, or damaged in any byte, a tile is refused
+	for (size_t c : { (size_t)2, (size_t)3, (size_t)5 })
+	{
+		vector<uint8_t> tile;
+		CHECK(codec.Encode(cases[c].heightfield, tile));
+		CHECK(Decodes(codec, tile, tile.size()));
+
+		int accepted = 0;
+		for (size_t length = 0; length < tile.size(); ++length)
+			if (Decodes(codec, tile, length))
+				++accepted;
+		CHECK(accepted == 0);
+
+		accepted = 0;
+		for (size_t offset = 0; offset < tile.size(); ++offset)
+		{
+			for (uint8_t bit : { (uint8_t)0x01, (uint8_t)0x80 })
+			{
+				vector<uint8_t> damaged = tile;
+				damaged[offset] ^= bit;
+				if (Decodes(codec, damaged, damaged.size()))
+					++accepted;
+			}
+		}
+		CHECK(accepted == 0);
+	}
+
+	// Through a file, and a missing file is an error
+	{
+		const string fileName = string(TEST_OUTPUT_DIR) + "/tile.hmt";
+		CHECK(codec.SaveToFile(fileName, cases[0].heightfield));
+		Heightfield loaded;
+		CHECK(codec.LoadFromFile(fileName, loaded));
+		CHECK(loaded.GetWidth() == 257 && loaded.GetHeight() == 257);
+
+		vector<uint8_t> tile;
+		Heightfield decoded;
+		CHECK(codec.Encode(cases[0].heightfield, tile) && codec.Decode(tile.data(), tile.size(), decoded));
+		CHECK(memcmp(loaded.GetData(), decoded.GetData(), sizeof(float) * 257 * 257) == 0);
+		CHECK(!codec.LoadFromFile(string(TEST_OUTPUT_DIR) + "/missing.hmt", loaded));
+	}
+
+	// Decode time of a 256x256 terrain tile
+	{
+		vector<uint8_t> tile;
+		CHECK(codec.Encode(cases[1].heightfield, tile));
+		Heightfield output;
+		const int repeats = 200;
+		auto start = chrono::steady_clock::now();
+		for (int i = 0; i < repeats; ++i)
+			CHECK(codec.Decode(tile.data(), tile.size(), output));
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() / repeats;
+		printf("256x256: %zu bytes (%.2f bits per sample), decoded in %.1f us, %.0f Msamples/s\n",
+			tile.size(), tile.size() * 8.0 / (256 * 256), seconds * 1e6, 256 * 256 / seconds / 1e6);
+	}
+
+	return TestResult();
+}
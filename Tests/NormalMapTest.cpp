@@ -0,0 +1,146 @@
+// Normal maps are stored as BC5 and CalcBumpMap rebuilds Z from X and Y (DecodeBumpMapXY).
+// Before that they were sampled as three channels, straight from the RGBA8 file (or the DXT5
+// one for the cone), and decoded by the old DecodeBumpMap, which took Z as the stored blue
+// without the 2x - 1. Each shipped normal map is put through both paths, with the shader's maths, and
+// measured against the normal the texel encodes.
+#include "TestCheck.h"
+
+#include "BlockCompressor.h"
+#include "ImageIO.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+	struct NormalMap
+	{
+		const char*	fileName;
+		float		maxMeanDegrees;		// BC5, Balanced
+		float		maxDegrees;
+	};
+
+	// Bounds a little above what each map measures today
+	const NormalMap NORMAL_MAPS[] =
+	{
+		{ "Resources/Brick Textures/normals.dds",		0.4f,	6.5f },
+		{ "Resources/Rock Textures/rock_bump.dds",		2.0f,	25.0f },
+		{ "Resources/Crate Textures/Crate_NRM.dds",		1.3f,	16.0f },
+		{ "Resources/conenormal.dds",					0.25f,	10.0f },
+	};
+
+	float Unorm(uint8_t v)
+	{
+		return v / 255.0f;
+	}
+
+	void Normalise(float v[3])
+	{
+		const float length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int c = 0; c < 3; ++c)
+			v[c] /= length;
+	}
+
+	// The unit normal the texel encodes, in the shaders' sign convention (DecodeBumpMapXY negates
+	// X and Y); degenerate texels point straight out
+	void EncodedNormal(const uint8_t* texel, float normal[3])
+	{
+		normal[0] = -Unorm(texel[0]) * 2.0f + 1.0f;
+		normal[1] = -Unorm(texel[1]) * 2.0f + 1.0f;
+		normal[2] = -max(Unorm(texel[2]) * 2.0f - 1.0f, 0.0f);
+		if (normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] < 1e-12f)
+		{
+			normal[0] = normal[1] = 0.0f;
+			normal[2] = -1.0f;
+			return;
+		}
+		Normalise(normal);
+	}
+
+	void DecodeBumpMap(const uint8_t* texel, float normal[3])
+	{
+		normal[0] = -Unorm(texel[0]) * 2.0f + 1.0f;
+		normal[1] = -Unorm(texel[1]) * 2.0f + 1.0f;
+		normal[2] = -Unorm(texel[2]);
+		Normalise(normal);
+	}
+
+	void DecodeBumpMapXY(const uint8_t* texel, float normal[3])
+	{
+		normal[0] = -Unorm(texel[0]) * 2.0f + 1.0f;
+		normal[1] = -Unorm(texel[1]) * 2.0f + 1.0f;
+		normal[2] = -sqrt(min(max(1.0f - normal[0] * normal[0] - normal[1] * normal[1], 0.0f), 1.0f));
+		Normalise(normal);
+	}
+
+	struct AngleError
+	{
+		double		sum = 0.0;
+		float		largest = 0.0f;
+		size_t		count = 0;
+
+		void Add(const float a[3], const float b[3])
+		{
+			const float cosine = min(max(a[0] * b[0] + a[1] * b[1] + a[2] * b[2], -1.0f), 1.0f);
+			const float degrees = acos(cosine) * (180.0f / 3.14159265f);
+			sum += degrees;
+			largest = max(largest, degrees);
+			++count;
+		}
+
+		float Mean() const { return count ? (float)(sum / count) : 0.0f; }
+	};
+}
+
+int main()
+{
+	printf("%-40s %7s | %-13s | %-13s | %-13s\n", "", "", "old (RGB)", "RGBA8, XY", "BC5, XY");
+	printf("%-40s %7s | %5s %7s | %5s %7s | %5s %7s\n", "map", "size", "mean", "max", "mean", "max", "mean", "max");
+
+	for (const NormalMap& map : NORMAL_MAPS)
+	{
+		Image normals;
+		CHECK(ImageIO::LoadDDS(map.fileName, normals));
+		if (normals.GetWidth() == 0)
+			continue;
+
+		CompressedImage compressed;
+		BlockCompressor::CompressNormalMap(normals, BCQualityBalanced, compressed);
+		Image decoded;
+		BlockCompressor::Decompress(compressed, decoded);
+
+		AngleError old, uncompressed, bc5;
+		const size_t texels = (size_t)normals.GetWidth() * normals.GetHeight();
+		for (size_t i = 0; i < texels; ++i)
+		{
+			const uint8_t* texel = normals.GetData() + i * 4;
+			float encoded[3], sampled[3];
+			EncodedNormal(texel, encoded);
+
+			DecodeBumpMap(texel, sampled);
+			old.Add(encoded, sampled);
+			DecodeBumpMapXY(texel, sampled);
+			uncompressed.Add(encoded, sampled);
+			DecodeBumpMapXY(decoded.GetData() + i * 4, sampled);
+			bc5.Add(encoded, sampled);
+		}
+		printf("%-40s %3dx%-3d | %5.2f %7.2f | %5.2f %7.2f | %5.2f %7.2f\n", map.fileName, normals.GetWidth(), normals.GetHeight(),
+			old.Mean(), old.largest, uncompressed.Mean(), uncompressed.largest, bc5.Mean(), bc5.largest);
+
+		// A quarter of the RGBA8 file's bytes
+		CHECK(compressed.blocks.size() == (size_t)((normals.GetWidth() + 3) / 4) * ((normals.GetHeight() + 3) / 4) * 16);
+		CHECK(bc5.Mean() <= map.maxMeanDegrees);
+		CHECK(bc5.largest <= map.maxDegrees);
+		CHECK(bc5.Mean() < old.Mean());
+		CHECK(uncompressed.Mean() < old.Mean());
+
+		// The importer's own measure agrees with the shader's maths
+		float meanDegrees, maxDegrees;
+		BlockCompressor::NormalMapError(normals, compressed, meanDegrees, maxDegrees);
+		CHECK(fabs(meanDegrees - bc5.Mean()) < 0.01f);
+		CHECK(fabs(maxDegrees - bc5.largest) < 0.05f);
+	}
+	return TestResult();
+}
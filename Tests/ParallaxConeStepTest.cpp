@@ -0,0 +1,74 @@
+// Relaxed cone step mapping against the layered march it sits beside, on each shipped
+// displacement map: ParallaxReference::Benchmark scores both traversals against the exact
+// intersection over the same fan of rays.
+#include "TestCheck.h"
+
+#include "ConeStepMap.h"
+#include "ImageIO.h"
+#include "ParallaxReference.h"
+
+using namespace std;
+
+namespace
+{
+	struct DisplacementMap
+	{
+		const char*	fileName;
+		float		maxAverageFetches;		// cone stepping
+		float		minConverged;
+	};
+
+	// Bounds a little outside what each map measures today
+	const DisplacementMap DISPLACEMENT_MAPS[] =
+	{
+		{ "Resources/Brick Textures/displacement.dds",	4.0f,	0.98f },
+		{ "Resources/Crate Textures/Crate_DISP.dds",	6.5f,	0.95f },
+		{ "Resources/Rock Textures/rock_height.dds",	7.7f,	0.92f },
+	};
+
+	void Print(const char* name, const ParallaxBenchmark& benchmark)
+	{
+		printf("  %-8s %5.2f fetches (max %2d), error %.3f texels (max %5.2f), %5.1f%% within a texel\n", name,
+			benchmark.averageFetches, benchmark.maxFetches, benchmark.averageError, benchmark.maxError, benchmark.converged * 100.0f);
+	}
+}
+
+int main()
+{
+	for (const DisplacementMap& map : DISPLACEMENT_MAPS)
+	{
+		Image image;
+		CHECK(ImageIO::LoadDDS(map.fileName, image));
+		if (image.GetWidth() == 0)
+			continue;
+		DepthField depth;
+		depth.Load(image);
+
+		const ConeStepSettings settings;
+		Image coneMap;
+		ConeStepMap::Bake(image, settings, coneMap);
+		CHECK(coneMap.GetWidth() == settings.size && coneMap.GetHeight() == settings.size);
+		DepthField coneDepth, coneRatio;
+		coneDepth.Load(coneMap, 0);
+		coneRatio.Load(coneMap, 1);
+
+		const ParallaxBenchmark linear = ParallaxReference::Benchmark(depth, [&](const ParallaxRay& ray)
+		{
+			return ParallaxReference::TraceLinear(depth, ray);
+		});
+		const ParallaxBenchmark cone = ParallaxReference::Benchmark(depth, [&](const ParallaxRay& ray)
+		{
+			return ConeStepMap::Trace(coneDepth, coneRatio, depth, settings, ray);
+		});
+
+		printf("%s, %dx%d\n", map.fileName, depth.GetWidth(), depth.GetHeight());
+		Print("linear", linear);
+		Print("cone", cone);
+
+		CHECK(cone.rays == linear.rays && cone.rays == 64 * 64 * 40);
+		CHECK(cone.maxFetches <= settings.coneSteps + settings.binarySteps);
+		CHECK(cone.averageFetches <= map.maxAverageFetches);
+		CHECK(cone.converged >= map.minConverged);
+	}
+	return TestResult();
+}
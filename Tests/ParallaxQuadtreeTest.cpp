@@ -0,0 +1,143 @@
+// Max-height pyramids and the quadtree traversal on each shipped displacement map: the pyramid
+// must bound every texel below it, ParallaxReference::Benchmark scores the traversal against the
+// exact intersection, and ParallaxReference::StepCounts maps its fetches from one grazing
+// direction, written out as an image next to the layered march's.
+#include "TestCheck.h"
+
+#include "ImageIO.h"
+#include "MaxHeightPyramid.h"
+#include "ParallaxReference.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+using namespace std;
+
+namespace
+{
+	struct DisplacementMap
+	{
+		const char*	fileName;
+		const char*	name;
+		float		maxAverageFetches;		// quadtree
+		float		minConverged;
+	};
+
+	// Bounds a little outside what each map measures today
+	const DisplacementMap DISPLACEMENT_MAPS[] =
+	{
+		{ "Resources/Brick Textures/displacement.dds",	"brick",	7.5f,	0.97f },
+		{ "Resources/Crate Textures/Crate_DISP.dds",	"crate",	14.0f,	0.97f },
+		{ "Resources/Rock Textures/rock_height.dds",	"rock",		14.5f,	0.94f },
+	};
+
+	const int HEAT_MAP_SIZE = 128;
+
+	bool BoundsLevelBelow(const DepthField& level, const DepthField& below)
+	{
+		for (int y = 0; y < level.GetHeight(); ++y)
+		{
+			for (int x = 0; x < level.GetWidth(); ++x)
+			{
+				const float highest = min(min(below.At(x * 2, y * 2), below.At(x * 2 + 1, y * 2)), min(below.At(x * 2, y * 2 + 1), below.At(x * 2 + 1, y * 2 + 1)));
+				if (level.At(x, y) != highest)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// Fetch counts as grey levels, white at maxFetches
+	void SaveHeatMap(const string& fileName, const vector<int>& counts, int maxFetches)
+	{
+		Image image(HEAT_MAP_SIZE, HEAT_MAP_SIZE);
+		for (size_t i = 0; i < counts.size(); ++i)
+		{
+			const uint8_t grey = (uint8_t)min(counts[i] * 255 / max(maxFetches, 1), 255);
+			uint8_t* texel = image.GetData() + i * 4;
+			texel[0] = texel[1] = texel[2] = grey;
+			texel[3] = 255;
+		}
+		CHECK(ImageIO::SaveDDS(fileName, image));
+	}
+}
+
+int main()
+{
+	for (const DisplacementMap& map : DISPLACEMENT_MAPS)
+	{
+		Image image;
+		CHECK(ImageIO::LoadDDS(map.fileName, image));
+		if (image.GetWidth() == 0)
+			continue;
+		DepthField depth;
+		depth.Load(image);
+
+		vector<DepthField> levels;
+		MaxHeightPyramid::Build(depth, levels);
+		vector<Image> images;
+		MaxHeightPyramid::Build(image, images);
+		CHECK(levels.size() == images.size());
+		CHECK(levels.back().GetWidth() == 1 && levels.back().GetHeight() == 1);
+		for (size_t level = 1; level < levels.size(); ++level)
+		{
+			CHECK(levels[level].GetWidth() * 2 == levels[level - 1].GetWidth());
+			CHECK(BoundsLevelBelow(levels[level], levels[level - 1]));
+		}
+
+		const MaxHeightTraceSettings settings;
+		const ParallaxTracer quadtree = [&](const ParallaxRay& ray)
+		{
+			return MaxHeightPyramid::Trace(levels, settings, ray);
+		};
+		const ParallaxTracer linear = [&](const ParallaxRay& ray)
+		{
+			return ParallaxReference::TraceLinear(depth, ray);
+		};
+		const ParallaxBenchmark benchmark = ParallaxReference::Benchmark(depth, quadtree);
+
+		printf("%s, %dx%d, %d levels\n", map.fileName, depth.GetWidth(), depth.GetHeight(), (int)levels.size());
+		printf("  quadtree %5.2f fetches (max %2d), error %.3f texels (max %5.2f), %5.1f%% within a texel\n",
+			benchmark.averageFetches, benchmark.maxFetches, benchmark.averageError, benchmark.maxError, benchmark.converged * 100.0f);
+
+		CHECK(benchmark.maxFetches <= settings.maxSteps + settings.refineSteps);
+		CHECK(benchmark.averageFetches <= map.maxAverageFetches);
+		CHECK(benchmark.converged >= map.minConverged);
+
+		// 30 degrees above the surface, from the south-east
+		const float viewX = cos(0.5236f) * 0.8f, viewY = cos(0.5236f) * 0.6f, viewZ = sin(0.5236f);
+		vector<int> quadtreeCounts, linearCounts;
+		ParallaxReference::StepCounts(quadtree, viewX, viewY, viewZ, HEAT_MAP_SIZE, quadtreeCounts);
+		ParallaxReference::StepCounts(linear, viewX, viewY, viewZ, HEAT_MAP_SIZE, linearCounts);
+		CHECK(quadtreeCounts.size() == (size_t)HEAT_MAP_SIZE * HEAT_MAP_SIZE);
+
+		// Row by row, each the fetches of the ray through that texel centre
+		for (int y = 0; y < HEAT_MAP_SIZE; y += 17)
+		{
+			for (int x = 0; x < HEAT_MAP_SIZE; x += 13)
+			{
+				const ParallaxRay ray = ParallaxReference::MakeRay((x + 0.5f) / HEAT_MAP_SIZE, (y + 0.5f) / HEAT_MAP_SIZE, viewX, viewY, viewZ);
+				CHECK(quadtreeCounts[(size_t)y * HEAT_MAP_SIZE + x] == quadtree(ray).fetches);
+			}
+		}
+
+		int quadtreeMax = 0, linearMax = 0;
+		double quadtreeSum = 0.0, linearSum = 0.0;
+		for (size_t i = 0; i < quadtreeCounts.size(); ++i)
+		{
+			CHECK(quadtreeCounts[i] >= 1 && linearCounts[i] >= 1);
+			quadtreeMax = max(quadtreeMax, quadtreeCounts[i]);
+			linearMax = max(linearMax, linearCounts[i]);
+			quadtreeSum += quadtreeCounts[i];
+			linearSum += linearCounts[i];
+		}
+		printf("  step counts at 30 degrees: quadtree %.2f (max %d), linear %.2f (max %d)\n",
+			quadtreeSum / quadtreeCounts.size(), quadtreeMax, linearSum / linearCounts.size(), linearMax);
+
+		const int scale = max(quadtreeMax, linearMax);
+		SaveHeatMap(string(TEST_OUTPUT_DIR) + "/" + map.name + "_quadtree.dds", quadtreeCounts, scale);
+		SaveHeatMap(string(TEST_OUTPUT_DIR) + "/" + map.name + "_linear.dds", linearCounts, scale);
+	}
+	return TestResult();
+}
@@ -0,0 +1,73 @@
+// Adaptive parallax layer counts on each shipped displacement map: ParallaxQuality::
+// BenchmarkScene traces a view over a tiled floor with the adaptive and the old fixed 5 to 20
+// layers, and the adaptive count must be both cheaper and closer to the exact intersection.
+#include "TestCheck.h"
+
+#include "ImageIO.h"
+#include "ParallaxQuality.h"
+
+using namespace std;
+
+namespace
+{
+	const char* const DISPLACEMENT_MAPS[] =
+	{
+		"Resources/Brick Textures/displacement.dds",
+		"Resources/Crate Textures/Crate_DISP.dds",
+		"Resources/Rock Textures/rock_height.dds",
+	};
+
+	void Print(const char* name, const ParallaxSceneBenchmark& scene)
+	{
+		printf("  %-14s %5.1f%% faded, %5.2f layers, %5.2f fetches, error %.3f | fixed %5.2f fetches, error %.3f\n", name,
+			scene.fadedOut * 100.0f, scene.averageLayers, scene.averageFetches, scene.averageError, scene.fixedAverageFetches, scene.fixedAverageError);
+	}
+}
+
+int main()
+{
+	ParallaxQualitySettings settings;
+	CHECK(ParallaxQuality::LayerCount(settings, 0.0f, 0.0f) == settings.minLayers);
+	CHECK(ParallaxQuality::LayerCount(settings, 1000.0f, 0.0f) == settings.maxLayers);
+	CHECK(ParallaxQuality::LayerCount(settings, 40.0f, 2.0f) == 40.0f / 4.0f * settings.qualityScale);
+	CHECK(ParallaxQuality::DistanceFade(settings, settings.fadeStart) == 1.0f);
+	CHECK(ParallaxQuality::DistanceFade(settings, settings.fadeEnd) == 0.0f);
+
+	ParallaxQualitySettings noFade;
+	noFade.fadeStart = noFade.fadeEnd = 1e6f;
+	ParallaxQualitySettings finer;
+	finer.qualityScale = 4.0f;
+
+	for (const char* fileName : DISPLACEMENT_MAPS)
+	{
+		Image image;
+		CHECK(ImageIO::LoadDDS(fileName, image));
+		if (image.GetWidth() == 0)
+			continue;
+		DepthField depth;
+		depth.Load(image);
+
+		printf("%s, %dx%d\n", fileName, depth.GetWidth(), depth.GetHeight());
+		const ParallaxSceneBenchmark scene = ParallaxQuality::BenchmarkScene(depth, settings);
+		const ParallaxSceneBenchmark unfaded = ParallaxQuality::BenchmarkScene(depth, noFade);
+		const ParallaxSceneBenchmark fine = ParallaxQuality::BenchmarkScene(depth, finer);
+		Print("default", scene);
+		Print("no fade", unfaded);
+		Print("quality 4", fine);
+
+		CHECK(scene.pixels > 0 && scene.pixels == unfaded.pixels);
+		CHECK(scene.fadedOut > 0.05f && scene.fadedOut < 0.15f);
+		CHECK(scene.averageLayers >= settings.minLayers && scene.averageLayers <= settings.maxLayers);
+
+		// Cheaper and closer than the fixed layers
+		CHECK(scene.averageFetches < scene.fixedAverageFetches);
+		CHECK(scene.averageError < scene.fixedAverageError);
+
+		// Fading is what makes the distance free; more layers per texel buy accuracy
+		CHECK(unfaded.fadedOut == 0.0f);
+		CHECK(unfaded.averageFetches > scene.averageFetches);
+		CHECK(fine.averageLayers > scene.averageLayers);
+		CHECK(fine.averageError <= scene.averageError);
+	}
+	return TestResult();
+}
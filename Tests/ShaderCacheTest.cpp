@@ -0,0 +1,212 @@
+// ShaderCache with a stand-in compiler: the "bytecode" is the request and source it was given,
+// so a hit can be told from a compile by what comes back, and any source holding #error fails.
+#include "TestCheck.h"
+
+#include "ShaderCache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const string DIRECTORY = string(TEST_OUTPUT_DIR) + "/";
+	const string CACHE_FILE = DIRECTORY + "shaders.bin";
+	const string SHADER_FILE = DIRECTORY + "shader.fx";
+	const string COMPILER_TAG = "stub 1.0 /O3";
+
+	atomic<int> g_compiles(0);
+
+	bool StubCompile(const ShaderRequest& request, const string& source, vector<uint8_t>& code, string& errors)
+	{
+		++g_compiles;
+		if (source.find("#error") != string::npos)
+		{
+			errors = request.file + ": #error";
+			return false;
+		}
+		const string text = ShaderCache::Identity(request) + "\n" + source;
+		code.assign(text.begin(), text.end());
+		return true;
+	}
+
+	void WriteFile(const string& fileName, const string& contents)
+	{
+		ofstream file(fileName, ios::binary | ios::trunc);
+		file << contents;
+	}
+
+	string ReadFile(const string& fileName)
+	{
+		ifstream file(fileName, ios::binary);
+		return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	}
+
+	bool Contains(const ShaderBytecode& result, const string& text)
+	{
+		return string(result.code.begin(), result.code.end()).find(text) != string::npos;
+	}
+
+	// One run of the application: open the cache, load everything, save it back
+	struct Run
+	{
+		bool					opened = false;
+		bool					loaded = false;
+		vector<ShaderBytecode>	results;
+		ShaderCacheStats		stats;
+		size_t					entryCount = 0;
+		int						compiles = 0;
+
+		explicit Run(const vector<ShaderRequest>& requests)
+		{
+			ShaderCache cache(CACHE_FILE, StubCompile, COMPILER_TAG);
+			opened = cache.Open();
+			g_compiles = 0;
+			loaded = cache.Load(requests, results);
+			compiles = g_compiles;
+			stats = cache.GetStats();
+			entryCount = cache.GetEntryCount();
+			CHECK(cache.Save());
+		}
+	};
+
+	ShaderRequest Request(const string& entryPoint, const string& mode)
+	{
+		ShaderRequest request;
+		request.file = SHADER_FILE;
+		request.entryPoint = entryPoint;
+		request.profile = "ps_4_0";
+		request.defines.push_back({ "MODE", mode });
+		return request;
+	}
+}
+
+int main()
+{
+	mkdir((DIRECTORY + "include").c_str(), 0755);
+	remove(CACHE_FILE.c_str());
+	WriteFile(SHADER_FILE, "#include \"include/lighting.fxh\"\nfloat4 PS() : SV_Target { return Light(); }\n");
+	WriteFile(DIRECTORY + "include/lighting.fxh", "#include <common.fxh>\nfloat4 Light() { return 1; }\n");
+	WriteFile(DIRECTORY + "include/common.fxh", "// version 1\n");
+
+	vector<ShaderRequest> requests;
+	for (int mode = 0; mode < 8; ++mode)
+		requests.push_back(Request("PS", to_string(mode)));
+	const size_t count = requests.size();
+
+	// Cold: no cache file, everything compiled
+	{
+		Run run(requests);
+		CHECK(!run.opened);
+		CHECK(run.loaded);
+		CHECK(run.compiles == (int)count && run.stats.compiled == (int)count && run.stats.hits == 0);
+		CHECK(run.entryCount == count);
+		for (const ShaderBytecode& result : run.results)
+			CHECK(result.valid && !result.fromCache && Contains(result, "|PS|ps_4_0|MODE="));
+	}
+
+	// Warm: everything from the file, the same bytecode, nothing compiled
+	const string saved = ReadFile(CACHE_FILE);
+	{
+		Run run(requests);
+		CHECK(run.opened);
+		CHECK(run.loaded);
+		CHECK(run.compiles == 0 && run.stats.hits == (int)count);
+		for (size_t i = 0; i < count; ++i)
+			CHECK(run.results[i].valid && run.results[i].fromCache && Contains(run.results[i], "MODE=" + to_string(i)));
+		CHECK(ReadFile(CACHE_FILE) == saved);
+	}
+
+	// An edit two includes down invalidates every entry, in place
+	WriteFile(DIRECTORY + "include/common.fxh", "// version 2\n");
+	{
+		Run run(requests);
+		CHECK(run.loaded);
+		CHECK(run.compiles == (int)count && run.stats.invalidated == (int)count && run.stats.hits == 0);
+		CHECK(run.entryCount == count);
+	}
+	CHECK(ReadFile(CACHE_FILE) != saved && !ifstream(CACHE_FILE + ".tmp"));
+	CHECK(Run(requests).compiles == 0);
+
+	// A changed define is a new identity: compiled and added, the rest still hit
+	requests[3].defines[0].value = "99";
+	{
+		Run run(requests);
+		CHECK(run.loaded);
+		CHECK(run.compiles == 1 && run.stats.hits == (int)count - 1 && run.stats.invalidated == 0);
+		CHECK(run.entryCount == count + 1);
+		CHECK(!run.results[3].fromCache && Contains(run.results[3], "MODE=99"));
+	}
+	CHECK(Run(requests).compiles == 0);
+
+	// A missing source falls back to the last bytecode built for it; with none, the load fails
+	rename(SHADER_FILE.c_str(), (SHADER_FILE + ".moved").c_str());
+	{
+		Run run(requests);
+		CHECK(run.loaded);
+		CHECK(run.compiles == 0 && run.stats.fallbacks == (int)count);
+		for (const ShaderBytecode& result : run.results)
+			CHECK(result.valid && result.fromCache);
+
+		vector<ShaderRequest> unknown = { Request("PS", "new") };
+		Run missing(unknown);
+		CHECK(!missing.loaded);
+		CHECK(missing.compiles == 0 && missing.stats.failed == 1);
+		CHECK(!missing.results[0].valid && !missing.results[0].errors.empty());
+	}
+	rename((SHADER_FILE + ".moved").c_str(), SHADER_FILE.c_str());
+
+	// A truncated file is thrown away and everything rebuilt
+	const string good = ReadFile(CACHE_FILE);
+	const vector<ShaderBytecode> expected = Run(requests).results;
+	for (size_t length = 0; length < good.size(); ++length)
+	{
+		WriteFile(CACHE_FILE, good.substr(0, length));
+		Run run(requests);
+		CHECK(!run.opened);
+		CHECK(run.loaded && run.compiles == (int)count && run.entryCount == count);
+	}
+
+	// Damage anywhere never serves the wrong bytecode: a damaged entry throws the file away, and
+	// the only bytes outside the checksums (the header's flags) change nothing
+	for (size_t offset = 0; offset < good.size(); ++offset)
+	{
+		string damaged = good;
+		damaged[offset] ^= 0x20;
+		WriteFile(CACHE_FILE, damaged);
+		Run run(requests);
+		CHECK(run.loaded);
+		CHECK(run.opened ? run.compiles == 0 : run.compiles == (int)count);
+		for (size_t i = 0; i < count; ++i)
+			CHECK(run.results[i].code == expected[i].code);
+	}
+	CHECK(Run(requests).compiles == 0);
+
+	// A failed compile reports its errors and is never cached, so it is tried again next time
+	requests.push_back(Request("Broken", "0"));
+	requests.back().file = DIRECTORY + "broken.fx";
+	WriteFile(requests.back().file, "#error not finished\n");
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		Run run(requests);
+		CHECK(!run.loaded);
+		CHECK(run.compiles == 1 && run.stats.failed == 1 && run.stats.hits == (int)count);
+		CHECK(run.entryCount == count);
+		CHECK(!run.results.back().valid && !run.results.back().fromCache && run.results.back().errors.find("#error") != string::npos);
+	}
+	WriteFile(requests.back().file, "float4 Broken() : SV_Target { return 0; }\n");
+	{
+		Run run(requests);
+		CHECK(run.loaded);
+		CHECK(run.compiles == 1 && run.entryCount == count + 1);
+	}
+	CHECK(Run(requests).compiles == 0);
+
+	return TestResult();
+}
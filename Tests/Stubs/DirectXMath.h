@@ -0,0 +1,35 @@
+#pragma once
+
+// Just the DirectXMath storage types the portable modules use, so they build without the SDK.
+// Nothing here does any maths; code that needs XMVECTOR operations stays out of the tests.
+namespace DirectX
+{
+	const float XM_PI = 3.141592654f;
+	const float XM_PIDIV2 = 1.570796327f;
+
+	struct XMFLOAT2
+	{
+		float x, y;
+		XMFLOAT2() = default;
+		XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+	};
+
+	struct XMFLOAT3
+	{
+		float x, y, z;
+		XMFLOAT3() = default;
+		XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+	};
+
+	struct XMFLOAT4
+	{
+		float x, y, z, w;
+		XMFLOAT4() = default;
+		XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	};
+
+	struct XMFLOAT4X4
+	{
+		float m[4][4];
+	};
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+// Stand-in for the parts of the Windows and D3D11 headers the device-side texture code uses,
+// so it builds off Windows. Interfaces are plain reference-counted objects: textures keep
+// their description, views the resource they were made from, and LiveObjects counts whatever
+// has not been released yet so tests can check nothing leaks. Devices and contexts are opaque;
+// the tests pass nullptr and supply the upload functions themselves.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+typedef int32_t		HRESULT;
+typedef uint32_t	DWORD;
+typedef unsigned int	UINT;
+
+#define S_OK					((HRESULT)0)
+#define E_FAIL					((HRESULT)0x80004005L)
+#define E_INVALIDARG			((HRESULT)0x80070057L)
+#define E_OUTOFMEMORY			((HRESULT)0x8007000EL)
+#define E_NOINTERFACE			((HRESULT)0x80004002L)
+#define SUCCEEDED(hr)			((HRESULT)(hr) >= 0)
+#define FAILED(hr)				((HRESULT)(hr) < 0)
+#define ERROR_SUCCESS			0L
+#define HRESULT_FROM_WIN32(x)	((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000))
+#define __uuidof(x)				0
+
+inline DWORD GetLastError() { return ERROR_SUCCESS; }
+
+// Source annotations used by DDSTextureLoader.h
+#define _In_
+#define _In_opt_
+#define _In_z_
+#define _In_reads_bytes_(size)
+#define _Out_opt_
+#define _Outptr_opt_
+
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R32G32B32A32_FLOAT = 2,
+	DXGI_FORMAT_R32G32B32A32_UINT = 3,
+	DXGI_FORMAT_R16G16B16A16_FLOAT = 10,
+	DXGI_FORMAT_R16G16B16A16_UNORM = 11,
+	DXGI_FORMAT_R32G32_FLOAT = 16,
+	DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+	DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+	DXGI_FORMAT_R8G8B8A8_UINT = 30,
+	DXGI_FORMAT_R16G16_FLOAT = 34,
+	DXGI_FORMAT_R16G16_UNORM = 35,
+	DXGI_FORMAT_R32_FLOAT = 41,
+	DXGI_FORMAT_R8G8_UNORM = 49,
+	DXGI_FORMAT_R16_FLOAT = 54,
+	DXGI_FORMAT_R16_UNORM = 56,
+	DXGI_FORMAT_R8_UNORM = 61,
+	DXGI_FORMAT_A8_UNORM = 65,
+	DXGI_FORMAT_BC1_TYPELESS = 70,
+	DXGI_FORMAT_BC1_UNORM = 71,
+	DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+	DXGI_FORMAT_BC2_UNORM = 74,
+	DXGI_FORMAT_BC2_UNORM_SRGB = 75,
+	DXGI_FORMAT_BC3_UNORM = 77,
+	DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+	DXGI_FORMAT_BC4_UNORM = 80,
+	DXGI_FORMAT_BC4_SNORM = 81,
+	DXGI_FORMAT_BC5_UNORM = 83,
+	DXGI_FORMAT_BC5_SNORM = 84,
+	DXGI_FORMAT_B5G6R5_UNORM = 85,
+	DXGI_FORMAT_B8G8R8A8_UNORM = 87,
+	DXGI_FORMAT_BC6H_TYPELESS = 94,
+	DXGI_FORMAT_BC7_UNORM = 98,
+	DXGI_FORMAT_BC7_UNORM_SRGB = 99,
+};
+
+enum D3D11_USAGE
+{
+	D3D11_USAGE_DEFAULT = 0,
+	D3D11_USAGE_IMMUTABLE = 1,
+	D3D11_USAGE_DYNAMIC = 2,
+	D3D11_USAGE_STAGING = 3,
+};
+
+enum D3D11_BIND_FLAG
+{
+	D3D11_BIND_SHADER_RESOURCE = 0x8,
+};
+
+enum D3D11_RESOURCE_DIMENSION
+{
+	D3D11_RESOURCE_DIMENSION_TEXTURE2D = 3,
+};
+
+enum D3D11_RESOURCE_MISC_FLAG
+{
+	D3D11_RESOURCE_MISC_TEXTURECUBE = 0x4,
+};
+
+struct DXGI_SAMPLE_DESC
+{
+	UINT			Count;
+	UINT			Quality;
+};
+
+struct D3D11_TEXTURE2D_DESC
+{
+	UINT			Width;
+	UINT			Height;
+	UINT			MipLevels;
+	UINT			ArraySize;
+	DXGI_FORMAT		Format;
+	DXGI_SAMPLE_DESC	SampleDesc;
+	D3D11_USAGE		Usage;
+	UINT			BindFlags;
+	UINT			CPUAccessFlags;
+	UINT			MiscFlags;
+};
+
+namespace D3D11Stub
+{
+	inline std::atomic<int>& LiveObjects()
+	{
+		static std::atomic<int> live(0);
+		return live;
+	}
+}
+
+struct IUnknown
+{
+	IUnknown() { ++D3D11Stub::LiveObjects(); }
+	virtual ~IUnknown() { --D3D11Stub::LiveObjects(); }
+
+	unsigned long AddRef() { return ++m_references; }
+	unsigned long Release()
+	{
+		const long references = --m_references;
+		if (references == 0)
+			delete this;
+		return references;
+	}
+
+private:
+	std::atomic<long>	m_references{ 1 };
+};
+
+struct ID3D11Device;
+struct ID3D11DeviceContext;
+
+struct ID3D11Resource : IUnknown
+{
+	// Only textures are ever asked for
+	HRESULT QueryInterface(int, void** object)
+	{
+		AddRef();
+		*object = this;
+		return S_OK;
+	}
+};
+
+struct ID3D11Texture2D : ID3D11Resource
+{
+	D3D11_TEXTURE2D_DESC	desc = {};
+
+	void GetDesc(D3D11_TEXTURE2D_DESC* out) const { *out = desc; }
+};
+
+struct ID3D11ShaderResourceView : IUnknown
+{
+	explicit ID3D11ShaderResourceView(ID3D11Resource* resource) : m_resource(resource) { resource->AddRef(); }
+	~ID3D11ShaderResourceView() { m_resource->Release(); }
+
+	void GetResource(ID3D11Resource** resource) const
+	{
+		m_resource->AddRef();
+		*resource = m_resource;
+	}
+
+private:
+	ID3D11Resource*		m_resource;
+};
@@ -0,0 +1,149 @@
+// Sculpting rebuilds only what an edit touched: HeightPyramid::UpdateRegion refreshes the nodes
+// over the changed samples and Terrain::UpdateRegion recomputes the vertices
+// TerrainMesh::GetChunkRegion names. After every batch of random brush dabs both must equal a
+// rebuild of the same heightfield from scratch, bit for bit.
+#include "TestCheck.h"
+
+#include "HeightPyramid.h"
+#include "Heightfield.h"
+#include "TerrainBrush.h"
+#include "TerrainGenerator.h"
+#include "TerrainMesh.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const int CHUNKS_PER_SIDE = 6;
+	const int CHUNK_QUADS = 32;
+	const float CELL_SIZE = 0.5f;
+	const float TEXTURE_REPEAT = 16.0f;
+
+	struct Chunk
+	{
+		int						x0;
+		int						z0;
+		vector<SimpleVertex>	vertices;
+	};
+
+	// What Terrain::UpdateRegion does, with the vertex buffer upload replaced by a copy
+	void UpdateRegion(const Heightfield& heightfield, HeightPyramid& pyramid, vector<Chunk>& chunks, const DirtyRect& samples)
+	{
+		pyramid.UpdateRegion(samples.x0, samples.y0, samples.x1, samples.y1);
+
+		const int stride = CHUNK_QUADS + 1;
+		for (Chunk& chunk : chunks)
+		{
+			DirtyRect vertices = TerrainMesh::GetChunkRegion(samples, heightfield.GetWidth(), heightfield.GetHeight(), chunk.x0, chunk.z0, CHUNK_QUADS);
+			for (int z = vertices.y0; z <= vertices.y1; ++z)
+				for (int x = vertices.x0; x <= vertices.x1; ++x)
+					TerrainMesh::ComputeVertex(heightfield, CELL_SIZE, TEXTURE_REPEAT, x, z, chunk.vertices[(size_t)(z - chunk.z0) * stride + (x - chunk.x0)]);
+		}
+	}
+
+	bool PyramidsEqual(const HeightPyramid& a, const HeightPyramid& b)
+	{
+		if (a.GetLevelCount() != b.GetLevelCount())
+			return false;
+		for (int level = 0; level < a.GetLevelCount(); ++level)
+		{
+			if (a.GetLevelWidth(level) != b.GetLevelWidth(level) || a.GetLevelHeight(level) != b.GetLevelHeight(level))
+				return false;
+			for (int z = 0; z < a.GetLevelHeight(level); ++z)
+			{
+				for (int x = 0; x < a.GetLevelWidth(level); ++x)
+				{
+					float minA, maxA, minB, maxB;
+					a.GetRange(level, x, z, minA, maxA);
+					b.GetRange(level, x, z, minB, maxB);
+					if (minA != minB || maxA != maxB)
+						return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	int CountDifferentVertices(const Heightfield& heightfield, const vector<Chunk>& chunks)
+	{
+		int different = 0;
+		vector<SimpleVertex> rebuilt;
+		for (const Chunk& chunk : chunks)
+		{
+			TerrainMesh::BuildChunkVertices(heightfield, CELL_SIZE, TEXTURE_REPEAT, chunk.x0, chunk.z0, CHUNK_QUADS, rebuilt);
+			for (size_t i = 0; i < rebuilt.size(); ++i)
+				different += memcmp(&rebuilt[i], &chunk.vertices[i], sizeof(SimpleVertex)) != 0;
+		}
+		return different;
+	}
+}
+
+int main()
+{
+	const int samples = CHUNKS_PER_SIDE * CHUNK_QUADS + 1;
+	Heightfield heightfield(samples, samples, CELL_SIZE);
+	GenerateFractalTerrain(heightfield, FractalTerrainSettings());
+
+	HeightPyramid pyramid;
+	pyramid.Build(heightfield);
+	vector<Chunk> chunks;
+	for (int cz = 0; cz < CHUNKS_PER_SIDE; ++cz)
+	{
+		for (int cx = 0; cx < CHUNKS_PER_SIDE; ++cx)
+		{
+			Chunk chunk;
+			chunk.x0 = cx * CHUNK_QUADS;
+			chunk.z0 = cz * CHUNK_QUADS;
+			TerrainMesh::BuildChunkVertices(heightfield, CELL_SIZE, TEXTURE_REPEAT, chunk.x0, chunk.z0, CHUNK_QUADS, chunk.vertices);
+			chunks.push_back(chunk);
+		}
+	}
+
+	// Dabs of every mode and size, including ones hanging over the edges and corners
+	const float extent = (samples - 1) * CELL_SIZE;
+	mt19937 random(29);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	int dabs = 0;
+	for (int batch = 0; batch < 40; ++batch)
+	{
+		for (int i = 0; i < 10; ++i)
+		{
+			BrushSettings brush;
+			brush.mode = (int)(random() % 4);
+			brush.radius = 0.3f + unit(random) * 12.0f;
+			brush.strength = 0.5f + unit(random) * 8.0f;
+			brush.falloff = unit(random);
+			brush.flattenHeight = unit(random) * 20.0f;
+			float x = -brush.radius + unit(random) * (extent + 2.0f * brush.radius);
+			float z = -brush.radius + unit(random) * (extent + 2.0f * brush.radius);
+
+			DirtyRect changed = ApplyTerrainBrush(heightfield, x, z, brush, 1.0f / 30.0f);
+			if (changed.IsEmpty())
+				continue;
+			UpdateRegion(heightfield, pyramid, chunks, changed);
+			++dabs;
+		}
+
+		HeightPyramid rebuilt;
+		rebuilt.Build(heightfield);
+		CHECK(PyramidsEqual(pyramid, rebuilt));
+		CHECK(CountDifferentVertices(heightfield, chunks) == 0);
+	}
+	CHECK(dabs > 300);
+
+	// The comparison does catch an edit left out of the update
+	BrushSettings brush;
+	brush.radius = 3.0f;
+	ApplyTerrainBrush(heightfield, extent * 0.5f, extent * 0.5f, brush, 1.0f);
+	HeightPyramid rebuilt;
+	rebuilt.Build(heightfield);
+	CHECK(!PyramidsEqual(pyramid, rebuilt));
+	CHECK(CountDifferentVertices(heightfield, chunks) > 0);
+
+	printf("%d dabs\n", dabs);
+	return TestResult();
+}
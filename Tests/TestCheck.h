@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdio>
+
+// The headless tests are plain executables: a failed CHECK prints where it failed and the test
+// carries on, and main returns TestResult() so ctest sees any failure.
+namespace TestCheck
+{
+	inline int& Failures()
+	{
+		static int failures = 0;
+		return failures;
+	}
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			++TestCheck::Failures(); \
+		} \
+	} while (0)
+
+inline int TestResult()
+{
+	if (TestCheck::Failures() != 0)
+	{
+		std::printf("%d checks failed\n", TestCheck::Failures());
+		return 1;
+	}
+	std::printf("passed\n");
+	return 0;
+}
@@ -0,0 +1,292 @@
+// AtlasBuilder placement, in clamp and wrap gutter modes, for textures whose sizes are and are not
+// whole texels of the last level: at every level each texture's rectangle lands on whole texels,
+// holds that level of its own chain, and is ringed by a gutter that repeats its edge or continues
+// from the opposite one, so a bilinear tap anywhere in it never reaches another texture. A mesh
+// remapped by RemapTexCoords, or through BuildLookupTable, samples the same as its own texture.
+#include "TestCheck.h"
+
+#include "Image.h"
+#include "MipGenerator.h"
+#include "SimpleVertex.h"
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// Textures, the atlas's expected chains and a bilinear sampler
+namespace
+{
+	// Random colour with an alpha that names the texture, which every level of its chain keeps
+	Image MakeTexture(int width, int height, int id, mt19937& random)
+	{
+		Image image(width, height);
+		uniform_int_distribution<int> texel(0, 255);
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				uint8_t* p = image.At(x, y);
+				p[0] = (uint8_t)texel(random);
+				p[1] = (uint8_t)texel(random);
+				p[2] = (uint8_t)texel(random);
+				p[3] = (uint8_t)(8 + id * 8);
+			}
+		}
+		return image;
+	}
+
+	bool SameTexel(const uint8_t* a, const uint8_t* b)
+	{
+		return memcmp(a, b, 4) == 0;
+	}
+
+	int Wrap(int value, int size)
+	{
+		value %= size;
+		return value < 0 ? value + size : value;
+	}
+
+	// Channel c at (u, v), as a linear sampler with wrap or clamp addressing would return it
+	float Sample(const Image& image, float u, float v, int c, bool wrap)
+	{
+		const int width = image.GetWidth();
+		const int height = image.GetHeight();
+		float x = u * width - 0.5f;
+		float y = v * height - 0.5f;
+		int x0 = (int)floor(x);
+		int y0 = (int)floor(y);
+		float fx = x - x0;
+		float fy = y - y0;
+
+		auto fetch = [&](int tx, int ty)
+		{
+			tx = wrap ? Wrap(tx, width) : min(max(tx, 0), width - 1);
+			ty = wrap ? Wrap(ty, height) : min(max(ty, 0), height - 1);
+			return (float)image.At(tx, ty)[c];
+		};
+		float top = fetch(x0, y0) + (fetch(x0 + 1, y0) - fetch(x0, y0)) * fx;
+		float bottom = fetch(x0, y0 + 1) + (fetch(x0 + 1, y0 + 1) - fetch(x0, y0 + 1)) * fx;
+		return top + (bottom - top) * fy;
+	}
+
+	// The scatter rock: a squashed octahedron with each face's corners at (0.5, 0), (0, 1), (1, 1)
+	vector<SimpleVertex> MakeRock()
+	{
+		const float corners[6][3] = { { 1, 0, 0 }, { 0, 0, 1 }, { -1, 0, 0 }, { 0, 0, -1 }, { 0, 0.7f, 0 }, { 0, -0.7f, 0 } };
+		const int faces[8][3] = { { 4, 1, 0 }, { 4, 2, 1 }, { 4, 3, 2 }, { 4, 0, 3 }, { 5, 0, 1 }, { 5, 1, 2 }, { 5, 2, 3 }, { 5, 3, 0 } };
+		const float uvs[3][2] = { { 0.5f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f } };
+
+		vector<SimpleVertex> vertices;
+		for (const auto& face : faces)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				SimpleVertex vertex = {};
+				vertex.Pos = DirectX::XMFLOAT3(corners[face[corner]][0], corners[face[corner]][1], corners[face[corner]][2]);
+				vertex.TexCoord = DirectX::XMFLOAT2(uvs[corner][0], uvs[corner][1]);
+				vertices.push_back(vertex);
+			}
+		}
+		return vertices;
+	}
+}
+
+int main()
+{
+	mt19937 random(48);
+
+	// Sizes that are whole texels of the last level (16 at level 0) and sizes that are not
+	const int sizes[][2] = { { 64, 64 }, { 50, 30 }, { 17, 90 }, { 128, 40 }, { 1, 1 }, { 33, 33 }, { 100, 7 }, { 16, 48 }, { 90, 90 }, { 75, 120 }, { 31, 64 }, { 200, 13 } };
+	const int count = (int)(sizeof(sizes) / sizeof(sizes[0]));
+	vector<Image> images;
+	for (int i = 0; i < count; ++i)
+		images.push_back(MakeTexture(sizes[i][0], sizes[i][1], i, random));
+
+	for (AtlasGutter mode : { AtlasGutterClamp, AtlasGutterWrap })
+	{
+		const bool wrap = mode == AtlasGutterWrap;
+		AtlasSettings settings;
+		settings.pageSize = 256;
+		settings.mipCount = 5;
+		settings.gutter = 1;
+		settings.gutterMode = mode;
+		const int unit = 1 << (settings.mipCount - 1);
+
+		TextureAtlas atlas;
+		int placed = AtlasBuilder::Build(images.data(), count, settings, atlas);
+		CHECK(placed == count);
+		CHECK(atlas.pageCount >= 2);
+		CHECK((int)atlas.pages.size() == atlas.pageCount * settings.mipCount);
+
+		// Each texture's chain as the atlas should hold it, made from the size it was rounded up to
+		vector<vector<Image>> chains(count);
+		for (int i = 0; i < count; ++i)
+		{
+			const AtlasEntry& entry = atlas.entries[i];
+			CHECK(entry.width % unit == 0 && entry.width >= sizes[i][0] && entry.width < sizes[i][0] + unit);
+			CHECK(entry.height % unit == 0 && entry.height >= sizes[i][1] && entry.height < sizes[i][1] + unit);
+			if (entry.width == sizes[i][0] && entry.height == sizes[i][1])
+				MipGenerator::Generate(images[i], settings.mipSettings, chains[i]);
+			else
+				MipGenerator::Generate(images[i].Resampled(entry.width, entry.height, wrap), settings.mipSettings, chains[i]);
+			CHECK((int)chains[i].size() >= settings.mipCount);
+		}
+
+		// Every level: whole-texel rectangles, their own chain inside, the right gutter around
+		// them, and no texel of a texture's bilinear footprint belonging to another
+		for (int mip = 0; mip < settings.mipCount; ++mip)
+		{
+			const int levelSize = settings.pageSize >> mip;
+			const int gutter = (settings.gutter * unit) >> mip;
+			CHECK(gutter >= 1);
+
+			vector<vector<int>> owner(atlas.pageCount, vector<int>((size_t)levelSize * levelSize, -1));
+			for (int i = 0; i < count; ++i)
+			{
+				const AtlasEntry& entry = atlas.entries[i];
+				const Image& level = atlas.pages[(size_t)entry.page * settings.mipCount + mip];
+				CHECK(level.GetWidth() == levelSize && level.GetHeight() == levelSize);
+
+				float u0 = entry.offsetU * levelSize, u1 = (entry.offsetU + entry.scaleU) * levelSize;
+				float v0 = entry.offsetV * levelSize, v1 = (entry.offsetV + entry.scaleV) * levelSize;
+				CHECK(u0 == floor(u0) && u1 == floor(u1) && v0 == floor(v0) && v1 == floor(v1));
+				const int x = (int)u0, y = (int)v0, width = (int)u1 - x, height = (int)v1 - y;
+				const Image& expected = chains[i][mip];
+				CHECK(width == expected.GetWidth() && height == expected.GetHeight());
+				CHECK(x - gutter >= 0 && y - gutter >= 0 && x + width + gutter <= levelSize && y + height + gutter <= levelSize);
+
+				int contentErrors = 0, gutterErrors = 0, overlaps = 0;
+				for (int row = -gutter; row < height + gutter; ++row)
+				{
+					for (int column = -gutter; column < width + gutter; ++column)
+					{
+						int& own = owner[entry.page][(size_t)(y + row) * levelSize + x + column];
+						if (own != -1)
+							++overlaps;
+						own = i;
+
+						const uint8_t* texel = level.At(x + column, y + row);
+						int sx = wrap ? Wrap(column, width) : min(max(column, 0), width - 1);
+						int sy = wrap ? Wrap(row, height) : min(max(row, 0), height - 1);
+						bool inside = column >= 0 && column < width && row >= 0 && row < height;
+						if (!SameTexel(texel, expected.At(sx, sy)))
+							++(inside ? contentErrors : gutterErrors);
+					}
+				}
+				CHECK(contentErrors == 0);
+				CHECK(gutterErrors == 0);
+				CHECK(overlaps == 0);
+
+				// The farthest texels a bilinear tap within the rectangle reaches are one outside it
+				for (int row = -1; row <= height; ++row)
+					for (int column = -1; column <= width; ++column)
+						if (level.At(x + column, y + row)[3] != 8 + i * 8)
+							++gutterErrors;
+				CHECK(gutterErrors == 0);
+			}
+		}
+
+		// Level 0 of the textures that needed no rounding is exactly the texture
+		for (int i = 0; i < count; ++i)
+		{
+			const AtlasEntry& entry = atlas.entries[i];
+			if (entry.width != sizes[i][0] || entry.height != sizes[i][1])
+				continue;
+			const Image& level = atlas.pages[(size_t)entry.page * settings.mipCount];
+			int errors = 0;
+			for (int y = 0; y < entry.height; ++y)
+				if (memcmp(level.At(entry.x, entry.y + y), images[i].GetRow(y), (size_t)entry.width * 4) != 0)
+					++errors;
+			CHECK(errors == 0);
+		}
+
+		// The rock mesh moved into each texture's rectangle, by RemapTexCoords and by the lookup
+		// table a shader would index, samples at every level as its own texture does
+		vector<float> table;
+		AtlasBuilder::BuildLookupTable(atlas, table);
+		CHECK(table.size() == (size_t)count * 8);
+
+		const vector<SimpleVertex> rock = MakeRock();
+		uniform_real_distribution<float> unit01(0.0f, 1.0f);
+		for (int i = 0; i < count; ++i)
+		{
+			const AtlasEntry& entry = atlas.entries[i];
+			const float* row = &table[(size_t)i * 8];
+			CHECK(row[4] == (float)entry.page);
+
+			vector<SimpleVertex> vertices = rock;
+			CHECK(AtlasBuilder::RemapTexCoords(vertices.data(), vertices.size(), sizeof(SimpleVertex), offsetof(SimpleVertex, TexCoord), entry));
+
+			float worst = 0.0f;
+			for (size_t face = 0; face < vertices.size(); face += 3)
+			{
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					const SimpleVertex& original = rock[face + corner];
+					const SimpleVertex& moved = vertices[face + corner];
+					CHECK(moved.Pos.x == original.Pos.x && moved.Pos.y == original.Pos.y && moved.Pos.z == original.Pos.z);
+					CHECK(moved.TexCoord.x == original.TexCoord.x * row[0] + row[2]);
+					CHECK(moved.TexCoord.y == original.TexCoord.y * row[1] + row[3]);
+				}
+
+				// Points across the face, interpolated as the rasteriser would
+				for (int sample = 0; sample < 16; ++sample)
+				{
+					float a = unit01(random), b = unit01(random);
+					if (a + b > 1.0f)
+					{
+						a = 1.0f - a;
+						b = 1.0f - b;
+					}
+					const float weights[3] = { 1.0f - a - b, a, b };
+					float u = 0, v = 0, atlasU = 0, atlasV = 0;
+					for (int corner = 0; corner < 3; ++corner)
+					{
+						u += rock[face + corner].TexCoord.x * weights[corner];
+						v += rock[face + corner].TexCoord.y * weights[corner];
+						atlasU += vertices[face + corner].TexCoord.x * weights[corner];
+						atlasV += vertices[face + corner].TexCoord.y * weights[corner];
+					}
+
+					for (int mip = 0; mip < settings.mipCount; ++mip)
+					{
+						const Image& level = atlas.pages[(size_t)entry.page * settings.mipCount + mip];
+						for (int c = 0; c < 4; ++c)
+							worst = max(worst, fabs(Sample(level, atlasU, atlasV, c, false) - Sample(chains[i][mip], u, v, c, wrap)));
+					}
+				}
+			}
+			CHECK(worst < 1.0f);
+		}
+
+		// Coordinates outside 0..1 need frac() in the shader, so the mesh is left as it was
+		vector<SimpleVertex> vertices = rock;
+		vertices[5].TexCoord.x = 1.25f;
+		CHECK(!AtlasBuilder::RemapTexCoords(vertices.data(), vertices.size(), sizeof(SimpleVertex), offsetof(SimpleVertex, TexCoord), atlas.entries[0]));
+		CHECK(vertices[0].TexCoord.x == rock[0].TexCoord.x && vertices[0].TexCoord.y == rock[0].TexCoord.y);
+	}
+
+	// A texture larger than a page less its gutter is left out, and the rest still placed
+	{
+		AtlasSettings settings;
+		settings.pageSize = 128;
+		settings.mipCount = 4;
+		vector<Image> textures;
+		textures.push_back(MakeTexture(32, 32, 0, random));
+		textures.push_back(MakeTexture(120, 20, 1, random));
+		textures.push_back(MakeTexture(20, 20, 2, random));
+
+		TextureAtlas atlas;
+		CHECK(AtlasBuilder::Build(textures.data(), (int)textures.size(), settings, atlas) == 2);
+		CHECK(atlas.entries[0].page == 0 && atlas.entries[1].page == -1 && atlas.entries[2].page == 0);
+		CHECK(atlas.pageCount == 1);
+	}
+
+	return TestResult();
+}
@@ -0,0 +1,283 @@
+// TextureCache reference counting and eviction, on the stand-in D3D objects in Stubs: textures
+// stay while any handle holds them, files with the same bytes share one texture, unreferenced
+// textures go least recently released first once over budget, and nothing leaks.
+#include "TestCheck.h"
+
+#include "DDSFile.h"
+#include "DDSTextureLoader.h"
+#include "ImageIO.h"
+#include "ImageTexture.h"
+#include "JobSystem.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+using namespace std;
+
+// The uploads the cache goes through, making stand-in textures of the right size
+namespace
+{
+	ID3D11ShaderResourceView* MakeView(UINT width, UINT height, UINT mipCount, DXGI_FORMAT format)
+	{
+		ID3D11Texture2D* texture = new ID3D11Texture2D();
+		texture->desc.Width = width;
+		texture->desc.Height = height;
+		texture->desc.MipLevels = mipCount;
+		texture->desc.ArraySize = 1;
+		texture->desc.Format = format;
+		ID3D11ShaderResourceView* view = new ID3D11ShaderResourceView(texture);
+		texture->Release();
+		return view;
+	}
+
+	HRESULT MakeViewFromDDS(const uint8_t* data, size_t size, size_t maxSize, ID3D11ShaderResourceView** view)
+	{
+		DDSFile::Layout layout;
+		if (!DDSFile::Parse(data, size, layout))
+			return E_FAIL;
+		UINT width = layout.header->width, height = layout.header->height, mipCount = max(layout.header->mipMapCount, 1u);
+		while (maxSize && mipCount > 1 && (width > maxSize || height > maxSize))
+		{
+			width = max(width / 2, 1u);
+			height = max(height / 2, 1u);
+			--mipCount;
+		}
+		*view = MakeView(width, height, mipCount, layout.dx10 ? (DXGI_FORMAT)layout.dx10->dxgiFormat : DXGI_FORMAT_R8G8B8A8_UNORM);
+		return S_OK;
+	}
+}
+
+HRESULT CreateTextureFromImage(ID3D11Device*, const Image& image, bool, ID3D11ShaderResourceView** view)
+{
+	*view = MakeView(image.GetWidth(), image.GetHeight(), 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+	return S_OK;
+}
+
+HRESULT CreateTextureFromMips(ID3D11Device*, const Image* mips, int mipCount, ID3D11ShaderResourceView** view)
+{
+	*view = MakeView(mips[0].GetWidth(), mips[0].GetHeight(), mipCount, DXGI_FORMAT_R8G8B8A8_UNORM);
+	return S_OK;
+}
+
+HRESULT CreateTextureFromBlocks(ID3D11Device*, const CompressedImage* mips, int mipCount, ID3D11ShaderResourceView** view)
+{
+	*view = MakeView(mips[0].width, mips[0].height, mipCount, (DXGI_FORMAT)BlockCompressor::DXGIFormat(mips[0].format));
+	return S_OK;
+}
+
+size_t TextureLevelBytes(DXGI_FORMAT format, UINT width, UINT height)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC4_UNORM:
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+	default:
+		return (size_t)width * height * 4;
+	}
+}
+
+namespace DirectX
+{
+	HRESULT CreateDDSTextureFromMemory(ID3D11Device*, const uint8_t* ddsData, size_t ddsDataSize, ID3D11Resource**, ID3D11ShaderResourceView** textureView, size_t maxsize, DDS_ALPHA_MODE*)
+	{
+		return MakeViewFromDDS(ddsData, ddsDataSize, maxsize, textureView);
+	}
+
+	HRESULT CreateDDSTextureFromMemoryEx(ID3D11Device*, const uint8_t* ddsData, size_t ddsDataSize, size_t maxsize, D3D11_USAGE, unsigned int, unsigned int, unsigned int, bool, ID3D11Resource**, ID3D11ShaderResourceView** textureView, DDS_ALPHA_MODE*)
+	{
+		return MakeViewFromDDS(ddsData, ddsDataSize, maxsize, textureView);
+	}
+}
+
+namespace
+{
+	const string DIRECTORY = string(TEST_OUTPUT_DIR) + "/";
+
+	wstring Wide(const string& text)
+	{
+		return wstring(text.begin(), text.end());
+	}
+
+	wstring TextureFile(const char* name)
+	{
+		return Wide(DIRECTORY + name);
+	}
+
+	void WriteTexture(const char* name, int size, uint32_t colour)
+	{
+		Image image(size, size);
+		image.Fill(colour);
+		CHECK(ImageIO::SaveDDS(DIRECTORY + name, image));
+	}
+
+	// Frames until every load is in
+	void Pump(TextureLoader& loader)
+	{
+		while (loader.GetPendingCount() > 0)
+		{
+			JobSystem::Get().WaitIdle();
+			loader.Update(4);
+		}
+	}
+}
+
+int main()
+{
+	WriteTexture("a.dds", 8, 0xff0000ff);
+	WriteTexture("a copy.dds", 8, 0xff0000ff);
+	WriteTexture("b.dds", 16, 0xff00ff00);
+	WriteTexture("c.dds", 32, 0xffff0000);
+	WriteTexture("d.dds", 64, 0xff00ffff);
+	ofstream(DIRECTORY + "bad.dds", ios::binary) << "not a DDS file";
+
+	TextureLoader loader;
+	CHECK(SUCCEEDED(loader.Init(nullptr)));
+	const int placeholders = D3D11Stub::LiveObjects();
+	{
+		TextureStreamer streamer;
+		CHECK(SUCCEEDED(streamer.Init(nullptr)));
+		TextureCache cache(loader, streamer);
+		ID3D11ShaderResourceView* white = loader.GetPlaceholder(TexturePlaceholder::White);
+
+		// One entry per canonical path, one texture per content
+		{
+			TextureHandle a = cache.Acquire(TextureFile("a.dds"), TexturePlaceholder::White);
+			wstring otherSpelling = TextureFile("A.DDS");
+			replace(otherSpelling.begin(), otherSpelling.end(), L'/', L'\\');
+			TextureHandle sameFile = cache.Acquire(otherSpelling, TexturePlaceholder::White);
+			TextureHandle sameBytes = cache.Acquire(TextureFile("a copy.dds"), TexturePlaceholder::White);
+			CHECK(a.Get() == white && !a.IsLoaded());
+			CHECK(cache.GetEntryCount() == 2 && cache.GetHitCount() == 1);
+
+			Pump(loader);
+			CHECK(a.IsLoaded() && a.Get() != white);
+			CHECK(sameFile.Get() == a.Get() && sameBytes.Get() == a.Get());
+			CHECK(cache.GetTextureCount() == 1 && cache.GetSharedByContentCount() == 1);
+			const size_t bytes = cache.GetResidentBytes();
+			CHECK(bytes > 0);
+
+			// Evicting one path leaves the texture to the other
+			a.Reset();
+			sameFile.Reset();
+			cache.SetBudget(0);
+			cache.Trim();
+			CHECK(cache.GetEvictionCount() == 1 && cache.GetTextureCount() == 1 && cache.GetResidentBytes() == bytes);
+			CHECK(sameBytes.IsLoaded() && sameBytes.Get() != white);
+			sameBytes.Reset();
+			cache.Trim();
+			CHECK(cache.GetEvictionCount() == 2 && cache.GetTextureCount() == 0 && cache.GetResidentBytes() == 0);
+			cache.SetBudget(256u << 20);
+		}
+
+		// Unreadable files keep their placeholder, or take their fallback
+		{
+			int fallbacks = 0;
+			TextureHandle bad = cache.Acquire(TextureFile("bad.dds"), TexturePlaceholder::FlatNormal);
+			TextureHandle missing = cache.Acquire(TextureFile("missing.dds"), TexturePlaceholder::White, [&]()
+			{
+				++fallbacks;
+				return MakeView(4, 4, 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+			});
+			Pump(loader);
+			CHECK(!bad.IsLoaded() && bad.Get() == loader.GetPlaceholder(TexturePlaceholder::FlatNormal));
+			CHECK(missing.IsLoaded() && missing.Get() != white && fallbacks == 1);
+		}
+		cache.SetBudget(0);
+		cache.Trim();
+		CHECK(cache.GetResidentBytes() == 0);
+		cache.SetBudget(256u << 20);
+
+		// Every copy holds the texture; the last one going lets it be evicted
+		{
+			const int evictions = cache.GetEvictionCount();
+			TextureHandle first = cache.Acquire(TextureFile("b.dds"), TexturePlaceholder::White);
+			Pump(loader);
+			ID3D11ShaderResourceView* view = first.Get();
+
+			TextureHandle copied(first);
+			TextureHandle assigned;
+			assigned = copied;
+			assigned = assigned;
+			TextureHandle moved(move(copied));
+			CHECK(!copied.IsValid() && copied.Get() == nullptr && !copied.IsLoaded());
+			TextureHandle moveAssigned;
+			moveAssigned = move(moved);
+			CHECK(!moved.IsValid());
+
+			cache.SetBudget(0);
+			TextureHandle* holders[] = { &first, &assigned, &moveAssigned };
+			for (TextureHandle* holder : holders)
+			{
+				cache.Trim();
+				CHECK(cache.GetEvictionCount() == evictions && cache.GetResidentBytes() > 0);
+				for (TextureHandle* other : holders)
+					CHECK(!other->IsValid() || other->Get() == view);
+				holder->Reset();
+			}
+			cache.Trim();
+			CHECK(cache.GetEvictionCount() == evictions + 1 && cache.GetResidentBytes() == 0);
+			cache.SetBudget(256u << 20);
+		}
+
+		// Over budget, unreferenced textures go least recently released first
+		{
+			const char* names[] = { "a.dds", "b.dds", "c.dds", "d.dds" };
+			size_t bytes[4];
+			TextureHandle handles[4];
+			size_t total = 0;
+			for (int i = 0; i < 4; ++i)
+			{
+				handles[i] = cache.Acquire(TextureFile(names[i]), TexturePlaceholder::White);
+				Pump(loader);
+				bytes[i] = cache.GetResidentBytes() - total;
+				total += bytes[i];
+			}
+			CHECK(cache.GetTextureCount() == 4);
+
+			// Released d, b, a, c, a frame apart
+			const int order[] = { 3, 1, 0, 2 };
+			for (int i : order)
+			{
+				handles[i].Reset();
+				cache.Trim();
+			}
+			CHECK(cache.GetResidentBytes() == total);
+
+			const int evictions = cache.GetEvictionCount();
+			cache.SetBudget(total - 1);
+			cache.Trim();
+			CHECK(cache.GetEvictionCount() == evictions + 1 && cache.GetResidentBytes() == total - bytes[3]);
+
+			// b alone would fit; a goes too once the budget asks for one byte more
+			cache.SetBudget(total - bytes[3] - bytes[1] - 1);
+			cache.Trim();
+			CHECK(cache.GetEvictionCount() == evictions + 3 && cache.GetResidentBytes() == bytes[2]);
+
+			// c is still there to pick up again; d loads again, and is kept while held
+			TextureHandle c = cache.Acquire(TextureFile("c.dds"), TexturePlaceholder::White);
+			CHECK(c.IsLoaded() && loader.GetPendingCount() == 0);
+			TextureHandle d = cache.Acquire(TextureFile("d.dds"), TexturePlaceholder::White);
+			CHECK(!d.IsLoaded() && d.Get() == white && loader.GetPendingCount() == 1);
+			Pump(loader);
+			cache.SetBudget(0);
+			cache.Trim();
+			CHECK(c.IsLoaded() && d.IsLoaded() && cache.GetResidentBytes() == bytes[2] + bytes[3]);
+			CHECK(cache.GetEvictionCount() == evictions + 3);
+		}
+
+		cache.Cleanup();
+		CHECK(cache.GetTextureCount() == 0 && cache.GetResidentBytes() == 0);
+		CHECK(D3D11Stub::LiveObjects() == placeholders);
+		streamer.Cleanup();
+	}
+	loader.Cleanup();
+	CHECK(D3D11Stub::LiveObjects() == 0);
+	return TestResult();
+}
@@ -0,0 +1,211 @@
+// TextureResidency planning, with every change completed at once as TextureStreamer would once
+// the upload lands: textures load a level at a time, the neediest first; a smaller budget takes
+// levels back from the least visible; textures showing more detail than asked for give it up
+// first but never below what they asked for; and once every candidate has gone stale, the least
+// recently requested falls back to its tail first. Nothing ever drops below its tail.
+#include "TestCheck.h"
+
+#include "TextureResidency.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const int TAIL_MIP = 4;
+	const size_t NO_LIMIT = (size_t)-1;
+
+	// An RGBA8 256x256 texture: level m alone, down to 1x1
+	vector<size_t> Levels()
+	{
+		vector<size_t> levels;
+		for (int size = 256; size >= 1; size /= 2)
+			levels.push_back((size_t)size * size * 4);
+		return levels;
+	}
+
+	// Bytes resident with levels from mip down
+	size_t Bytes(int mip)
+	{
+		const vector<size_t> levels = Levels();
+		size_t bytes = 0;
+		for (int m = mip; m < (int)levels.size(); ++m)
+			bytes += levels[m];
+		return bytes;
+	}
+
+	// One frame of the streamer: plan, then finish every change
+	vector<ResidencyChange> Frame(TextureResidency& residency, size_t budget, int maxChanges = 8)
+	{
+		vector<ResidencyChange> changes;
+		residency.Plan(budget, maxChanges, changes);
+		for (const ResidencyChange& change : changes)
+			residency.Complete(change.id, change.mip);
+		return changes;
+	}
+
+	bool Is(const ResidencyChange& change, int id, int mip)
+	{
+		return change.id == id && change.mip == mip;
+	}
+}
+
+int main()
+{
+	// Loads: a level at a time, the furthest from its request first, one change a frame here
+	TextureResidency residency;
+	const int a = residency.Add(Levels(), TAIL_MIP);
+	const int b = residency.Add(Levels(), TAIL_MIP);
+	CHECK(residency.GetResidentMip(a) == TAIL_MIP && residency.GetResidentBytes() == 2 * Bytes(TAIL_MIP));
+	{
+		residency.Request(a, 0, 10.0f);
+		residency.Request(b, 2, 1.0f);
+		vector<ResidencyChange> changes;
+		residency.Plan(NO_LIMIT, 8, changes);
+		CHECK(changes.size() == 2 && Is(changes[0], a, 3) && Is(changes[1], b, 3));
+		CHECK(residency.IsPending(a) && residency.GetPendingCount() == 2);
+
+		// Abandoned: the level stays as it was and the change is planned again
+		residency.Complete(a, TAIL_MIP);
+		residency.Complete(b, 3);
+		CHECK(!residency.IsPending(a) && residency.GetResidentMip(a) == TAIL_MIP);
+		CHECK(residency.GetResidentBytes() == Bytes(TAIL_MIP) + Bytes(3));
+
+		for (int frame = 0; frame < 10; ++frame)
+		{
+			residency.Request(a, 0, 10.0f);
+			residency.Request(b, 2, 1.0f);
+			CHECK(Frame(residency, NO_LIMIT, 1).size() <= 1);
+		}
+		CHECK(residency.GetResidentMip(a) == 0 && residency.GetResidentMip(b) == 2);
+		CHECK(residency.GetResidentBytes() == Bytes(0) + Bytes(2));
+		CHECK(residency.GetWantedBytes() == Bytes(0) + Bytes(2));
+	}
+
+	// A smaller budget: the least visible gives way first, only as far as needed, and nothing
+	// loads back over the budget while it stands
+	{
+		residency.Request(a, 0, 10.0f);
+		residency.Request(b, 2, 1.0f);
+		vector<ResidencyChange> changes = Frame(residency, Bytes(0) + Bytes(3));
+		CHECK(changes.size() == 1 && Is(changes[0], b, 3));
+
+		const size_t budget = Bytes(1) + Bytes(TAIL_MIP);
+		residency.Request(a, 0, 10.0f);
+		residency.Request(b, 2, 1.0f);
+		changes = Frame(residency, budget);
+		CHECK(changes.size() == 2 && Is(changes[0], b, TAIL_MIP) && Is(changes[1], a, 1));
+		CHECK(residency.GetResidentBytes() <= budget);
+
+		for (int frame = 0; frame < 5; ++frame)
+		{
+			residency.Request(a, 0, 10.0f);
+			residency.Request(b, 2, 1.0f);
+			CHECK(Frame(residency, budget).empty());
+		}
+		CHECK(residency.GetResidentMip(a) == 1 && residency.GetResidentMip(b) == TAIL_MIP);
+
+		// Nothing drops below its tail, even with no budget at all
+		residency.Request(a, 0, 10.0f);
+		changes = Frame(residency, 0);
+		CHECK(changes.size() == 1 && Is(changes[0], a, TAIL_MIP));
+		CHECK(residency.GetResidentBytes() == 2 * Bytes(TAIL_MIP));
+	}
+
+	// Over-resolved textures give up levels first, even ahead of less visible ones, but never
+	// below the level they asked for
+	{
+		TextureResidency over;
+		const int c = over.Add(Levels(), TAIL_MIP);
+		const int k = over.Add(Levels(), TAIL_MIP);
+		const int d = over.Add(Levels(), TAIL_MIP);
+		for (int frame = 0; frame < 6; ++frame)
+		{
+			over.Request(c, 0, 100.0f);
+			over.Request(k, 1, 5.0f);
+			Frame(over, NO_LIMIT);
+		}
+		CHECK(over.GetResidentMip(c) == 0 && over.GetResidentMip(k) == 1);
+
+		const size_t budget = Bytes(0) + Bytes(1) + Bytes(TAIL_MIP);
+		over.Request(c, 2, 100.0f);
+		over.Request(k, 1, 5.0f);
+		over.Request(d, 0, 10.0f);
+		vector<ResidencyChange> changes = Frame(over, budget);
+		CHECK(changes.size() == 2 && Is(changes[0], c, 1) && Is(changes[1], d, 3));
+
+		vector<ResidencyChange> drops;
+		for (int frame = 0; frame < 10; ++frame)
+		{
+			over.Request(c, 2, 100.0f);
+			over.Request(k, 1, 5.0f);
+			over.Request(d, 0, 10.0f);
+			for (const ResidencyChange& change : Frame(over, budget))
+				if (change.id != d)
+					drops.push_back(change);
+		}
+		CHECK(drops.size() == 2 && Is(drops[0], c, 2) && Is(drops[1], k, 2));
+		CHECK(over.GetResidentMip(d) == 0 && over.GetResidentBytes() <= budget);
+	}
+
+	// All stale: the least recently requested falls back to its tail first. Ids run the other
+	// way, so the order cannot come from them.
+	{
+		TextureResidency stale;
+		const int g = stale.Add(Levels(), TAIL_MIP);
+		const int f = stale.Add(Levels(), TAIL_MIP);
+		const int e = stale.Add(Levels(), TAIL_MIP);
+		const int h = stale.Add(Levels(), TAIL_MIP);
+		for (int frame = 0; frame < 6; ++frame)
+		{
+			for (int id : { e, f, g })
+				stale.Request(id, 0, 5.0f);
+			Frame(stale, NO_LIMIT);
+		}
+		for (int frame = 0; frame < 4; ++frame)
+		{
+			if (frame < 2)
+				stale.Request(f, 0, 5.0f);
+			stale.Request(g, 0, 5.0f);
+			Frame(stale, NO_LIMIT);
+		}
+		for (int frame = 0; frame <= TextureResidency::STALE_FRAMES; ++frame)
+			CHECK(Frame(stale, NO_LIMIT).empty());
+		for (int id : { e, f, g })
+			CHECK(stale.GetWantedMip(id) == TAIL_MIP && stale.GetResidentMip(id) == 0);
+
+		const size_t budget = Bytes(0) + 3 * Bytes(TAIL_MIP);
+		vector<int> dropped;
+		for (int frame = 0; frame < 12; ++frame)
+		{
+			stale.Request(h, 0, 1.0f);
+			for (const ResidencyChange& change : Frame(stale, budget))
+			{
+				if (change.id != h && (dropped.empty() || dropped.back() != change.id))
+					dropped.push_back(change.id);
+			}
+		}
+		CHECK(dropped.size() == 3 && dropped[0] == e && dropped[1] == f && dropped[2] == g);
+		for (int id : { e, f, g })
+			CHECK(stale.GetResidentMip(id) == TAIL_MIP);
+		CHECK(stale.GetResidentMip(h) == 0 && stale.GetResidentBytes() == budget);
+
+		// A removed texture gives its bytes back and its id to the next one added
+		stale.Remove(h);
+		CHECK(stale.GetResidentBytes() == 3 * Bytes(TAIL_MIP) && stale.GetTextureCount() == 3);
+		CHECK(stale.Add(Levels(), TAIL_MIP) == h);
+	}
+
+	// The level whose texels are closest to one per pixel
+	{
+		CHECK(TextureResidency::MipForScreenSize(256, 256, 256.0f) == 0);
+		CHECK(TextureResidency::MipForScreenSize(256, 256, 1000.0f) == 0);
+		CHECK(TextureResidency::MipForScreenSize(256, 128, 64.0f) == 2);
+		CHECK(TextureResidency::MipForScreenSize(1024, 512, 300.0f) == 1);
+		CHECK(TextureResidency::MipForScreenSize(256, 256, 0.0f) == 8);
+		CHECK(TextureResidency::MipForScreenSize(256, 256, 0.01f) == 8);
+	}
+
+	return TestResult();
+}
@@ -0,0 +1,452 @@
+// VirtualPageManager, VirtualFeedback and VirtualTileFile without a device: coarser pages are
+// planned first, eviction takes the least recently seen page but never the top one or one seen
+// in the frame just planned, stale pages reload into their own slot, the page table points every
+// page at its closest resident ancestor, feedback outside the texture is dropped, and a tile
+// file cut short or with removals reopens to exactly the records written whole.
+#include "TestCheck.h"
+
+#include "VirtualPageManager.h"
+#include "VirtualTileFile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const string DIRECTORY = string(TEST_OUTPUT_DIR) + "/";
+
+	// 8 x 8 pages of 28 texels and a 2 texel border, so four levels and a 224 texel texture
+	VirtualTextureLayout SmallLayout()
+	{
+		VirtualTextureLayout layout;
+		layout.pagesPerSide = 8;
+		layout.pageSize = 32;
+		layout.border = 2;
+		return layout;
+	}
+
+	const uint32_t TOP = PackVirtualPage(3, 0, 0);
+
+	// One frame: the feedback saw each page in count texels, then up to maxLoads are planned
+	vector<uint32_t> RequestAndPlan(VirtualPageManager& manager, initializer_list<VirtualPageRequest> requests, int maxLoads = 100)
+	{
+		vector<VirtualPageRequest> seen(requests);
+		manager.Request(seen.data(), (int)seen.size());
+		vector<uint32_t> loads;
+		manager.Plan(maxLoads, loads);
+		return loads;
+	}
+
+	void CompleteAll(VirtualPageManager& manager, const vector<uint32_t>& loads)
+	{
+		for (uint32_t page : loads)
+			manager.Complete(page);
+	}
+
+	// Entries that do not name the page's own slot, or its closest resident ancestor's
+	int CountPageTableErrors(const VirtualPageManager& manager)
+	{
+		const VirtualTextureLayout& layout = manager.GetLayout();
+		const int mipCount = layout.GetMipCount();
+		const int slotsPerSide = manager.GetSlotsPerSide();
+		int errors = 0;
+		for (int mip = 0; mip < mipCount; ++mip)
+		{
+			const int side = layout.pagesPerSide >> mip;
+			for (int y = 0; y < side; ++y)
+			{
+				for (int x = 0; x < side; ++x)
+				{
+					int resident = mip;
+					int slot = -1;
+					for (; resident < mipCount && slot < 0; ++resident)
+						slot = manager.GetSlot(PackVirtualPage(resident, x >> (resident - mip), y >> (resident - mip)));
+					--resident;
+
+					const uint8_t* texel = manager.GetPageTable(mip) + ((size_t)y * side + x) * 4;
+					bool right = slot < 0 ? texel[3] == 0 :
+						texel[0] == slot % slotsPerSide && texel[1] == slot / slotsPerSide && texel[2] == resident && texel[3] == 255;
+					if (!right)
+						++errors;
+				}
+			}
+		}
+		return errors;
+	}
+
+	vector<uint8_t> MakeTile(size_t size, uint32_t seed, bool noisy)
+	{
+		vector<uint8_t> tile(size);
+		uint32_t state = seed * 2654435761u + 1;
+		for (size_t i = 0; i < size; ++i)
+		{
+			state = state * 1664525u + 1013904223u;
+			tile[i] = noisy ? (uint8_t)(state >> 24) : (uint8_t)(i / 16 + seed);
+		}
+		return tile;
+	}
+
+	vector<uint8_t> ReadFile(const string& fileName)
+	{
+		ifstream file(fileName, ios::binary);
+		return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	}
+
+	void WriteFile(const string& fileName, const uint8_t* data, size_t size)
+	{
+		ofstream(fileName, ios::binary | ios::trunc).write(reinterpret_cast<const char*>(data), size);
+	}
+
+	// What a reopened file should hold once the records up to end have been replayed
+	struct TileFileState
+	{
+		uint64_t					end;
+		map<uint32_t, vector<uint8_t>>	tiles;
+	};
+
+	bool Holds(VirtualTileFile& file, const TileFileState& state)
+	{
+		if (file.GetFileSize() != state.end || file.GetTileCount() != state.tiles.size())
+			return false;
+		uint64_t rawBytes = 0;
+		vector<uint8_t> tile;
+		for (const auto& expected : state.tiles)
+		{
+			if (!file.Read(expected.first, tile) || tile != expected.second)
+				return false;
+			rawBytes += expected.second.size();
+		}
+		return file.GetRawBytes() == rawBytes;
+	}
+}
+
+int main()
+{
+	const VirtualTextureLayout layout = SmallLayout();
+	CHECK(layout.GetMipCount() == 4 && layout.GetPageCount() == 85 && layout.GetVirtualSize() == 224);
+
+	// A page brings every page above it; coarser levels go first, then the most seen
+	{
+		VirtualPageManager manager;
+		manager.Init(layout, 4);
+		vector<uint32_t> loads = RequestAndPlan(manager, { { PackVirtualPage(0, 1, 1), 10 }, { PackVirtualPage(1, 1, 1), 20 }, { PackVirtualPage(0, 6, 6), 25 } });
+		const vector<uint32_t> expected =
+		{
+			TOP,
+			PackVirtualPage(2, 0, 0), PackVirtualPage(2, 1, 1),		// 10 + 20 texels under the first
+			PackVirtualPage(1, 3, 3), PackVirtualPage(1, 1, 1), PackVirtualPage(1, 0, 0),
+			PackVirtualPage(0, 6, 6), PackVirtualPage(0, 1, 1),
+		};
+		CHECK(loads == expected);
+		CHECK(manager.GetPendingCount() == 8 && manager.IsPending(TOP));
+
+		// Only the coarsest fit when loads are short, and the rest come the next frame
+		VirtualPageManager limited;
+		limited.Init(layout, 4);
+		loads = RequestAndPlan(limited, { { PackVirtualPage(0, 1, 1), 10 }, { PackVirtualPage(0, 6, 6), 50 } }, 3);
+		CHECK(loads == vector<uint32_t>({ TOP, PackVirtualPage(2, 1, 1), PackVirtualPage(2, 0, 0) }));
+		CompleteAll(limited, loads);
+		loads = RequestAndPlan(limited, { { PackVirtualPage(0, 1, 1), 10 }, { PackVirtualPage(0, 6, 6), 50 } }, 3);
+		CHECK(loads == vector<uint32_t>({ PackVirtualPage(1, 3, 3), PackVirtualPage(1, 0, 0), PackVirtualPage(0, 6, 6) }));
+
+		// Out of range requests are ignored
+		const VirtualPageRequest outside[] = { { PackVirtualPage(4, 0, 0), 1 }, { PackVirtualPage(0, 8, 0), 1 }, { PackVirtualPage(2, 0, 2), 1 } };
+		limited.Request(outside, 3);
+		CHECK(limited.GetRequestedCount() == 0);
+	}
+
+	// Eviction takes the page seen longest ago, never the top page however old
+	{
+		VirtualPageManager manager;
+		manager.Init(layout, 2);
+		CompleteAll(manager, RequestAndPlan(manager, { { PackVirtualPage(0, 0, 0), 1 } }));
+		CHECK(manager.GetResidentCount() == 4);
+		const int topSlot = manager.GetSlot(TOP);
+
+		// Seen last in frames 1, 2 and 3
+		RequestAndPlan(manager, { { PackVirtualPage(1, 0, 0), 1 } });
+		RequestAndPlan(manager, { { PackVirtualPage(2, 0, 0), 1 } });
+		vector<uint32_t> loads = RequestAndPlan(manager, { { PackVirtualPage(0, 7, 7), 1 } });
+		CHECK(loads == vector<uint32_t>({ PackVirtualPage(2, 1, 1), PackVirtualPage(1, 3, 3), PackVirtualPage(0, 7, 7) }));
+		for (int frame = 0; frame < 4; ++frame)
+			RequestAndPlan(manager, {});
+
+		const uint32_t victims[] = { PackVirtualPage(0, 0, 0), PackVirtualPage(1, 0, 0), PackVirtualPage(2, 0, 0) };
+		for (int i = 0; i < 3; ++i)
+		{
+			const int slot = manager.GetSlot(victims[i]);
+			CHECK(manager.Complete(loads[i]) == slot);
+			CHECK(manager.GetSlot(victims[i]) == -1 && manager.GetEvictionCount() == i + 1);
+		}
+		CHECK(manager.GetSlot(TOP) == topSlot && manager.GetResidentCount() == 4);
+		CHECK(manager.UpdatePageTable() && CountPageTableErrors(manager) == 0);
+
+		// Every page seen in the same frame as the top one, which is in the first slot
+		VirtualPageManager tied;
+		tied.Init(layout, 2);
+		loads = RequestAndPlan(tied, { { PackVirtualPage(0, 0, 0), 1 }, { PackVirtualPage(0, 7, 7), 1 } });
+		CHECK(loads.size() == 7 && loads[0] == TOP);
+		for (int i = 0; i < 4; ++i)
+			tied.Complete(loads[i]);
+		CHECK(tied.GetSlot(TOP) == 0);
+		for (int frame = 0; frame < 2; ++frame)
+			RequestAndPlan(tied, {});
+		for (int i = 4; i < 7; ++i)
+			CHECK(tied.Complete(loads[i]) > 0);
+		CHECK(tied.GetSlot(TOP) == 0 && tied.GetEvictionCount() == 3);
+	}
+
+	// A page seen in the frame just planned, or already seen again since, keeps its slot
+	{
+		VirtualPageManager manager;
+		manager.Init(layout, 2);
+		CompleteAll(manager, RequestAndPlan(manager, { { PackVirtualPage(0, 0, 0), 1 } }));
+
+		vector<uint32_t> loads = RequestAndPlan(manager, { { PackVirtualPage(0, 0, 0), 1 }, { PackVirtualPage(0, 7, 7), 1 } });
+		CHECK(loads.size() == 3);
+		for (uint32_t page : loads)
+			CHECK(manager.Complete(page) == -1);
+		CHECK(manager.GetEvictionCount() == 0 && manager.GetPendingCount() == 0 && manager.GetSlot(PackVirtualPage(0, 0, 0)) >= 0);
+
+		// Dropped pages are planned again; the next frame's feedback protects what it sees
+		loads = RequestAndPlan(manager, { { PackVirtualPage(0, 7, 7), 1 } });
+		CHECK(loads.size() == 3);
+		VirtualPageRequest again = { PackVirtualPage(0, 0, 0), 1 };
+		manager.Request(&again, 1);
+		for (uint32_t page : loads)
+			CHECK(manager.Complete(page) == -1);
+		CHECK(manager.GetEvictionCount() == 0);
+
+		// Seen one frame before the one planned is old enough
+		vector<uint32_t> none;
+		manager.Plan(0, none);
+		loads = RequestAndPlan(manager, { { PackVirtualPage(0, 7, 7), 1 } });
+		CHECK(loads.size() == 3);
+		for (uint32_t page : loads)
+			CHECK(manager.Complete(page) >= 0);
+		CHECK(manager.GetEvictionCount() == 3 && manager.GetSlot(PackVirtualPage(0, 0, 0)) == -1);
+	}
+
+	// Invalidate marks what covers the texels, borders included; the reload goes back in place
+	{
+		VirtualPageManager manager;
+		manager.Init(layout, 4);
+		CompleteAll(manager, RequestAndPlan(manager, { { PackVirtualPage(0, 0, 0), 1 }, { PackVirtualPage(0, 7, 7), 1 } }));
+		CHECK(manager.GetResidentCount() == 7);
+		CHECK(manager.UpdatePageTable());
+		const vector<uint8_t> table(manager.GetPageTable(0), manager.GetPageTable(0) + 8 * 8 * 4);
+
+		// Texel 31 of the texture is past page 0's border of 2 beyond its 28
+		const float size = (float)layout.GetVirtualSize();
+		manager.Invalidate(31.5f / size, 10.5f / size, 31.5f / size, 10.5f / size);
+		CHECK(!manager.IsStale(PackVirtualPage(0, 0, 0)) && manager.IsStale(PackVirtualPage(1, 0, 0)));
+
+		const uint32_t pages[] = { TOP, PackVirtualPage(2, 0, 0), PackVirtualPage(1, 0, 0), PackVirtualPage(0, 0, 0) };
+		int slots[4];
+		for (int i = 0; i < 4; ++i)
+			slots[i] = manager.GetSlot(pages[i]);
+		manager.Invalidate(29.5f / size, 10.5f / size, 29.5f / size, 10.5f / size);
+		for (uint32_t page : pages)
+			CHECK(manager.IsStale(page));
+		CHECK(!manager.IsStale(PackVirtualPage(0, 7, 7)) && !manager.IsStale(PackVirtualPage(1, 3, 3)) && !manager.IsStale(PackVirtualPage(2, 1, 1)));
+		CHECK(!manager.IsStale(PackVirtualPage(0, 1, 0)));		// covered, but never loaded
+
+		vector<uint32_t> loads = RequestAndPlan(manager, { { PackVirtualPage(0, 0, 0), 1 } });
+		CHECK(loads == vector<uint32_t>(pages, pages + 4));
+		for (int i = 0; i < 4; ++i)
+			CHECK(!manager.IsStale(pages[i]) && manager.IsPending(pages[i]) && manager.GetSlot(pages[i]) == slots[i]);
+
+		// Still shown as they were while reloading, and then in the same slots
+		CHECK(!manager.UpdatePageTable());
+		for (int i = 0; i < 4; ++i)
+			CHECK(manager.Complete(pages[i]) == slots[i]);
+		CHECK(!manager.UpdatePageTable());
+		CHECK(equal(table.begin(), table.end(), manager.GetPageTable(0)));
+		CHECK(manager.GetResidentCount() == 7 && manager.GetEvictionCount() == 0);
+
+		// Invalidated while pending, here through the border reaching back over page 0, a page is
+		// loaded once more, with those above it
+		loads = RequestAndPlan(manager, { { PackVirtualPage(0, 1, 0), 1 } });
+		CHECK(loads == vector<uint32_t>({ PackVirtualPage(0, 1, 0) }));
+		manager.Invalidate(26.5f / size, 10.5f / size, 26.5f / size, 10.5f / size);
+		CHECK(manager.IsStale(PackVirtualPage(0, 1, 0)));
+		CHECK(manager.Complete(PackVirtualPage(0, 1, 0)) >= 0);
+		loads = RequestAndPlan(manager, { { PackVirtualPage(0, 1, 0), 1 } });
+		CHECK(loads == vector<uint32_t>({ TOP, PackVirtualPage(2, 0, 0), PackVirtualPage(1, 0, 0), PackVirtualPage(0, 1, 0) }));
+	}
+
+	// The page table falls back to the closest resident ancestor as pages come and go
+	{
+		VirtualPageManager manager;
+		manager.Init(layout, 2);
+		CHECK(manager.UpdatePageTable() && CountPageTableErrors(manager) == 0);
+		CHECK(manager.GetPageTable(0)[3] == 0);
+
+		CompleteAll(manager, RequestAndPlan(manager, { { PackVirtualPage(0, 5, 2), 1 } }, 2));
+		CHECK(manager.UpdatePageTable() && CountPageTableErrors(manager) == 0);
+		const uint8_t* texel = manager.GetPageTable(0) + (2 * 8 + 5) * 4;
+		CHECK(texel[2] == 2 && texel[3] == 255);
+		texel = manager.GetPageTable(0) + (7 * 8 + 0) * 4;
+		CHECK(texel[2] == 3 && texel[3] == 255);
+
+		// Pages over the whole texture, a few loads a frame, through many evictions
+		uint32_t seed = 7;
+		int errors = 0;
+		for (int frame = 0; frame < 200; ++frame)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const int mip = (seed >> 8) % 3;
+			const int side = layout.pagesPerSide >> mip;
+			CompleteAll(manager, RequestAndPlan(manager, { { PackVirtualPage(mip, (seed >> 12) % side, (seed >> 20) % side), 1 } }, 2));
+			manager.UpdatePageTable();
+			errors += CountPageTableErrors(manager);
+		}
+		CHECK(errors == 0);
+		CHECK(manager.GetEvictionCount() > 50 && manager.GetSlot(TOP) >= 0);
+	}
+
+	// Feedback: each page seen once with its texel count, nothing outside the texture
+	{
+		const int width = 16, height = 4;
+		const size_t pitch = width * 4 + 12;
+		vector<uint8_t> texels(pitch * height, 0xFF);
+		const uint8_t values[width][4] =
+		{
+			{ 1, 2, 0, 255 }, { 7, 7, 0, 255 }, { 3, 3, 1, 255 }, { 0, 0, 3, 255 },
+			{ 1, 2, 0, 0 },						// nothing drawn
+			{ 0, 0, 4, 255 }, { 0, 0, 200, 255 },	// no such level
+			{ 8, 0, 0, 255 }, { 0, 8, 0, 255 },	// past the edge of the top level
+			{ 4, 0, 1, 255 }, { 0, 4, 1, 255 },	// and of others
+			{ 2, 0, 2, 255 }, { 1, 0, 3, 255 }, { 0, 1, 3, 255 },
+			{ 1, 2, 0, 255 }, { 1, 1, 2, 255 },
+		};
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x)
+				copy(values[x], values[x] + 4, &texels[y * pitch + x * 4]);
+
+		vector<VirtualPageRequest> requests;
+		VirtualFeedback::Analyse(texels.data(), width, height, pitch, layout, requests);
+		map<uint32_t, int> counts;
+		for (const VirtualPageRequest& request : requests)
+			counts[request.page] += request.count;
+		const map<uint32_t, int> expected =
+		{
+			{ PackVirtualPage(0, 1, 2), 2 * height }, { PackVirtualPage(0, 7, 7), height },
+			{ PackVirtualPage(1, 3, 3), height }, { PackVirtualPage(2, 1, 1), height }, { TOP, height },
+		};
+		CHECK(requests.size() == expected.size() && counts == expected);
+	}
+
+	// A file cut short anywhere reopens to the records written whole, and appends after them
+	{
+		const string fileName = DIRECTORY + "torn.vtf";
+		VirtualTileFile file;
+		CHECK(file.Create(fileName));
+
+		vector<TileFileState> states;
+		states.push_back({ file.GetFileSize(), {} });
+		auto write = [&](uint32_t key, const vector<uint8_t>& tile)
+		{
+			CHECK(file.Write(key, tile.data(), tile.size()));
+			TileFileState state = states.back();
+			state.end = file.GetFileSize();
+			state.tiles[key] = tile;
+			states.push_back(state);
+		};
+		write(1, MakeTile(900, 1, false));
+		write(2, MakeTile(600, 2, true));
+		write(3, MakeTile(1200, 3, false));
+		write(1, MakeTile(700, 4, true));
+		file.Remove(2);
+		states.push_back(states.back());
+		states.back().end = file.GetFileSize();
+		states.back().tiles.erase(2);
+		write(4, MakeTile(500, 5, true));
+		CHECK(file.GetStoredBytes() < file.GetRawBytes());
+		CHECK(Holds(file, states.back()));
+		file.Close();
+
+		const vector<uint8_t> whole = ReadFile(fileName);
+		CHECK(whole.size() == states.back().end);
+		const string cutName = DIRECTORY + "cut.vtf";
+		int wrong = 0;
+		for (size_t length = 0; length <= whole.size(); ++length)
+		{
+			WriteFile(cutName, whole.data(), length);
+			VirtualTileFile cut;
+			if (length < sizeof(VirtualTileFileHeader))
+			{
+				wrong += cut.Open(cutName);
+				continue;
+			}
+			size_t last = 0;
+			while (last + 1 < states.size() && states[last + 1].end <= length)
+				++last;
+			if (!cut.Open(cutName) || !Holds(cut, states[last]))
+				++wrong;
+		}
+		CHECK(wrong == 0);
+
+		// Cut inside the last record: the next write replaces it and survives reopening
+		WriteFile(cutName, whole.data(), whole.size() - 100);
+		{
+			VirtualTileFile cut;
+			CHECK(cut.Open(cutName) && Holds(cut, states[states.size() - 2]));
+			const vector<uint8_t> tile = MakeTile(2000, 6, true);
+			CHECK(cut.Write(5, tile.data(), tile.size()));
+		}
+		VirtualTileFile reopened;
+		CHECK(reopened.Open(cutName));
+		TileFileState state = states[states.size() - 2];
+		state.tiles[5] = MakeTile(2000, 6, true);
+		state.end = reopened.GetFileSize();
+		CHECK(Holds(reopened, state) && !reopened.Contains(4));
+
+		// Not a tile file at all
+		WriteFile(cutName, reinterpret_cast<const uint8_t*>("not a tile file"), 15);
+		CHECK(!reopened.Open(cutName) && !reopened.IsOpen());
+	}
+
+	// Removals are records too, and hold after reopening until the tile is written again
+	{
+		const string fileName = DIRECTORY + "removed.vtf";
+		{
+			VirtualTileFile file;
+			CHECK(file.Create(fileName));
+			for (uint32_t key = 1; key <= 3; ++key)
+			{
+				const vector<uint8_t> tile = MakeTile(1000, key, false);
+				CHECK(file.Write(key, tile.data(), tile.size()));
+			}
+			file.Remove(2);
+			const uint64_t size = file.GetFileSize();
+			file.Remove(2);
+			file.Remove(9);
+			CHECK(file.GetFileSize() == size && file.GetTileCount() == 2);
+		}
+
+		VirtualTileFile file;
+		vector<uint8_t> tile;
+		CHECK(file.Open(fileName));
+		CHECK(file.GetTileCount() == 2 && file.GetRawBytes() == 2000);
+		CHECK(!file.Contains(2) && !file.Read(2, tile));
+		CHECK(file.Read(1, tile) && tile == MakeTile(1000, 1, false));
+		CHECK(file.Read(3, tile) && tile == MakeTile(1000, 3, false));
+
+		const vector<uint8_t> rewritten = MakeTile(300, 8, true);
+		CHECK(file.Write(2, rewritten.data(), rewritten.size()));
+		file.Remove(3);
+		CHECK(file.Open(fileName));
+		CHECK(file.GetTileCount() == 2 && !file.Contains(3));
+		CHECK(file.Read(2, tile) && tile == rewritten);
+	}
+
+	return TestResult();
+}